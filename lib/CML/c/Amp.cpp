@@ -85,6 +85,23 @@ CML_NEW_ERROR( TrjError, NoneAvailable, "No trajectory segments currently availa
 // local functions
 static bool isCanMode( AMP_MODE mode );
 
+/**
+  Thread used by Amp::InitParallel to initialize one amplifier.
+  */
+class AmpInitThread: public JobThread
+{
+public:
+   Amp *amp;
+   Network *net;
+   int16 nodeID;
+   AmpSettings settings;
+
+   void run( void )
+   {
+      err = amp->Init( *net, nodeID, settings );
+   }
+};
+
 /***************************************************************************/
 /**
   Construct and initialize an amplifier object.
@@ -179,6 +196,7 @@ const Error *Amp::InitAxis( AmpSettings &settings )
    // Init some local variables
    initialSettings = settings;
    pvtTrjRef      = 0;
+   pvtPreloadAll  = false;
    linkRef        = 0;
    pvtSegID       = 0;
    pvtSegActive   = 0;
@@ -477,6 +495,11 @@ const Error *Amp::Init( Network &net, int16 nodeID, AmpSettings &settings )
    }
 
    sdo.EnableBlkUpld();
+   sdo.EnableBlkDnld();
+
+   // Anything cached from before the init may be out of date
+   sdo.EnableCache( settings.cacheConfig );
+   sdo.InvalidateCache();
 
    err = InitAxis( settings );
 
@@ -489,6 +512,66 @@ retErr:
    return err;
 }
 
+/***************************************************************************/
+/**
+  Initialize a group of amplifiers at the same time.
+
+  Amp::Init makes a long series of SDO transfers to the amplifier, each of 
+  which waits for the amplifier's response.  Initializing several amplifiers
+  one after another therefore takes a time proportional to the number of 
+  amplifiers.  This function runs the initialization of each amplifier in 
+  its own thread, so the SDO transfers to the different nodes overlap on 
+  the network and the whole group takes about as long as one amplifier.
+
+  Each amplifier is initialized with a copy of the passed settings.  If 
+  AmpSettings::synchUseFirstAmp is set, only the first amplifier in the 
+  array may become the synch producer, just as when they are initialized
+  in order.
+
+  @param net Reference to the Network for the amps.
+  @param ct The number of amplifiers to initialize.
+  @param a Array of at least ct amplifier objects.
+  @param nodeID Array of at least ct node IDs, one for each amplifier.
+  @param settings Amplifier settings to be used.
+  @return A pointer to the error returned by the first amplifier (in array
+          order) that failed to initialize, or NULL if they all succeeded.
+  */
+/***************************************************************************/
+const Error *Amp::InitParallel( Network &net, uint16 ct, Amp a[], int16 nodeID[], AmpSettings &settings )
+{
+   if( !ct ) return 0;
+
+   AmpInitThread *thread = new AmpInitThread[ ct ];
+   JobThread **job = new JobThread*[ ct ];
+   if( !thread || !job )
+   {
+      delete[] thread;
+      delete[] job;
+      return &ThreadError::Alloc;
+   }
+
+   for( int i=0; i<ct; i++ )
+   {
+      thread[i].amp      = &a[i];
+      thread[i].net      = &net;
+      thread[i].nodeID   = nodeID[i];
+      thread[i].settings = settings;
+      job[i] = &thread[i];
+
+      if( i && settings.synchUseFirstAmp )
+      {
+         thread[i].settings.synchUseFirstAmp = false;
+         thread[i].settings.synchProducer = false;
+      }
+   }
+
+   const Error *err = JobThread::RunAll( job, ct );
+
+   delete[] job;
+   delete[] thread;
+   return err;
+}
+
 /***************************************************************************/
 /**
    Initialize an Amp object for use with a secondary axis of a multi-axis 
@@ -1244,8 +1327,12 @@ void Amp::HandleStateChange( NodeState from, NodeState to )
 {
    // On a guard error, wake up any task that's pending
    // on my semaphore (i.e. waiting for move done, etc)
+   // The amp may have been reset, so nothing cached can be trusted.
    if( to == NODESTATE_GUARDERR )
+   {
+      sdo.InvalidateCache();
       eventMap.setBits( AMPEVENT_NODEGUARD );
+   }
 }
 
 /***************************************************************************/
@@ -1280,7 +1367,10 @@ const Error *Amp::ClearNodeGuardEvent( void )
    if( err ) return err;
 
    if( status & ESTAT_RESET )
+   {
+      sdo.InvalidateCache();
       return &AmpError::Reset;
+   }
 
    eventMap.clrBits( AMPEVENT_NODEGUARD );
    return 0;
@@ -1756,6 +1846,11 @@ AmpSettings::AmpSettings( void )
    resetOnInit = false;
 
    maxPvtSendCt = 6;
+   pvtAdaptive  = false;
+   pvtMinMargin = 20;
+   pvtCacheSize = 0;
+
+   cacheConfig = false;
 }
 
 uint32 Amp::GetNetworkRef( void )
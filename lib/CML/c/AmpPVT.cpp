@@ -13,6 +13,7 @@
   network.
   */
 
+#include <string.h>
 #include "CML.h"
 
 CML_NAMESPACE_USE();
@@ -285,16 +286,62 @@ void Amp::FinishPvtTrj( void )
 /***************************************************************************/
 const Error *Amp::SendTrajectory( Trajectory &trj, bool start )
 {
-   const Error *err;
+   SdoFuture f;
+
+   const Error *err = PvtPreloadStart( f );
+   if( !err ) err = PvtPreload( trj, f );
+   if( !err ) err = PvtPreloadFinish( trj, f, start );
+   return err;
+}
+
+/***************************************************************************/
+/**
+  Start uploading a PVT trajectory to the amplifier.  This is the first of 
+  the three steps taken by Amp::SendTrajectory, and puts the amplifier in 
+  PVT mode and requests its PVT buffer status.  The status isn't waited on
+  here, so when a trajectory is sent to several amplifiers at once their
+  requests are outstanding on the network together.
 
+  Amp::PvtPreload must be called next with the same future.
+
+  @param f Future used to collect the buffer status.
+  @return An error object.
+  */
+/***************************************************************************/
+const Error *Amp::PvtPreloadStart( SdoFuture &f )
+{
    // Make sure we are in interpolated position mode
-   err = SetAmpMode( AMPMODE_CAN_PVT );
+   const Error *err = SetAmpMode( AMPMODE_CAN_PVT );
    if( err ) return err;
 
+   // Request the trajectory buffer status value.
+   return UpldAsync( OBJID_PVT_BUFF_STAT, 0, f );
+}
+
+/***************************************************************************/
+/**
+  Fill the amplifier's PVT buffer with the start of a trajectory.  This is the
+  second step taken by Amp::SendTrajectory.  It waits for the buffer status 
+  requested by Amp::PvtPreloadStart, writes as many segments as the buffer 
+  will take, and requests the status again.
+
+  The segments are written with the PVT receive PDO, so nothing is waited on 
+  here unless the buffer first has to be cleared.  If this returns success, 
+  Amp::PvtPreloadFinish must be called next with the same future.
+
+  @param trj The trajectory to be sent.
+  @param f Future used to collect the buffer status.
+  @return An error object.
+  */
+/***************************************************************************/
+const Error *Amp::PvtPreload( Trajectory &trj, SdoFuture &f )
+{
+   const Error *err;
+
    // Get the trajectory buffer status value.
-   uint32 stat;
-   err = GetPvtBuffStat( stat );
+   err = f.Wait();
    if( err ) return err;
+   uint32 stat = f.GetValue();
 
    // Clear any buffer errors that are outstanding.
    if( stat & PVTSTAT_ERROR )
@@ -342,19 +389,37 @@ const Error *Amp::SendTrajectory( Trajectory &trj, bool start )
    // as large as the buffer on the drive
    if( n > MAX_SEG_XFER ) n = MAX_SEG_XFER;
 
+   // Size the segment cache to hold everything that can be in the
+   // amp's buffer or on the way to it.
+   int cacheSize = initialSettings.pvtCacheSize;
+   if( !cacheSize )
+   {
+      cacheSize = 2*pvtBuffSize;
+      if( cacheSize < PVTCACHESIZE ) cacheSize = PVTCACHESIZE;
+   }
+   pvtCache.SetSize( cacheSize );
+
    // Keep track of the first segment being sent
    pvtSegActive = pvtSegID = (stat & PVTSTAT_NEXTID);
+   pvtFlow.Reset( pvtBuffSize, initialSettings.pvtMinMargin, pvtSegID );
 
    /**************************************************
-    * Upload as many segments as possible.  I use an
-    * SDO to upload the segments here, but will use a 
-    * PDO to upload the rest of the profile once we
-    * start moving.  This simplifies my error handling
-    * here when I can afford the overhead of the SDO.
+    * Upload as many segments as possible.  These are
+    * written with the PVT PDO just like the rest of
+    * the profile.  Any that are lost will show up in 
+    * the buffer status read once they've been sent.
+    *
+    * With adaptive flow control, only enough to meet
+    * the flow target is preloaded and the rest is 
+    * streamed once the move starts.  This keeps the
+    * bus free for the other amps of a linkage.
     **************************************************/
    uint8 segBuff[MAX_SEG_XFER][8];
    uint8 time;
    int i, ct;
+   int32 queued = 0;
+   bool adaptive = initialSettings.pvtAdaptive;
+   bool last = false;
    for( i=ct=0; i<n; i++ )
    {
       uunit p,v;
@@ -380,6 +445,7 @@ const Error *Amp::SendTrajectory( Trajectory &trj, bool start )
       {
          err = FormatPosInit( pos, segBuff[ct++] );
          if( err ) break;
+         pvtFlow.SegmentSent( pvtSegID, 0 );
          pvtLastPos = pos;
          pvtSegID++;
          i++;
@@ -393,6 +459,8 @@ const Error *Amp::SendTrajectory( Trajectory &trj, bool start )
       if( err ) break;
 
       pvtCache.AddSegment( segBuff[ct++], pvtSegID, p );
+      pvtFlow.SegmentSent( pvtSegID, time );
+      queued += time;
 
       // Update the segment ID counter and the last segment
       // position info.
@@ -400,7 +468,14 @@ const Error *Amp::SendTrajectory( Trajectory &trj, bool start )
       pvtLastPos = pos;
 
       // If time is zero, this is the last segment in the move.
-      if( !time ) break;
+      if( !time )
+      {
+         last = true;
+         break;
+      }
+
+      if( adaptive && pvtFlow.Enough( queued, ct ) )
+         break;
    }
 
    // If the trajectory object indicated that there were no segments available, then
@@ -411,9 +486,10 @@ const Error *Amp::SendTrajectory( Trajectory &trj, bool start )
 
    // Upload the segments to the drive
    if( !err ) err = PvtWriteBuff( segBuff, ct, false );
+   if( !err ) pvtFlow.BatchSent( pvtSegID, Thread::getTimeNS() );
 
-   // Get the buffer status.  We'll process this later
-   if( !err ) err = GetPvtBuffStat( stat );
+   // Request the buffer status.  We'll process this later
+   if( !err ) err = UpldAsync( OBJID_PVT_BUFF_STAT, 0, f );
 
    // If an error occurred during the download, flush 
    // the buffer and return the error code.
@@ -424,10 +500,41 @@ const Error *Amp::SendTrajectory( Trajectory &trj, bool start )
       return err;
    }
 
+   // Note whether the trajectory has more segments to send
+   pvtPreloadAll = last;
+   return 0;
+}
+
+/***************************************************************************/
+/**
+  Finish uploading a PVT trajectory to the amplifier.  This is the last step
+  taken by Amp::SendTrajectory.  It waits for the buffer status requested by
+  Amp::PvtPreload, resends any segments that were lost, and keeps a reference
+  to the trajectory if the amplifier's buffer couldn't hold all of it.
+
+  @param trj The trajectory passed to Amp::PvtPreload.
+  @param f Future used to collect the buffer status.
+  @param start If true, the profile is started by this call.
+  @return An error object.
+  */
+/***************************************************************************/
+const Error *Amp::PvtPreloadFinish( Trajectory &trj, SdoFuture &f, bool start )
+{
+   // Get the buffer status.  If this failed, flush the buffer 
+   // and return the error code.
+   const Error *err = f.Wait();
+   if( err )
+   {
+      trj.Finish();
+      PvtBufferFlush();
+      return err;
+   }
+   uint32 stat = f.GetValue();
+
    // If the whole profile hasn't been sent, keep a reference
    // to the trajectory object so I can spool it up to the 
    // amp as buffer space becomes available.
-   if( time )
+   if( !pvtPreloadAll )
       pvtTrjRef = trj.GrabRef();
    else
    {
@@ -495,6 +602,31 @@ const Error *Amp::GetPvtSegPos( uunit &pos )
    return &AmpError::pvtPosUnavail;
 }
 
+/***************************************************************************/
+/**
+  Get the statistics kept by the adaptive PVT flow control.  These are kept
+  whether or not AmpSettings::pvtAdaptive is set, and describe how well the
+  amplifier's PVT buffer is being kept supplied.
+
+  @param stats The statistics are returned here.
+  */
+/***************************************************************************/
+void Amp::GetPvtFlowStats( PvtFlowStats &stats )
+{
+   stats = pvtFlow.stats;
+}
+
+/***************************************************************************/
+/**
+  Clear the statistics kept by the adaptive PVT flow control.  The measured
+  delays that set the buffer target are kept.
+  */
+/***************************************************************************/
+void Amp::ClearPvtFlowStats( void )
+{
+   pvtFlow.ClearStats();
+}
+
 /***************************************************************************/
 /**
   Write to the PVT buffer on the amp.  We use a PDO to do this on CANopen,
@@ -567,11 +699,19 @@ void Amp::PvtStatusUpdate( uint32 status )
    // Keep track of the active segment ID
    pvtSegActive = ampNextID - pvtBuffSize + freeCt - 1;
 
+   // Let the flow control measure the delays and find how much
+   // motion is buffered in the amp or on the way to it.
+   int64 now = Thread::getTimeNS();
+   uint16 sentID = pvtUseCache ? pvtCacheID : pvtSegID;
+   int32 queued = pvtFlow.Status( ampNextID, pvtSegActive, sentID, pvtTrjRef != 0, now );
+   bool adaptive = initialSettings.pvtAdaptive;
+
    // If the amplifier has experienced an underflow error, then
    // it has already aborted the trajectory.  At this point there
    // is no reason to send more segments, so I'll just return.
    if( errors & PVTERR_UNDERFLOW )
    {
+      if( pvtTrjRef ) pvtFlow.stats.underflows++;
       FinishPvtTrj();
       return;
    }
@@ -584,25 +724,40 @@ void Amp::PvtStatusUpdate( uint32 status )
    // the error was cleared since there could be other pending
    // status messages coming my way with the old error flagged, and
    // I don't want to get confused about where the error occurred.
+   // If the amp already has every segment sent, there's nothing to
+   // resend.  This happens when the error was caused by a resent
+   // segment that the amp had in fact already received.
    if( errors & PVTERR_SEQUENCE )
    {
+      pvtFlow.stats.seqErrors++;
       PvtClearErrors( PVTERR_SEQUENCE );
-      pvtUseCache = true;
       pvtCacheID = ampNextID;
+      pvtUseCache = (pvtCacheID != pvtSegID);
       return;
    }
 
+   // The amp only sees a sequence error when a segment arrives after a
+   // lost one, so losing the last segments written goes unnoticed by it.
+   // If they still haven't arrived well after they were written, I'll 
+   // resend them from the cache.
+   if( !pvtUseCache && pvtFlow.Stalled( ampNextID, pvtSegID, now ) )
+   {
+      pvtCacheID = sentID = ampNextID;
+      pvtUseCache = true;
+   }
+
    // OK, no errors that we care about.  Reduce the free count value
    // passed in the status to take any recently sent segments into
    // account.  The result is the number of new segments we can
    // send safely.
-   if( pvtUseCache )
-      freeCt -= (pvtCacheID - ampNextID);
-   else
-      freeCt -= (pvtSegID - ampNextID);
+   freeCt -= (sentID - ampNextID);
+
+   // Number of segments held by the amp or on the way to it
+   int held = pvtBuffSize - freeCt;
 
    // Reduce the number of messages to send based on the trajectories
-   // desired buffer usage.
+   // desired buffer usage.  Also pass on the shortest segment time
+   // that lets the amp's buffer hold the flow control target.
    if( pvtTrjRef )
    {
       RefObjLocker<Trajectory> trj( pvtTrjRef );
@@ -612,12 +767,21 @@ void Amp::PvtStatusUpdate( uint32 status )
          int max = trj->MaximumBufferPointsToUse();
          if( max < pvtBuffSize )
             freeCt -= (pvtBuffSize-max);
+
+         uint8 minTime = pvtFlow.MinSegTime();
+         if( adaptive && minTime != pvtFlow.stats.minSegTime )
+         {
+            pvtFlow.stats.minSegTime = minTime;
+            trj->SetMinSegmentTime( minTime );
+         }
       }
    }
 
    // Limit the number of new segments I'll send in response
-   // to a single status message.  
-   if( freeCt > initialSettings.maxPvtSendCt )
+   // to a single status message.  With adaptive flow control
+   // the limit doesn't apply while the amp is running short.
+   if( (!adaptive || queued >= pvtFlow.stats.target) && 
+       (freeCt > initialSettings.maxPvtSendCt) )
       freeCt = initialSettings.maxPvtSendCt;
 
    // Also limit based on local buffer size
@@ -626,33 +790,53 @@ void Amp::PvtStatusUpdate( uint32 status )
 
    // Load a buffer with the segments to send
    uint8 segBuff[MAX_SEG_XFER][8];
-   int ct;
-   for( int i=ct=0; i<freeCt; i++ )
+   int ct = 0;
+
+   // See if we need to resend old segments.  If so, I'll
+   // copy as many as will fit out of the cache in one go.
+   if( pvtUseCache && freeCt > 0 )
    {
-      // See if we need to resend an old segment.  
-      // If so, I'll pull it out of the cache.
-      if( pvtUseCache )
+      int n = (uint16)(pvtSegID - pvtCacheID);
+      if( n > freeCt ) n = freeCt;
+
+      // If the necessary segments aren't available, then 
+      // I have no choice but to flush the cache and 
+      // abort the profile.
+      ct = pvtCache.GetSegments( segBuff, pvtCacheID, n );
+      if( ct < n )
       {
-         // If the necessary segment isn't available, then 
-         // I have no choice but to flush the cache and 
-         // abort the profile.
-         if( !pvtCache.GetSegment( segBuff[ct++], pvtCacheID ) )
-         {
-            PvtBufferFlush();
-            FinishPvtTrj();
-            return;
-         }
-
-         if( ++pvtCacheID == pvtSegID )
-            pvtUseCache = false;
+         cml.Warn( "Amp %d PVT segment %u no longer cached, aborting\n", GetNodeID(), pvtCacheID+ct );
+         pvtFlow.stats.cacheMisses++;
+         PvtBufferFlush();
+         FinishPvtTrj();
+         return;
       }
 
+      for( int i=0; i<ct; i++ )
+         queued += pvtFlow.SegTime( pvtCacheID+i );
+
+      pvtFlow.stats.resends += ct;
+      pvtCacheID += ct;
+      if( pvtCacheID == pvtSegID )
+         pvtUseCache = false;
+   }
+
+   while( ct < freeCt )
+   {
+      // Any resends still needed wait for the next status
+      if( pvtUseCache )
+         break;
+
       // We need to get a new segment from the trajectory generator.
       // If there isn't one then it means that we're done sending
       // segments out.
       else if( !pvtTrjRef ) 
          break;
 
+      // With adaptive flow control, stop once the amp has enough
+      else if( adaptive && pvtFlow.Enough( queued, held+ct ) )
+         break;
+
       else
       {
          RefObjLocker<Trajectory> trj( pvtTrjRef );
@@ -700,6 +884,9 @@ void Amp::PvtStatusUpdate( uint32 status )
 
          // Add this segment to my cache for later error handling
          pvtCache.AddSegment( segBuff[ct++], pvtSegID, p );
+         pvtFlow.SegmentSent( pvtSegID, time );
+         pvtFlow.stats.segsSent++;
+         queued += time;
 
          pvtSegID++;
          pvtLastPos = pos;
@@ -712,7 +899,8 @@ void Amp::PvtStatusUpdate( uint32 status )
    }
 
    // Send the segments
-   PvtWriteBuff( segBuff, ct );
+   if( ct && !PvtWriteBuff( segBuff, ct ) )
+      pvtFlow.BatchSent( pvtUseCache ? pvtCacheID : pvtSegID, Thread::getTimeNS() );
 
    return;
 }
@@ -731,6 +919,8 @@ void Amp::PvtStatusUpdate( uint32 status )
 /***************************************************************************/
 void PvtSegCache::AddSegment( uint8 *seg, uint16 id, uunit p )
 {
+   if( !size ) return;
+
    // If the ID is not one greater then the last ID
    // added to the cache, then clear it.  
    // Segments must be added to the cache in order 
@@ -745,19 +935,18 @@ void PvtSegCache::AddSegment( uint8 *seg, uint16 id, uunit p )
    // Figure out where to put this one
    int index;
 
-   if( ct < PVTCACHESIZE )
+   if( ct < size )
       index = ct++;
    else
    {
       oldest++;
       index = top++;
-      if( top == PVTCACHESIZE )
+      if( top == size )
          top = 0;
    }
 
    // Add the new segment
-   for( int i=0; i<8; i++ )
-      cache[index][i] = seg[i];
+   memcpy( cache[index], seg, 8 );
    pos[index] = p;
 }
 
@@ -780,15 +969,71 @@ bool PvtSegCache::GetSegment( uint8 *seg, uint16 id )
       return false;
 
    index += top;
-   if( index >= PVTCACHESIZE )
-      index -= PVTCACHESIZE;
-
-   for( int i=0; i<8; i++ )
-      seg[i] = cache[index][i];
+   if( index >= size )
+      index -= size;
 
+   memcpy( seg, cache[index], 8 );
    return true;
 }
 
+/***************************************************************************/
+/**
+  Get a run of consecutive segments from the cache.  The segments are copied
+  out with at most two block copies, one either side of the end of the ring.
+  @param seg An array where the segment data will be copied.
+  @param id The ID number of the first segment requested.
+  @param n The number of segments requested.
+  @return The number of segments copied.  This is less then n if some of
+  the requested segments aren't available.
+  */
+/***************************************************************************/
+int PvtSegCache::GetSegments( uint8 seg[][8], uint16 id, int n )
+{
+   int16 index = id - oldest;
+
+   // Fail if the first segment is outside my range
+   if( index < 0 || index >= ct )
+      return 0;
+
+   if( n > ct - index )
+      n = ct - index;
+
+   int start = index + top;
+   if( start >= size )
+      start -= size;
+
+   int first = size - start;
+   if( first > n ) first = n;
+
+   memcpy( seg, cache[start], first*8 );
+   if( n > first )
+      memcpy( seg[first], cache[0], (n-first)*8 );
+
+   return n;
+}
+
+/***************************************************************************/
+/**
+  Set the number of segments the cache can hold.  The cache is cleared.
+  The memory is only reallocated if the size changes.
+  @param n The new cache size.
+  */
+/***************************************************************************/
+void PvtSegCache::SetSize( uint16 n )
+{
+   Clear();
+
+   if( n == size )
+      return;
+
+   delete[] cache;
+   delete[] pos;
+
+   cache = new uint8[n][8];
+   pos = new uunit[n];
+   size = n;
+}
+
 /***************************************************************************/
 /**
   Get the position corresponding to the specified segment from the cache.
@@ -807,10 +1052,227 @@ bool PvtSegCache::GetPosition( uunit *p, uint16 id )
       return false;
 
    index += top;
-   if( index >= PVTCACHESIZE )
-      index -= PVTCACHESIZE;
+   if( index >= size )
+      index -= size;
 
    *p = pos[index];
    return true;
 }
 
+
+/***************************************************************************/
+/**
+  Default constructor for the PVT flow control.
+  */
+/***************************************************************************/
+PvtFlowCtrl::PvtFlowCtrl()
+{
+   stats.latencyAvg = stats.statusGapAvg = 0;
+   ClearStats();
+   Reset( 32, 20, 0 );
+}
+
+/***************************************************************************/
+/**
+  Prepare for a new trajectory.  The delays measured on earlier trajectories
+  are kept, since they are a property of the network rather then of the
+  trajectory.
+  @param size The size of the amplifier's PVT buffer
+  @param margin The least motion time (ms) to keep buffered on top of the
+  measured delays.
+  @param first The ID of the first segment of the trajectory.
+  */
+/***************************************************************************/
+void PvtFlowCtrl::Reset( uint16 size, uint16 margin, uint16 first )
+{
+   buffSize = size;
+   minMargin = margin;
+   firstID = first;
+   pending = false;
+   sentTime = 0;
+   lastStatus = 0;
+   lastActive = first;
+   stats.minSegTime = 0;
+   UpdateTarget();
+   memset( segTime, 0, sizeof(segTime) );
+}
+
+/***************************************************************************/
+/**
+  Clear the flow statistics.  The average delays are kept, since the buffer 
+  target is based on them.
+  */
+/***************************************************************************/
+void PvtFlowCtrl::ClearStats( void )
+{
+   int32 latAvg = stats.latencyAvg;
+   int32 gapAvg = stats.statusGapAvg;
+
+   memset( &stats, 0, sizeof(stats) );
+   stats.latencyAvg = latAvg;
+   stats.statusGapAvg = gapAvg;
+   stats.marginMin = 0x7FFFFFFF;
+}
+
+/***************************************************************************/
+/**
+  Note that a batch of segments has just been written to the amplifier.  The
+  time until a status update shows the last of them received gives a sample
+  of the latency.  Only one batch at a time is timed.
+  @param nextID The ID following the last segment written
+  @param now The present time, from Thread::getTimeNS
+  */
+/***************************************************************************/
+void PvtFlowCtrl::BatchSent( uint16 nextID, int64 now )
+{
+   sentTime = now;
+   if( pending ) return;
+
+   pending = true;
+   pendID = nextID - 1;
+   pendTime = now;
+}
+
+/***************************************************************************/
+/**
+  Process a PVT status update from the amplifier.  This updates the measured
+  delays and the buffer target, and finds how much motion is held by the 
+  amplifier.
+  @param nextID The ID of the next segment the amplifier expects
+  @param activeID The ID of the segment the amplifier is running
+  @param sentID The ID following the last segment written
+  @param streaming True if more of the trajectory remains to be sent
+  @param now The present time, from Thread::getTimeNS
+  @return The motion time (ms) buffered in the amplifier or on the way to it.
+  */
+/***************************************************************************/
+int32 PvtFlowCtrl::Status( uint16 nextID, uint16 activeID, uint16 sentID, bool streaming, int64 now )
+{
+   stats.statusCt++;
+
+   int32 margin = 0, queued;
+   int i, n;
+
+   // The gaps between status updates only matter while the amp is running
+   // the trajectory and more of it remains to be sent.
+   bool running = streaming && ((int16)(activeID - firstID) >= 0);
+
+   // The amp sends a status update as each segment finishes, so most of
+   // the time between updates is the motion run in between.  Only the 
+   // part beyond that is a delay in getting the status back.
+   if( running && lastStatus )
+   {
+      int32 ran = 0;
+      n = (int16)(activeID - lastActive);
+      if( n > 255 ) n = 255;
+      for( i=0; i<n; i++ )
+         ran += segTime[ (lastActive+i) & 0xFF ];
+
+      int32 gap = (int32)((now - lastStatus) / 1000) - ran*1000;
+      if( gap < 0 ) gap = 0;
+
+      stats.statusGapAvg += (gap - stats.statusGapAvg) / 8;
+      if( gap > stats.statusGapMax ) stats.statusGapMax = gap;
+   }
+   lastStatus = running ? now : 0;
+   lastActive = activeID;
+
+   if( pending && (int16)(nextID - pendID) > 0 )
+   {
+      int32 lat = (int32)((now - pendTime) / 1000);
+      pending = false;
+
+      if( !stats.latencyMax ) stats.latencyAvg = lat;
+      else stats.latencyAvg += (lat - stats.latencyAvg) / 8;
+
+      if( !stats.latencyMin || lat < stats.latencyMin ) stats.latencyMin = lat;
+      if( lat > stats.latencyMax ) stats.latencyMax = lat;
+   }
+
+   // Add up the segments buffered after the active one, and those
+   // written but not yet received.  The active segment is left out
+   // since some unknown part of it has already run.
+   n = (int16)(nextID - activeID - 1);
+   if( n > 255 ) n = 255;
+   for( i=0; i<n; i++ )
+      margin += segTime[ (activeID+1+i) & 0xFF ];
+
+   queued = margin;
+   n = (int16)(sentID - nextID);
+   if( n > 255 ) n = 255;
+   for( i=0; i<n; i++ )
+      queued += segTime[ (nextID+i) & 0xFF ];
+
+   // While the trajectory is running, note how close the buffer came
+   // to running dry.  If less motion is buffered than the worst delay
+   // in replacing it, an underflow was only narrowly missed.
+   stats.margin = margin;
+   if( running )
+   {
+      if( margin < stats.marginMin ) stats.marginMin = margin;
+      if( margin*1000 < stats.latencyMax + stats.statusGapMax )
+         stats.riskCt++;
+   }
+
+   UpdateTarget();
+   return queued;
+}
+
+/***************************************************************************/
+/**
+  Find the motion time to keep buffered from the delays measured so far.
+  */
+/***************************************************************************/
+void PvtFlowCtrl::UpdateTarget( void )
+{
+   // Aim to keep twice the usual delays buffered, plus the worst latency
+   // seen and the configured margin.  Once segments have been lost, also
+   // allow for the extra round trip taken to clear the error and resend.
+   int32 delay = 2*stats.latencyAvg + 2*stats.statusGapAvg + stats.latencyMax;
+   if( stats.seqErrors )
+      delay += stats.latencyMax + stats.statusGapMax;
+   int32 target = minMargin + (delay + 999) / 1000;
+   if( target > 10000 ) target = 10000;
+   stats.target = target;
+}
+
+/***************************************************************************/
+/**
+  Check whether segments written to the amplifier appear to have been lost.
+  This is the case if the amplifier still hasn't received all of them some
+  time after the last was written, allowing for the worst latency seen plus
+  the usual one, and at least 10 milliseconds.
+  @param nextID The ID of the next segment the amplifier expects
+  @param sentID The ID following the last segment written
+  @param now The present time, from Thread::getTimeNS
+  @return true if the segments from nextID on should be resent.
+  */
+/***************************************************************************/
+bool PvtFlowCtrl::Stalled( uint16 nextID, uint16 sentID, int64 now )
+{
+   if( !sentTime || (int16)(sentID - nextID) <= 0 )
+      return false;
+
+   int64 timeout = (int64)stats.latencyMax + stats.latencyAvg;
+   if( timeout < 10000 ) timeout = 10000;
+
+   return (now - sentTime) > timeout * 1000;
+}
+
+/***************************************************************************/
+/**
+  Find the shortest segment time that lets the amplifier's buffer hold the
+  target motion time.  Two buffer positions are left for the interpolation.
+  @return The segment time in milliseconds, 1 to 255.
+  */
+/***************************************************************************/
+uint8 PvtFlowCtrl::MinSegTime( void )
+{
+   int slots = buffSize - 2;
+   if( slots < 1 ) slots = 1;
+
+   int32 ms = (stats.target + slots - 1) / slots;
+   if( ms < 1 ) ms = 1;
+   if( ms > 255 ) ms = 255;
+   return (uint8)ms;
+}
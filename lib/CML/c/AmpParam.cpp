@@ -2995,6 +2995,18 @@ const Error *Amp::Upld32( int16 index, int16 sub, int32 &data )
    DO_SDO( Upld32( index, sub, data ) );
 }
 
+/// Start an upload of an object in this Amps object dictionary without
+/// waiting for the response.  See SDO::UpldAsync for details.
+/// The object number is adjusted based on the axis number if necessary.
+/// @param index The index of the object to be uploaded.
+/// @param sub The sub-index of the object to be uploaded.
+/// @param f The future used to collect the result.
+/// @return A pointer to an error object, or NULL on success
+const Error *Amp::UpldAsync( int16 index, int16 sub, SdoFuture &f )
+{
+   DO_SDO( UpldAsync( index, sub, f ) );
+}
+
 /// Download data to an object in this Amps object dictionary.
 /// The object number is adjusted based on the axis number if necessary.
 /// @param index The index of the object to be downloaded.
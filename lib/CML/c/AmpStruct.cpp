@@ -1924,6 +1924,11 @@ const Error *Amp::GetAmpConfig( AmpConfig &cfg )
 {
    int32 l;
 
+   // Configuration objects only change when written, so they may be
+   // read from the SDO dictionary cache if it's enabled.
+   RefObjLocker<Amp> pri( primaryAmpRef );
+   SdoCacheScope cs( pri ? pri->sdo : sdo );
+
    const Error *err = GetAmpName( cfg.name );
    if( !err ) err = Upload( OBJID_CME2_CONFIG, 0, l=COPLEY_MAX_STRING, (uint8*)cfg.CME_Config );
 
@@ -2003,6 +2008,11 @@ const Error *Amp::GetAmpConfig( AmpConfig &cfg )
 /***************************************************************************/
 const Error *Amp::SetAmpConfig( AmpConfig &cfg )
 {
+   // Objects that already hold the new value are not written again 
+   // if the SDO dictionary cache is enabled.
+   RefObjLocker<Amp> pri( primaryAmpRef );
+   SdoCacheScope cs( pri ? pri->sdo : sdo );
+
    const Error *err = SetAmpName( cfg.name );
 
    if( !err ) err = Download( OBJID_CME2_CONFIG, 0, COPLEY_MAX_STRING-1, (uint8*)cfg.CME_Config );
@@ -17,9 +17,6 @@ This file contains the AMP object methods used to handle unit conversions.
 
 CML_NAMESPACE_USE();
 
-// macro used for rounding floats
-#define Round(x)  ((x>=0) ? (x+0.5) : (x-0.5))
-
 /***************************************************************************/
 /**
 Configure the user programmable units.
@@ -182,8 +179,7 @@ On single encoder systems either of these functions can be used.
 int32 Amp::PosUser2Load( uunit pos )
 {
 #ifdef CML_ENABLE_USER_UNITS
-   pos *= u2lPos;
-   return (int32)Round(pos);
+   return RoundToInt32( pos * u2lPos );
 #else
    return pos;
 #endif
@@ -212,8 +208,7 @@ On single encoder systems either of these functions can be used.
 int32 Amp::VelUser2Load( uunit vel )
 {
 #ifdef CML_ENABLE_USER_UNITS
-   vel *= u2lVel;
-   return (int32)Round(vel);
+   return RoundToInt32( vel * u2lVel );
 #else
    return vel;
 #endif
@@ -242,8 +237,7 @@ Amp::AccUser2Mtr.  On single encoder systems either of these functions can be us
 int32 Amp::AccUser2Load( uunit acc )
 {
 #ifdef CML_ENABLE_USER_UNITS
-   acc *= u2lAcc;
-   return (int32)Round(acc);
+   return RoundToInt32( acc * u2lAcc );
 #else
    return acc;
 #endif
@@ -272,13 +266,10 @@ the load encoder resolution.
 int32 Amp::JrkUser2Load( uunit jrk )
 {
 #ifdef CML_ENABLE_USER_UNITS
-   jrk *= u2lJrk;
    // If a value for jerk is passed, we want to make sure it doesn't round
    // to zero and prevent motion
-   if ( (jrk < 0.5 || jrk > -0.5) && (int32)Round(jrk) == 0 )
-      return 1;
-   else
-      return (int32)Round(jrk);
+   int32 j = RoundToInt32( jrk * u2lJrk );
+   return j ? j : 1;
 #else
    return jrk;
 #endif
@@ -412,8 +403,7 @@ Load encoder positions can be converted using Amp::PosUser2Load.
 int32 Amp::PosUser2Mtr( uunit pos )
 {
 #ifdef CML_ENABLE_USER_UNITS
-   pos *= u2mPos;
-   return (int32)Round(pos);
+   return RoundToInt32( pos * u2mPos );
 #else
    return pos;
 #endif
@@ -433,8 +423,7 @@ Load encoder velocities can be converted using Amp::VelUser2Load.
 int32 Amp::VelUser2Mtr( uunit vel )
 {
 #ifdef CML_ENABLE_USER_UNITS
-   vel *= u2mVel;
-   return (int32)Round(vel);
+   return RoundToInt32( vel * u2mVel );
 #else
    return vel;
 #endif
@@ -454,8 +443,7 @@ Load encoder accelerations can be converted using Amp::AccUser2Load.
 int32 Amp::AccUser2Mtr( uunit acc )
 {
 #ifdef CML_ENABLE_USER_UNITS
-   acc *= u2mAcc;
-   return (int32)Round(acc);
+   return RoundToInt32( acc * u2mAcc );
 #else
    return acc;
 #endif
@@ -18,6 +18,7 @@ implement the global CML object.
 #include <stdio.h>
 #include <string.h>
 #include <stdarg.h>
+#include <atomic>
 #endif
 
 // Global CML object
@@ -27,6 +28,191 @@ CML_NAMESPACE_END()
 
 CML_NAMESPACE_USE();
 
+#ifdef CML_FILE_ACCESS_OK
+
+// Size of each thread's log ring in bytes.  Must be a power of 2.
+#define CML_LOG_RING_SIZE      65536
+
+// Longest text message that can be logged asynchronously.  Longer
+// messages are truncated.
+#define CML_LOG_MAX_TEXT       1024
+
+// Period (milliseconds) at which the log writer thread empties the rings
+#define CML_LOG_WRITE_PERIOD   5
+
+// Kinds of record stored in the log rings
+#define LOGREC_TEXT            1
+#define LOGREC_CAN             2
+
+/**
+Header of each record in a log ring.  The size includes the header, and is
+followed by the text of a message or a CanTraceRecord.
+*/
+struct LogRecHdr
+{
+   uint16 size;
+   uint8 kind;
+   uint8 reserved[5];
+   int64 time;
+};
+
+/***************************************************************************/
+/**
+Single producer, single consumer ring of log records.
+
+Each thread that writes to the log while asynchronous logging is enabled is
+given its own ring, so adding a record never waits on another thread.  The 
+log writer thread is the only reader.  The head and tail are free running
+byte counts; only the owning thread moves the head and only the writer moves
+the tail.  If a ring is full the record is dropped and counted.
+
+Rings are linked into a list which is only ever added to.  When a thread 
+exits its ring is released and the next new thread reuses it.
+*/
+/***************************************************************************/
+class LogRing
+{
+public:
+   std::atomic<uint32> head;
+   std::atomic<uint32> tail;
+   std::atomic<uint32> dropped;
+   std::atomic<bool> owned;
+   LogRing *next;
+
+   /// Head position the present drain stops at.  Used only by the writer.
+   uint32 limit;
+
+   LogRing(): head(0), tail(0), dropped(0), owned(true), next(0), limit(0) {}
+
+   void Push( LogRecHdr &hdr, const void *body, int len )
+   {
+      uint32 h = head.load( std::memory_order_relaxed );
+      uint32 t = tail.load( std::memory_order_acquire );
+
+      hdr.size = (uint16)(sizeof(LogRecHdr) + len);
+      if( CML_LOG_RING_SIZE - (h-t) < hdr.size )
+      {
+         dropped.fetch_add( 1, std::memory_order_relaxed );
+         return;
+      }
+
+      Put( h, &hdr, sizeof(LogRecHdr) );
+      Put( h+sizeof(LogRecHdr), body, len );
+      head.store( h + hdr.size, std::memory_order_release );
+   }
+
+   bool Peek( LogRecHdr &hdr )
+   {
+      uint32 t = tail.load( std::memory_order_relaxed );
+      if( t == limit ) return false;
+      Get( t, &hdr, sizeof(LogRecHdr) );
+      return true;
+   }
+
+   void Pop( const LogRecHdr &hdr, void *body )
+   {
+      uint32 t = tail.load( std::memory_order_relaxed );
+      Get( t+sizeof(LogRecHdr), body, hdr.size - sizeof(LogRecHdr) );
+      tail.store( t + hdr.size, std::memory_order_release );
+   }
+
+private:
+   byte buff[ CML_LOG_RING_SIZE ];
+
+   void Put( uint32 pos, const void *src, int len )
+   {
+      pos &= CML_LOG_RING_SIZE-1;
+      int n = CML_LOG_RING_SIZE - pos;
+      if( n > len ) n = len;
+      memcpy( &buff[pos], src, n );
+      memcpy( buff, (const byte*)src + n, len-n );
+   }
+
+   void Get( uint32 pos, void *dst, int len )
+   {
+      pos &= CML_LOG_RING_SIZE-1;
+      int n = CML_LOG_RING_SIZE - pos;
+      if( n > len ) n = len;
+      memcpy( dst, &buff[pos], n );
+      memcpy( (byte*)dst + n, buff, len-n );
+   }
+};
+
+// List of all log rings
+static std::atomic<LogRing*> ringList( 0 );
+
+/// Releases a thread's log ring when the thread exits.
+struct LogRingOwner
+{
+   LogRing *ring;
+   ~LogRingOwner(){ if( ring ) ring->owned.store( false, std::memory_order_release ); }
+};
+static thread_local LogRingOwner ringOwner;
+
+/***************************************************************************/
+/**
+Return the log ring of the calling thread.  The first call made by a thread
+takes over a ring released by a thread that has exited, or adds a new one
+to the list.
+*/
+/***************************************************************************/
+static LogRing *GetLogRing( void )
+{
+   LogRing *r = ringOwner.ring;
+   if( r ) return r;
+
+   for( r = ringList.load( std::memory_order_acquire ); r; r = r->next )
+   {
+      bool owned = false;
+      if( r->owned.compare_exchange_strong( owned, true ) )
+         break;
+   }
+
+   if( !r )
+   {
+      r = new LogRing;
+      r->next = ringList.load( std::memory_order_relaxed );
+      while( !ringList.compare_exchange_weak( r->next, r, std::memory_order_release, std::memory_order_relaxed ) );
+   }
+
+   ringOwner.ring = r;
+   return r;
+}
+
+CML_NAMESPACE_START()
+
+/***************************************************************************/
+/**
+Background thread that writes the contents of the log rings to the log 
+and trace files.
+*/
+/***************************************************************************/
+class LogWriter: public Thread
+{
+   CopleyMotionLibrary *lib;
+public:
+   LogWriter( CopleyMotionLibrary *l ): lib(l)
+   {
+      // File writes should never hold up the threads being logged, so
+      // the writer runs under normal scheduling rather than real time.
+      setRealTime( false );
+      setPriority( 0 );
+   }
+
+   void run( void )
+   {
+      while( 1 )
+      {
+         sleep( CML_LOG_WRITE_PERIOD );
+         lib->Drain();
+      }
+   }
+};
+
+CML_NAMESPACE_END()
+
+#endif
+
 /***************************************************************************/
 /**
 Default constructor for the CopleyMotionLibrary object.
@@ -42,19 +228,27 @@ CopleyMotionLibrary::CopleyMotionLibrary()
    flushOutput = false;
    destroyed = false;
    maxLogSize = 1000000;
+   asyncLog = false;
+   writer = 0;
+   traceFileName = 0;
+   trace = 0;
+   traceSize = 0;
 
    SetLogFile( "cml.log" );
 }
 
 /***************************************************************************/
 /**
-Destructor for CopleyMotionLibrary object.  This simply closes the log file
-if one is open.
+Destructor for CopleyMotionLibrary object.  This writes out any messages 
+still waiting to be logged and closes the log and trace files.
 */
 /***************************************************************************/
 CopleyMotionLibrary::~CopleyMotionLibrary()
 {
 #ifdef CML_FILE_ACCESS_OK
+   SetAsyncLog( false );
+   Drain();
+
    mutex.Lock();
    if( log )
    {
@@ -63,6 +257,18 @@ CopleyMotionLibrary::~CopleyMotionLibrary()
       destroyed = true;
    }
 
+   if( trace )
+   {
+      fclose( (FILE*)trace );
+      trace = NULL;
+   }
+
+   if( traceFileName )
+   {
+      delete[] traceFileName;
+      traceFileName = 0;
+   }
+
    if( logFileBackup )
    {
       delete logFileBackup;
@@ -140,18 +346,155 @@ void CopleyMotionLibrary::SetFlushLog( bool flush )
 Flush the log file (if one is open).  This forces the log contents to be
 written to disk, thus preventing it from being lost if the program exits
 without calling the CML object destructor.
+
+Any messages waiting in the asynchronous log rings are written out first.
 */
 /***************************************************************************/
 void CopleyMotionLibrary::FlushLog( void )
 {
 #ifdef CML_FILE_ACCESS_OK
+   Drain();
+
    mutex.Lock();
    if( log )
       fflush( (FILE*)log );
+   if( trace )
+      fflush( (FILE*)trace );
    mutex.Unlock();
 #endif
 }
 
+/***************************************************************************/
+/**
+Enable or disable asynchronous logging.  
+
+By default every message is written to the log file by the thread that 
+logs it, while holding a mutex shared by all threads.  With high debug 
+levels, and LOG_CAN in particular, this puts file writes on the CANopen
+receive thread and every other time critical thread in the system.
+
+When asynchronous logging is enabled each thread instead formats its 
+message into its own lock free ring buffer and returns.  CAN frames are
+stored as a fixed size binary record and are not formatted at all.  A low
+priority background thread empties the rings every few milliseconds, 
+merges the messages of all threads in time order and writes them to the 
+log file (and the CAN trace file if one is set).  Log file rotation only 
+happens on this thread.
+
+A thread that logs faster than the writer can keep up with will fill its
+ring.  Messages that don't fit are dropped, and the number dropped is 
+written to the log.  Messages longer than 1024 characters are truncated.
+
+The default is false (synchronous logging).
+
+@param async True to enable asynchronous logging
+*/
+/***************************************************************************/
+void CopleyMotionLibrary::SetAsyncLog( bool async )
+{
+#ifdef CML_FILE_ACCESS_OK
+   drainMutex.Lock();
+
+   if( async && !writer && !destroyed )
+   {
+      writer = new LogWriter( this );
+      // Error() is a member function here, so the class name needs the tag
+      const class Error *err = writer->start();
+      if( err )
+      {
+         delete writer;
+         writer = 0;
+         drainMutex.Unlock();
+         Warn( "Unable to start the log writer thread: %s\n", err->toString() );
+         return;
+      }
+      asyncLog = true;
+   }
+
+   else if( !async && writer )
+   {
+      asyncLog = false;
+      drainMutex.Unlock();
+
+      // The writer may be waiting on the drain mutex, so it's stopped 
+      // without holding it.
+      writer->stop();
+      delete writer;
+      writer = 0;
+
+      // Anything logged while switching over is written out here
+      Drain();
+      return;
+   }
+
+   drainMutex.Unlock();
+#endif
+}
+
+/***************************************************************************/
+/**
+Set the binary CAN trace file.  
+
+When a trace file is set, CAN frames logged with LogCAN are written to 
+this file as CanTraceRecord structures instead of as text in the log file.
+This is much more compact, and with asynchronous logging enabled it's the
+cheapest way to keep a full record of the bus traffic.  The cantrace 
+example program converts the file back into text.
+
+The file is created when the first frame is written to it.  Like the log 
+file, once it exceeds the max log size it's renamed with a .bak extension
+and a new file is started.
+
+@param fname The trace file name, or NULL to log CAN frames as text in the 
+       log file (the default).
+*/
+/***************************************************************************/
+void CopleyMotionLibrary::SetCanTraceFile( const char *fname )
+{
+#ifdef CML_FILE_ACCESS_OK
+   if( destroyed ) return;
+
+   // Records already logged go to the old file
+   Drain();
+
+   mutex.Lock();
+   if( trace )
+   {
+      fclose( (FILE*)trace );
+      trace = 0;
+      traceSize = 0;
+   }
+
+   if( traceFileName )
+   {
+      delete[] traceFileName;
+      traceFileName = 0;
+   }
+
+   if( fname )
+      traceFileName = CloneString( fname );
+   mutex.Unlock();
+#endif
+}
+
+/***************************************************************************/
+/**
+Return the number of asynchronous log messages dropped because a thread's 
+log ring was full and not yet reported in the log.  The count is cleared 
+each time the writer thread records it in the log.
+@return The number of messages dropped.
+*/
+/***************************************************************************/
+uint32 CopleyMotionLibrary::GetDroppedLogCount( void )
+{
+   uint32 n = 0;
+#ifdef CML_FILE_ACCESS_OK
+   for( LogRing *r = ringList.load( std::memory_order_acquire ); r; r = r->next )
+      n += r->dropped.load( std::memory_order_relaxed );
+#endif
+   return n;
+}
+
 /***************************************************************************/
 /**
 Set the debug message log file name.  This file will be used to log 
@@ -220,6 +563,9 @@ void CopleyMotionLibrary::SetMaxLogSize( int32 max )
 Write the CAN frame to the log file.  The log level must be at least LOG_FILT_CAN
 for this to be written.
 
+If a CAN trace file has been set the frame is written there as a binary 
+CanTraceRecord, otherwise it's written to the log file as text.
+
 @param recv True if this was a received message, false for transmit messages
 @param frame The frame to log
 */
@@ -237,50 +583,83 @@ void CopleyMotionLibrary::LogCAN( bool recv, struct CanFrame &frame )
       if( (frame.id > 0x700) && (frame.id < 0x780) ) return;
    }
 
-   // Return immediately if the log file can't be open
-   if( !OpenLogFile() ) return;
+   CanTraceRecord rec;
+   rec.time     = Thread::getTimeNS();
+   rec.id       = frame.id;
+   rec.type     = (uint8)frame.type;
+   rec.recv     = recv ? 1 : 0;
+   rec.length   = (frame.length > 8) ? 8 : frame.length;
+   rec.reserved = 0;
+   memcpy( rec.data, frame.data, 8 );
+
+   if( asyncLog )
+   {
+      LogRecHdr hdr;
+      hdr.kind = LOGREC_CAN;
+      hdr.time = rec.time;
+      GetLogRing()->Push( hdr, &rec, sizeof(rec) );
+      return;
+   }
+
+   WriteCAN( rec );
+
+   // Flush the file if requested to do so
+   if( flushOutput )
+      FlushLog();
+#endif
+}
 
-   // Log a message describing the CAN frame
-   switch( frame.type )
+/***************************************************************************/
+/**
+Format a CAN trace record as the line of text used for it in the log file.
+This is the same text whether it's written to the log directly or decoded 
+later from a binary trace file.
+
+@param buff Buffer where the zero terminated text is returned
+@param max Size of the buffer.  128 bytes is enough for any frame.
+@param rec The record to format
+@return The length of the text, not including the terminator.
+*/
+/***************************************************************************/
+int CopleyMotionLibrary::FormatCAN( char *buff, int max, const CanTraceRecord &rec )
+{
+#ifdef CML_FILE_ACCESS_OK
+   const char *dir = rec.recv ? "CAN.R" : "CAN.X";
+   int n;
+
+   switch( rec.type )
    {
       case CAN_FRAME_DATA:
       {
-         if( recv )
-            logSize += fprintf( (FILE *)log, "CAN.R: 0x%08x - ", frame.id );
-         else
-            logSize += fprintf( (FILE *)log, "CAN.X: 0x%08x - ", frame.id );
+         n = snprintf( buff, max, "%s: 0x%08x - ", dir, rec.id );
 
-         for( int i=0; i<frame.length; i++ )
-            logSize += fprintf( (FILE *)log, "0x%02x ", frame.data[i] );
+         int len = (rec.length > 8) ? 8 : rec.length;
+         for( int i=0; i<len && n<max; i++ )
+            n += snprintf( buff+n, max-n, "0x%02x ", rec.data[i] );
 
-         logSize += fprintf( (FILE *)log, "\n" );
+         if( n<max )
+            n += snprintf( buff+n, max-n, "\n" );
          break;
       }
 
       case CAN_FRAME_REMOTE:
-         if( recv )
-            logSize += fprintf( (FILE *)log, "CAN.R: 0x%08x - RMT\n", frame.id );
-         else
-            logSize += fprintf( (FILE *)log, "CAN.X: 0x%08x - RMT\n", frame.id );
+         n = snprintf( buff, max, "%s: 0x%08x - RMT\n", dir, rec.id );
          break;
 
       case CAN_FRAME_ERROR:
-         logSize += fprintf( (FILE*)log, "CAN Error frame\n" );
+         n = snprintf( buff, max, "CAN Error frame\n" );
          break;
 
       default:
-         logSize += fprintf( (FILE*)log, "Unknown CAN frame type!\n" );
+         n = snprintf( buff, max, "Unknown CAN frame type!\n" );
          break;
    }
 
-   mutex.Unlock();
-
-   // Flush the file if requested to do so
-   if( flushOutput )
-      FlushLog();
-
-   if( logSize > maxLogSize )
-      ResizeLog();
+   if( n >= max ) n = max-1;
+   return n;
+#else
+   if( max > 0 ) buff[0] = 0;
+   return 0;
 #endif
 }
 
@@ -300,22 +679,10 @@ void CopleyMotionLibrary::Debug( const char *fmt, ... )
 #ifdef CML_FILE_ACCESS_OK
    if( debugLevel < LOG_DEBUG ) return;
 
-   // Return immediately if the log file can't be open
-   if( !OpenLogFile() ) return;
-
-   // Write to the file.
    va_list ap;
    va_start( ap, fmt );
-   logSize += vfprintf( (FILE *)log, fmt, ap );
-   mutex.Unlock();
+   LogText( fmt, ap );
    va_end( ap );
-
-   // Flush the file if requested to do so
-   if( flushOutput )
-      FlushLog();
-
-   if( logSize > maxLogSize )
-      ResizeLog();
 #endif
 }
 
@@ -335,22 +702,10 @@ void CopleyMotionLibrary::Warn( const char *fmt, ... )
 #ifdef CML_FILE_ACCESS_OK
    if( debugLevel < LOG_WARNINGS ) return;
 
-   // Return immediately if the log file can't be open
-   if( !OpenLogFile() ) return;
-
-   // Write to the file.
    va_list ap;
    va_start( ap, fmt );
-   logSize += vfprintf( (FILE *)log, fmt, ap );
-   mutex.Unlock();
+   LogText( fmt, ap );
    va_end( ap );
-
-   // Flush the file if requested to do so
-   if( flushOutput )
-      FlushLog();
-
-   if( logSize > maxLogSize )
-      ResizeLog();
 #endif
 }
 
@@ -370,15 +725,46 @@ void CopleyMotionLibrary::Error( const char *fmt, ... )
 #ifdef CML_FILE_ACCESS_OK
    if( debugLevel < LOG_ERRORS ) return;
 
+   va_list ap;
+   va_start( ap, fmt );
+   LogText( fmt, ap );
+   va_end( ap );
+#endif
+}
+
+/***************************************************************************/
+/**
+Write a formatted text message to the log.  With asynchronous logging the
+message is formatted into the calling thread's log ring, otherwise it's
+written to the log file directly.
+
+@param fmt A printf style format string
+@param ap The format arguments
+*/
+/***************************************************************************/
+void CopleyMotionLibrary::LogText( const char *fmt, va_list ap )
+{
+#ifdef CML_FILE_ACCESS_OK
+   if( asyncLog )
+   {
+      char text[ CML_LOG_MAX_TEXT ];
+      int n = vsnprintf( text, sizeof(text), fmt, ap );
+      if( n < 0 ) return;
+      if( n >= (int)sizeof(text) ) n = sizeof(text)-1;
+
+      LogRecHdr hdr;
+      hdr.kind = LOGREC_TEXT;
+      hdr.time = Thread::getTimeNS();
+      GetLogRing()->Push( hdr, text, n );
+      return;
+   }
+
    // Return immediately if the log file can't be open
    if( !OpenLogFile() ) return;
 
    // Write to the file.
-   va_list ap;
-   va_start( ap, fmt );
    logSize += vfprintf( (FILE *)log, fmt, ap );
    mutex.Unlock();
-   va_end( ap );
 
    // Flush the file if requested to do so
    if( flushOutput )
@@ -389,6 +775,186 @@ void CopleyMotionLibrary::Error( const char *fmt, ... )
 #endif
 }
 
+/***************************************************************************/
+/**
+Write a block of text to the log file.  The log is resized if this takes
+it past the max size.
+*/
+/***************************************************************************/
+void CopleyMotionLibrary::WriteText( const char *text, int len )
+{
+#ifdef CML_FILE_ACCESS_OK
+   if( !OpenLogFile() ) return;
+   logSize += (int32)fwrite( text, 1, len, (FILE *)log );
+   mutex.Unlock();
+
+   if( logSize > maxLogSize )
+      ResizeLog();
+#endif
+}
+
+/***************************************************************************/
+/**
+Write a CAN trace record to the trace file if one has been set, or as text
+to the log file if not.
+*/
+/***************************************************************************/
+void CopleyMotionLibrary::WriteCAN( const CanTraceRecord &rec )
+{
+#ifdef CML_FILE_ACCESS_OK
+   if( !traceFileName )
+   {
+      char text[128];
+      int n = FormatCAN( text, sizeof(text), rec );
+      WriteText( text, n );
+      return;
+   }
+
+   if( !OpenTraceFile() ) return;
+
+   traceSize += (int32)fwrite( &rec, 1, sizeof(rec), (FILE *)trace );
+   if( traceSize > maxLogSize )
+   {
+      fclose( (FILE*)trace );
+      trace = 0;
+      traceSize = 0;
+   }
+   mutex.Unlock();
+#endif
+}
+
+/***************************************************************************/
+/**
+Write out the contents of all the log rings.  
+
+Records are taken from the rings in time order, so messages from different
+threads are interleaved in the log the same way they would have been if 
+they were written directly.  The drain stops at the records that were in 
+the rings when it started, so it finishes even if other threads keep on
+logging.
+*/
+/***************************************************************************/
+void CopleyMotionLibrary::Drain( void )
+{
+#ifdef CML_FILE_ACCESS_OK
+   LogRing *list = ringList.load( std::memory_order_acquire );
+   if( !list ) return;
+
+   drainMutex.Lock();
+
+   LogRing *r;
+   for( r = list; r; r = r->next )
+      r->limit = r->head.load( std::memory_order_acquire );
+
+   while( 1 )
+   {
+      LogRing *first = 0;
+      LogRecHdr hdr, firstHdr;
+
+      for( r = list; r; r = r->next )
+      {
+         if( r->Peek( hdr ) && (!first || hdr.time < firstHdr.time) )
+         {
+            first = r;
+            firstHdr = hdr;
+         }
+      }
+
+      if( !first ) break;
+
+      union
+      {
+         char text[ CML_LOG_MAX_TEXT ];
+         CanTraceRecord can;
+      } body;
+
+      first->Pop( firstHdr, &body );
+
+      if( firstHdr.kind == LOGREC_CAN )
+         WriteCAN( body.can );
+      else
+         WriteText( body.text, firstHdr.size - sizeof(LogRecHdr) );
+   }
+
+   for( r = list; r; r = r->next )
+   {
+      uint32 n = r->dropped.exchange( 0, std::memory_order_relaxed );
+      if( n )
+      {
+         char text[80];
+         int len = snprintf( text, sizeof(text), "CML log ring full, %u messages dropped\n", n );
+         WriteText( text, len );
+      }
+   }
+
+   drainMutex.Unlock();
+
+   // When asynchronous, the log is flushed after each drain rather than 
+   // after each message.
+   if( flushOutput && asyncLog )
+   {
+      mutex.Lock();
+      if( log )
+         fflush( (FILE*)log );
+      if( trace )
+         fflush( (FILE*)trace );
+      mutex.Unlock();
+   }
+#endif
+}
+
+/***************************************************************************/
+/**
+Open the CAN trace file.  Like OpenLogFile this returns true with the mutex 
+locked if the file is open.  An old trace file is renamed with a .bak 
+extension before a new one is created, and the new file starts with the
+trace file header.
+
+If the file can't be created, CAN frames are written to the log file as text
+from then on.
+
+@return true if the file is open.
+*/
+/***************************************************************************/
+bool CopleyMotionLibrary::OpenTraceFile( void )
+{
+#ifndef CML_FILE_ACCESS_OK
+   return false;
+#else
+   if( destroyed ) return false;
+
+   mutex.Lock();
+   if( trace )
+      return true;
+
+   if( destroyed || !traceFileName )
+   {
+      mutex.Unlock();
+      return false;
+   }
+
+   char *backup = new char[ strlen(traceFileName) + 5 ];
+   strcpy( backup, traceFileName );
+   strcat( backup, ".bak" );
+   remove( backup );
+   rename( traceFileName, backup );
+   delete[] backup;
+
+   trace = (void*)fopen( traceFileName, "wb" );
+   if( !trace )
+   {
+      delete[] traceFileName;
+      traceFileName = 0;
+      mutex.Unlock();
+      Warn( "Unable to create CAN trace file, CAN frames will be logged as text\n" );
+      return false;
+   }
+
+   traceSize = (int32)fwrite( CML_CANTRACE_MAGIC, 1, 8, (FILE *)trace );
+   return true;
+#endif
+}
+
 /***************************************************************************/
 /**
 Open the log file.  
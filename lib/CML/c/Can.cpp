@@ -82,6 +82,59 @@ const Error *CanInterface::Xmit( CanFrame &frame, Timeout timeout )
    return XmitFrame( frame, timeout );
 }
 
+/***************************************************************************/
+/**
+Receive a block of CAN frames.  This waits for the first frame like the
+single frame version of Recv, then returns it along with any other frames 
+that have already been received, up to the passed maximum.  Reading frames
+in blocks is much more efficient when they arrive in bursts.
+
+@param frame An array of at least max frames that will be filled by the read.
+@param max The maximum number of frames to read.
+@param ct On success, this will be set to the number of frames read (at least 1).
+@param timeout The timeout (ms) to wait for the first frame.  A timeout of 0 will
+               return immediately if no data is available.  A timeout of < 0 will 
+               wait forever.
+@return A pointer to an error object, or NULL on success.
+*/
+/***************************************************************************/
+const Error *CanInterface::Recv( CanFrame frame[], int max, int &ct, Timeout timeout )
+{
+   ct = 0;
+   if( max < 1 ) return &CanError::BadParam;
+
+   const Error *err = RecvFrames( frame, max, ct, timeout );
+   if( err ) 
+   {
+      ct = 0;
+      return err;
+   }
+
+   for( int i=0; i<ct; i++ )
+      cml.LogCAN( true, frame[i] );
+   return 0;
+}
+
+/***************************************************************************/
+/**
+Write a block of CAN frames to the CAN network.  The frames are sent in
+the order they appear in the array.
+@param frame An array of the frames to write.
+@param ct The number of frames to write.
+@param timeout The time to wait for each frame to be successfully sent.
+               If the timeout is 0, the frames are written to the output queue and
+               the function returns without waiting for them to be sent.  If the 
+               timeout is <0 then the function will delay forever.
+@return A pointer to an error object, or NULL on success.
+*/
+/***************************************************************************/
+const Error *CanInterface::Xmit( CanFrame frame[], int ct, Timeout timeout )
+{
+   for( int i=0; i<ct; i++ )
+      cml.LogCAN( false, frame[i] );
+   return XmitFrames( frame, ct, timeout );
+}
+
 /***************************************************************************/
 /**
 Standard destructor for base CanInterface object.
@@ -114,6 +167,34 @@ const Error *CanInterface::XmitFrame( CanFrame &frame, Timeout timeout )
    return &ThreadError::Timeout;
 }
 
+/**************************************************
+* The default block functions just pass each frame
+* to the single frame versions.
+**************************************************/
+const Error *CanInterface::RecvFrames( CanFrame frame[], int max, int &ct, Timeout timeout )
+{
+   ct = 0;
+   const Error *err = RecvFrame( frame[0], timeout );
+   if( err ) return err;
+
+   for( ct=1; ct<max; ct++ )
+   {
+      if( RecvFrame( frame[ct], 0 ) )
+         break;
+   }
+   return 0;
+}
+
+const Error *CanInterface::XmitFrames( CanFrame frame[], int ct, Timeout timeout )
+{
+   for( int i=0; i<ct; i++ )
+   {
+      const Error *err = XmitFrame( frame[i], timeout );
+      if( err ) return err;
+   }
+   return 0;
+}
+
 /*************************************************************
  * This is a private utility function used by some of the 
  * CAN Interface objects.  It converts the port name string
@@ -18,6 +18,13 @@ This class is used for over all control of the CANopen network.
 
 #include "CML.h"
 
+// Maximum number of frames read from the CAN interface at once
+#define RECV_BATCH      32
+
+// Maximum number of receive filters passed to the CAN interface.  If more 
+// are needed, the interface is just left to receive everything.
+#define MAX_RECV_FILTER 128
+
 /**
   Frame handling function for time stamp generator.
   This function is called when a new sync frame is received.
@@ -38,6 +45,14 @@ CML_NAMESPACE_END()
 
 CML_NAMESPACE_USE();
 
+/// Return true for the emergency, SDO response and node guarding frames, 
+/// which are always included in the CAN interface's receive filter.
+static bool InDefaultFilter( uint32 id )
+{
+   uint32 type = id & 0xFFFFFF80;
+   return (type == 0x080) || (type == 0x580) || (type == 0x700);
+}
+
 // static CANopen error objects
 CML_NEW_ERROR( CanOpenError, ThreadStart,     "Error starting CANopen read thread" );
 CML_NEW_ERROR( CanOpenError, BadParam,        "Bad parameter value" );
@@ -66,11 +81,15 @@ CanOpen::CanOpen( void )
    guard.SetCo( this );
    synchProducer = 0;
    errorFrameCt = 0;
+   filterFrames = false;
 
    int i;
    for( i=0; i<CML_HASH_SIZE; i++ )
       hash[i] = 0;
 
+   for( i=0; i<2048; i++ )
+      stdRcvr[i] = 0;
+
    for( i=0; i<128; i++ )
       nodes[i] = 0;
 
@@ -218,6 +237,9 @@ const Error *CanOpen::Open( CanInterface &ci, CanOpenSettings &settings )
 
    setPriority( settings.readThreadPriority );
 
+   err = setAffinity( settings.readThreadCPU );
+   if( err ) return err;
+
    // See if the lower level CAN interface supports timestamps.
    // If not, make sure we aren't trying to be the timing master.
    if( !ci.SupportsTimestamps() )
@@ -225,11 +247,17 @@ const Error *CanOpen::Open( CanInterface &ci, CanOpenSettings &settings )
 
    timingMaster = settings.useAsTimingReference;
 
+   filterFrames = settings.filterFrames;
+   UpdateRecvFilter();
+
    // Start a thread that will listen for messages 
    // on the CAN network.
    if( start() )
       return &CanOpenError::ThreadStart;
 
+   if( !isRealTime() )
+      cml.Warn( "CANopen read thread is not running with real time scheduling\n" );
+
    if( guard.start() )
       return &CanOpenError::ThreadStart;
 
@@ -485,44 +513,105 @@ assigns the standard CAN message ID and transmits the resulting CAN frame.
 */
 /***************************************************************************/
 const Error *CanOpen::XmitSDO( Node *n, uint8 *buff, uint16 len, uint16 *ret, Timeout timeout )
+{
+   // SDOs must be 8 bytes long for CANopen
+   if( len != 8 )
+      return &CanOpenError::BadParam;
+
+   *ret = 8;
+
+   if( !timeout )
+      return StartSDO( n, buff, len, 0 );
+
+   Semaphore sem;
+   const Error *err = StartSDO( n, buff, len, &sem );
+   if( err ) return err;
+
+   return FinishSDO( n, &sem, timeout );
+}
+
+/***************************************************************************/
+/**
+Transmit an SDO message over the CANopen network without waiting for the
+response.  When the response arrives it's copied to the passed buffer and
+the passed semaphore is posted.  CanOpen::FinishSDO must then be called to 
+complete the transfer.
+
+Each node has its own SDO response channel, so transfers to different 
+nodes may all be outstanding at once.  Only one transfer may be outstanding
+to any one node.
+
+@param n Pointer to the node to whom the SDO is addressed.
+@param buff Buffer containing the formatted SDO data.  The response is 
+       returned here.
+@param len  Length of the SDO data in bytes.  Must be 8 bytes for CANopen.
+@param done Semaphore posted when the response is received.  If NULL, no
+       response is expected.
+@param timeout Max time to wait for the SDO to be sent.
+@return A pointer to an error object, or NULL on success.
+*/
+/***************************************************************************/
+const Error *CanOpen::StartSDO( Node *n, uint8 *buff, uint16 len, Semaphore *done, Timeout timeout )
 {
    CanOpenNodeInfo *ni = GetCoInfo(n);
    CanFrame frame;
-   Semaphore sem;
 
    // SDOs must be 8 bytes long for CANopen
    if( len != 8 )
       return &CanOpenError::BadParam;
 
-   *ret = 8;
-
    frame.id = 0x600 + n->GetNodeID();
    frame.type = CAN_FRAME_DATA;
    frame.length = 8;
    for( int i=0; i<8; i++ )
       frame.data[i] = buff[i];
 
-   if( timeout )
+   if( done )
    {
       mtx.Lock();
       ni->sdoBuff = buff;
-      ni->sdoSemPtr = &sem;
+      ni->sdoSemPtr = done;
+      mtx.Unlock();
+   }
+
+   if( timeout > 1000 ) timeout = 1000;
+   const Error *err = Xmit( frame, timeout );
+
+   if( err && done )
+   {
+      mtx.Lock();
+      ni->sdoBuff = 0;
+      ni->sdoSemPtr = 0;
       mtx.Unlock();
    }
 
-   const Error *err = Xmit( frame, 1000 );
-   if( err ) goto done;
+   return err;
+}
+
+/***************************************************************************/
+/**
+Wait for the response to an SDO started with CanOpen::StartSDO.  
 
-   if( !timeout ) return 0;
+@param n Pointer to the node to whom the SDO was addressed.
+@param done The semaphore passed to CanOpen::StartSDO
+@param timeout Max time to wait for the response.
+@return A pointer to an error object, or NULL on success.
+*/
+/***************************************************************************/
+const Error *CanOpen::FinishSDO( Node *n, Semaphore *done, Timeout timeout )
+{
+   CanOpenNodeInfo *ni = GetCoInfo(n);
 
-   err = sem.Get( timeout );
+   const Error *err = done->Get( timeout );
    if( err == &ThreadError::Timeout )
       err = &CanOpenError::SDO_Timeout;
 
-done:
    mtx.Lock();
-   ni->sdoBuff = 0;
-   ni->sdoSemPtr = 0;
+   if( ni->sdoSemPtr == done )
+   {
+      ni->sdoBuff = 0;
+      ni->sdoSemPtr = 0;
+   }
    mtx.Unlock();
    return err;
 }
@@ -532,12 +621,17 @@ done:
 CAN network read thread.  This function defines the thread that will be
 used to read the CAN network and pass received frames to the various 
 CANopen network reader objects.
+
+Each time the thread wakes up it reads all of the frames that are waiting
+(up to a limit) in one call to the CAN interface, which is much cheaper 
+than reading them one at a time when several nodes respond at once.
 */
 /***************************************************************************/
 void CanOpen::run( void )
 {
    const Error *err;
-   CanFrame frame;
+   CanFrame frame[ RECV_BATCH ];
+   int ct;
 
    while( canRef )
    {
@@ -551,7 +645,7 @@ void CanOpen::run( void )
             return;
          }
 
-         err = can->Recv( frame, 200 );
+         err = can->Recv( frame, RECV_BATCH, ct, 200 );
       }
 
       // Ignore timeouts
@@ -565,59 +659,74 @@ void CanOpen::run( void )
          continue;
       }
 
-      if( frame.type == CAN_FRAME_ERROR )
-      {
-         errorFrameCt++;
-         continue;
-      }
+      for( int i=0; i<ct; i++ )
+         HandleFrame( frame[i] );
+   }
+}
 
-      uint32 rcvrRef = LookupReceiver( frame.id );
-      if( rcvrRef )
-      {
-         RefObjLocker<Receiver> r( rcvrRef );
-         if( r ) r->NewFrame(frame);
-      }
+/***************************************************************************/
+/**
+Pass one received frame to its receiver, and handle the standard CANopen
+messages that the network object processes itself.
+@param frame The received frame.
+*/
+/***************************************************************************/
+void CanOpen::HandleFrame( CanFrame &frame )
+{
+   if( frame.type == CAN_FRAME_ERROR )
+   {
+      errorFrameCt++;
+      return;
+   }
 
-      // Try doing some default handling for some standard messages
-      if( frame.type == CAN_FRAME_DATA )
-      {
-         uint32 type = frame.id & 0xFFFFFF80;
+   uint32 rcvrRef = LookupReceiver( frame.id );
+   if( rcvrRef )
+   {
+      RefObjLocker<Receiver> r( rcvrRef );
+      if( r ) r->NewFrame(frame);
+   }
 
-         RefObjLocker<Node> n( nodes[ frame.id & 0x7F ] );
-         if( !n ) continue;
+   // Try doing some default handling for some standard messages.
+   // Only these need the node, so other frames (i.e. PDOs) don't 
+   // pay for locking it.
+   uint32 type = frame.id & 0xFFFFFF80;
+   if( frame.type == CAN_FRAME_DATA && 
+       (type == 0x00000080 || type == 0x00000700 || type == 0x00000580) )
+   {
+      RefObjLocker<Node> n( nodes[ frame.id & 0x7F ] );
+      if( !n ) return;
 
-         CanOpenNodeInfo *ni = GetCoInfo(n);
+      CanOpenNodeInfo *ni = GetCoInfo(n);
 
-         switch( type )
-         {
-            // Emergency object
-            case 0x00000080:
-               n->HandleEmergency( frame );
-               break;
+      switch( type )
+      {
+         // Emergency object
+         case 0x00000080:
+            n->HandleEmergency( frame );
+            break;
 
-               // Node guarding
-            case 0x00000700:
-            {
-               MutexLocker ml( mtx );
-               guard.HandleNMT( frame, ni );
-               break;
-            }
+            // Node guarding
+         case 0x00000700:
+         {
+            MutexLocker ml( mtx );
+            guard.HandleNMT( frame, ni );
+            break;
+         }
 
-               // SDO response.
-            case 0x00000580:
+            // SDO response.
+         case 0x00000580:
+         {
+            MutexLocker ml( mtx );
+            if( ni->sdoSemPtr )
             {
-               MutexLocker ml( mtx );
-               if( ni->sdoSemPtr )
-               {
 
-                  int i;
-                  for( i=0; i<8; i++ )
-                     ni->sdoBuff[i] = frame.data[i];
-                  ni->sdoSemPtr->Put();
-                  ni->sdoSemPtr = 0;
-               }
-               break;
+               int i;
+               for( i=0; i<8; i++ )
+                  ni->sdoBuff[i] = frame.data[i];
+               ni->sdoSemPtr->Put();
+               ni->sdoSemPtr = 0;
             }
+            break;
          }
       }
    }
@@ -632,9 +741,11 @@ This constructor simply sets all the settings to their default values.
 CanOpenSettings::CanOpenSettings( void )
 {
    readThreadPriority = 9;
+   readThreadCPU = -1;
    useAsTimingReference = false;
    syncID = 0x080;
    timeID = 0x180;
+   filterFrames = true;
 }
 
 /***************************************************************************/
@@ -910,8 +1021,18 @@ void CanOpen::NodeGuardThread::run( void )
                continue;
          }
 
-         // Re-insert this node into my list at the appropriate time
-         AddNode( next, now + ni->guardTimeout );
+         // Re-insert this node into my list at the appropriate time.  Guard
+         // messages are scheduled from the last deadline rather than from now
+         // so they go out at a fixed rate.  If a whole period was missed, skip
+         // ahead instead of sending a burst of guard messages.
+         uint32 due = now + ni->guardTimeout;
+         if( ni->guardType == GUARDTYPE_NODEGUARD )
+         {
+            uint32 fixed = ni->eventTime + ni->guardTimeout;
+            if( (int32)(fixed - now) > 0 )
+               due = fixed;
+         }
+         AddNode( next, due );
       }
    }
 }
@@ -1163,12 +1284,26 @@ const Error *CanOpen::EnableReceiver( uint32 msgID, Receiver *rcvr )
 {
    MutexLocker ml( hashMtx );
 
-   coHashEntry **pp = searchHash( msgID );
+   // Standard IDs go directly in their table entry
+   if( msgID < 2048 )
+   {
+      if( stdRcvr[msgID] )
+         return &CanOpenError::RcvrPresent;
 
-   if( *pp )
-      return &CanOpenError::RcvrPresent;
+      stdRcvr[msgID] = rcvr->GrabRef();
+   }
+   else
+   {
+      coHashEntry **pp = searchHash( msgID );
 
-   *pp = new coHashEntry( msgID, rcvr );
+      if( *pp )
+         return &CanOpenError::RcvrPresent;
+
+      *pp = new coHashEntry( msgID, rcvr );
+   }
+
+   if( !InDefaultFilter( msgID ) )
+      UpdateRecvFilter();
    return 0;
 }
 
@@ -1184,25 +1319,101 @@ const Error *CanOpen::DisableReceiver( uint32 canMsgID )
 {
    MutexLocker ml( hashMtx );
 
-   coHashEntry **pp = searchHash( canMsgID );
+   if( canMsgID < 2048 )
+   {
+      uint32 ref = stdRcvr[canMsgID].exchange( 0 );
+      if( !ref )
+         return &CanOpenError::RcvrNotFound;
+
+      RefObj::ReleaseRef( ref );
+   }
+   else
+   {
+      coHashEntry **pp = searchHash( canMsgID );
 
-   if( !*pp )
-      return &CanOpenError::RcvrNotFound;
+      if( !*pp )
+         return &CanOpenError::RcvrNotFound;
 
-   coHashEntry *entry = *pp;
-   *pp = entry->next;
-   delete entry;
+      coHashEntry *entry = *pp;
+      *pp = entry->next;
+      delete entry;
+   }
+
+   if( !InDefaultFilter( canMsgID ) )
+      UpdateRecvFilter();
    return 0;
 }
 
+/***************************************************************************/
+/**
+Pass the set of frames this object uses to the CAN interface's receive 
+filter.  These are the IDs of the enabled receivers, and the emergency, 
+node guarding and SDO response frames of all nodes.
+*/
+/***************************************************************************/
+void CanOpen::UpdateRecvFilter( void )
+{
+   if( !filterFrames ) return;
+
+   MutexLocker ml( hashMtx );
+
+   uint32 id[ MAX_RECV_FILTER ];
+   uint32 mask[ MAX_RECV_FILTER ];
+   int ct = 0;
+
+   // Emergency, SDO response and node guarding frames of any node.
+   // Receivers of these IDs are covered by the same filters.
+   id[ct] = 0x080;  mask[ct++] = 0x20000780;
+   id[ct] = 0x580;  mask[ct++] = 0x20000780;
+   id[ct] = 0x700;  mask[ct++] = 0x20000780;
+
+   for( int i=0; i<2048 && ct<=MAX_RECV_FILTER; i++ )
+   {
+      if( !stdRcvr[i] || InDefaultFilter( i ) )
+         continue;
+
+      if( ct < MAX_RECV_FILTER )
+      {
+         id[ct] = i;
+         mask[ct] = 0x200007FF;
+      }
+      ct++;
+   }
+
+   for( int i=0; i<CML_HASH_SIZE && ct<=MAX_RECV_FILTER; i++ )
+   {
+      for( coHashEntry *e = hash[i]; e; e = e->next )
+      {
+         if( ct < MAX_RECV_FILTER )
+         {
+            id[ct] = e->canMsgID;
+            mask[ct] = 0x3FFFFFFF;
+         }
+         ct++;
+      }
+   }
+
+   // Too many to filter, just receive everything
+   if( ct > MAX_RECV_FILTER )
+      ct = 0;
+
+   RefObjLocker<CanInterface> can( canRef );
+   if( can ) can->SetRecvFilter( id, mask, ct );
+}
+
 /**
- * Search the hash table for a receiver associated with this message ID.
+ * Find the receiver associated with this message ID.  Standard IDs are
+ * found in their table without locking, which is the case for all 
+ * frames used by CANopen.  Extended IDs are searched for in the hash.
  *
  * @param canMsgID The CAN message ID to search for.
  * @return A reference to the receiver, or 0 if no receiver is found.
  */
 uint32 CanOpen::LookupReceiver( uint32 canMsgID )
 {
+   if( canMsgID < 2048 )
+      return stdRcvr[canMsgID];
+
    MutexLocker ml( hashMtx );
    coHashEntry *entry = *searchHash( canMsgID );
    if( !entry ) return 0;
@@ -1213,6 +1424,12 @@ void CanOpen::ClearHash( void )
 {
    MutexLocker ml( hashMtx );
 
+   for( int i=0; i<2048; i++ )
+   {
+      uint32 ref = stdRcvr[i].exchange( 0 );
+      if( ref ) RefObj::ReleaseRef( ref );
+   }
+
    for( int i=0; i<CML_HASH_SIZE; i++ )
    {
       coHashEntry *entry = hash[i];
@@ -457,7 +457,9 @@ protected:
    bool enabled;
 
    // Update the sync manager on the node which is used to read/write these PDOs.
-   // This is called any time a PDO is added/removed from the list
+   // This is called any time a PDO is added/removed from the list.  It talks
+   // to the node over the mailbox, so it's called without the cyclic mutex;
+   // the list is disabled, so the cycle thread leaves it alone until it's done.
    const Error *UpdtSyncMgr( Node *node )
    {
       const Error *err;
@@ -519,8 +521,13 @@ protected:
       err = ecat->CfgSyncMgr( node, smBase, ramAddr, byteCt, smCtrl );
       if( err ) return err;
 
-      // If everything went well, we can enable the PDO
+      // If everything went well, we can enable the PDO and
+      // have the cycle thread add it to its frames
+      MutexLocker cl( ecat->cyclicMutex );
+      mtx.Lock();
       enabled = true;
+      mtx.Unlock();
+      ecat->InvalidateCycle();
       return 0;
    }
 
@@ -555,6 +562,8 @@ protected:
       enabled = false;
    }
 
+   friend class EtherCAT;
+
 public:
    ~PDO_List()
    {
@@ -568,8 +577,9 @@ public:
       return enabled;
    }
 
-   // Add the PDO to my list of enabled PDOs
-   const Error *AddPDO( Node *node, PDO *pdo, int slot )
+   // Add the PDO to my list of enabled PDOs.  The list is left disabled
+   // until UpdtSyncMgr is called.
+   void AddPDO( PDO *pdo, int slot )
    {
       PDO_Info pi;
       pi.ref   = pdo->GrabRef();
@@ -579,12 +589,11 @@ public:
       enabled = false;
       pdos.add(pi);
       mtx.Unlock();
-
-      return UpdtSyncMgr( node );
    }
 
-   // Remove a PDO from my list of enabled PDOs
-   const Error *RemPDO( Node *node, int slot )
+   // Remove a PDO from my list of enabled PDOs.  The list is left disabled
+   // until UpdtSyncMgr is called.
+   void RemPDO( int slot )
    {
       uint16 objID = mapBase + slot;
 
@@ -602,12 +611,11 @@ public:
 
       enabled = false;
       mtx.Unlock();
-
-      return UpdtSyncMgr( node );
    }
 
-   // Remove this PDO from any location in the list of enabled PDOs
-   const Error *RemPDO( Node *node, PDO *pdo )
+   // Remove this PDO from any location in the list of enabled PDOs.
+   // The list is left disabled until UpdtSyncMgr is called.
+   void RemPDO( PDO *pdo )
    {
       uint32 pdoRef = pdo->RefID();
 
@@ -630,8 +638,6 @@ public:
 
       enabled = false;
       mtx.Unlock();
-
-      return UpdtSyncMgr( node );
    }
 
    void SetSyncRamAddr( uint16 addr )
@@ -662,7 +668,13 @@ public:
       {
          RefObjLocker<Node> nodePtr( nodeRef );
          if( nodePtr )
+         {
             nodePtr->SetState( NODESTATE_GUARDERR );
+
+            // The cycle thread stops exchanging data with the node
+            RefObjLocker<EtherCAT> ecat( nodePtr->GetNetworkRef() );
+            if( ecat ) ecat->InvalidateCycle();
+         }
       }
 
       // Find a pointer to the frame buffer holding the received data
@@ -710,7 +722,18 @@ public:
    // Returns true if the PDO data was successfully updated
    bool Freshen( EtherCAT *ecat )
    {
-      uint8 *ptr = buff;
+      return Freshen( ecat, buff );
+   }
+
+   // Freshen the data where it sits in the frame this datagram 
+   // was last loaded into.
+   bool FreshenInPlace( EtherCAT *ecat )
+   {
+      return Freshen( ecat, (uint8*)getDataPtr() );
+   }
+
+   bool Freshen( EtherCAT *ecat, uint8 *ptr )
+   {
       for( int i=0; i<pdos.length(); i++ )
       {
          if( !ecat->LoadPdoDat( pdos[i].ref, ptr, pdos[i].byteLen ) )
@@ -770,6 +793,9 @@ public:
    // This mutex protects access to the mailbox
    Mutex mbxMtx;
 
+   // Held while the PDO lists are changed and their sync managers updated
+   Mutex pdoMtx;
+
    EtherCatNodeInfo( Node *node )
    {
       id = -1;
@@ -801,6 +827,55 @@ public:
    }
 };
 
+// Most PDO datagrams the cycle frames can hold.  Each takes at least
+// 12 bytes of header and one of data.
+#define ECAT_CYCLE_MAX_DGRAMS    (CML_MAX_ECAT_CYCLE_FRAMES * MAX_ECAT_DATA / 13)
+
+/***************************************************************************/
+/**
+The process data frames exchanged by the EtherCAT cycle thread.
+
+The frames are built once from the enabled PDOs of every node in safe-op
+or operational mode, and a copy of each is kept as it was built.  Each 
+cycle the frames are restored from these copies and only the receive PDO
+data is written into them, so the nodes don't need to be looked up or the
+frames put together again every cycle.  The frames are rebuilt whenever
+EtherCAT::cycleLayout changes.
+*/
+/***************************************************************************/
+class EcatCycleImage
+{
+public:
+   // Value of EtherCAT::cycleLayout the frames were built for
+   uint32 layout;
+
+   // The frames, and a copy of each as it was built
+   EcatFrame frame[ CML_MAX_ECAT_CYCLE_FRAMES ];
+   uint8 image[ CML_MAX_ECAT_CYCLE_FRAMES ][ MAX_ECAT_FRAME ];
+   int16 size[ CML_MAX_ECAT_CYCLE_FRAMES ];
+   int frameCt;
+
+   // Every PDO datagram in the frames, and the receive PDOs among them
+   PDO_List *pdo[ ECAT_CYCLE_MAX_DGRAMS ];
+   RPDO_List *rpdo[ ECAT_CYCLE_MAX_DGRAMS ];
+   int pdoCt, rpdoCt;
+
+   // Reads the system time of the reference clock
+   ARMW dcTime;
+   bool useDC;
+
+   // Integral term of the loop locking the cycle to the distributed clock
+   int64 dcInteg;
+
+   EcatCycleImage( void ): dcTime( 0, 0x910, 8 )
+   {
+      layout = 0;
+      frameCt = pdoCt = rpdoCt = 0;
+      useDC = false;
+      dcInteg = 0;
+   }
+};
+
 CML_NAMESPACE_END()
 
 uint8 EcatFrame::dgIndex = 0;
@@ -821,6 +896,9 @@ EtherCAT::EtherCAT( void )
    readThreadRunning = false;
    cycThreadRunning = false;
    refClkNode = -1;
+   cycleLayout = 0;
+   sync0Period = 0;
+   ClearCycleStats();
 
    for( int i=0; i<CML_MAX_ECAT_FRAMES; i++ )
       sentFrames[i] = 0;
@@ -882,11 +960,16 @@ const Error *EtherCAT::Open( EtherCatHardware &xmit, EtherCatHardware &recv, Eth
 
    cml.Debug( "Starting EtherCAT read thread\n" );
    readThread.setPriority( settings.readThreadPriority );
+   err = readThread.setAffinity( settings.readThreadCPU );
+   if( err ) goto fail;
    readThread.ecat = this;
    err = readThread.start();
    if( err ) goto fail;
    readThreadRunning = true;
 
+   if( !readThread.isRealTime() )
+      cml.Warn( "EtherCAT read thread is not running with real time scheduling\n" );
+
    // Read some basic information on all the connected devices
    frame.Reset();
    frame.Add( &brd );
@@ -939,10 +1022,15 @@ const Error *EtherCAT::Open( EtherCatHardware &xmit, EtherCatHardware &recv, Eth
 
    cml.Debug( "Starting EtherCAT cycle thread\n" );
    cycleThread.setPriority( settings.cycleThreadPriority );
+   err = cycleThread.setAffinity( settings.cycleThreadCPU );
+   if( err ) goto fail;
    cycleThread.ecat = this;
    cycleThread.start();
    cycThreadRunning = true;
 
+   if( !cycleThread.isRealTime() )
+      cml.Warn( "EtherCAT cycle thread is not running with real time scheduling\n" );
+
    return 0;
 
 fail:
@@ -1113,6 +1201,7 @@ const Error *EtherCAT::AttachNode( Node *n )
 
    // Keep a reference to this node for future reference
    nodes[id] = n->GrabRef();
+   InvalidateCycle();
 
    return 0;
 }
@@ -1321,6 +1410,7 @@ const Error *EtherCAT::DetachNode( Node *n )
 
    delete ni;
    SetNodeInfo( n, 0 );
+   InvalidateCycle();
    cyclicMutex.Unlock();
 
    return 0;
@@ -1505,7 +1595,10 @@ const Error *EtherCAT::SetSync0Period( Node *n, uint32 ns )
 
       // If the sync0 time changed, then I'm done.
       if( sync2 != nxtTime )
+      {
+         sync0Period = ns;
          return 0;
+      }
 
       // If the system time somehow passed the sync0 time, then the setup failed for some strange reason
       if( sys2 > sync2 )
@@ -1555,13 +1648,20 @@ const Error *EtherCAT::PdoDisable( Node *node, uint16 slot, bool isTxPDO )
    EtherCatNodeInfo *ni = GetEcatInfo( node );
    if( !ni ) return &EtherCatError::NodeNotInit;
 
-   const Error *err;
-   if( isTxPDO )
-      err = ni->tpdos.RemPDO( node, slot );
-   else
-      err = ni->rpdos.RemPDO( node, slot );
+   PDO_List &list = isTxPDO ? (PDO_List &)ni->tpdos : (PDO_List &)ni->rpdos;
 
-   return err;
+   // Only one change to a node's PDOs at a time
+   MutexLocker pl( ni->pdoMtx );
+
+   // Keep the cycle thread off the PDO list while it's changed
+   cyclicMutex.Lock();
+   InvalidateCycle();
+   list.RemPDO( slot );
+   cyclicMutex.Unlock();
+
+   // The sync manager is updated over the mailbox, so this is done 
+   // without holding up the cycle thread.
+   return list.UpdtSyncMgr( node );
 }
 
 const Error *EtherCAT::PdoEnable( Node *node, uint16 slot, PDO *pdo )
@@ -1569,15 +1669,23 @@ const Error *EtherCAT::PdoEnable( Node *node, uint16 slot, PDO *pdo )
    EtherCatNodeInfo *ni = GetEcatInfo( node );
    if( !ni ) return &EtherCatError::NodeNotInit;
 
-   const Error *err;
-   if( pdo->IsTxPDO() )
-      err = ni->tpdos.AddPDO( node, pdo, slot );
-   else
-   {
-      err = ni->rpdos.AddPDO( node, pdo, slot );
-      // This just fills a buffer with the current PDO data 
-      if( !err ) XmitPDO( pdo, 0 );
-   }
+   PDO_List &list = pdo->IsTxPDO() ? (PDO_List &)ni->tpdos : (PDO_List &)ni->rpdos;
+
+   // Only one change to a node's PDOs at a time
+   MutexLocker pl( ni->pdoMtx );
+
+   // Keep the cycle thread off the PDO list while it's changed
+   cyclicMutex.Lock();
+   InvalidateCycle();
+   list.AddPDO( pdo, slot );
+   cyclicMutex.Unlock();
+
+   // The sync manager is updated over the mailbox, so this is done 
+   // without holding up the cycle thread.
+   const Error *err = list.UpdtSyncMgr( node );
+
+   // This just fills a buffer with the current PDO data 
+   if( !err && !pdo->IsTxPDO() ) XmitPDO( pdo, 0 );
 
    return err;
 }
@@ -1634,25 +1742,32 @@ void EtherCAT::ReadThreadFunc( void )
          continue;
       }
 
+      // The hardware may hand back its own receive buffer rather than
+      // copying into mine.  In that case it stays locked until the packet
+      // has been processed and released.
+      uint8 *msg = buff;
       uint16 count = MAX_ECAT_FRAME;
-      err = hwPtr->RecvPacket( buff, &count, 50 );
-      hwPtr->UnlockRef();
+      err = hwPtr->RecvPacketInPlace( &msg, &count, 50 );
 
       if( err )
       {
+         hwPtr->UnlockRef();
          cml.Debug( "EtherCAT::ReadThreadFunc - error reading EtherCAT frame: %s\n", err->toString() );
          continue;
       }
 
       // Try to grab an index and ID number stored in the beginning 
       // of the frame.
-      EcatFrame *frame = FindFrame( count, buff );
-      if( !frame )
-         continue;
+      EcatFrame *frame = FindFrame( count, msg );
+      if( frame )
+      {
+         // Process the frame
+         err = frame->Process( msg, count );
+         frame->UnlockRef();
+      }
 
-      // Process the frame
-      err = frame->Process( buff, count );
-      frame->UnlockRef();
+      hwPtr->ReleasePacket( msg );
+      hwPtr->UnlockRef();
    }
 
    mtx.Lock();
@@ -1664,75 +1779,287 @@ void EtherCAT::ReadThreadFunc( void )
 
 /**
   This thread runs in the background and is responsible for polling the 
-  process data of all devices on the network periodically.
+  process data of all devices on the network periodically.  Cycles start 
+  on fixed deadlines, so the rate doesn't depend on the time taken to 
+  build and send each frame.  The frames themselves are only rebuilt when
+  the set of nodes or PDOs changes, see EcatCycleImage.
 */
 void EtherCAT::CycleThreadFunc( void )
 {
    cml.Debug( "EtherCAT::CycleThreadFunc started\n" );
-   EcatFrame frame;
+   EcatCycleImage *img = new EcatCycleImage;
+   img->layout = cycleLayout - 1;
+
+   const Error *err = cycleTimer.Start( settings.cyclePeriod );
+   if( err )
+      cml.Error( "EtherCAT::CycleThreadFunc - error starting cycle timer: %s\n", err->toString() );
 
    // Run until a semaphore is posted telling us it's time to shut down
    while( !stopSem )
    {
-      Thread::sleep(settings.cyclePeriod);
+      if( err || cycleTimer.Wait() )
+         Thread::sleep(settings.cyclePeriod);
       if( stopSem ) break;
 
-      frame.Reset();
-
-      ARMW dcTime( refClkNode, 0x910, 8 );
-      if( refClkNode >= 0 )
-         frame.Add( &dcTime );
+      int64 start = Thread::getTimeNS();
 
       cyclicMutex.Lock();
+      RunCycle( *img, start );
 
-      // FIXME - I should also poll the AL status of the nodes to watch for errors
-      for( int n=0; n<nodeCt; n++ )
-      {
-         if( !nodes[n] ) continue;
+      // Toggle a bit in the event map.
+      cyclicUpdate.setMask( cyclicUpdate.getMask() ^ 1 );
+      cyclicMutex.Unlock();
+   }
 
-         // Convert my reference to a node pointer
-         Node *node = (Node*)RefObj::LockRef( nodes[n] );
-         if( !node ) continue;
+   delete img;
 
-         // Check the node state.  Process data only works in safe-op or op mode.
-         NodeState state = node->GetState();
-         if( (state!=NODESTATE_OPERATIONAL) && (state!=NODESTATE_SAFE_OP) )
-         {
-            node->UnlockRef();
-            continue;
-         }
+   EtherCatCycleStats stats;
+   GetCycleStats( stats );
+   cml.Debug( "EtherCAT::CycleThreadFunc %u cycles, %u overruns, jitter %d/%d/%d ns, latency %d/%d/%d ns (min/avg/max)\n",
+              stats.cycles, stats.overruns, stats.jitterMin, stats.jitterAvg, stats.jitterMax,
+              stats.latencyMin, stats.latencyAvg, stats.latencyMax );
+   cml.Debug( "EtherCAT::CycleThreadFunc %u lost frames, %u working counter errors, %u rebuilds\n",
+              stats.lostFrames, stats.wkcErrors, stats.rebuilds );
 
-         EtherCatNodeInfo *ni = GetEcatInfo( node );
-         if( !ni )
-         {
-            node->UnlockRef();
-            continue;
-         }
+   mtx.Lock();
+   cml.Debug( "EtherCAT::CycleThreadFunc stopping %p\n", stopSem );
+   if( stopSem )
+      stopSem->Put();
+   mtx.Unlock();
+}
 
-         // Add a datagram used to send PDO data to node
-         if( ni->rpdos.isEnabled() && ni->rpdos.Freshen( this ) )
-            AddToFrame( &frame, &ni->rpdos );
+// Add a PDO datagram to the cycle frames, starting a new frame if the
+// last one is full.  Returns false if it won't fit at all.
+static bool AddToCycle( EcatCycleImage &img, PDO_List *dg )
+{
+   if( img.pdoCt >= ECAT_CYCLE_MAX_DGRAMS )
+      return false;
+
+   // Clear any link left over from the last time the datagram was loaded
+   dg->Reset();
+
+   const Error *err = img.frame[ img.frameCt-1 ].Add( dg );
+   if( (err == &EtherCatError::DatagramWontFit) && (img.frameCt < CML_MAX_ECAT_CYCLE_FRAMES) )
+   {
+      EcatFrame *frame = &img.frame[ img.frameCt++ ];
+      frame->Reset();
+      err = frame->Add( dg );
+   }
+
+   if( err )
+   {
+      cml.Error( "EtherCAT process data doesn't fit in %d frames\n", CML_MAX_ECAT_CYCLE_FRAMES );
+      return false;
+   }
+
+   img.pdo[ img.pdoCt++ ] = dg;
+   return true;
+}
+
+/**
+  Build the frames exchanged each cycle from the enabled PDOs of every node
+  that's in safe-op or operational mode.  This is called by the cycle thread
+  with the cyclic mutex held whenever cycleLayout changes.
+*/
+void EtherCAT::BuildCycleImage( EcatCycleImage &img )
+{
+   img.layout = cycleLayout;
+   img.frameCt = 1;
+   img.pdoCt = 0;
+   img.rpdoCt = 0;
+   img.frame[0].Reset();
+   cycStats.rebuilds++;
+
+   // Read the reference clock's system time each cycle.  This also passes
+   // it on to the other nodes to correct their drift.
+   img.useDC = (refClkNode >= 0);
+   if( img.useDC )
+   {
+      img.dcTime.Init( 13, -refClkNode, 0x910, 8 );
+      img.frame[0].Add( &img.dcTime );
+   }
+
+   for( int n=0; n<nodeCt; n++ )
+   {
+      if( !nodes[n] ) continue;
+
+      // Check the node state.  Process data only works in safe-op or op mode.
+      // The node info can only be freed with the cyclic mutex held, so it's 
+      // safe to use once the node is unlocked.
+      Node *node = (Node*)RefObj::LockRef( nodes[n] );
+      if( !node ) continue;
+
+      NodeState state = node->GetState();
+      EtherCatNodeInfo *ni = GetEcatInfo( node );
+      node->UnlockRef();
 
-         // Add a datagram used to read PDO data from node
-         if( ni->tpdos.isEnabled() )
-            AddToFrame( &frame, &ni->tpdos );
+      if( !ni || ((state!=NODESTATE_OPERATIONAL) && (state!=NODESTATE_SAFE_OP)) )
+         continue;
+
+      // Add a datagram used to send PDO data to node
+      if( ni->rpdos.isEnabled() && ni->rpdos.Freshen( this ) && AddToCycle( img, &ni->rpdos ) )
+         img.rpdo[ img.rpdoCt++ ] = &ni->rpdos;
+
+      // Add a datagram used to read PDO data from node
+      if( ni->tpdos.isEnabled() )
+         AddToCycle( img, &ni->tpdos );
+   }
+
+   if( img.frame[0].IsEmpty() )
+      img.frameCt = 0;
+
+   // Keep a copy of each frame as built
+   for( int i=0; i<img.frameCt; i++ )
+   {
+      img.size[i] = img.frame[i].getSize();
+      memcpy( img.image[i], img.frame[i].getBuff(), img.size[i] );
+   }
+
+   cml.Debug( "EtherCAT cycle rebuilt, %d frames, %d PDO datagrams\n", img.frameCt, img.pdoCt );
+}
+
+/**
+  Run one cycle of process data exchange.  This is called by the cycle
+  thread with the cyclic mutex held.
+  @param img The cycle frames.
+  @param start The time (ns) the cycle started.
+*/
+void EtherCAT::RunCycle( EcatCycleImage &img, int64 start )
+{
+   int i;
+
+   if( img.layout != cycleLayout )
+      BuildCycleImage( img );
+
+   if( !img.frameCt )
+      return;
 
-         node->UnlockRef();
+   // Put the frames back the way they were built, which resets the
+   // working counters and addresses changed by the nodes last cycle.
+   // Any late response to the last cycle is discarded first.
+   for( i=0; i<img.frameCt; i++ )
+   {
+      while( !img.frame[i].WaitResponse( 0 ) );
+      memcpy( img.frame[i].getBuff(), img.image[i], img.size[i] );
+   }
+
+   // Write the latest receive PDO data straight into the frames
+   for( i=0; i<img.rpdoCt; i++ )
+   {
+      if( !img.rpdo[i]->FreshenInPlace( this ) )
+         InvalidateCycle();
+   }
+
+   int sent = 0;
+   for( ; sent<img.frameCt; sent++ )
+   {
+      if( SendFrame( &img.frame[sent], 0, 0 ) )
+         break;
+   }
+
+   // Wait up to a cycle period for each frame to come back
+   bool ok = (sent == img.frameCt);
+   for( i=0; i<sent; i++ )
+   {
+      if( img.frame[i].WaitResponse( settings.cyclePeriod ) )
+      {
+         ReleaseFrameRef( &img.frame[i] );
+         cycStats.lostFrames++;
+         ok = false;
       }
+   }
 
-      // If any PDOs were added to the frame, process it
-      if( !frame.IsEmpty() ) SendFrame( &frame, 50, 0 );
+   if( !ok ) return;
 
-      // Toggle a bit in the event map.
-      cyclicUpdate.setMask( cyclicUpdate.getMask() ^ 1 );
-      cyclicMutex.Unlock();
+   int32 lat = (int32)(Thread::getTimeNS() - start);
+   if( !latencyCt || lat < cycStats.latencyMin ) cycStats.latencyMin = lat;
+   if( !latencyCt || lat > cycStats.latencyMax ) cycStats.latencyMax = lat;
+   latencySum += lat;
+   latencyCt++;
+
+   for( i=0; i<img.pdoCt; i++ )
+   {
+      if( img.pdo[i]->getWKT() != 1 )
+         cycStats.wkcErrors++;
    }
 
-   mtx.Lock();
-   cml.Debug( "EtherCAT::CycleThreadFunc stopping %p\n", stopSem );
-   if( stopSem )
-      stopSem->Put();
-   mtx.Unlock();
+   if( img.useDC )
+   {
+      int64 dc;
+      img.dcTime.getData( &dc, 8 );
+      AlignToDC( img, dc );
+   }
+}
+
+/**
+  Nudge the cycle timer so the process data frames reach the reference
+  clock at a fixed point in the SYNC0 period.  SYNC0 pulses fall on 
+  multiples of the SYNC0 period in distributed clock time, so the phase
+  is just the reference clock's time when the frame passed it, modulo 
+  the period.  A PI loop is used; the integral term takes out the steady
+  drift between the host clock and the distributed clock.
+  @param img The cycle frames.
+  @param dc The reference clock system time read by this cycle's frame.
+*/
+void EtherCAT::AlignToDC( EcatCycleImage &img, int64 dc )
+{
+   int64 per = (int64)(settings.cyclePeriod * 1000000);
+   int32 p = (int32)sync0Period;
+
+   if( !settings.dcAlign || !p || (per % p) )
+   {
+      cycStats.dcPhase = 0;
+      return;
+   }
+
+   int32 target = (settings.dcShift < 0) ? p/2 : settings.dcShift % p;
+   int32 phase = (int32)((dc - target) % p);
+   if( phase < 0 ) phase += p;
+   if( phase > p/2 ) phase -= p;
+   cycStats.dcPhase = phase;
+
+   img.dcInteg += phase;
+
+   int64 lim = (int64)p * 32;
+   if( img.dcInteg >  lim ) img.dcInteg =  lim;
+   if( img.dcInteg < -lim ) img.dcInteg = -lim;
+
+   // Frames late in the period bring the next deadline forward
+   int32 adj = phase/16 + (int32)(img.dcInteg/1024);
+   if( adj >  p/32 ) adj =  p/32;
+   if( adj < -p/32 ) adj = -p/32;
+   cycleTimer.Adjust( -adj );
+}
+
+/**
+  Return statistics gathered by the cycle thread since the network was 
+  opened or the statistics were last cleared.  These are updated by the 
+  cycle thread without locking, so the values may come from adjacent cycles.
+  @param stats The statistics are returned here.
+*/
+void EtherCAT::GetCycleStats( EtherCatCycleStats &stats )
+{
+   stats = cycStats;
+
+   PeriodicTimerStats t;
+   cycleTimer.GetStats( t );
+   stats.cycles    = t.cycles;
+   stats.overruns  = t.overruns;
+   stats.jitterMin = t.jitterMin;
+   stats.jitterMax = t.jitterMax;
+   stats.jitterAvg = t.jitterAvg;
+   stats.latencyAvg = latencyCt ? (int32)(latencySum / latencyCt) : 0;
+}
+
+/**
+  Clear the statistics returned by GetCycleStats.
+*/
+void EtherCAT::ClearCycleStats( void )
+{
+   memset( &cycStats, 0, sizeof(cycStats) );
+   latencySum = 0;
+   latencyCt = 0;
+   cycleTimer.ClearStats();
 }
 
 /// Wait for the cyclic thread to update.
@@ -2093,6 +2420,7 @@ const Error *EtherCAT::SetNodeAlState( Node *n, uint16 state )
    while( 1 )
    {
       n->SetState( FindNodeState(x) );
+      InvalidateCycle();
 
       // Just return if the mode is correct
       if( x == state ) return 0;
@@ -28,10 +28,9 @@ Default constructor for an Event object.
        defaults to zero.
 */
 /***************************************************************************/
-Event::Event( uint32 val )
+Event::Event( uint32 val ): fired(1)
 {
    map = 0; 
-   semPtr = 0; 
    chainMap = 0;
    value = val;
 }
@@ -42,10 +41,9 @@ Event object copy constructor
 @param e Another event that this will copy.
 */
 /***************************************************************************/
-Event::Event( const Event &e )
+Event::Event( const Event &e ): fired(1)
 {
    map = 0; 
-   semPtr = 0; 
    chainMap = 0;
    value = e.value;
 }
@@ -98,30 +96,27 @@ const Error *Event::setValue( uint32 val )
 
 /***************************************************************************/
 /**
-Update this event's mask.  If this event has a semaphore associated with it,
-and this update causes it to become true, then the semaphore will be posted.
+Update this event's mask.  If a thread is waiting on this event and this
+update causes it to become true, then the waiting thread is woken.
+This is called with the map's mutex locked.
 @param newMask The new mask value
 */
 /***************************************************************************/
 void Event::update( uint32 mask )
 {
-   bool t = isTrue( mask );
-
-   mtx.Lock();
-   if( t )
+   if( isTrue( mask ) )
    {
       trueMask = mask;
 
       if( chainMap )
          chainMap->setBits( chainMask );
 
-      if( semPtr )
-         semPtr->Put();
+      if( !fired.Value() )
+         fired.Post( 1 );
    }
 
    else if( chainMap )
       chainMap->clrBits( chainMask );
-   mtx.Unlock();
 }
 
 /***************************************************************************/
@@ -141,31 +136,37 @@ Note that the event should not be owned by any event map when this is called.
 /***************************************************************************/
 const Error *Event::Wait( EventMap &m, Timeout timeout )
 {
-   Semaphore sem;
-
    // Make sure the event is available
    if( map ) return &EventError::AlreadyOwned;
 
-   mtx.Lock();
-   semPtr = &sem;
-   mtx.Unlock();
+   // If the event is already true there's no need to attach it to
+   // the map at all, unless it's chained to another one.
+   uint32 mask = m.getMask();
+   if( !chainMap && isTrue( mask ) )
+   {
+      trueMask = mask;
+      return 0;
+   }
+
+   fired.Set( 0 );
 
    const Error *err = m.Add( this );
    if( err )
    {
-      mtx.Lock();
-      semPtr = 0;
-      mtx.Unlock();
+      fired.Set( 1 );
       return err;
    }
 
-   err = sem.Get(timeout);
+   err = fired.Wait( 0, timeout );
 
+   // Removing the event synchronizes with the last update, so
+   // both the fired flag and trueMask are settled after this.
    m.Remove( this );
 
-   mtx.Lock();
-   semPtr = 0;
-   mtx.Unlock();
+   if( fired.Value() )
+      err = 0;
+
+   fired.Set( 1 );
    return err;
 }
 
@@ -188,10 +189,11 @@ handled automatically by the EventMap destructor.
 /***************************************************************************/
 void Event::setChain( class EventMap &map, uint32 mask )
 {
-   mtx.Lock();
+   EventMap *owner = this->map;
+   if( owner ) owner->mutex.Lock();
    chainMap = &map;
    chainMask = mask;
-   mtx.Unlock();
+   if( owner ) owner->mutex.Unlock();
 }
 
 /***************************************************************************/
@@ -202,9 +204,12 @@ setup using the Event::setChain method.
 /***************************************************************************/
 void Event::delChain( void )
 {
-   mtx.Lock();
+   // Updates are made with the owning map's mutex held, so taking it
+   // here ensures no update is still using the chained map on return.
+   EventMap *owner = map;
+   if( owner ) owner->mutex.Lock();
    chainMap = 0;
-   mtx.Unlock();
+   if( owner ) owner->mutex.Unlock();
 }
 
 /***************************************************************************/
@@ -245,8 +250,12 @@ const Error *EventMap::Add( Event *e )
    if( list ) list->prev = e;
    list = e;
 
+   // Start watching the event's bits before reading the mask, so
+   // any change made after this read will cause a notification.
+   watched.fetch_or( e->watchBits() );
+
    // Update the event 
-   e->update( mask );
+   e->update( mask.load() );
    mutex.Unlock();
 
    return 0;
@@ -274,6 +283,7 @@ const Error *EventMap::Remove( Event *e )
    if( e->next ) e->next->prev = e->prev;
    if( e->prev ) e->prev->next = e->next;
    else list = e->next;
+   Rewatch();
    mutex.Unlock();
 
    e->map = 0;
@@ -282,15 +292,67 @@ const Error *EventMap::Remove( Event *e )
 
 /***************************************************************************/
 /**
-Update the mask associated with this event map.
-It is assumed that the mutex is already locked when this function is called.
+Update the mask associated with this event map.  The mask is changed with an
+atomic compare and swap, and attached events are only notified if one of the
+bits they depend on has changed.  Most updates, which leave the watched bits
+alone, therefore don't take the mutex.
+@param bits The mask bits to change
+@param value The new value of those bits
 */
 /***************************************************************************/
-void EventMap::update( uint32 newMask )
+void EventMap::update( uint32 bits, uint32 value )
 {
-   mask = newMask;
+   uint32 old = mask.load( std::memory_order_relaxed );
+   uint32 newMask;
+   do
+   {
+      newMask = (old & ~bits) | value;
+   } while( !mask.compare_exchange_weak( old, newMask ) );
+
+   if( (old ^ newMask) & watched.load() )
+      Notify( newMask );
+}
 
+/***************************************************************************/
+/**
+Pass a new mask value to all attached events.
+
+Events are first tested against the mask produced by the caller's update, so
+a waiting event sees a state that may have been only brief.  If the mask has
+since been changed again by another thread, the events are tested again with
+the latest value.  Since that's read with the mutex held, the last thread to
+get here always leaves chained maps consistent with the final mask.
+@param newMask The mask value set by the caller
+*/
+/***************************************************************************/
+void EventMap::Notify( uint32 newMask )
+{
+   Event *e;
+
+   mutex.Lock();
+   for( e = list; e; e = e->next )
+      e->update( newMask );
+
+   uint32 cur = mask.load();
+   if( cur != newMask )
+   {
+      for( e = list; e; e = e->next )
+         e->update( cur );
+   }
+   mutex.Unlock();
+}
+
+/***************************************************************************/
+/**
+Recalculate the bits watched by the attached events.
+It is assumed that the mutex is already locked when this function is called.
+*/
+/***************************************************************************/
+void EventMap::Rewatch( void )
+{
+   uint32 w = 0;
    for( Event *e = list; e; e = e->next )
-      e->update( mask );
+      w |= e->watchBits();
+   watched.store( w );
 }
 
@@ -35,6 +35,40 @@ CML_NEW_ERROR( LinkError, UnknownAmpErr,    "An amplifier error occurred" );
 CML_NEW_ERROR( LinkError, StartMoveTO,      "Timeout waiting on amplifier to respond to start move command" );
 CML_NEW_ERROR( LinkError, NotSupported,     "Support for this function was not enabled in the library" );
 CML_NEW_ERROR( LinkError, AmpRemoved,       "An amp object referenced by the linkage is no longer valid" );
+CML_NEW_ERROR( LinkError, BadSetting,       "An illegal setting was passed to Linkage::Configure" );
+
+// Amplifier events that are reflected in the linkage status.  The linkage
+// status is only updated when one of these changes on an amplifier.
+#define ERROR_EVENTS       (LINKEVENT_NODEGUARD | LINKEVENT_FAULT | LINKEVENT_ERROR | \
+                            LINKEVENT_QUICKSTOP | LINKEVENT_ABORT | LINKEVENT_DISABLED )
+
+#define STATUS_EVENTS      (ERROR_EVENTS | LINKEVENT_POSWARN | LINKEVENT_POSWIN | \
+                            LINKEVENT_VELWIN | LINKEVENT_POSLIM | LINKEVENT_NEGLIM | \
+                            LINKEVENT_SOFTLIM_POS | LINKEVENT_SOFTLIM_NEG | \
+                            LINKEVENT_MOVEDONE | LINKEVENT_TRJDONE )
+
+/**
+  Thread used by Linkage::GetAmpConfig and Linkage::SetAmpConfig to 
+  access the configuration of one amplifier.
+  */
+class LinkConfigThread: public JobThread
+{
+public:
+   uint32 ampRef;
+   AmpConfig *cfg;
+   bool set;
+
+   void run( void )
+   {
+      RefObjLocker<Amp> amp( ampRef );
+      if( !amp )
+         err = &LinkError::AmpRemoved;
+      else if( set )
+         err = amp->SetAmpConfig( *cfg );
+      else
+         err = amp->GetAmpConfig( *cfg );
+   }
+};
 
 /***************************************************************************/
 /**
@@ -49,6 +83,7 @@ Linkage::Linkage( void ): ctrlPDO( *this )
    trjUseCount = 0;
    ampct = 0;
    maxVel = maxAcc = maxDec = maxJrk = 0;
+   axisLimits = false;
    linkTrjRef = 0;
 
    for( int i=0; i<CML_MAX_AMPS_PER_LINK; i++ )
@@ -56,9 +91,14 @@ Linkage::Linkage( void ): ctrlPDO( *this )
       ampRef[i] = 0;
 #ifdef CML_LINKAGE_TRJ_BUFFER_SIZE
       ampTrj[i].Init( this );
+      ampTrj[i].SetSize( cfg.trjBufferSize );
 #endif
    }
 
+#ifdef CML_LINKAGE_TRJ_BUFFER_SIZE
+   trjGenBusy.clear();
+#endif
+
    ClearLatchedError();
 }
 
@@ -70,6 +110,11 @@ Linkage::Linkage( void ): ctrlPDO( *this )
 Linkage::~Linkage()
 {
    KillRef();
+
+   // Stop the linkage thread before the members it uses are destroyed.
+   // Thread::~Thread runs too late for that, and with too short a timeout.
+   stop();
+
    for( int i=0; i<ampct; i++ )
    {
       if( ampRef[i] )
@@ -120,6 +165,36 @@ void Linkage::InvalidateAmp( uint32 a )
 /***************************************************************************/
 const Error *Linkage::Configure( LinkSettings &settings )
 {
+#ifdef CML_LINKAGE_TRJ_BUFFER_SIZE
+   if( settings.trjBufferSize < 2 || settings.trjBatchSize < 1 )
+      return &LinkError::BadSetting;
+
+   if( settings.trjBufferSize != cfg.trjBufferSize )
+   {
+      if( linkTrjRef )
+         return &LinkError::AmpTrjInUse;
+
+      for( int i=0; i<CML_MAX_AMPS_PER_LINK; i++ )
+      {
+         const Error *err = ampTrj[i].SetSize( settings.trjBufferSize );
+         if( err ) return err;
+      }
+   }
+#endif
+
+   if( settings.threadPriority < 0 || settings.threadPriority > 9 || settings.threadCPU < -1 )
+      return &LinkError::BadSetting;
+
+   // These take effect right away if my thread is already running
+   if( settings.threadPriority != cfg.threadPriority )
+      setPriority( settings.threadPriority );
+
+   if( settings.threadCPU != cfg.threadCPU )
+   {
+      const Error *err = setAffinity( settings.threadCPU );
+      if( err ) return err;
+   }
+
    cfg = settings;
    return 0;
 }
@@ -160,6 +235,112 @@ const Error *Linkage::Init( uint16 ct, Amp a[] )
    return Init( ct, aptr );
 }
 
+/***************************************************************************/
+/**
+  Initialize a group of amplifiers and then a new linkage object holding them.
+
+  The amplifiers are initialized at the same time using Amp::InitParallel, 
+  which is much quicker than initializing them one after another when there
+  are several of them.
+
+  @param net The network the amplifiers are on.
+
+  @param ct The number of amplifiers to be used with this linkage.
+  Note that this must be between 1 and CML_MAX_AMPS_PER_LINK.
+
+  @param a An array of amplifiers to be initialized and assigned to this 
+  linkage.  There must be at least ct amplifiers in this array.
+
+  @param nodeID An array holding the node ID of each amplifier.
+
+  @param settings The settings used to initialize the amplifiers.
+
+  @return An error object pointer, or NULL on success.
+  */
+/***************************************************************************/
+const Error *Linkage::Init( Network &net, uint16 ct, Amp a[], int16 nodeID[], AmpSettings &settings )
+{
+   if( ct < 1 || ct > CML_MAX_AMPS_PER_LINK )
+      return &LinkError::BadAmpCount;
+
+   const Error *err = Amp::InitParallel( net, ct, a, nodeID, settings );
+   if( err ) return err;
+
+   return Init( ct, a );
+}
+
+/***************************************************************************/
+/**
+  Read the configuration of every amplifier in the linkage.  
+
+  The amplifiers are read at the same time, each on its own thread, so the
+  SDO transfers to the different nodes overlap on the network.  If the 
+  amplifiers were initialized with AmpSettings::cacheConfig set, values 
+  already known are not read from the amplifiers again.
+
+  @param cfg An array of at least Linkage::GetAmpCount configuration 
+         structures which will be filled in.
+  @return An error object pointer, or NULL on success.
+  */
+/***************************************************************************/
+const Error *Linkage::GetAmpConfig( AmpConfig cfg[] )
+{
+   return AmpConfigAll( cfg, false );
+}
+
+/***************************************************************************/
+/**
+  Update the configuration of every amplifier in the linkage.  
+
+  The amplifiers are updated at the same time, each on its own thread.  If
+  the amplifiers were initialized with AmpSettings::cacheConfig set, only 
+  the parameters which differ from the values last read from or written to 
+  each amplifier are sent, so restoring a configuration that is mostly 
+  unchanged is very quick.
+
+  @param cfg An array of at least Linkage::GetAmpCount configuration 
+         structures holding the new configuration of each amplifier.
+  @return An error object pointer, or NULL on success.
+  */
+/***************************************************************************/
+const Error *Linkage::SetAmpConfig( AmpConfig cfg[] )
+{
+   return AmpConfigAll( cfg, true );
+}
+
+/***************************************************************************/
+/**
+  Read or write the configuration of all amplifiers in parallel.
+  @param cfg Array of configuration structures, one for each amplifier.
+  @param set If true, the configuration is written, else it's read.
+  @return The error returned by the first amplifier (in linkage order) that
+          failed, or NULL on success.
+  */
+/***************************************************************************/
+const Error *Linkage::AmpConfigAll( AmpConfig cfg[], bool set )
+{
+   if( !ampct ) return 0;
+
+   LinkConfigThread *thread = new LinkConfigThread[ ampct ];
+   if( !thread ) return &ThreadError::Alloc;
+
+   JobThread *job[ CML_MAX_AMPS_PER_LINK ];
+   for( int i=0; i<ampct; i++ )
+   {
+      thread[i].ampRef = ampRef[i];
+      thread[i].cfg    = &cfg[i];
+      thread[i].set    = set;
+      job[i] = &thread[i];
+   }
+
+   // A configuration error is only returned, it isn't latched as a move 
+   // error of the linkage.
+   const Error *err = JobThread::RunAll( job, ampct );
+
+   delete[] thread;
+   return err;
+}
+
 /***************************************************************************/
 /**
   Initialize a new linkage object.  If the object has already been initialized,
@@ -236,12 +417,18 @@ const Error *Linkage::Init( uint16 ct, Amp *a[] )
    for( i=0; i<ct; i++ )
    {
       stateEvent[ i ].link = this;
+      stateEvent[ i ].setValue( STATUS_EVENTS );
       a[i]->eventMap.Add( &stateEvent[i] );
    }
 
    // Start my thread
+   setPriority( cfg.threadPriority );
+   setAffinity( cfg.threadCPU );
    start();
 
+   if( !isRealTime() )
+      cml.Warn( "Linkage %d thread is not running with real time scheduling\n", linkID );
+
    // If these amps are on a CANopen network, then initialize 
    // a PDO used to send control words to each amplifier
    // We use a slightly different technique on EtherCAT networks
@@ -295,9 +482,10 @@ uint32 Linkage::GetAmpRef( uint16 i )
 /***************************************************************************/
 /**
   Get the current commanded position of the linkage.  Note that this function
-  queries the position of each amplifier sequentially and therefore the returned
+  queries the position of each amplifier separately and therefore the returned
   position information will only be accurate if the linkage is at rest when the
-  function is called.
+  function is called.  The requests to all the amplifiers are sent together, 
+  so they wait for the network once rather then once per amplifier.
 
   @param p A point that will be filled in with the current Linkage commanded 
   position.
@@ -317,11 +505,26 @@ const Error *Linkage::GetPositionCommand( PointN &p )
    int i;
    const Error *err;
 
+   SdoFuture f[CML_MAX_AMPS_PER_LINK];
+
+   for( i=0; i<ampct; i++ )
+   {
+      RefObjLocker<Amp> amp( ampRef[i] );
+      if( amp ) amp->UpldAsync( OBJID_POS_CMD, 0, f[i] );
+   }
+
+   // Collect the responses.  Asynchronous transfers aren't retried, so
+   // any that failed are read again the usual way.
    for( i=0; i<ampct; i++ )
    {
       RefObjLocker<Amp> amp( ampRef[i] );
       if( !amp )
          err = &LinkError::AmpRemoved;
+      else if( !f[i].Wait() )
+      {
+         pos[i] = amp->PosLoad2User( (int32)f[i].GetValue() );
+         err = 0;
+      }
       else
          err = amp->GetPositionCommand( pos[i] );
       if( err )
@@ -346,7 +549,9 @@ const Error *Linkage::GetPositionCommand( PointN &p )
 
 /***************************************************************************/
 /**
-  Set limits used for multi-axis point-to-point moves.
+  Set limits used for multi-axis point-to-point moves.  These limits apply to
+  the vector distance along the line of the move, and replace any per-axis 
+  limits previously set.
 
   @param vel Maximum velocity
   @param acc Maximum acceleration
@@ -364,7 +569,52 @@ const Error *Linkage::SetMoveLimits( uunit vel, uunit acc, uunit dec, uunit jrk
    maxAcc = acc;
    maxDec = dec;
    maxJrk = jrk;
+   axisLimits = false;
+
+   return 0;
+}
+
+/***************************************************************************/
+/**
+  Set separate limits for each axis, used for multi-axis point-to-point moves.
+  Moves made by Linkage::MoveTo will then run as fast as the most limited axis
+  allows, see LinkTrjScurve::Calculate.  These limits replace the ones set
+  by the other version of this function.
+
+  @param vel Maximum velocity of each axis
+  @param acc Maximum acceleration of each axis
+  @param dec Maximum deceleration of each axis
+  @param jrk Maximum jerk of each axis
+  @return An error object pointer, or NULL on success.
+  */
+/***************************************************************************/
+const Error *Linkage::SetMoveLimits( PointN &vel, PointN &acc, PointN &dec, PointN &jrk )
+{
+   int d = vel.getDim();
+
+   if( d < 1 || d > CML_MAX_AMPS_PER_LINK || acc.getDim() != d || dec.getDim() != d || jrk.getDim() != d )
+      return &LinkError::AxisCount;
+
+   for( int i=0; i<d; i++ )
+   {
+      if( vel[i] <= 0 || acc[i] <= 0 || dec[i] <= 0 || jrk[i] <= 0 )
+         return &LinkError::BadMoveLimit;
+   }
 
+   axisVel.setDim( d );
+   axisAcc.setDim( d );
+   axisDec.setDim( d );
+   axisJrk.setDim( d );
+
+   for( int i=0; i<d; i++ )
+   {
+      axisVel[i] = vel[i];
+      axisAcc[i] = acc[i];
+      axisDec[i] = dec[i];
+      axisJrk[i] = jrk[i];
+   }
+
+   axisLimits = true;
    return 0;
 }
 
@@ -387,10 +637,43 @@ const Error *Linkage::GetMoveLimits( uunit &vel, uunit &acc, uunit &dec, uunit &
    return 0;
 }
 
+/***************************************************************************/
+/**
+  Return the per-axis move limits currently set for this linkage.
+  @param vel Returns maximum velocity of each axis
+  @param acc Returns maximum acceleration of each axis
+  @param dec Returns maximum deceleration of each axis
+  @param jrk Returns maximum jerk of each axis
+  @return An error object pointer, or NULL on success.  LinkError::BadMoveLimit
+          is returned if no per-axis limits have been set.
+  */
+/***************************************************************************/
+const Error *Linkage::GetMoveLimits( PointN &vel, PointN &acc, PointN &dec, PointN &jrk )
+{
+   if( !axisLimits )
+      return &LinkError::BadMoveLimit;
+
+   int d = axisVel.getDim();
+   vel.setDim( d );
+   acc.setDim( d );
+   dec.setDim( d );
+   jrk.setDim( d );
+
+   for( int i=0; i<d; i++ )
+   {
+      vel[i] = axisVel[i];
+      acc[i] = axisAcc[i];
+      dec[i] = axisDec[i];
+      jrk[i] = axisJrk[i];
+   }
+   return 0;
+}
+
 /***************************************************************************/
 /**
   Move to a specified position.  This move uses the limits previously set using
-  Linkage::SetMoveLimits.
+  Linkage::SetMoveLimits, either per-axis or along the line of the move 
+  depending on which version was called last.
 
   @param p The point to move to.
   @param start If true (the default), the profile will be started by this call.
@@ -401,6 +684,8 @@ const Error *Linkage::GetMoveLimits( uunit &vel, uunit &acc, uunit &dec, uunit &
 /***************************************************************************/
 const Error *Linkage::MoveTo( PointN &p, bool start )
 {
+   if( axisLimits )
+      return MoveTo( p, axisVel, axisAcc, axisDec, axisJrk, start );
    return MoveTo( p, maxVel, maxAcc, maxDec, maxJrk, start );
 }
 
@@ -458,6 +743,50 @@ const Error *Linkage::MoveTo( PointN &p, uunit vel, uunit acc, uunit dec, uunit
 #endif
 }
 
+/***************************************************************************/
+/**
+  Move to a point in space using separate limits for each axis.  This is the
+  same straight line move as the other versions of this function, but the
+  profile is the fastest one that keeps each axis within its own limits.
+  See LinkTrjScurve::Calculate for details.
+
+  @param p The point in N space to move to.
+  @param vel Maximum velocity of each axis
+  @param acc Maximum acceleration of each axis
+  @param dec Maximum deceleration of each axis
+  @param jrk Maximum jerk of each axis
+  @param start If true (the default), the profile will be started by this call.
+               If false, the profile will be uploaded, but not started.  In that case
+               the move may be later started by a call to Linkage::StartMove.
+
+  @return An error object pointer, or NULL on success.
+  */
+/***************************************************************************/
+const Error *Linkage::MoveTo( PointN &p, PointN &vel, PointN &acc, PointN &dec, PointN &jrk, bool start )
+{
+#ifndef CML_ALLOW_FLOATING_POINT
+   return &LinkError::NotSupported;
+#else
+   ClearLatchedError();
+
+   if( p.getDim() != GetAxesCount() || vel.getDim() != GetAxesCount() )
+      return &LinkError::AxisCount;
+
+   const Error *err;
+
+   Point<CML_MAX_AMPS_PER_LINK> startPos;
+   startPos.setDim( GetAxesCount() );
+
+   err = GetPositionCommand( startPos );
+   if( err ) return err;
+
+   err = scurve.Calculate( startPos, p, vel, acc, dec, jrk );
+   if( err ) return err;
+
+   return SendTrajectory( scurve, start );
+#endif
+}
+
 #ifdef CML_LINKAGE_TRJ_BUFFER_SIZE
 /***************************************************************************/
 /**
@@ -493,19 +822,61 @@ const Error *Linkage::SendTrajectory( LinkTrajectory &trj, bool start )
    linkTrjRef = trj.GrabRef();
    IncTrjUseCount();
 
-   for( int i=0; i<ampct; i++ )
+   // The trajectory is sent to all the amplifiers together, one step of
+   // Amp::SendTrajectory at a time.  That way the status requests and
+   // preloaded segments of every amplifier are on the network at once,
+   // rather then each amplifier waiting for the one before it.
+   SdoFuture f[CML_MAX_AMPS_PER_LINK];
+   const Error *err = 0;
+   int i, errAmp = 0;
+
+   for( i=0; i<ampct && !err; i++ )
    {
-      const Error *err;
       RefObjLocker<Amp> amp( ampRef[i] );
       if( !amp )
          err = &LinkError::AmpRemoved;
       else
-         err = amp->SendTrajectory( ampTrj[i], false );
-      if( err )
+         err = amp->PvtPreloadStart( f[i] );
+      if( err ) errAmp = i;
+   }
+
+   // Amps that were preloaded are finished even after an error, which
+   // leaves them holding the start of the move but not running it.
+   int loaded = 0;
+   for( i=0; i<ampct && !err; i++ )
+   {
+      RefObjLocker<Amp> amp( ampRef[i] );
+      if( !amp )
+         err = &LinkError::AmpRemoved;
+      else
+         err = amp->PvtPreload( ampTrj[i], f[i] );
+      if( err ) errAmp = i;
+      else loaded++;
+   }
+
+   for( i=0; i<loaded; i++ )
+   {
+      RefObjLocker<Amp> amp( ampRef[i] );
+      const Error *e = amp ? amp->PvtPreloadFinish( ampTrj[i], f[i], false ) : &LinkError::AmpRemoved;
+      if( e && !err )
       {
-         DecTrjUseCount();
-         return LatchError( err, i );
+         err = e;
+         errAmp = i;
+      }
+   }
+
+   // On error, amps that were preloaded let go of the trajectory they
+   // would have streamed, as they do when StartMove fails.
+   if( err )
+   {
+      for( i=0; i<ampct; i++ )
+      {
+         RefObjLocker<Amp> amp( ampRef[i] );
+         if( amp ) amp->FinishPvtTrj();
       }
+
+      DecTrjUseCount();
+      return LatchError( err, errAmp );
    }
 
    // Lower the usage count here to make up for the initial increase.
@@ -535,7 +906,7 @@ const Error *Linkage::StartMove( void )
    uint32 allAmps = (1<<ampct) - 1;
    const Error *err = 0;
    EventAny events[CML_MAX_AMPS_PER_LINK];
-   EventMap map;
+   EventMap &map = startMap;
    int i;
 
    // Create an event to monitor the status of the
@@ -643,11 +1014,20 @@ const Error *Linkage::StartMove( void )
 
    // Reset the event chaining that I setup.  This ensures that the
    // events won't point to an event map that has been destroyed
-   // already.
+   // already.  If the move couldn't be started, the amps also let go
+   // of any trajectory they were still streaming, as Amp::StartPVT does.
 cleanup:
    for( i=0; i<ampct; i++ )
+   {
       events[i].delChain();
 
+      if( err )
+      {
+         RefObjLocker<Amp> amp( ampRef[i] );
+         if( amp ) amp->FinishPvtTrj();
+      }
+   }
+
    return err;
 }
 
@@ -849,23 +1229,45 @@ const Error *Linkage::GetError( uint32 mask )
 #ifdef CML_LINKAGE_TRJ_BUFFER_SIZE
 /***************************************************************************/
 /**
-  Get the next PVT segment.  This function is called by an amplifier trajectory
+  Get more PVT segments.  This function is called by an amplifier trajectory
   object when it requires a new trajectory point and doesn't have one cached.
-  The linkage trajectory is queried for it's next point, and after this point
-  is converted from axis space to amplifier space, the point is distributed to
-  all amplifier trajectory objects.
+
+  Only one thread generates points at a time.  If some other thread is already
+  doing so, this returns TrjError::NoneAvailable immediately rather then 
+  waiting.  The amplifier treats that as a request to try again on its next
+  PVT status update, by which time the other thread has filled its buffer.
 
   @return A pointer to an error object, or NULL on success.
   */
 /***************************************************************************/
 const Error *Linkage::RequestNextTrjPoint( void )
 {
-   const Error *err;
-
    if( !linkTrjRef )
       return &LinkError::NoActiveTrj;
 
-   MutexLocker ml( mtx );
+   if( trjGenBusy.test_and_set( std::memory_order_acquire ) )
+      return &TrjError::NoneAvailable;
+
+   const Error *err = GenerateTrjBatch();
+
+   trjGenBusy.clear( std::memory_order_release );
+   return err;
+}
+
+/***************************************************************************/
+/**
+  Query the linkage trajectory for a batch of points.  Each point is converted
+  from axis space to amplifier space and distributed to all amplifier trajectory
+  objects.  The batch size is limited by the linkage settings, the trajectory,
+  and the free space in the fullest amplifier buffer.
+
+  @return A pointer to an error object, or NULL on success.  If some amplifier
+          buffer is full, TrjError::NoneAvailable is returned.
+  */
+/***************************************************************************/
+const Error *Linkage::GenerateTrjBatch( void )
+{
+   const Error *err = 0;
 
    uunit pos[ CML_MAX_AMPS_PER_LINK ];
    uunit vel[ CML_MAX_AMPS_PER_LINK ];
@@ -878,22 +1280,50 @@ const Error *Linkage::RequestNextTrjPoint( void )
       return &LinkError::NoActiveTrj;
    }
 
-   bool useVel = trj->UseVelocityInfo();
-   err = trj->NextSegment( pos, vel, time );
-   if( err ) return err;
+   int n = cfg.trjBatchSize;
 
-   // Convert from the frame of each axis to the frame used by the drive
-   if( useVel )
-      err = ConvertAxisToAmp( pos, vel );
-   else
-      err = ConvertAxisToAmpPos( pos );
-
-   if( err ) return err;
+   int max = trj->MaximumBatchPoints();
+   if( n > max ) n = max;
 
    for( int i=0; i<ampct; i++ )
-      ampTrj[i].AddPoint( pos[i], vel[i], time, useVel );
+   {
+      int free = ampTrj[i].FreeCount();
+      if( n > free ) n = free;
+   }
 
-   return 0;
+   // Amps drain their buffers at different times, so another amp's 
+   // buffer may still be full when this one runs out.  The caller tries
+   // again on its next status update, by which time there is room.
+   if( n < 1 )
+      return &TrjError::NoneAvailable;
+
+   int ct;
+   for( ct=0; ct<n; ct++ )
+   {
+      bool useVel = trj->UseVelocityInfo();
+      err = trj->NextSegment( pos, vel, time );
+      if( err ) break;
+
+      // Convert from the frame of each axis to the frame used by the drive
+      if( useVel )
+         err = ConvertAxisToAmp( pos, vel );
+      else
+         err = ConvertAxisToAmpPos( pos );
+
+      if( err ) break;
+
+      for( int i=0; i<ampct; i++ )
+         ampTrj[i].AddPoint( pos[i], vel[i], time, useVel );
+
+      // Zero time marks the end of the trajectory
+      if( !time ) break;
+   }
+
+   // A short batch isn't an error as long as something was generated
+   if( ct > 0 && err == &TrjError::NoneAvailable )
+      err = 0;
+
+   return err;
 }
 
 /***************************************************************************/
@@ -951,9 +1381,6 @@ const Error *Linkage::DecTrjUseCount( void )
   */
 /***************************************************************************/
 
-#define ERROR_EVENTS       (LINKEVENT_NODEGUARD | LINKEVENT_FAULT | LINKEVENT_ERROR | \
-                            LINKEVENT_QUICKSTOP | LINKEVENT_ABORT | LINKEVENT_DISABLED )
-
 void Linkage::UpdateStatus( void )
 {
    uint32 orMask = 0;
@@ -1086,8 +1513,14 @@ void Linkage::run( void )
          cml.Debug( "Link %d error from amp %d while waiting on move.\n  %s\n",  
                     linkID, errAmp, err->toString() );
 
-      // On error, halt the linkage
+      // On error, halt the linkage.  The rest of the trajectory will 
+      // never be run, so the amps stop streaming it.
       HaltMove();
+      for( int i=0; i<ampct; i++ )
+      {
+         RefObjLocker<Amp> amp( ampRef[i] );
+         if( amp ) amp->FinishPvtTrj();
+      }
 
       allDone.Wait( eventMap, -1 );
    }
@@ -1119,6 +1552,42 @@ void Linkage::AmpTrj::Init( Linkage *lptr )
    linkPtr = lptr;
    head = tail = 0;
    inUse = false;
+   lastUseVel = true;
+   minSegTime = 0;
+}
+
+/***************************************************************************/
+/**
+  Set the number of points this buffer can hold.  Any points held are discarded,
+  so this must not be called while the buffer is in use.
+  @param n The number of points
+  @return A pointer to an error object, or NULL on success.
+  */
+/***************************************************************************/
+const Error *Linkage::AmpTrj::SetSize( int n )
+{
+   if( inUse )
+      return &LinkError::AmpTrjInUse;
+
+   // One slot is always left empty to tell a full ring from an empty one
+   delete[] pts;
+   pts = new TrjPoint[ n+1 ];
+   size = n+1;
+   head = tail = 0;
+   return 0;
+}
+
+/***************************************************************************/
+/**
+  Return the number of points that may be added to the buffer.  This is only 
+  exact for the producer; the consumer may free more space at any time.
+  */
+/***************************************************************************/
+int Linkage::AmpTrj::FreeCount( void )
+{
+   int h = head.load( std::memory_order_relaxed );
+   int t = tail.load( std::memory_order_acquire );
+   return size - 1 - (h - t + size) % size;
 }
 
 /***************************************************************************/
@@ -1143,7 +1612,8 @@ const Error *Linkage::AmpTrj::StartNew( void )
 void Linkage::AmpTrj::Finish( void )
 {
    inUse = false;
-   head = tail = 0;
+   head.store( 0, std::memory_order_relaxed );
+   tail.store( 0, std::memory_order_relaxed );
    linkPtr->DecTrjUseCount();
 }
 
@@ -1154,17 +1624,18 @@ void Linkage::AmpTrj::Finish( void )
 /***************************************************************************/
 const Error *Linkage::AmpTrj::AddPoint( uunit pos, uunit vel, uint8 time, bool useVel )
 {
-   int newHead = (head+1) % CML_LINKAGE_TRJ_BUFFER_SIZE;
+   int h = head.load( std::memory_order_relaxed );
+   int newHead = (h+1) % size;
 
-   if( newHead == tail )
+   if( newHead == tail.load( std::memory_order_acquire ) )
       return &LinkError::AmpTrjOverflow;
 
-   p[head] = pos;
-   v[head] = vel;
-   t[head] = time;
-   u[head] = useVel;
+   pts[h].p = pos;
+   pts[h].v = vel;
+   pts[h].t = time;
+   pts[h].u = useVel;
 
-   head = newHead;
+   head.store( newHead, std::memory_order_release );
 
    return 0;
 }
@@ -1176,10 +1647,19 @@ const Error *Linkage::AmpTrj::AddPoint( uunit pos, uunit vel, uint8 time, bool u
 /***************************************************************************/
 bool Linkage::AmpTrj::UseVelocityInfo( void )
 {
-   if( head == tail )
+   int t = tail.load( std::memory_order_relaxed );
+
+   if( head.load( std::memory_order_acquire ) == t )
+   {
       linkPtr->RequestNextTrjPoint();
 
-   return u[tail];
+      // Nothing generated, the next call to NextSegment will say so
+      if( head.load( std::memory_order_acquire ) == t )
+         return lastUseVel;
+   }
+
+   lastUseVel = pts[t].u;
+   return lastUseVel;
 }
 
 /***************************************************************************/
@@ -1200,6 +1680,31 @@ int Linkage::AmpTrj::MaximumBufferPointsToUse( void )
    return trj->MaximumBufferPointsToUse();
 }
 
+/***************************************************************************/
+/**
+  Pass a suggested shortest segment time on to the linkage trajectory.
+  The longest time suggested by any amplifier in the linkage is used.
+  */
+/***************************************************************************/
+void Linkage::AmpTrj::SetMinSegmentTime( uint8 ms )
+{
+   minSegTime = ms;
+
+   uint8 max = 0;
+   for( int i=0; i<linkPtr->ampct; i++ )
+   {
+      if( linkPtr->ampTrj[i].minSegTime > max )
+         max = linkPtr->ampTrj[i].minSegTime;
+   }
+
+   if( !linkPtr->linkTrjRef )
+      return;
+
+   RefObjLocker<LinkTrajectory> trj( linkPtr->linkTrjRef );
+   if( trj )
+      trj->SetMinSegmentTime( max );
+}
+
 /***************************************************************************/
 /**
   Get the next segment for the PVT move.
@@ -1211,17 +1716,22 @@ const Error *Linkage::AmpTrj::NextSegment( uunit &pos, uunit &vel, uint8 &time )
 
    const Error *err;
 
-   if( head == tail )
+   int t = tail.load( std::memory_order_relaxed );
+
+   if( head.load( std::memory_order_acquire ) == t )
    {
       err = linkPtr->RequestNextTrjPoint();
       if( err ) return err;
+
+      if( head.load( std::memory_order_acquire ) == t )
+         return &TrjError::NoneAvailable;
    }
 
-   pos  = p[tail];
-   vel  = v[tail];
-   time = t[tail];
+   pos  = pts[t].p;
+   vel  = pts[t].v;
+   time = pts[t].t;
 
-   tail = (tail+1) % CML_LINKAGE_TRJ_BUFFER_SIZE;
+   tail.store( (t+1) % size, std::memory_order_release );
 
    return 0;
 }
@@ -1312,5 +1822,13 @@ LinkSettings::LinkSettings()
    moveAckTimeout = 200;
    haltOnPosWarn = false;
    haltOnVelWin = false;
+#ifdef CML_LINKAGE_TRJ_BUFFER_SIZE
+   trjBufferSize = CML_LINKAGE_TRJ_BUFFER_SIZE;
+#else
+   trjBufferSize = 0;
+#endif
+   trjBatchSize = 8;
+   threadPriority = 5;
+   threadCPU = -1;
 }
 
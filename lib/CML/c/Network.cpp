@@ -18,6 +18,7 @@ This class is used for over all control of the CANopen network.
 #include "CML_Error.h"
 #include "CML_Network.h"
 #include "CML_Node.h"
+#include "CML_CanOpen.h"
 
 CML_NAMESPACE_USE();
 
@@ -73,3 +74,62 @@ int32 Network::maxSdoFromNode( Node *n )
    return 8;
 }
 
+/***************************************************************************/
+/**
+Start an SDO transfer without waiting for the response.  The response will
+be written to the passed buffer, and the transfer must be completed by a 
+call to Network::FinishSDO with the same semaphore.  This allows requests
+to several nodes to be outstanding on the network at once.
+
+Only one transfer may be outstanding to a node at a time, and only single
+message (expedited) SDO transfers may be started this way.
+
+Networks that can't overlap SDO transfers use this default implementation,
+which does the whole transfer here.
+
+@param n Pointer to the node to whom the SDO is addressed.
+@param data Buffer holding the formatted SDO data.  Must be at least 8 bytes
+       long.  The first 8 bytes of the response are returned here.
+@param len Length of the SDO data in bytes.
+@param done Semaphore used to signal the arrival of the response.
+@param timeout Max time to wait for the request to be sent.
+@return A pointer to an error object, or NULL on success.
+*/
+/***************************************************************************/
+const Error *Network::StartSDO( Node *n, uint8 *data, uint16 len, Semaphore *done, Timeout timeout )
+{
+   // The response may be as long as the mailbox on some networks.
+   // This is the same limit used for all SDO transfers.
+   uint8 buff[512];
+   uint16 ret = sizeof(buff);
+
+   if( len > 8 ) return &CanOpenError::BadParam;
+
+   for( int i=0; i<len; i++ )
+      buff[i] = data[i];
+
+   const Error *err = XmitSDO( n, buff, len, &ret, timeout );
+   if( err ) return err;
+
+   for( int i=0; i<8; i++ )
+      data[i] = buff[i];
+   return 0;
+}
+
+/***************************************************************************/
+/**
+Wait for the response to an SDO transfer started by Network::StartSDO.  This
+must be called for every transfer that was started successfully, even if
+the response is no longer wanted.
+
+@param n Pointer to the node to whom the SDO was addressed.
+@param done The semaphore passed to Network::StartSDO
+@param timeout Max time to wait for the response.
+@return A pointer to an error object, or NULL on success.
+*/
+/***************************************************************************/
+const Error *Network::FinishSDO( Node *n, Semaphore *done, Timeout timeout )
+{
+   return 0;
+}
+
@@ -12,26 +12,35 @@
 This file holds the code needed to implement the CML reference counting objects.
 */
 
+#include <atomic>
+
 #include "CML.h"
 
 #define ADD_NAMES_TO_REFINFO
 
+// Locking, unlocking, grabbing and releasing references are the most 
+// frequent operations, and are done with atomic operations on the 
+// reference info structure without taking the table mutex.  The mutex 
+// is only used to allocate, recycle and list the structures.
+//
+// A lock count of -1 marks a structure that's on the recycled list.  
+// LockRef only increments counts that are not negative, so a recycled
+// structure can't be locked.  KillRef clears the object pointer before 
+// waiting for the lock count to reach zero, so a LockRef that raced with 
+// it either sees the pointer cleared and backs out, or is waited for.
+
 CML_NAMESPACE_START()
 struct RefInfo
 {
-   int refCt;          // Number of open references
-   int lockCt;         // Number of locks for this reference
-   bool autoDeleteEna; // If true, delete object when refCt == 1
+   std::atomic<int32> refCt;     // Number of open references
+   std::atomic<int32> lockCt;    // Number of locks for this reference
+   std::atomic<RefObj*> ptr;     // Object, or NULL once it's been destroyed
+   bool autoDeleteEna;           // If true, delete object when refCt == 1
+   int32 next;                   // Used when on the recycled list
 
 #ifdef ADD_NAMES_TO_REFINFO
    const char *name;   // Reference name for debugging
 #endif
-
-   union
-   {
-      RefObj *ptr;     // Used when this object is active
-      int32 next;      // Used when on the recycled list
-   };
 };
 
 CML_NAMESPACE_END()
@@ -53,15 +62,18 @@ CML_NAMESPACE_USE();
 
 #define REF_PER_BLOCK               (1<<CML_REF_BITS)
 
+// The block table and counts are only changed with the table mutex held,
+// but are read without it.  A block is filled in before the block count
+// is increased to include it.
 static RefInfo *refBlocks[ MAX_BLOCKS ];
-static uint16 totAllocBlocks = 0;
+static std::atomic<uint16> totAllocBlocks( 0 );
 static uint16 remainInBlock = 0;
 static int32 recycleList = -1;
-static int32 nextNewRef = 0;
+static std::atomic<int32> nextNewRef( 0 );
 
 // local functions
 static RefInfo *GetRefInfoPtr( int32 id );
-static void ReleaseRefInfo( RefInfo *ri, int32 id );
+static int32 ReleaseRefInfo( RefInfo *ri, int32 id );
 
 // This function replaces the previous static declaration of the reference
 // table mutex.  This was changed to avoid static object initialization
@@ -113,19 +125,28 @@ RefObj::RefObj( const char *name )
          return;
       }
 
-      refBlocks[ totAllocBlocks ] = new RefInfo[ REF_PER_BLOCK ];
-      CML_ASSERT( refBlocks[totAllocBlocks] );
+      RefInfo *blk = new RefInfo[ REF_PER_BLOCK ];
+      CML_ASSERT( blk );
 
-      if( !refBlocks[totAllocBlocks] )
+      if( !blk )
       {
          cml.Error( "Failed to allocate new reference block!\n" );
          return;
       }
 
+      // Unused structures can't be locked
+      for( int i=0; i<REF_PER_BLOCK; i++ )
+      {
+         blk[i].refCt = 0;
+         blk[i].lockCt = -1;
+         blk[i].ptr = 0;
+      }
+
+      refBlocks[ totAllocBlocks ] = blk;
       totAllocBlocks++;
       remainInBlock = REF_PER_BLOCK;
 
-      cml.Debug( "Just allocated reference block %d\n", totAllocBlocks );
+      cml.Debug( "Just allocated reference block %d\n", (int)totAllocBlocks );
    }
 
    // If I didn't get a reference off the recycle list, grab the
@@ -139,15 +160,17 @@ RefObj::RefObj( const char *name )
 
    CML_ASSERT( ri );
 
-   // Initialize the reference info structure
+   // Initialize the reference info structure.  The lock count is 
+   // set last since it makes the structure lockable.
    ri->refCt         = 1;
-   ri->lockCt        = 0;
    ri->ptr           = this;
    ri->autoDeleteEna = false;
 
 #ifdef ADD_NAMES_TO_REFINFO
    ri->name  = name;
 #endif
+
+   ri->lockCt        = 0;
 }
 
 /***************************************************************************/
@@ -202,19 +225,13 @@ void RefObj::KillRef( void )
    // RefObj.
    if( refID < 0 ) return;
 
-   refTblMtx().Lock();
-
    // Get the info associated with this reference.
    RefInfo *ri = GetRefInfoPtr( myID );
 
    // Make sure we found the info structure.  This
    // should never fail.
    CML_ASSERT( ri );
-   if( !ri )
-   {
-      refTblMtx().Unlock();
-      return;
-   }
+   if( !ri ) return;
 
    // Clear the pointer stored in this info structure.
    // This prevents any other thread from locking the
@@ -223,12 +240,8 @@ void RefObj::KillRef( void )
 
    // Wait until this object is no longer locked
    // by any other thread.
-   for( int i=0; (i<2000) && ri->lockCt; i++ )
-   {
-      refTblMtx().Unlock();
+   for( int i=0; (i<2000) && ri->lockCt > 0; i++ )
       Thread::sleep(1);
-      refTblMtx().Lock();
-   }
 
    // If this fails it's a pretty serious error.  It means that some other 
    // object is still holding a pointer to this object and we are being
@@ -239,8 +252,6 @@ void RefObj::KillRef( void )
 
    ReleaseRefInfo( ri, myID );
    refID = -1;
-
-   refTblMtx().Unlock();
 }
 
 /***************************************************************************/
@@ -282,8 +293,6 @@ to the object.
 /***************************************************************************/
 uint32 RefObj::GrabRef( void )
 {
-   MutexLocker ml( refTblMtx() );
-
    RefInfo *ri = GetRefInfoPtr( refID );
    if( !ri ) return 0;
 
@@ -303,20 +312,21 @@ void RefObj::ReleaseRef( uint32 val )
    // Find my internal ID value associated with this reference.
    int32 refID = val-1;
 
-   MutexLocker ml( refTblMtx() );
-
    // Find the reference info structure.  This will return null
    // if an invalid reference number was passed
    RefInfo *ri = GetRefInfoPtr( refID );
    if( !ri ) return;
 
-   ReleaseRefInfo( ri, refID );
+   // Read these before releasing, the structure may be recycled after
+   bool autoDelete = ri->autoDeleteEna;
+   RefObj *ptr = ri->ptr;
+
+   int32 ct = ReleaseRefInfo( ri, refID );
    
-   // If auto delete is enabled, then check
-   if ( (ri->autoDeleteEna) && ri->refCt<=1 )
-   {
-      delete ri->ptr;
-   }
+   // If auto delete is enabled, delete the object when only its own
+   // reference remains.
+   if( autoDelete && ct == 1 && ptr )
+      delete ptr;
 }
 
 /***************************************************************************/
@@ -336,27 +346,28 @@ RefObj *RefObj::LockRef( uint32 val )
 {
    int32 refID = val-1;
 
-   MutexLocker ml( refTblMtx() );
-
    // Find my local info about this reference 
    RefInfo *ri = GetRefInfoPtr( refID );
 
    // Just return null if the reference is no longer valid
    if( !ri ) return 0;
 
-   // Make sure the lock count isn't negative.  If it is, 
-   // then this reference isn't valid (the ref info is on 
-   // my recycle list)
-   CML_ASSERT( ri->lockCt >= 0 );
-   if( ri->lockCt < 0 )
-      return 0;
+   // Lock the reference unless the lock count is negative, which
+   // means this reference isn't valid (the ref info is on my 
+   // recycle list)
+   int32 ct = ri->lockCt.load();
+   do
+   {
+      CML_ASSERT( ct >= 0 );
+      if( ct < 0 ) return 0;
+   } while( !ri->lockCt.compare_exchange_weak( ct, ct+1 ) );
 
-   // Lock the reference and return a pointer to the object
-   // if the object still exists in the system.
-   if( ri->ptr )
-      ri->lockCt++;
+   // Return a pointer to the object if it still exists in the 
+   // system.  If it's being destroyed, back out the lock.
+   RefObj *ptr = ri->ptr;
+   if( !ptr ) ri->lockCt--;
 
-   return ri->ptr;
+   return ptr;
 }
 
 /***************************************************************************/
@@ -366,8 +377,6 @@ Unlock an object that was previously locked using RefObj::Lock.
 /***************************************************************************/
 void RefObj::UnlockRef( void )
 {
-   MutexLocker ml( refTblMtx() );
-
    // Find my local info about this reference 
    RefInfo *ri = GetRefInfoPtr( refID );
 
@@ -393,7 +402,8 @@ void RefObj::UnlockRef( void )
  * The lowest n bits of the ID give the index into an array,
  * and the next m bits give the array number.
  *
- * The local mutex should be locked when this function is called.
+ * The local mutex doesn't need to be held.  Blocks are never freed, so
+ * the structure returned stays valid.
  */
 static RefInfo *GetRefInfoPtr( int32 id )
 {
@@ -416,15 +426,21 @@ static RefInfo *GetRefInfoPtr( int32 id )
    return &tbl[ ndx ];
 }
 
-static void ReleaseRefInfo( RefInfo *ri, int32 id )
+/**
+ * Release one reference to a structure, and recycle it if that was the 
+ * last one.  Returns the number of references remaining.
+ */
+static int32 ReleaseRefInfo( RefInfo *ri, int32 id )
 {
    // Make sure the reference info is sane.  There must be at least
    // one reference.
-   CML_ASSERT( ri->refCt > 0 );
-   ri->refCt--;
+   int32 ct = --ri->refCt;
+   CML_ASSERT( ct >= 0 );
 
-   if( !ri->refCt )
+   if( !ct )
    {
+      MutexLocker ml( refTblMtx() );
+
       // Make sure the reference isn't locked (shouldn't happen)
       // If this assertion is hit it means that the parent object of this reference
       // is being destroyed while some other object still has it locked.
@@ -434,11 +450,26 @@ static void ReleaseRefInfo( RefInfo *ri, int32 id )
       // then this assertion will be hit.
       CML_ASSERT( ri->lockCt == 0 );
 
+      // Mark the structure invalid.  A LockRef that found the object
+      // gone may still be backing out its lock, so wait for it.
+      int32 lk = 0;
+      for( int i=0; !ri->lockCt.compare_exchange_weak( lk, -1 ); i++ )
+      {
+         if( lk < 0 ) break;
+         if( lk > 0 && i > 1000 )
+         {
+            ri->lockCt = -1;
+            break;
+         }
+         lk = 0;
+      }
+
       // Add this to my list of recycled info structures.
       ri->next = recycleList;
-      ri->lockCt = -1;
       recycleList = id;
    }
+
+   return ct;
 }
 
 /**
@@ -447,7 +478,7 @@ static void ReleaseRefInfo( RefInfo *ri, int32 id )
 */
 void RefObj::LogRefs( void )
 {
-   cml.Debug( "List of outstanding references.  Total allocated %d\n", nextNewRef );
+   cml.Debug( "List of outstanding references.  Total allocated %d\n", (int)nextNewRef );
 
    int32 refNum = 1;
 
@@ -470,11 +501,11 @@ void RefObj::LogRefs( void )
 
          // If the pointer is zero, then the object has been deleted, but there are outstanding references to it.
          if( !ptr )
-            cml.Debug( " - Reference 0x%08x (%s) has %d open references, but the reference is no longer valid.\n", refNum, riName, blk[j].refCt );
+            cml.Debug( " - Reference 0x%08x (%s) has %d open references, but the reference is no longer valid.\n", refNum, riName, (int)blk[j].refCt );
 
          // Otherwise, the reference is still live
          else
-            cml.Debug( " - Reference 0x%08x has %d open references.  Attached to pointer %p, name %s\n", refNum, blk[j].refCt, ptr, ptr->name );
+            cml.Debug( " - Reference 0x%08x has %d open references.  Attached to pointer %p, name %s\n", refNum, (int)blk[j].refCt, ptr, ptr->name );
       }
    }
    cml.Debug( "End of reference list\n" );
@@ -12,12 +12,87 @@
 
 This file contains the code used to implement the CANopen SDO objects.
 */
+#include <string.h>
 #include "CML.h"
 
 #define MAX_SDO_LEN 512
 
+// Number of entries in an SDO dictionary cache (must be a power of 2)
+#define SDO_CACHE_SIZE       1024
+
+// Largest object held in the dictionary cache (bytes)
+#define SDO_CACHE_DATA       16
+
 CML_NAMESPACE_USE();
 
+/**
+One object in an SDO dictionary cache.  An entry is only valid if its 
+version matches the version of the cache.  
+*/
+struct SdoCacheEntry
+{
+   uint32 key;
+   uint32 version;
+   int32 max;
+   int32 len;
+   byte data[ SDO_CACHE_DATA ];
+};
+
+CML_NAMESPACE_START()
+
+/***************************************************************************/
+/**
+Local copy of the objects read from and written to a node's dictionary.
+This is a simple open addressed hash table indexed by the object 
+multiplexor.  Invalidating the cache just bumps its version number.
+*/
+/***************************************************************************/
+class SdoCache
+{
+public:
+   uint32 version;
+   uint32 hits;
+   uint32 xfers;
+   SdoCacheEntry entry[ SDO_CACHE_SIZE ];
+
+   SdoCache( void )
+   {
+      version = 1;
+      hits = xfers = 0;
+      memset( entry, 0, sizeof(entry) );
+   }
+
+   /// Find the entry for an object.  If add is true and there isn't one, 
+   /// a new (invalid) entry is returned.  NULL is returned if the object
+   /// isn't found, or the table is full.
+   SdoCacheEntry *Find( int16 index, int16 sub, bool add )
+   {
+      uint32 key = ((uint32)(uint16)index << 8 | (uint8)sub) + 1;
+      uint32 h = (key * 2654435761u) >> 22;
+
+      for( int i=0; i<SDO_CACHE_SIZE; i++ )
+      {
+         SdoCacheEntry *e = &entry[ (h+i) & (SDO_CACHE_SIZE-1) ];
+         if( e->key == key ) 
+            return (add || e->version == version) ? e : 0;
+
+         if( !e->key )
+         {
+            if( !add ) return 0;
+            e->key = key;
+            e->version = 0;
+            return e;
+         }
+      }
+      return 0;
+   }
+};
+
+CML_NAMESPACE_END()
+
+// SDO whose dictionary cache is in use by this thread (see SdoCacheScope)
+static thread_local SDO *cacheScope = 0;
+
 /**************************************************
 * SDO Error objects
 **************************************************/
@@ -66,6 +141,18 @@ SDO::SDO( void )
    node     = 0;
    timeout  = 2000;
    maxRetry = 4;
+   pending  = 0;
+   cache    = 0;
+}
+
+/***************************************************************************/
+/**
+SDO destructor.  Frees the dictionary cache if one was used.
+*/
+/***************************************************************************/
+SDO::~SDO( void )
+{
+   if( cache ) delete cache;
 }
 
 /***************************************************************************/
@@ -304,6 +391,204 @@ const Error *SDO::UpldString( int16 index, int16 sub, int32 &len, char *data )
    return 0;
 }
 
+/***************************************************************************/
+/**
+Start an upload of an object of up to 32 bits without waiting for the 
+node's response.  The uploaded value is returned by SdoFuture::GetValue
+once SdoFuture::Wait has returned success.
+
+Only one transfer can be in progress on an SDO at a time.  If an earlier
+asynchronous transfer on this SDO hasn't been waited on yet, it's completed
+first.  Transfers on the SDOs of different nodes run concurrently.
+
+Unlike the synchronous methods, asynchronous transfers are not retried
+on failure.
+
+@param index The index of the object to be uploaded.
+@param sub The sub-index of the object to be uploaded.
+@param f The future used to collect the result.
+@return An error object if the request could not be sent, or NULL.  The 
+        result of the transfer itself is returned by SdoFuture::Wait.
+*/
+/***************************************************************************/
+const Error *SDO::UpldAsync( int16 index, int16 sub, SdoFuture &f )
+{
+   f.Wait();
+
+   // send an "Initiate SDO upload" message.
+   f.upload = true;
+   f.buff[0] = 0x40;
+   for( int i=4; i<8; i++ )
+      f.buff[i] = 0;
+
+   return StartAsync( index, sub, f );
+}
+
+/***************************************************************************/
+/**
+Start a download of an object of up to 32 bits without waiting for the 
+node's response.  The result of the download is returned by SdoFuture::Wait.
+
+Only one transfer can be in progress on an SDO at a time.  If an earlier
+asynchronous transfer on this SDO hasn't been waited on yet, it's completed
+first.  Transfers on the SDOs of different nodes run concurrently.
+
+@param index The index of the object to be downloaded.
+@param sub The sub-index of the object to be downloaded.
+@param size The size of the object in bytes (1 to 4).
+@param data The data to be downloaded.
+@param f The future used to collect the result.
+@return An error object if the request could not be sent, or NULL.
+*/
+/***************************************************************************/
+const Error *SDO::DnldAsync( int16 index, int16 sub, int32 size, uint32 data, SdoFuture &f )
+{
+   f.Wait();
+
+   if( size < 1 || size > 4 )
+      return f.err = &CanOpenError::BadParam;
+
+   // send an expedited "Initiate SDO download" message.
+   f.upload = false;
+   f.buff[0] = 0x23 | ((4-size)<<2);
+   for( int i=0; i<4; i++ )
+      f.buff[i+4] = (i<size) ? ByteCast(data>>(8*i)) : 0;
+
+   return StartAsync( index, sub, f );
+}
+
+/***************************************************************************/
+/**
+Send the request held in the future and register it as this SDO's pending
+transfer.
+*/
+/***************************************************************************/
+const Error *SDO::StartAsync( int16 index, int16 sub, SdoFuture &f )
+{
+   f.value = 0;
+   f.size  = 0;
+
+   if( !node ) return f.err = &CanOpenError::NotInitialized;
+
+   MutexLocker ml( mutex );
+
+   // Finish any asynchronous transfer still using the SDO
+   if( pending ) FinishAsync( *pending );
+
+   f.buff[1] = mplex[0] = ByteCast(index);
+   f.buff[2] = mplex[1] = ByteCast(index>>8);
+   f.buff[3] = mplex[2] = ByteCast(sub);
+
+   // A response to an earlier transfer that timed out may have posted
+   // the semaphore after it was given up on.
+   while( !f.done.Get(0) ){}
+
+   RefObjLocker<Network> net( node->GetNetworkRef() );
+   if( !net ) return f.err = &NodeError::NetworkUnavailable;
+
+   f.err = net->StartSDO( node, f.buff, 8, &f.done, timeout );
+   if( f.err ) return f.err;
+
+   f.sdo = this;
+   pending = &f;
+   return 0;
+}
+
+/***************************************************************************/
+/**
+Wait for the response to an asynchronous transfer and check it.
+*/
+/***************************************************************************/
+const Error *SDO::FinishAsync( SdoFuture &f )
+{
+   MutexLocker ml( mutex );
+   if( pending != &f ) return f.err;
+
+   pending = 0;
+   f.sdo = 0;
+
+   RefObjLocker<Network> net( node->GetNetworkRef() );
+   if( !net ) return f.err = &NodeError::NetworkUnavailable;
+
+   const Error *err = net->FinishSDO( node, &f.done, timeout );
+   if( err ) return f.err = SendAbort( err );
+
+   // Uploads are checked the same way as a synchronous upload.  If the
+   // node answers with a segmented transfer it's finished here.
+   if( f.upload )
+   {
+      uint8 buff[MAX_SDO_LEN];
+      byte data[4] = { 0, 0, 0, 0 };
+      int32 size = 4;
+
+      for( int i=0; i<8; i++ )
+         buff[i] = f.buff[i];
+
+      err = UploadFinish( size, data, 8, buff );
+      if( !err )
+      {
+         f.value = bytes_to_uint32( data );
+         f.size = size;
+      }
+      return f.err = err;
+   }
+
+   // Check for abort
+   int scs = 7 & (f.buff[0]>>5);
+   if( scs == 4 ) return f.err = getAbortRcvdErr( f.buff );
+
+   // I expect an scs value of 3 (init download response).
+   if( scs != 3 )
+      return f.err = SendAbort( &CanOpenError::SDO_BadMsgRcvd );
+
+   // If the multiplexor was not right, abort the transfer
+   if( (f.buff[1] != mplex[0]) || (f.buff[2] != mplex[1]) || (f.buff[3] != mplex[2]) )
+      return f.err = SendAbort( &CanOpenError::SDO_BadMuxRcvd );
+
+   return f.err = 0;
+}
+
+/***************************************************************************/
+/**
+Default constructor for an SDO future.
+*/
+/***************************************************************************/
+SdoFuture::SdoFuture( void )
+{
+   sdo    = 0;
+   err    = 0;
+   upload = false;
+   value  = 0;
+   size   = 0;
+}
+
+/***************************************************************************/
+/**
+SDO future destructor.  If the transfer is still in progress this waits 
+for it to finish.
+*/
+/***************************************************************************/
+SdoFuture::~SdoFuture( void )
+{
+   Wait();
+}
+
+/***************************************************************************/
+/**
+Wait for the node to respond to the transfer.  This returns immediately if
+the response has already been collected, either by an earlier call or 
+because another transfer was started on the same SDO.
+
+@return The result of the transfer.
+*/
+/***************************************************************************/
+const Error *SdoFuture::Wait( void )
+{
+   SDO *s = sdo;
+   if( s ) s->FinishAsync( *this );
+   return err;
+}
+
 /***************************************************************************/
 /**
 Download data using this SDO.  The passed array of data is downloaded to the
@@ -319,14 +604,22 @@ const Error *SDO::Download( int16 index, int16 sub, int32 size, byte *data )
 {
    const Error *err = 0;
 
+   // Within an SdoCacheScope, writing the value the object already holds
+   // is skipped.
+   if( cache && CacheDnld( index, sub, size, data, true ) )
+      return 0;
+
    for( uint8 i=0; i<maxRetry; i++ )
    {
       err = _Download( index, sub, size, data );
-      if( !err ) return 0;
+      if( !err ) break;
 
       cml.Debug( "Error (%s) on SDO download attempt %d to 0x%04x.%d, retrying...\n", err->toString(), i, index, sub );
    }
 
+   if( cache ) 
+      CacheDnld( index, sub, err ? 0 : size, data, false );
+
    return err;
 }
 
@@ -362,13 +655,22 @@ const Error *SDO::_Download( int16 index, int16 sub, int32 size, byte *data )
    // mailbox is normally much larger then this.
    CML_ASSERT( maxXfer >= 8 );
 
-   //FIXME: Not implemented, Copley drives have no current use for it
-   // Use a block download if it makes sense to do so
-   //if( blkDnldOK && size >= SDO_BLK_DNLD_THRESHOLD )
-   //   return BlockDnld( index, sub, size, data );
+   // Use a block download if it makes sense to do so.  If the node
+   // refuses it, fall back to normal downloads from now on.
+   if( blkDnldOK && size >= SDO_BLK_DNLD_THRESHOLD )
+   {
+      err = BlockDnld( index, sub, size, data );
+      if( !err ) return 0;
+
+      cml.Debug( "Block download to 0x%04x.%d failed (%s), using normal downloads\n", index, sub, err->toString() );
+      blkDnldOK = false;
+   }
 
    MutexLocker ml( mutex );
 
+   // Finish any asynchronous transfer still using the SDO
+   if( pending ) FinishAsync( *pending );
+
    // send an "Initiate SDO download" message.
 
    // Copy the object multiplexor to the frame
@@ -480,16 +782,226 @@ const Error *SDO::Upload( int16 index, int16 sub, int32 &size, byte *data )
    const Error *err = 0;
    int32 max = size;
 
+   // Within an SdoCacheScope, values already known are not read again
+   if( cache && CacheUpld( index, sub, size, data ) )
+      return 0;
+
    for( uint8 i=0; i<maxRetry; i++ )
    {
       err = _Upload( index, sub, size, data );
-      if( !err ) return 0;
+      if( !err ) break;
       cml.Debug( "Error (%s) on SDO upload attempt %d, retrying...\n", err->toString(), i );
       size = max;
    }
+
+   if( cache && !err )
+      CacheStore( index, sub, max, size, data );
+
    return err;
 }
 
+/***************************************************************************/
+/**
+Enable or disable the dictionary cache of this SDO.
+
+When the cache is enabled, the SDO keeps a local copy of the small objects
+(up to 16 bytes) it reads from and writes to the node.  The copy is only 
+used for transfers made inside an SdoCacheScope, which marks a block of 
+code as accessing configuration objects that only change when they are 
+written through this SDO.  Within the scope an upload of an object that is
+already known returns the local copy without any network traffic, and a 
+download of the value the object already holds is skipped.  
+
+Outside of a scope every transfer goes to the node as usual, but the local
+copy is kept up to date with any values written.
+
+The cache can't see changes made to the node by other means, such as 
+another program configuring it.  In that case SDO::InvalidateCache should be 
+called.  Amp objects do this whenever the amplifier is initialized or found
+to have been reset.
+
+The cache is disabled by default.
+
+@param enable True to enable the cache, false to disable and free it.
+@return A valid CANopen error object.
+*/
+/***************************************************************************/
+const Error *SDO::EnableCache( bool enable )
+{
+   MutexLocker ml( mutex );
+
+   if( enable && !cache )
+   {
+      cache = new SdoCache;
+      if( !cache ) return &ThreadError::Alloc;
+   }
+   else if( !enable && cache )
+   {
+      delete cache;
+      cache = 0;
+   }
+   return 0;
+}
+
+/***************************************************************************/
+/**
+Invalidate the dictionary cache.  All objects will be read from the node 
+again the next time they are needed.
+*/
+/***************************************************************************/
+void SDO::InvalidateCache( void )
+{
+   MutexLocker ml( mutex );
+   if( !cache ) return;
+
+   // Version zero marks a new entry, so it's skipped
+   if( !++cache->version ) cache->version = 1;
+}
+
+/***************************************************************************/
+/**
+Return the version of the dictionary cache.  This changes every time the
+cache is invalidated, so a caller holding values read from the node can use
+it to tell if they may be out of date.
+@return The cache version, or 0 if the cache is disabled.
+*/
+/***************************************************************************/
+uint32 SDO::GetCacheVersion( void )
+{
+   MutexLocker ml( mutex );
+   return cache ? cache->version : 0;
+}
+
+/***************************************************************************/
+/**
+Return counts of the transfers made inside an SdoCacheScope.
+@param hits The number of transfers answered from the cache.
+@param xfers The number of transfers that went to the node.
+*/
+/***************************************************************************/
+void SDO::GetCacheStats( uint32 &hits, uint32 &xfers )
+{
+   MutexLocker ml( mutex );
+   hits = cache ? cache->hits : 0;
+   xfers = cache ? cache->xfers : 0;
+}
+
+/***************************************************************************/
+/**
+Look for an upload in the cache.  
+@return true if the data was found and returned.
+*/
+/***************************************************************************/
+bool SDO::CacheUpld( int16 index, int16 sub, int32 &size, byte *data )
+{
+   if( cacheScope != this ) return false;
+
+   MutexLocker ml( mutex );
+   SdoCacheEntry *e = cache->Find( index, sub, false );
+
+   // The cached value may have been truncated by a smaller buffer
+   if( !e || (e->len >= e->max && size > e->max) )
+   {
+      cache->xfers++;
+      return false;
+   }
+
+   if( size > e->len ) size = e->len;
+   memcpy( data, e->data, size );
+   cache->hits++;
+   return true;
+}
+
+/***************************************************************************/
+/**
+Update the cache after a download, or check a download against it.
+@param size The number of bytes written, or 0 if the download failed.
+@param check If true, only check if the cache already holds this value.
+@return When checking, true if the download can be skipped.
+*/
+/***************************************************************************/
+bool SDO::CacheDnld( int16 index, int16 sub, int32 size, byte *data, bool check )
+{
+   if( check && cacheScope != this ) return false;
+
+   MutexLocker ml( mutex );
+   SdoCacheEntry *e = cache->Find( index, sub, false );
+
+   if( check )
+   {
+      if( e && e->len == size && !memcmp( e->data, data, size ) )
+      {
+         cache->hits++;
+         return true;
+      }
+      cache->xfers++;
+      return false;
+   }
+
+   // A failed download leaves the value unknown
+   if( !size )
+   {
+      if( e ) e->version = 0;
+      return false;
+   }
+
+   // Outside a scope, only objects already in the cache are updated
+   if( e || cacheScope == this )
+      CacheStore( index, sub, size+1, size, data );
+   return false;
+}
+
+/***************************************************************************/
+/**
+Store an object's value in the cache.  Objects that are too large are not
+cached.
+@param max The buffer size the object was read into.  If it was filled the
+       object may have been truncated.
+*/
+/***************************************************************************/
+void SDO::CacheStore( int16 index, int16 sub, int32 max, int32 size, byte *data )
+{
+   MutexLocker ml( mutex );
+
+   SdoCacheEntry *e = cache->Find( index, sub, (cacheScope == this) );
+   if( !e ) return;
+
+   if( size > SDO_CACHE_DATA ) 
+   {
+      e->version = 0;
+      return;
+   }
+
+   memcpy( e->data, data, size );
+   e->len = size;
+   e->max = max;
+   e->version = cache->version;
+}
+
+/***************************************************************************/
+/**
+Start using the dictionary cache of an SDO on this thread.  Transfers made
+on the SDO by this thread are answered from the cache until the scope object
+is destroyed.  If the SDO's cache is not enabled this has no effect.
+@param sdo The SDO whose cache should be used.
+*/
+/***************************************************************************/
+SdoCacheScope::SdoCacheScope( SDO &sdo )
+{
+   prev = cacheScope;
+   cacheScope = &sdo;
+}
+
+/***************************************************************************/
+/**
+Stop using the dictionary cache.
+*/
+/***************************************************************************/
+SdoCacheScope::~SdoCacheScope( void )
+{
+   cacheScope = prev;
+}
+
 /***************************************************************************/
 /**
 Upload data using this SDO.  This internal function is used to make a single
@@ -520,6 +1032,9 @@ const Error *SDO::_Upload( int16 index, int16 sub, int32 &size, byte *data )
 
    MutexLocker ml( mutex );
 
+   // Finish any asynchronous transfer still using the SDO
+   if( pending ) FinishAsync( *pending );
+
    // send an "Initiate SDO upload" message.
    buff[0] = 0x40;
 
@@ -767,6 +1282,9 @@ const Error *SDO::BlockUpld( int16 index, int16 sub, int32 &size, byte *data )
 
    MutexLocker ml( mutex );
 
+   // Finish any asynchronous transfer still using the SDO
+   if( pending ) FinishAsync( *pending );
+
    // send an "Initiate block upload" message.
    buff[0] = 0xA0;
 
@@ -901,8 +1419,113 @@ to this function is downloaded to the object dictionary of the CANopen node
 /***************************************************************************/
 const Error *SDO::BlockDnld( int16 index, int16 sub, int32 size, byte *data )
 {
-   // This isn't supported yet, just return an error
-   return &CanOpenError::NotSupported;
+   const Error *err;
+   uint8 buff[MAX_SDO_LEN];
+
+   // Make sure the SDO has been initialized
+   if( !node ) return &CanOpenError::NotInitialized;
+
+   // Check for a reasonable size
+   if( size <= 0 ) return &CanOpenError::BadParam;
+
+   if( node->GetNetworkType() != NET_TYPE_CANOPEN )
+      return &SDO_Error::NoBlkXfers;
+
+   MutexLocker ml( mutex );
+
+   // Finish any asynchronous transfer still using the SDO
+   if( pending ) FinishAsync( *pending );
+
+   // send an "Initiate block download" message with the size
+   // indicated and no CRC.
+   buff[0] = 0xC2;
+   buff[1] = mplex[0] = ByteCast(index);
+   buff[2] = mplex[1] = ByteCast(index>>8);
+   buff[3] = mplex[2] = ByteCast(sub);
+   int32_to_bytes( size, &buff[4] );
+
+   uint16 retLen = MAX_SDO_LEN;
+   err = XmitSDO( buff, 8, &retLen, timeout );
+   if( err ) return SendAbort( err );
+
+   // Check for abort
+   int scs = 7 & (buff[0]>>5);
+   if( scs == 4 ) return getAbortRcvdErr( buff );
+
+   // I expect an scs value of 5 (block download response).
+   if( (scs != 5) || (buff[0] & 3) )
+      return SendAbort( &CanOpenError::SDO_BadMsgRcvd );
+
+   if( (buff[1] != mplex[0]) || (buff[2] != mplex[1]) || (buff[3] != mplex[2]) )
+      return SendAbort( &CanOpenError::SDO_BadMuxRcvd );
+
+   int blkSize = buff[4];
+   if( blkSize < 1 || blkSize > 127 )
+      return SendAbort( SDO_ABORT_BLOCK_SIZE, &SDO_Error::Block_size );
+
+   // Send the data in blocks of up to blkSize segments.  Only the last 
+   // segment of each block waits for a response, which acknowledges 
+   // the segments received.  Anything after the last segment
+   // acknowledged is sent again in the next block.
+   int32 sent = 0;
+   while( sent < size )
+   {
+      int32 pos = sent;
+      int seq;
+
+      for( seq=1; seq<=blkSize && pos<size; seq++ )
+      {
+         int ct = (size-pos > 7) ? 7 : size-pos;
+         pos += ct;
+
+         buff[0] = seq;
+         if( pos >= size ) buff[0] |= 0x80;
+
+         int i;
+         for( i=0; i<ct; i++ ) buff[i+1] = ByteCast( data[pos-ct+i] );
+         for( ; i<7; i++ )     buff[i+1] = 0;
+
+         bool last = (seq == blkSize) || (pos >= size);
+         retLen = MAX_SDO_LEN;
+         err = XmitSDO( buff, 8, &retLen, last ? timeout : 0 );
+         if( err ) return SendAbort( err );
+      }
+      seq--;
+
+      scs = 7 & (buff[0]>>5);
+      if( scs == 4 ) return getAbortRcvdErr( buff );
+
+      // I expect a block download response
+      if( (scs != 5) || ((buff[0] & 3) != 2) )
+         return SendAbort( &CanOpenError::SDO_BadMsgRcvd );
+
+      int ack = buff[1];
+      if( ack > seq )
+         return SendAbort( SDO_ABORT_BLOCK_SEQ, &SDO_Error::Block_seq );
+
+      sent = (ack == seq) ? pos : sent + 7*ack;
+
+      blkSize = buff[2];
+      if( blkSize < 1 || blkSize > 127 )
+         return SendAbort( SDO_ABORT_BLOCK_SIZE, &SDO_Error::Block_size );
+   }
+
+   // End the block download, giving the number of unused 
+   // bytes in the last segment.
+   buff[0] = 0xC1 | (((7 - size%7) % 7) << 2);
+   for( int i=1; i<8; i++ ) buff[i] = 0;
+
+   retLen = MAX_SDO_LEN;
+   err = XmitSDO( buff, 8, &retLen, timeout );
+   if( err ) return SendAbort( err );
+
+   scs = 7 & (buff[0]>>5);
+   if( scs == 4 ) return getAbortRcvdErr( buff );
+
+   if( (scs != 5) || ((buff[0] & 3) != 1) )
+      return SendAbort( &CanOpenError::SDO_BadMsgRcvd );
+
+   return 0;
 }
 
 /***************************************************************************/
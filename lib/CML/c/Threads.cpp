@@ -8,7 +8,9 @@
 /********************************************************/
 
 /** \file 
-This file only contains definitions for the generic thread error objects.
+This file contains definitions for the generic thread error objects, the
+JobThread::RunAll function and the PeriodicTimer class, which is built on
+Thread::sleepUntil.
 The code used to implement the OS specific thread methods is located in
 Operating system specific files such as Threads_posix.cpp and Threads_w32.cpp.
 */
@@ -24,5 +26,157 @@ CML_NEW_ERROR( ThreadError, Timeout,   "Timeout" );
 CML_NEW_ERROR( ThreadError, General,   "General thread error" );
 CML_NEW_ERROR( ThreadError, BadParam,  "Illegal parameter value" );
 CML_NEW_ERROR( ThreadError, Alloc,     "Memory allocation error" );
+CML_NEW_ERROR( ThreadError, MemLock,   "Unable to lock process memory" );
+
+/***************************************************************************/
+/**
+Run a group of jobs at the same time and wait for them all to finish.
+The first job is run on the calling thread, and the rest each on their own
+thread.  A job whose thread can't be started is run on the calling thread
+afterwards.  Each started thread is joined before this returns, so the job
+objects may be deleted then.
+@param job Array of ct jobs to run.
+@param ct The number of jobs.
+@return The error returned by the first job (in array order) that failed, 
+        or NULL if they all succeeded.
+*/
+/***************************************************************************/
+const Error *JobThread::RunAll( JobThread *job[], int ct )
+{
+   int i;
+   for( i=0; i<ct; i++ )
+   {
+      job[i]->err = 0;
+      job[i]->started = i && !job[i]->start();
+   }
+
+   if( ct ) job[0]->run();
+
+   const Error *err = 0;
+   for( i=0; i<ct; i++ )
+   {
+      if( job[i]->started )
+         job[i]->join();
+      else if( i )
+         job[i]->run();
+
+      if( job[i]->err && !err )
+         err = job[i]->err;
+   }
+
+   return err;
+}
+
+/***************************************************************************/
+/**
+Default constructor.  PeriodicTimer::Start must be called before the timer
+is waited on.
+*/
+/***************************************************************************/
+PeriodicTimer::PeriodicTimer( void )
+{
+   period = 0;
+   deadline = 0;
+   ClearStats();
+}
+
+/***************************************************************************/
+/**
+Start the timer.  The first deadline is one period from now.
+@param per The timer period in milliseconds.  Must be greater than zero.
+@return A pointer to an error object, or NULL on success.
+*/
+/***************************************************************************/
+const Error *PeriodicTimer::Start( Timeout per )
+{
+   if( per <= 0 )
+      return &ThreadError::BadParam;
+
+   period = (int64)(per * 1000000);
+   deadline = Thread::getTimeNS() + period;
+   ClearStats();
+   return 0;
+}
+
+/***************************************************************************/
+/**
+Wait for the next deadline.  If the calling thread is already more than a
+period past it, the deadlines it missed are counted as overruns and the 
+next one still in the future is used, so the timer never runs a burst of
+short cycles to catch up.
+@return A pointer to an error object, or NULL on success.
+*/
+/***************************************************************************/
+const Error *PeriodicTimer::Wait( void )
+{
+   if( !period )
+      return &ThreadError::BadParam;
+
+   int64 now = Thread::getTimeNS();
+   if( now - deadline >= period )
+   {
+      int64 missed = (now - deadline) / period;
+      overruns += (uint32)missed;
+      deadline += missed * period;
+   }
+
+   const Error *err = Thread::sleepUntil( deadline );
+   if( err ) return err;
+
+   int64 late = Thread::getTimeNS() - deadline;
+   int32 j = (late > 0x7FFFFFFF) ? 0x7FFFFFFF : (int32)late;
+
+   if( !cycles || j < jitterMin ) jitterMin = j;
+   if( !cycles || j > jitterMax ) jitterMax = j;
+   jitterSum += j;
+   cycles++;
+
+   deadline += period;
+   return 0;
+}
+
+/***************************************************************************/
+/**
+Move the next deadline, and all the ones after it, by a small amount.
+This can be used to lock the timer to some other clock by nudging it 
+a little each period.
+@param ns The number of nanoseconds to delay the deadlines by.  Negative
+          values bring them forward.
+*/
+/***************************************************************************/
+void PeriodicTimer::Adjust( int32 ns )
+{
+   deadline += ns;
+}
+
+/***************************************************************************/
+/**
+Return the statistics gathered since the timer was started or the 
+statistics were last cleared.  These are updated by the thread waiting
+on the timer without locking, so a copy taken from another thread may mix
+values from adjacent cycles.
+@param stats The statistics are returned here.
+*/
+/***************************************************************************/
+void PeriodicTimer::GetStats( PeriodicTimerStats &stats )
+{
+   stats.cycles    = cycles;
+   stats.overruns  = overruns;
+   stats.jitterMin = jitterMin;
+   stats.jitterMax = jitterMax;
+   stats.jitterAvg = cycles ? (int32)(jitterSum / cycles) : 0;
+}
+
+/***************************************************************************/
+/**
+Clear the timer statistics.
+*/
+/***************************************************************************/
+void PeriodicTimer::ClearStats( void )
+{
+   cycles = overruns = 0;
+   jitterMin = jitterMax = 0;
+   jitterSum = 0;
+}
 
 
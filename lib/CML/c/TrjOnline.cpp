@@ -0,0 +1,442 @@
+/********************************************************/
+/*                                                      */
+/*  Copley Motion Libraries                             */
+/*                                                      */
+/*  Copyright (c) 2002 Copley Controls Corp.            */
+/*                     http://www.copleycontrols.com    */
+/*                                                      */
+/********************************************************/
+
+/** \file
+  Implementation of the LinkTrjOnline class.
+  */
+
+#include "CML_Settings.h"
+#ifdef CML_ALLOW_FLOATING_POINT
+
+#include <math.h>
+#include "CML.h"
+
+CML_NAMESPACE_USE();
+
+CML_NEW_ERROR( TrjOnlineError, BadParam,  "An illegal input parameter was passed" );
+CML_NEW_ERROR( TrjOnlineError, InUse,     "Trajectory is currently in use" );
+CML_NEW_ERROR( TrjOnlineError, Ended,     "The online trajectory has been ended" );
+
+// Planning step (seconds) and the number of bisection passes used to
+// find the jerk for each step.
+#define STEP_TIME       0.001
+#define JERK_ITERATIONS 40
+
+/**
+Advance a state by constant jerk for some time.
+*/
+static void Advance( double &p, double &v, double &a, double j, double t )
+{
+   p += v*t + a*t*t/2 + j*t*t*t/6;
+   v += a*t + j*t*t/2;
+   a += j*t;
+}
+
+/***************************************************************************/
+/**
+Default constructor.  LinkTrjOnline::Init must be called before the
+trajectory is sent to a linkage.
+*/
+/***************************************************************************/
+LinkTrjOnline::LinkTrjOnline( void )
+{
+   dim = 0;
+   maxBuff = 3;
+   segMs = 10;
+   inUse = false;
+   ending = false;
+   targetID = 0;
+   settled = true;
+}
+
+/***************************************************************************/
+/**
+Prepare the trajectory for a new move.  The linkage starts at rest at the
+passed position, which is also the initial target.
+
+@param start The position of the linkage when the move starts.  This is
+       normally the linkage's commanded position, see Linkage::GetPositionCommand.
+@param vel The max velocity of each axis
+@param acc The max acceleration of each axis
+@param dec The max deceleration of each axis
+@param jrk The max jerk of each axis
+@param segTime Length (milliseconds) of the segments sent to the linkage.
+       Default 10 ms.
+@param bufferPts Number of segments to keep buffered in each amplifier.
+       Must be at least 2.  Default 3.
+@return A pointer to an error object, or NULL on success.
+*/
+/***************************************************************************/
+const Error *LinkTrjOnline::Init( PointN &start, PointN &vel, PointN &acc, PointN &dec,
+                                  PointN &jrk, uint8 segTime, int bufferPts )
+{
+   int d = start.getDim();
+
+   if( d < 1 || d > CML_MAX_AMPS_PER_LINK )
+      return &TrjOnlineError::BadParam;
+
+   if( vel.getDim() != d || acc.getDim() != d || dec.getDim() != d || jrk.getDim() != d )
+      return &TrjOnlineError::BadParam;
+
+   if( !segTime || bufferPts < 2 )
+      return &TrjOnlineError::BadParam;
+
+   for( int i=0; i<d; i++ )
+   {
+      if( vel[i] <= 0 || acc[i] <= 0 || dec[i] <= 0 || jrk[i] <= 0 )
+         return &TrjOnlineError::BadParam;
+   }
+
+   if( inUse )
+      return &TrjOnlineError::InUse;
+
+   MutexLocker ml( mtx );
+
+   dim = d;
+   segMs = segTime;
+   maxBuff = bufferPts;
+
+   for( int i=0; i<dim; i++ )
+   {
+      maxV[i] = vel[i];
+      maxA[i] = acc[i];
+      maxD[i] = dec[i];
+      maxJ[i] = jrk[i];
+
+      target[i] = p[i] = start[i];
+      v[i] = a[i] = 0;
+   }
+
+   targetID++;
+   settled = true;
+   ending = false;
+   return 0;
+}
+
+/***************************************************************************/
+/**
+Set a new target.  This may be called at any time, including while the
+linkage is moving towards an earlier target.
+
+@param t The position to move to.  Its dimension must match the one passed
+       to LinkTrjOnline::Init.
+@return A pointer to an error object, or NULL on success.
+*/
+/***************************************************************************/
+const Error *LinkTrjOnline::SetTarget( PointN &t )
+{
+   if( t.getDim() != dim )
+      return &TrjOnlineError::BadParam;
+
+   if( ending )
+      return &TrjOnlineError::Ended;
+
+   MutexLocker ml( mtx );
+
+   for( int i=0; i<dim; i++ )
+      target[i] = t[i];
+
+   targetID++;
+   settled = false;
+   return 0;
+}
+
+/***************************************************************************/
+/**
+Return the present target.
+@param t The target is returned here.
+@return A pointer to an error object, or NULL on success.
+*/
+/***************************************************************************/
+const Error *LinkTrjOnline::GetTarget( PointN &t )
+{
+   MutexLocker ml( mtx );
+
+   t.setDim( dim );
+   for( int i=0; i<dim; i++ )
+      t[i] = target[i];
+   return 0;
+}
+
+/***************************************************************************/
+/**
+Return true once every axis has come to rest at the latest target.  The
+state is updated as segments are generated, so this lags the linkage by
+the segments buffered in the amplifiers.
+@return true if the trajectory is at rest at the target.
+*/
+/***************************************************************************/
+bool LinkTrjOnline::IsSettled( void )
+{
+   MutexLocker ml( mtx );
+   return settled;
+}
+
+/***************************************************************************/
+/**
+End the trajectory.  The linkage will come to rest at the present target and
+the move will finish normally.  The target may not be changed after this
+until the trajectory is initialized again.
+@return A pointer to an error object, or NULL on success.
+*/
+/***************************************************************************/
+const Error *LinkTrjOnline::End( void )
+{
+   ending = true;
+   return 0;
+}
+
+/***************************************************************************/
+/**
+Start a new move using this trajectory.
+@return A pointer to an error object, or NULL on success.
+*/
+/***************************************************************************/
+const Error *LinkTrjOnline::StartNew( void )
+{
+   if( !dim ) return &TrjOnlineError::BadParam;
+   if( inUse.exchange( true ) ) return &TrjOnlineError::InUse;
+   return 0;
+}
+
+/***************************************************************************/
+/**
+Finish this trajectory.  Called by the linkage when the move ends or is aborted.
+*/
+/***************************************************************************/
+void LinkTrjOnline::Finish( void )
+{
+   inUse = false;
+}
+
+/***************************************************************************/
+/**
+Retrieve the next segment of this trajectory.
+
+The segment starts at the present state of each axis.  The state is then
+advanced through the segment one millisecond at a time towards the latest
+target.  Once the trajectory has been ended and every axis is at rest on
+the target, the final segment is returned.
+
+@param pos An array which will be filled with position information.
+@param vel An array which will be filled with velocity information.
+@param time A reference to a variable where the time (milliseconds) will be
+       returned.
+@return A pointer to an error object, or NULL on success.
+*/
+/***************************************************************************/
+const Error *LinkTrjOnline::NextSegment( uunit pos[], uunit vel[], uint8 &time )
+{
+   // Read the end flag first so that a target set before End() is seen
+   bool end = ending;
+
+   double tgt[ CML_MAX_AMPS_PER_LINK ];
+   uint32 id;
+   bool done;
+   {
+      MutexLocker ml( mtx );
+      for( int i=0; i<dim; i++ )
+         tgt[i] = target[i];
+      id = targetID;
+      done = settled;
+   }
+
+   for( int i=0; i<dim; i++ )
+   {
+      pos[i] = (uunit)p[i];
+      vel[i] = (uunit)v[i];
+   }
+
+   if( done && end )
+   {
+      time = 0;
+      return 0;
+   }
+
+   time = segMs;
+
+   done = true;
+   for( int i=0; i<dim; i++ )
+   {
+      bool axisDone = false;
+      for( int n=0; n<segMs; n++ )
+         axisDone = Step( i, tgt[i] );
+      done = done && axisDone;
+   }
+
+   // Only report settled if the target didn't change while stepping
+   MutexLocker ml( mtx );
+   if( id == targetID )
+      settled = done;
+
+   return 0;
+}
+
+/***************************************************************************/
+/**
+Advance one axis by one planning step.
+
+The jerk used is the one that makes the quickest stop from the state at the
+end of the step land on the target, limited by the axis jerk, acceleration
+and velocity limits.  Following the stopping curve every step gives a time
+optimal approach to a fixed target, and since nothing but the present state
+is used a new target takes effect on the next step.
+
+@param i The axis index
+@param tgt The target position of the axis
+@return true if the axis is at rest on the target.
+*/
+/***************************************************************************/
+bool LinkTrjOnline::Step( int i, double tgt )
+{
+   double J = maxJ[i];
+   double dt = STEP_TIME;
+
+   // Snap onto the target once within one step of jerk from it
+   if( fabs(tgt-p[i]) <= J*dt*dt*dt && fabs(v[i]) <= J*dt*dt && fabs(a[i]) <= J*dt )
+   {
+      p[i] = tgt;
+      v[i] = a[i] = 0;
+      return true;
+   }
+
+   double j, lo, hi;
+
+   // Find the jerk that puts the stopping point on the target.  The
+   // stopping point moves forward as the jerk increases.
+   if( Endpoint( i, J, tgt ) <= 0 )
+      j = J;
+   else if( Endpoint( i, -J, tgt ) >= 0 )
+      j = -J;
+   else
+   {
+      lo = -J; hi = J;
+      for( int n=0; n<JERK_ITERATIONS; n++ )
+      {
+         j = (lo+hi)/2;
+         if( Endpoint( i, j, tgt ) < 0 ) lo = j;
+         else hi = j;
+      }
+      j = (lo+hi)/2;
+   }
+
+   // Keep the velocity the axis reaches when its acceleration is brought
+   // back to zero within the velocity limit in both directions.
+   for( double s=-1; s<=1; s+=2 )
+   {
+      if( VelPeak( i, j, s ) <= maxV[i] )
+         continue;
+
+      lo = (s > 0) ? -J : j;
+      hi = (s > 0) ?  j : J;
+      for( int n=0; n<JERK_ITERATIONS; n++ )
+      {
+         double m = (lo+hi)/2;
+         if( (VelPeak( i, m, s ) > maxV[i]) == (s > 0) ) hi = m;
+         else lo = m;
+      }
+      j = (s > 0) ? lo : hi;
+   }
+
+   // Acceleration away from zero velocity is limited by acc,
+   // towards it by dec.
+   double aPos = (v[i] >= 0) ? maxA[i] : maxD[i];
+   double aNeg = (v[i] >  0) ? maxD[i] : maxA[i];
+
+   if( j > ( aPos - a[i])/dt ) j = ( aPos - a[i])/dt;
+   if( j < (-aNeg - a[i])/dt ) j = (-aNeg - a[i])/dt;
+   if( j >  J ) j =  J;
+   if( j < -J ) j = -J;
+
+   Advance( p[i], v[i], a[i], j, dt );
+   return false;
+}
+
+/***************************************************************************/
+/**
+Find how far past the target the axis would stop if it used the passed jerk
+for one step and then the quickest stop allowed by its limits.
+@param i The axis index
+@param j The jerk to use for the next step
+@param tgt The target position
+@return The stopping position less the target.
+*/
+/***************************************************************************/
+double LinkTrjOnline::Endpoint( int i, double j, double tgt )
+{
+   double pp = p[i], vv = v[i], aa = a[i];
+   Advance( pp, vv, aa, j, STEP_TIME );
+   return pp + Brake( i, vv, aa ) - tgt;
+}
+
+/***************************************************************************/
+/**
+Find the velocity the axis would reach if it used the passed jerk for one
+step and then brought its acceleration to zero as fast as possible.
+@param i The axis index
+@param j The jerk to use for the next step
+@param s Direction, 1 for the peak positive velocity or -1 for negative.
+@return The peak velocity in the direction s.
+*/
+/***************************************************************************/
+double LinkTrjOnline::VelPeak( int i, double j, double s )
+{
+   double pp = p[i], vv = v[i], aa = a[i];
+   Advance( pp, vv, aa, j, STEP_TIME );
+
+   vv *= s; aa *= s;
+   if( aa > 0 ) vv += aa*aa / (2*maxJ[i]);
+   return vv;
+}
+
+/***************************************************************************/
+/**
+Find the distance an axis travels in the quickest jerk limited stop from
+the passed velocity and acceleration.
+
+The acceleration is ramped to the peak deceleration, held there, and ramped
+back to zero just as the velocity reaches zero.  The peak is the axis
+deceleration limit, or less for a short stop.  If just removing the present
+acceleration would take the velocity through zero, the axis reverses and
+the stop is completed in the other direction.
+
+@param i The axis index
+@param vel The starting velocity
+@param acc The starting acceleration
+@return The signed distance travelled.
+*/
+/***************************************************************************/
+double LinkTrjOnline::Brake( int i, double vel, double acc )
+{
+   if( vel < 0 || (vel == 0 && acc < 0) )
+      return -Brake( i, -vel, -acc );
+
+   double J = maxJ[i];
+   double D = maxD[i];
+   double pos = 0;
+
+   if( acc < 0 && acc*acc > 2*J*vel )
+   {
+      Advance( pos, vel, acc, J, -acc/J );
+      return pos + Brake( i, vel, 0 );
+   }
+
+   double dp = sqrt( J*vel + acc*acc/2 );
+   if( dp > D ) dp = D;
+
+   Advance( pos, vel, acc, (acc > -dp) ? -J : J, fabs(acc+dp)/J );
+
+   double t = (vel - dp*dp/(2*J)) / dp;
+   if( t > 0 ) Advance( pos, vel, acc, 0, t );
+
+   Advance( pos, vel, acc, J, dp/J );
+   return pos;
+}
+
+#endif
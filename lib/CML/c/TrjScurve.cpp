@@ -523,6 +523,89 @@ const Error *LinkTrjScurve::Calculate( PointN &s, PointN &e, uunit vel,
    return 0;
 }
 
+/***************************************************************************/
+/**
+Calculate a multi-axis s-curve trajectory using separate limits for each axis.
+
+The move is the same straight line as the one found by the other version of
+this function.  The limits along the line are the largest ones that don't
+take any axis past its own limits.  An axis moving a fraction f of the total
+distance sees f times the velocity, acceleration and jerk of the move, so the
+limit along the line is the smallest of the axis limits divided by f.  Since
+the profile is only constrained by the limiting axis, this is the minimum time
+straight line move for the given limits.
+
+Axes that don't move place no limit on the move.
+
+@param s The starting position
+@param e The ending position
+@param vel The max velocity of each axis
+@param acc The max acceleration of each axis
+@param dec The max deceleration of each axis
+@param jrk The max jerk of each axis
+@return A pointer to an error object, or NULL on success.
+*/
+/***************************************************************************/
+const Error *LinkTrjScurve::Calculate( PointN &s, PointN &e, PointN &vel, 
+                                       PointN &acc, PointN &dec, PointN &jrk )
+{
+   int d = s.getDim();
+
+   CML_ASSERT( d <= CML_MAX_AMPS_PER_LINK );
+
+   if( e.getDim() != d || vel.getDim() != d || acc.getDim() != d || 
+       dec.getDim() != d || jrk.getDim() != d )
+      return &ScurveError::BadParam;
+
+   uunit dist = s.distance( e );
+
+   double invDist = (dist!=0) ? 1.0/dist : 0.0;
+
+   start.setDim( d );
+   for( int i=0; i<d; i++ )
+   {
+      if( vel[i] <= 0 || acc[i] <= 0 || dec[i] <= 0 || jrk[i] <= 0 )
+         return &ScurveError::BadParam;
+
+      start[i] = s[i];
+      scale[i] = (e[i] - s[i]) * invDist;
+   }
+
+   return trj.Calculate( dist, (uunit)AxisLimit( vel, dist ), (uunit)AxisLimit( acc, dist ), 
+                         (uunit)AxisLimit( dec, dist ), (uunit)AxisLimit( jrk, dist ) );
+}
+
+/***************************************************************************/
+/**
+Find the largest limit along the line of the move that keeps every axis 
+within its own limit.  The per-axis direction of the move must already have
+been calculated.
+@param lim The limits of each axis
+@param dist The length of the move
+@return The limit along the line.
+*/
+/***************************************************************************/
+double LinkTrjScurve::AxisLimit( PointN &lim, uunit dist )
+{
+   double min = -1;
+
+   for( int i=0; i<start.getDim(); i++ )
+   {
+      double f = fabs( scale[i] );
+      if( f <= 0 ) continue;
+
+      double l = lim[i] / f;
+      if( min < 0 || l < min )
+         min = l;
+   }
+
+   // A zero length move can use any limit, just keep the axis limit
+   if( min < 0 || dist == 0 )
+      min = lim[0];
+
+   return min;
+}
+
 /***************************************************************************/
 /**
 Start a new move using this trajectory.  The trajectory must have already
@@ -0,0 +1,273 @@
+/********************************************************/
+/*                                                      */
+/*  Copley Motion Libraries                             */
+/*                                                      */
+/*  Copyright (c) 2002 Copley Controls Corp.            */
+/*                     http://www.copleycontrols.com    */
+/*                                                      */
+/********************************************************/
+
+/** \file
+  Implementation of the LinkTrjStream class.
+  */
+
+#include "CML_Settings.h"
+#ifdef CML_ALLOW_FLOATING_POINT
+
+#include <math.h>
+#include "CML.h"
+
+CML_NAMESPACE_USE();
+
+CML_NEW_ERROR( TrjStreamError, BadParam,  "An illegal input parameter was passed" );
+CML_NEW_ERROR( TrjStreamError, Full,      "The trajectory set-point queue is full" );
+CML_NEW_ERROR( TrjStreamError, InUse,     "Trajectory is currently in use" );
+CML_NEW_ERROR( TrjStreamError, Ended,     "The trajectory stream has been ended" );
+
+/***************************************************************************/
+/**
+Default constructor.  LinkTrjStream::Init must be called before the
+trajectory is sent to a linkage.
+*/
+/***************************************************************************/
+LinkTrjStream::LinkTrjStream( void )
+{
+   dim = 0;
+   maxBuff = 4;
+   hold = 10;
+   inUse = false;
+   ending = false;
+   stopped = true;
+   prevTime = hold;
+   head = 0;
+   tail = 0;
+   waiting = false;
+}
+
+/***************************************************************************/
+/**
+Prepare the stream for a new move.  Any queued set-points are discarded.
+
+@param start The position of the linkage when the move starts.  This is
+       normally the linkage's commanded position, see Linkage::GetPositionCommand.
+@param holdTime Length (milliseconds) of the segments sent while waiting for
+       new set-points.  This bounds the extra latency added when the linkage
+       has come to rest.  Default 10 ms.
+@param bufferPts Number of segments to keep buffered in each amplifier.
+       Fewer points reduce the delay between adding a set-point and the linkage
+       acting on it.  Must be at least 2.  Default 4.
+@return A pointer to an error object, or NULL on success.
+*/
+/***************************************************************************/
+const Error *LinkTrjStream::Init( PointN &start, uint8 holdTime, int bufferPts )
+{
+   if( start.getDim() < 1 || start.getDim() > CML_MAX_AMPS_PER_LINK )
+      return &TrjStreamError::BadParam;
+
+   if( !holdTime || bufferPts < 2 )
+      return &TrjStreamError::BadParam;
+
+   if( inUse )
+      return &TrjStreamError::InUse;
+
+   dim = start.getDim();
+   hold = holdTime;
+   maxBuff = bufferPts;
+
+   for( int i=0; i<dim; i++ )
+      cur[i] = prev[i] = start[i];
+
+   prevTime = hold;
+   stopped = true;
+   ending = false;
+   head = 0;
+   tail = 0;
+   return 0;
+}
+
+/***************************************************************************/
+/**
+Add a set-point to the end of the stream.
+
+@param p The position to move to.  Its dimension must match the one passed
+       to LinkTrjStream::Init.
+@param time The time (milliseconds, 1 to 255) to take moving to this point
+       from the previous one.
+@param timeout How long to wait (milliseconds) for space if the queue is full.
+       Zero (the default) returns immediately, negative waits forever.
+@return A pointer to an error object, or NULL on success.
+*/
+/***************************************************************************/
+const Error *LinkTrjStream::AddPoint( PointN &p, uint8 time, Timeout timeout )
+{
+   if( p.getDim() != dim || !time )
+      return &TrjStreamError::BadParam;
+
+   if( ending )
+      return &TrjStreamError::Ended;
+
+   int h = head.load( std::memory_order_relaxed );
+   int newHead = (h+1) % CML_TRJSTREAM_SIZE;
+
+   // The waiting flag is set before the tail is checked again, and the 
+   // consumer checks it after storing a new tail, so either this sees the
+   // space or the consumer sees the flag and posts the semaphore.  A post
+   // that turns out not to be needed just causes one more pass of the loop.
+   while( newHead == tail.load( std::memory_order_acquire ) )
+   {
+      waiting.store( true );
+      if( newHead != tail.load() )
+         break;
+
+      if( spaceSem.Get( timeout ) )
+         return &TrjStreamError::Full;
+   }
+
+   for( int i=0; i<dim; i++ )
+      qPos[h][i] = p[i];
+   qTime[h] = time;
+
+   head.store( newHead, std::memory_order_release );
+   return 0;
+}
+
+/***************************************************************************/
+/**
+End the stream.  The linkage will finish the set-points already queued,
+come to rest at the last one and end the move.  No more set-points may be
+added until the stream is initialized again.
+@return A pointer to an error object, or NULL on success.
+*/
+/***************************************************************************/
+const Error *LinkTrjStream::End( void )
+{
+   ending.store( true, std::memory_order_release );
+   return 0;
+}
+
+/***************************************************************************/
+/**
+Return the number of set-points queued but not yet started.
+@return The number of queued set-points.
+*/
+/***************************************************************************/
+int LinkTrjStream::GetQueueCount( void )
+{
+   int t = tail.load( std::memory_order_acquire );
+   int h = head.load( std::memory_order_acquire );
+   return (h - t + CML_TRJSTREAM_SIZE) % CML_TRJSTREAM_SIZE;
+}
+
+/***************************************************************************/
+/**
+Limit linkage batches to the set-points that are queued now.  If none are,
+one hold segment may be generated.
+@return The maximum number of segments to request in the next batch.
+*/
+/***************************************************************************/
+int LinkTrjStream::MaximumBatchPoints( void )
+{
+   int ct = GetQueueCount();
+   return ct ? ct : 1;
+}
+
+/***************************************************************************/
+/**
+Start a new move using this trajectory.
+@return A pointer to an error object, or NULL on success.
+*/
+/***************************************************************************/
+const Error *LinkTrjStream::StartNew( void )
+{
+   if( !dim ) return &TrjStreamError::BadParam;
+   if( inUse.exchange( true ) ) return &TrjStreamError::InUse;
+   return 0;
+}
+
+/***************************************************************************/
+/**
+Finish this trajectory.  Called by the linkage when the move ends or is aborted.
+*/
+/***************************************************************************/
+void LinkTrjStream::Finish( void )
+{
+   inUse = false;
+}
+
+/***************************************************************************/
+/**
+Retrieve the next segment of this trajectory.
+
+The segment starts at the current set-point and runs to the next queued one.
+Each axis velocity is a weighted average of the slopes of the segments on
+either side of the set-point, limited to three times the smaller slope so the
+cubic segment can't overshoot (Fritsch-Carlson).  If no set-point is queued,
+a hold segment at zero velocity is returned instead, or the final segment if
+the stream has been ended.
+
+@param pos An array which will be filled with position information.
+@param vel An array which will be filled with velocity information.
+@param time A reference to a variable where the time (milliseconds) will be
+       returned.
+@return A pointer to an error object, or NULL on success.
+*/
+/***************************************************************************/
+const Error *LinkTrjStream::NextSegment( uunit pos[], uunit vel[], uint8 &time )
+{
+   // Read the end flag first so that any set-point added before End() is seen
+   bool end = ending.load( std::memory_order_acquire );
+
+   int t = tail.load( std::memory_order_relaxed );
+   int h = head.load( std::memory_order_acquire );
+
+   if( h == t )
+   {
+      for( int i=0; i<dim; i++ )
+      {
+         pos[i] = prev[i] = cur[i];
+         vel[i] = 0;
+      }
+      stopped = true;
+      time = end ? 0 : hold;
+      return 0;
+   }
+
+   uint8 t1 = qTime[t];
+   double t0 = prevTime;
+
+   for( int i=0; i<dim; i++ )
+   {
+      double v = 0;
+
+      if( !stopped )
+      {
+         double s0 = (cur[i] - prev[i]) * 1000.0 / t0;
+         double s1 = (qPos[t][i] - cur[i]) * 1000.0 / t1;
+
+         if( s0*s1 > 0 )
+         {
+            v = (t1*s0 + t0*s1) / (t0 + t1);
+
+            double lim = 3 * ((fabs(s0) < fabs(s1)) ? s0 : s1);
+            if( fabs(v) > fabs(lim) ) v = lim;
+         }
+      }
+
+      pos[i] = cur[i];
+      vel[i] = (uunit)v;
+      prev[i] = cur[i];
+      cur[i] = qPos[t][i];
+   }
+
+   time = t1;
+   prevTime = t1;
+   stopped = false;
+   tail.store( (t+1) % CML_TRJSTREAM_SIZE );
+
+   if( waiting.load() && waiting.exchange( false ) )
+      spaceSem.Put();
+
+   return 0;
+}
+
+#endif
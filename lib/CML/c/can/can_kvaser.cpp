@@ -47,6 +47,7 @@ static void FreeLibrary( void *handle );
 #endif
 
 /* local functions */
+static void ConvertFrame( CanFrame &frame, uint dlc, uint flags );
 static const Error *InitLibrary( void );
 static void UninitLibrary( void );
 static void CheckThreadStop( void );
@@ -255,11 +256,32 @@ const Error *KvaserCAN::SetBaud( int32 b )
   */
 /***************************************************************************/
 const Error *KvaserCAN::RecvFrame( CanFrame &frame, Timeout timeout )
+{
+   int ct;
+   return RecvFrames( &frame, 1, ct, timeout );
+}
+
+/***************************************************************************/
+/**
+  Receive all waiting CAN frames, up to a maximum count.  The first frame 
+  is waited for, the rest are read from the driver's queue without waiting.
+  The read count and thread stop checks are done once for the whole block.
+  @param frame An array of at least max frames to be filled by the read.
+  @param max The maximum number of frames to read.
+  @param ct Returns the number of frames read.
+  @param timeout The timeout (ms) to wait for the first frame.  A timeout of 0 will
+  return immediately if no data is available.  A timeout of < 0 will 
+  wait forever.
+  @return A pointer to an error object on failure, NULL on success.
+  */
+/***************************************************************************/
+const Error *KvaserCAN::RecvFrames( CanFrame frame[], int max, int &ct, Timeout timeout )
 {
    canStatus       status;
    uint    dlc, flags;
    ulong   time;
 
+   ct = 0;
    if( !open ) 
       return &CanError::NotOpen;
 
@@ -268,7 +290,7 @@ const Error *KvaserCAN::RecvFrame( CanFrame &frame, Timeout timeout )
    {
       IncReadCount( 1 );
       try {
-         status = LPcanRead( Handle_Rd, (long*)&frame.id, frame.data, &dlc, &flags, &time );
+         status = LPcanRead( Handle_Rd, (long*)&frame[0].id, frame[0].data, &dlc, &flags, &time );
       }
       catch( ... ) {
          IncReadCount( -1 );
@@ -308,7 +330,7 @@ const Error *KvaserCAN::RecvFrame( CanFrame &frame, Timeout timeout )
 
          IncReadCount( 1 );
          try {
-            status = LPcanReadWait( Handle_Rd, (long*)&frame.id, frame.data, &dlc, &flags, &time, to );
+            status = LPcanReadWait( Handle_Rd, (long*)&frame[0].id, frame[0].data, &dlc, &flags, &time, to );
          }
          catch( ... ) {
             IncReadCount( -1 );
@@ -324,6 +346,41 @@ const Error *KvaserCAN::RecvFrame( CanFrame &frame, Timeout timeout )
    if( status < 0 )
       return ConvertError( status );
 
+   ConvertFrame( frame[0], dlc, flags );
+
+   // Grab anything else that's already waiting
+   IncReadCount( 1 );
+   for( ct=1; ct<max && open; ct++ )
+   {
+      try {
+         status = LPcanRead( Handle_Rd, (long*)&frame[ct].id, frame[ct].data, &dlc, &flags, &time );
+      }
+      catch( ... ) {
+         IncReadCount( -1 );
+         throw;
+      }
+
+      if( status != canOK )
+         break;
+
+      ConvertFrame( frame[ct], dlc, flags );
+   }
+   IncReadCount( -1 );
+
+   return 0;
+}
+
+/***************************************************************************/
+/**
+  Fill in the frame type and length, and adjust the ID of a frame read 
+  from the Kvaser driver.
+  @param frame The frame, with its ID and data already read.
+  @param dlc The data length returned by the driver.
+  @param flags The message flags returned by the driver.
+  */
+/***************************************************************************/
+static void ConvertFrame( CanFrame &frame, uint dlc, uint flags )
+{
    // indicate an extended frame by turning on bit 29 of the frame id
    if( flags & canMSG_EXT )
    {
@@ -348,8 +405,6 @@ const Error *KvaserCAN::RecvFrame( CanFrame &frame, Timeout timeout )
       frame.type = CAN_FRAME_DATA;
 
    frame.length = dlc;
-
-   return 0;
 }
 
 /***************************************************************************/
@@ -410,6 +465,68 @@ const Error *KvaserCAN::XmitFrame( CanFrame &frame, Timeout timeout )
    return ConvertError( status );
 }
 
+/***************************************************************************/
+/**
+  Write a block of CAN frames to the CAN network.  The frames are queued 
+  with the driver in order while holding the mutex once for the whole 
+  block, so frames from other threads can't be interleaved with them.
+  @param frame An array of frames to write.
+  @param ct The number of frames to write.
+  @param timeout Not used, frames are queued without waiting for them 
+  to be sent (as with XmitFrame).
+  @return A pointer to an error object on failure, NULL on success.
+  */
+/***************************************************************************/
+const Error *KvaserCAN::XmitFrames( CanFrame frame[], int ct, Timeout timeout )
+{
+   int i;
+   long id[ 32 ];
+   uint flags[ 32 ];
+
+   // Process the frames in groups small enough for the local arrays
+   if( ct > 32 )
+   {
+      for( i=0; i<ct; i+=32 )
+      {
+         const Error *err = XmitFrames( &frame[i], (ct-i > 32) ? 32 : ct-i, timeout );
+         if( err ) return err;
+      }
+      return 0;
+   }
+
+   // Check all of the frames before sending any of them
+   for( i=0; i<ct; i++ )
+   {
+      if( frame[i].length > 8 )
+         return &CanError::BadParam;
+
+      switch( frame[i].type )
+      {
+         case CAN_FRAME_DATA:   flags[i] = 0;           break;
+         case CAN_FRAME_REMOTE: flags[i] = canMSG_RTR;  break;
+         default:
+            return &CanError::BadParam;
+      }
+
+      flags[i] |= (frame[i].id & 0x20000000) ? canMSG_EXT : canMSG_STD;
+      id[i] = frame[i].id & 0x1FFFFFFF;
+   }
+
+   MutexLocker ml( mutex );
+
+   if( !open ) 
+      return &CanError::NotOpen;
+
+   for( i=0; i<ct; i++ )
+   {
+      canStatus status = LPcanWrite( Handle_Wr, id[i], frame[i].data, frame[i].length, flags[i] );
+      if( status != canOK )
+         return ConvertError( status );
+   }
+
+   return 0;
+}
+
 /***************************************************************************/
 /**
   Convert error codes defined by the Vector CAN library into 
@@ -0,0 +1,2069 @@
+/********************************************************/
+/*                                                      */
+/*  Copley Motion Libraries                             */
+/*                                                      */
+/*  Copyright (c) 2002 Copley Controls Corp.            */
+/*                     http://www.copleycontrols.com    */
+/*                                                      */
+/********************************************************/
+
+/*
+   CAN object connected to a network of simulated Copley amplifiers.
+   */
+
+#include <math.h>
+#include <string.h>
+
+#include "can_sim.h"
+#include "CML.h"
+
+CML_NAMESPACE_USE();
+
+// Period (ns) at which the simulated amplifiers update their motion
+#define SIMCAN_TICK_NS          1000000
+
+// Size of the simulated object dictionary, and of the largest object in it
+#define SIMAMP_MAX_OBJ          256
+#define SIMAMP_OBJ_SIZE         32
+
+// Largest transfer the SDO server will accept
+#define SIMAMP_SDO_SIZE         4096
+
+// Largest PVT buffer
+#define SIMAMP_MAX_PVT          256
+
+// Time constant (ms) with which the motor follows the commanded position
+#define SIMAMP_SERVO_TC         2.0
+
+// Position error (counts) within which the motor is considered settled
+#define SIMAMP_SETTLE           2.0
+
+// Time (ms) taken by a homing move
+#define SIMAMP_HOME_TIME        100
+
+// Block size used for SDO block downloads
+#define SIMAMP_BLKSIZE          127
+
+// Bits of the object 0x2012 PVT buffer status word
+#define PVTERR_SEQUENCE         0x01
+#define PVTERR_OVERFLOW         0x02
+#define PVTERR_UNDERFLOW        0x04
+
+// Device control states
+enum SIMAMP_STATE
+{
+   SIMSTATE_SOD,               // Switch on disabled
+   SIMSTATE_RTSO,              // Ready to switch on
+   SIMSTATE_SO,                // Switched on
+   SIMSTATE_OE,                // Operation enabled
+   SIMSTATE_QS,                // Quick stop active
+   SIMSTATE_FAULT              // Fault
+};
+
+// SDO server states
+enum SIMAMP_SDO
+{
+   SIMSDO_IDLE,
+   SIMSDO_DNLD,                // Segmented download
+   SIMSDO_UPLD,                // Segmented upload
+   SIMSDO_BLKDNLD,             // Receiving block download segments
+   SIMSDO_BLKEND               // Waiting for the end of a block download
+};
+
+CML_NAMESPACE_START()
+
+/***************************************************************************/
+/**
+A single simulated amplifier on a SimCAN network.  This is only used
+internally by SimCAN, which calls it with its mutex held.
+*/
+/***************************************************************************/
+class SimAmp
+{
+public:
+   SimAmp( SimCAN &bus, int16 nodeID, int pvtBuffSize );
+
+   void Reset( int64 t );
+   void HandleFrame( CanFrame &frame, int64 t );
+   void Tick( int64 t );
+
+   int16 GetNodeID( void ){ return nodeID; }
+   int32 GetPosition( void ){ return Round( actPos ); }
+
+private:
+   /// One entry of the object dictionary
+   struct Obj
+   {
+      uint32 key;
+      uint8 len;
+      uint8 data[ SIMAMP_OBJ_SIZE ];
+   };
+
+   /// Decoded configuration of one PDO
+   struct Pdo
+   {
+      uint32 cob;
+      uint8 type;
+      int ct;
+      uint32 map[8];
+      uint8 last[8];
+      int len;
+      bool sent;
+      int syncCt;
+   };
+
+   /// One segment of the PVT buffer
+   struct Seg
+   {
+      double pos;
+      double vel;
+      uint8 time;
+      bool pt;
+   };
+
+   SimCAN &bus;
+   int16 nodeID;
+   int pvtSize;
+
+   Obj obj[ SIMAMP_MAX_OBJ ];
+   int objCt;
+
+   Pdo tpdo[8];
+   Pdo rpdo[8];
+
+   uint8 nmtState;
+   uint8 guardToggle;
+   int hbCt;
+   int32 syncAcc;
+   int64 lastTime;
+
+   int sdoMode;
+   uint16 sdoIndex;
+   uint8 sdoSub;
+   uint8 sdoBuff[ SIMAMP_SDO_SIZE ];
+   int sdoLen;
+   int sdoPos;
+   uint8 sdoToggle;
+   int blkSeq;
+
+   int state;
+   uint16 ctrl;
+   int8 mode;
+   uint32 latch;
+   uint32 sticky;
+   uint32 faults;
+
+   double cmdPos, cmdVel;
+   double actPos, actVel;
+   double target;
+   bool trjActive;
+   bool halting;
+   bool abortBit;
+   bool referenced;
+   int homeTime;
+
+   Seg pvt[ SIMAMP_MAX_PVT ];
+   int pvtHead, pvtCt;
+   uint16 pvtNext;
+   uint8 pvtErr;
+   double pvtLast;
+   bool pvtRun;
+   Seg cur;
+   int pvtTime;
+
+   static int32 Round( double x ){ return (int32)floor( x+0.5 ); }
+
+   void DefaultComm( void );
+   void BootUp( int64 t );
+   Obj *Find( uint16 index, uint8 sub );
+   uint32 Get( uint16 index, uint8 sub, uint32 def=0 );
+   void Set( uint16 index, uint8 sub, uint32 value, int len );
+   void SetStr( uint16 index, uint8 sub, const char *str );
+   int Read( uint16 index, uint8 sub, uint8 *data, int max );
+   void Write( uint16 index, uint8 sub, const uint8 *data, int len, int64 t );
+
+   void LoadPdos( void );
+   int PdoData( Pdo &pdo, uint8 *data );
+   void SendPdo( Pdo &pdo, int64 t, bool reply );
+   void CheckPdos( int64 t, bool reply );
+   void WritePdo( Pdo &pdo, CanFrame &frame, int64 t );
+   void Sync( int64 t );
+   void Nmt( uint8 cmd, int64 t );
+
+   void SdoRequest( CanFrame &frame, int64 t );
+   void SdoReply( uint8 *data, int64 t );
+   void SdoAbort( uint32 code, int64 t );
+
+   uint16 StatusWord( void );
+   uint32 EventStatus( void );
+   void SetControl( uint16 cw );
+   void NewState( int s );
+   void StartMove( void );
+   void StopMove( bool abort );
+   void ProfileStep( void );
+   void HaltStep( void );
+
+   void PvtWrite( const uint8 *data );
+   uint32 PvtStatus( void );
+   void PvtStep( void );
+};
+
+CML_NAMESPACE_END()
+
+// local functions
+static int32 Bytes2Int( const uint8 *b, int len );
+static int32 Int24( const uint8 *b );
+
+/***************************************************************************/
+/**
+  Construct a default simulated CAN network.
+  The network is closed initially and holds no amplifiers.
+  */
+/***************************************************************************/
+SimCAN::SimCAN( void ) : CanInterface()
+{
+   Init();
+}
+
+/***************************************************************************/
+/**
+  Construct a simulated CAN network with a specified port name.
+  The port name is only recorded.
+  @param port The port name string identifying the CAN device.
+  */
+/***************************************************************************/
+SimCAN::SimCAN( const char *port ) : CanInterface(port)
+{
+   Init();
+}
+
+/***************************************************************************/
+/**
+  Destructor.  This closes the network and deletes the simulated amplifiers.
+  */
+/***************************************************************************/
+SimCAN::~SimCAN( void )
+{
+   Close();
+
+   for( int i=0; i<ampCt; i++ )
+      delete amp[i];
+}
+
+void SimCAN::Init( void )
+{
+   open = false;
+   baud = 1000000;
+   respDelay = 200000;
+   dropRate = 0;
+   dropCt = 0;
+   busFree = 0;
+   nextTick = 0;
+   ampCt = 0;
+   rxHead = rxCt = 0;
+   rxOverflow = false;
+   filtCt = 0;
+   memset( &stats, 0, sizeof(stats) );
+}
+
+/***************************************************************************/
+/**
+  Open the simulated network.  Every simulated amplifier is reset and
+  sends its boot up message, and the thread that updates their motion
+  is started.
+  @return A pointer to an error object, or NULL on success.
+  */
+/***************************************************************************/
+const Error *SimCAN::Open( void )
+{
+   {
+      MutexLocker ml( mutex );
+
+      if( open )
+         return &CanError::AlreadyOpen;
+
+      int64 now = getTimeNS();
+      busFree = now;
+      nextTick = now + SIMCAN_TICK_NS;
+      rxHead = rxCt = 0;
+      rxOverflow = false;
+      open = true;
+
+      for( int i=0; i<ampCt; i++ )
+         amp[i]->Reset( now );
+   }
+
+   if( start() )
+   {
+      Close();
+      return &CanError::Driver;
+   }
+   return 0;
+}
+
+/***************************************************************************/
+/**
+  Close the simulated network.  The amplifiers stop where they are.
+  @return A pointer to an error object, or NULL on success.
+  */
+/***************************************************************************/
+const Error *SimCAN::Close( void )
+{
+   {
+      MutexLocker ml( mutex );
+      if( !open )
+         return 0;
+      open = false;
+   }
+
+   stop();
+
+   // Wake up any thread waiting to read a frame
+   rxSem.Put();
+   return 0;
+}
+
+/***************************************************************************/
+/**
+  Set the bit rate of the simulated network.  This sets how long each
+  frame takes on the simulated bus.
+  @param b The bit rate to set.
+  @return A pointer to an error object, or NULL on success.
+  */
+/***************************************************************************/
+const Error *SimCAN::SetBaud( int32 b )
+{
+   switch( b )
+   {
+      case 1000000:
+      case  800000:
+      case  500000:
+      case  250000:
+      case  125000:
+      case  100000:
+      case   50000:
+      case   20000:
+         break;
+
+      default:
+         return &CanError::BadBaud;
+   }
+
+   MutexLocker ml( mutex );
+   baud = b;
+   return 0;
+}
+
+/***************************************************************************/
+/**
+  Set the frames passed to the program.  Frames sent by the simulated
+  amplifiers which don't pass any filter are still seen by the other
+  amplifiers, as they would be on a real network.
+  @param id Array of message IDs to receive.
+  @param mask Array of masks giving the bits of each ID to check.
+  @param ct The number of filters.  If zero, all frames are received.
+  @return A pointer to an error object, or NULL on success.
+  */
+/***************************************************************************/
+const Error *SimCAN::SetRecvFilter( const uint32 id[], const uint32 mask[], int ct )
+{
+   if( ct < 0 || ct > SIMCAN_MAX_FILTER )
+      return &CanError::BadParam;
+
+   MutexLocker ml( mutex );
+   for( int i=0; i<ct; i++ )
+   {
+      filtID[i] = id[i];
+      filtMask[i] = mask[i];
+   }
+   filtCt = ct;
+   return 0;
+}
+
+/***************************************************************************/
+/**
+  Add a simulated amplifier to the network.  If the network is already
+  open the new amplifier sends its boot up message at once.
+  @param nodeID The CANopen node ID of the amplifier (1 to 127).
+  @param pvtBuffSize The number of segments its PVT buffer holds.
+         Copley amplifiers hold 32.
+  @return A pointer to an error object, or NULL on success.
+  */
+/***************************************************************************/
+const Error *SimCAN::AddAmp( int16 nodeID, int pvtBuffSize )
+{
+   if( nodeID < 1 || nodeID > 127 )
+      return &CanError::BadParam;
+
+   if( pvtBuffSize < 2 || pvtBuffSize > SIMAMP_MAX_PVT-1 )
+      return &CanError::BadParam;
+
+   MutexLocker ml( mutex );
+
+   if( ampCt >= SIMCAN_MAX_AMPS || FindAmp( nodeID ) )
+      return &CanError::BadParam;
+
+   SimAmp *a = new SimAmp( *this, nodeID, pvtBuffSize );
+   if( !a ) return &CanError::Alloc;
+
+   amp[ampCt++] = a;
+
+   if( open )
+      a->Reset( getTimeNS() );
+   return 0;
+}
+
+/***************************************************************************/
+/**
+  Get the actual position of a simulated amplifier's motor.  This reads
+  the simulation directly without using the network.
+  @param nodeID The node ID of the amplifier.
+  @param pos The position (encoder counts) is returned here.
+  @return A pointer to an error object, or NULL on success.
+  */
+/***************************************************************************/
+const Error *SimCAN::GetAmpPosition( int16 nodeID, int32 &pos )
+{
+   MutexLocker ml( mutex );
+
+   SimAmp *a = FindAmp( nodeID );
+   if( !a ) return &CanError::BadParam;
+
+   pos = a->GetPosition();
+   return 0;
+}
+
+/***************************************************************************/
+/**
+  Set the time taken by the simulated amplifiers to answer SDOs and remote
+  requests, and to react to any frame that changes their state.
+  @param us The delay in microseconds.  The default is 200.
+  */
+/***************************************************************************/
+void SimCAN::SetResponseDelay( int32 us )
+{
+   MutexLocker ml( mutex );
+   respDelay = (us < 0) ? 0 : us*1000;
+}
+
+/***************************************************************************/
+/**
+  Drop PDOs written by the program, as if they had been lost on the
+  network.  This is used to test how the program recovers, for example
+  from the PVT sequence errors that a lost segment causes.
+  @param n One of every n PDOs is dropped.  Zero (the default) drops none.
+  */
+/***************************************************************************/
+void SimCAN::SetDropRate( uint32 n )
+{
+   MutexLocker ml( mutex );
+   dropRate = n;
+   dropCt = 0;
+}
+
+/***************************************************************************/
+/**
+  Get the statistics kept by the simulated network.
+  @param s The statistics are returned here.
+  */
+/***************************************************************************/
+void SimCAN::GetStats( SimCANStats &s )
+{
+   MutexLocker ml( mutex );
+   s = stats;
+}
+
+/***************************************************************************/
+/**
+  Clear the statistics kept by the simulated network.
+  */
+/***************************************************************************/
+void SimCAN::ClearStats( void )
+{
+   MutexLocker ml( mutex );
+   memset( &stats, 0, sizeof(stats) );
+}
+
+/***************************************************************************/
+/**
+  Receive the next CAN frame.
+  @param frame A reference to the frame object that will be filled by the read.
+  @param timeout The timeout (ms) to wait for the frame.  A timeout of 0 will
+  return immediately if no data is available.  A timeout of < 0 will
+  wait forever.
+  @return A pointer to an error object, or NULL on success.
+  */
+/***************************************************************************/
+const Error *SimCAN::RecvFrame( CanFrame &frame, Timeout timeout )
+{
+   int ct;
+   return RecvFrames( &frame, 1, ct, timeout );
+}
+
+/***************************************************************************/
+/**
+  Receive all the frames that have finished on the simulated bus, up to the
+  passed maximum.  If none have, wait for the next.
+  @param frame Array of frames to fill.
+  @param max The size of the array.
+  @param ct Returns the number of frames received.
+  @param timeout The timeout (ms) to wait for the first frame.
+  @return A pointer to an error object, or NULL on success.
+  */
+/***************************************************************************/
+const Error *SimCAN::RecvFrames( CanFrame frame[], int max, int &ct, Timeout timeout )
+{
+   ct = 0;
+
+   int64 end = -1;
+   if( timeout >= 0 )
+      end = getTimeNS() + (int64)(timeout * 1000000);
+
+   while( 1 )
+   {
+      int64 now, next;
+      {
+         MutexLocker ml( mutex );
+
+         if( !open )
+            return &CanError::NotOpen;
+
+         if( rxOverflow )
+         {
+            rxOverflow = false;
+            return &CanError::Overflow;
+         }
+
+         now = getTimeNS();
+         Advance( now );
+
+         while( ct < max && rxCt && rxTime[rxHead] <= now )
+         {
+            frame[ct++] = rxFrame[rxHead];
+            rxHead = (rxHead+1) % SIMCAN_RXQ;
+            rxCt--;
+         }
+
+         if( ct ) return 0;
+
+         next = rxCt ? rxTime[rxHead] : -1;
+      }
+
+      if( end >= 0 )
+      {
+         if( now >= end )
+            return &CanError::Timeout;
+
+         if( next < 0 || next > end )
+         {
+            rxSem.Get( (Timeout)((end-now) / 1000000.0) );
+            continue;
+         }
+      }
+
+      // The next frame is still on the simulated bus
+      if( next >= 0 )
+         sleepUntil( next );
+      else
+         rxSem.Get( -1 );
+   }
+}
+
+/***************************************************************************/
+/**
+  Write a CAN frame to the simulated network.  The frame is handed to the
+  simulated amplifiers straight away.
+  @param frame A reference to the frame to write.
+  @param timeout Not used.
+  @return A pointer to an error object, or NULL on success.
+  */
+/***************************************************************************/
+const Error *SimCAN::XmitFrame( CanFrame &frame, Timeout timeout )
+{
+   return XmitFrames( &frame, 1, timeout );
+}
+
+/***************************************************************************/
+/**
+  Write several CAN frames to the simulated network.
+  @param frame The frames to write.
+  @param ct The number of frames.
+  @param timeout Not used.
+  @return A pointer to an error object, or NULL on success.
+  */
+/***************************************************************************/
+const Error *SimCAN::XmitFrames( CanFrame frame[], int ct, Timeout )
+{
+   MutexLocker ml( mutex );
+
+   if( !open )
+      return &CanError::NotOpen;
+
+   int64 now = getTimeNS();
+   Advance( now );
+
+   for( int i=0; i<ct; i++ )
+   {
+      stats.xmitFrames++;
+
+      // Drop the requested share of PDOs
+      int32 id = frame[i].id;
+      if( dropRate && (frame[i].type == CAN_FRAME_DATA) &&
+          ((id & 0x20000000) || (id >= 0x180 && id < 0x580)) )
+      {
+         if( ++dropCt >= dropRate )
+         {
+            dropCt = 0;
+            stats.dropped++;
+            continue;
+         }
+      }
+
+      int64 t = BusSlot( frame[i], now );
+      for( int j=0; j<ampCt; j++ )
+         amp[j]->HandleFrame( frame[i], t );
+   }
+   return 0;
+}
+
+/***************************************************************************/
+/**
+  Thread that keeps the simulated amplifiers moving when the program isn't
+  using the network.
+  */
+/***************************************************************************/
+void SimCAN::run( void )
+{
+   int64 next = getTimeNS();
+
+   while( 1 )
+   {
+      next += SIMCAN_TICK_NS;
+
+      // Don't try to make up for time this thread wasn't allowed to run
+      int64 now = getTimeNS();
+      if( next < now - 10*SIMCAN_TICK_NS )
+         next = now;
+
+      sleepUntil( next );
+
+      // Close stops this thread while it sleeps
+      MutexLocker ml( mutex );
+      if( open )
+         Advance( getTimeNS() );
+   }
+}
+
+/***************************************************************************/
+/**
+  Bring the simulated amplifiers up to the passed time.
+  */
+/***************************************************************************/
+void SimCAN::Advance( int64 now )
+{
+   while( nextTick <= now )
+   {
+      for( int i=0; i<ampCt; i++ )
+         amp[i]->Tick( nextTick );
+      nextTick += SIMCAN_TICK_NS;
+   }
+}
+
+/***************************************************************************/
+/**
+  Return the time (ns) a frame takes on the bus, allowing about one stuff
+  bit in ten.
+  */
+/***************************************************************************/
+int64 SimCAN::FrameTime( CanFrame &frame )
+{
+   int bits = (frame.id & 0x20000000) ? 67 : 47;
+   if( frame.type == CAN_FRAME_DATA )
+      bits += 8 * frame.length;
+
+   bits += bits / 10;
+   return (int64)bits * 1000000000 / baud;
+}
+
+/***************************************************************************/
+/**
+  Give a frame that is ready to send at the passed time its place on the
+  bus, and return the time at which it's finished.
+  */
+/***************************************************************************/
+int64 SimCAN::BusSlot( CanFrame &frame, int64 ready )
+{
+   if( busFree < ready ) busFree = ready;
+   busFree += FrameTime( frame );
+
+   int32 wait = (int32)((busFree - ready) / 1000);
+   if( wait > stats.maxBusWait ) stats.maxBusWait = wait;
+
+   return busFree;
+}
+
+/***************************************************************************/
+/**
+  Send a frame from a simulated amplifier.  The other amplifiers see it,
+  and it's queued for the program if it passes the receive filter.
+  @param from The amplifier sending the frame.
+  @param frame The frame.
+  @param t The time at which the amplifier produced it.
+  @param reply True if this is an answer to a frame the amplifier has just
+         received.  Replies are delayed by the amplifier's response time.
+  */
+/***************************************************************************/
+void SimCAN::Send( SimAmp *from, CanFrame &frame, int64 t, bool reply )
+{
+   // The bus time is charged when the frame is produced so that the
+   // response delay doesn't leave the bus idle for other frames.
+   int64 end = BusSlot( frame, t );
+   if( reply && end < t + respDelay + FrameTime(frame) )
+      end = t + respDelay + FrameTime(frame);
+
+   stats.recvFrames++;
+   frame.timestamp = (uint32)(end / 1000);
+
+   for( int i=0; i<ampCt; i++ )
+   {
+      if( amp[i] != from )
+         amp[i]->HandleFrame( frame, end );
+   }
+
+   if( Accept( frame ) )
+      Queue( frame, end );
+}
+
+/***************************************************************************/
+/**
+  Return true if a frame passes the receive filter.
+  */
+/***************************************************************************/
+bool SimCAN::Accept( CanFrame &frame )
+{
+   if( !filtCt || frame.type == CAN_FRAME_ERROR )
+      return true;
+
+   uint32 id = (uint32)frame.id;
+   for( int i=0; i<filtCt; i++ )
+   {
+      if( (id & filtMask[i]) == (filtID[i] & filtMask[i]) )
+         return true;
+   }
+   return false;
+}
+
+/***************************************************************************/
+/**
+  Queue a frame for the program.  The queue is kept in the order in which
+  frames finish on the bus.
+  */
+/***************************************************************************/
+void SimCAN::Queue( CanFrame &frame, int64 t )
+{
+   if( rxCt >= SIMCAN_RXQ )
+   {
+      stats.overflows++;
+      rxOverflow = true;
+      return;
+   }
+
+   int i = rxCt++;
+   while( i > 0 )
+   {
+      int prev = (rxHead + i - 1) % SIMCAN_RXQ;
+      if( rxTime[prev] <= t ) break;
+
+      int n = (rxHead + i) % SIMCAN_RXQ;
+      rxFrame[n] = rxFrame[prev];
+      rxTime[n] = rxTime[prev];
+      i--;
+   }
+
+   int n = (rxHead + i) % SIMCAN_RXQ;
+   rxFrame[n] = frame;
+   rxTime[n] = t;
+
+   // Wake the reader if this is the new earliest frame
+   if( !i ) rxSem.Put();
+}
+
+SimAmp *SimCAN::FindAmp( int16 nodeID )
+{
+   for( int i=0; i<ampCt; i++ )
+   {
+      if( amp[i]->GetNodeID() == nodeID )
+         return amp[i];
+   }
+   return 0;
+}
+
+/***************************************************************************/
+/**
+  Construct a simulated amplifier.  It's held in reset until the network
+  is opened.
+  */
+/***************************************************************************/
+SimAmp::SimAmp( SimCAN &b, int16 id, int buffSize ): bus(b)
+{
+   nodeID = id;
+   pvtSize = buffSize;
+   actPos = cmdPos = 0;
+   nmtState = 0;
+   objCt = 0;
+   memset( tpdo, 0, sizeof(tpdo) );
+   memset( rpdo, 0, sizeof(rpdo) );
+}
+
+/***************************************************************************/
+/**
+  Reset the amplifier as if it had just been powered up, and send the boot
+  up message.  The motor keeps its position.
+  */
+/***************************************************************************/
+void SimAmp::Reset( int64 t )
+{
+   objCt = 0;
+
+   // Identity and device information
+   Set( 0x1000, 0, 0x00020192, 4 );
+   Set( 0x1018, 0, 4, 1 );
+   Set( 0x1018, 1, 0x000000AB, 4 );
+   Set( 0x1018, 2, 0x00000001, 4 );
+   Set( 0x1018, 3, 0x00000001, 4 );
+   Set( 0x1018, 4, nodeID, 4 );
+   SetStr( 0x1008, 0, "SimAmp" );
+   SetStr( 0x6503, 0, "Simulated amplifier" );
+   SetStr( 0x6504, 0, "Copley Controls" );
+   Set( 0x6510, 13, 0x1000, 2 );            // Hardware type
+   Set( 0x6510, 24, 0x0200, 2 );            // Firmware version 2.00
+   Set( 0x6510, 25, 1, 2 );                 // Axis count
+   Set( 0x2300, 0, 30, 2 );
+   Set( 0x6086, 0, 0, 2 );
+   Set( 0x6502, 0, 0x000003E5, 4 );         // Supported modes
+
+   state = SIMSTATE_SOD;
+   ctrl = 0;
+   mode = 1;
+   latch = 0x00100000;                      // Reset latch
+   sticky = 0;
+   faults = 0;
+   cmdPos = actPos;
+   cmdVel = actVel = 0;
+   target = actPos;
+   trjActive = halting = abortBit = referenced = false;
+   homeTime = 0;
+
+   pvtHead = pvtCt = 0;
+   pvtNext = 0;
+   pvtErr = 0;
+   pvtLast = 0;
+   pvtRun = false;
+   pvtTime = 0;
+
+   DefaultComm();
+   BootUp( t );
+}
+
+/***************************************************************************/
+/**
+  Set the communication objects to their power up values.
+  */
+/***************************************************************************/
+void SimAmp::DefaultComm( void )
+{
+   Set( 0x1005, 0, 0x00000080, 4 );
+   Set( 0x1006, 0, 0, 4 );
+   Set( 0x100C, 0, 0, 2 );
+   Set( 0x100D, 0, 0, 1 );
+   Set( 0x1017, 0, 0, 2 );
+
+   for( int i=0; i<8; i++ )
+   {
+      uint32 r = 0x80000000, t = 0x80000000;
+      if( i < 4 )
+      {
+         r |= 0x200 + 0x100*i + nodeID;
+         t |= 0x180 + 0x100*i + nodeID;
+      }
+
+      Set( 0x1400+i, 0, 2, 1 );
+      Set( 0x1400+i, 1, r, 4 );
+      Set( 0x1400+i, 2, 255, 1 );
+      Set( 0x1600+i, 0, 0, 1 );
+      Set( 0x1800+i, 0, 2, 1 );
+      Set( 0x1800+i, 1, t, 4 );
+      Set( 0x1800+i, 2, 255, 1 );
+      Set( 0x1A00+i, 0, 0, 1 );
+   }
+   LoadPdos();
+
+   sdoMode = SIMSDO_IDLE;
+   guardToggle = 0;
+   hbCt = 0;
+   syncAcc = 0;
+}
+
+/***************************************************************************/
+/**
+  Enter the pre-operational state and send the boot up message.
+  */
+/***************************************************************************/
+void SimAmp::BootUp( int64 t )
+{
+   lastTime = t;
+   nmtState = 127;
+
+   CanFrame frame;
+   frame.type = CAN_FRAME_DATA;
+   frame.id = 0x700 + nodeID;
+   frame.length = 1;
+   frame.data[0] = 0;
+   bus.Send( this, frame, t, false );
+}
+
+SimAmp::Obj *SimAmp::Find( uint16 index, uint8 sub )
+{
+   uint32 key = ((uint32)index<<8) | sub;
+   for( int i=0; i<objCt; i++ )
+   {
+      if( obj[i].key == key )
+         return &obj[i];
+   }
+   return 0;
+}
+
+uint32 SimAmp::Get( uint16 index, uint8 sub, uint32 def )
+{
+   Obj *o = Find( index, sub );
+   if( !o ) return def;
+   return (uint32)Bytes2Int( o->data, o->len );
+}
+
+void SimAmp::Set( uint16 index, uint8 sub, uint32 value, int len )
+{
+   uint8 b[4];
+   for( int i=0; i<4; i++ )
+      b[i] = ByteCast( value >> (8*i) );
+
+   Obj *o = Find( index, sub );
+   if( !o )
+   {
+      if( objCt >= SIMAMP_MAX_OBJ ) return;
+      o = &obj[objCt++];
+      o->key = ((uint32)index<<8) | sub;
+   }
+
+   o->len = len;
+   memcpy( o->data, b, len );
+}
+
+void SimAmp::SetStr( uint16 index, uint8 sub, const char *str )
+{
+   int len = (int)strlen( str );
+   if( len > SIMAMP_OBJ_SIZE ) len = SIMAMP_OBJ_SIZE;
+
+   Set( index, sub, 0, 0 );
+   Obj *o = Find( index, sub );
+   if( !o ) return;
+
+   o->len = len;
+   memcpy( o->data, str, len );
+}
+
+/***************************************************************************/
+/**
+  Read an object.  Objects that follow the state of the amplifier are
+  worked out when read, others come from the dictionary.
+  @return The number of bytes read.
+  */
+/***************************************************************************/
+int SimAmp::Read( uint16 index, uint8 sub, uint8 *data, int max )
+{
+   uint32 value;
+   int len;
+
+   switch( index )
+   {
+      case 0x6041: value = StatusWord();               len = 2; break;
+      case 0x1002: value = EventStatus();              len = 4; break;
+      case 0x2180: value = sticky | EventStatus();
+                   sticky = 0;                         len = 4; break;
+      case 0x2181: value = latch;                      len = 4; break;
+      case 0x2183: value = faults;                     len = 4; break;
+      case 0x1001: value = faults ? 1 : 0;             len = 1; break;
+      case 0x6040: value = ctrl;                       len = 2; break;
+      case 0x6060:
+      case 0x6061: value = (uint8)mode;                len = 1; break;
+      case 0x6064:
+      case 0x2240: value = Round( actPos );            len = 4; break;
+      case 0x6062: value = Round( cmdPos );            len = 4; break;
+      case 0x60F4: value = Round( cmdPos-actPos );     len = 4; break;
+      case 0x6069: value = Round( actVel*10 );         len = 4; break;
+      case 0x606B: value = Round( cmdVel*10 );         len = 4; break;
+      case 0x2011: value = pvtSize - pvtCt;            len = 2; break;
+      case 0x2012: value = PvtStatus();                len = 4; break;
+      case 0x2013: value = pvtNext;                    len = 2; break;
+      case 0x1013: value = (uint32)(lastTime/1000);    len = 4; break;
+
+      default:
+      {
+         Obj *o = Find( index, sub );
+         if( !o )
+         {
+            value = 0;
+            len = 4;
+            break;
+         }
+
+         len = (o->len < max) ? o->len : max;
+         memcpy( data, o->data, len );
+         return len;
+      }
+   }
+
+   if( len > max ) len = max;
+   for( int i=0; i<len; i++ )
+      data[i] = ByteCast( value >> (8*i) );
+   return len;
+}
+
+/***************************************************************************/
+/**
+  Write an object, whether by SDO or by PDO.
+  */
+/***************************************************************************/
+void SimAmp::Write( uint16 index, uint8 sub, const uint8 *data, int len, int64 )
+{
+   uint32 value = (uint32)Bytes2Int( data, (len>4) ? 4 : len );
+
+   switch( index )
+   {
+      case 0x6040: SetControl( (uint16)value );       return;
+      case 0x2010: if( len == 8 ) PvtWrite( data );   return;
+      case 0x2181: latch &= ~value;                   return;
+      case 0x2183: faults &= ~value;                  return;
+
+      case 0x6060:
+         if( (int8)value != mode && trjActive )
+            StopMove( true );
+         mode = (int8)value;
+         return;
+
+      case 0x6064:
+      case 0x2240:
+         actPos = cmdPos = target = (int32)value;
+         return;
+   }
+
+   if( len > SIMAMP_OBJ_SIZE ) len = SIMAMP_OBJ_SIZE;
+   Set( index, sub, 0, 0 );
+   Obj *o = Find( index, sub );
+   if( o )
+   {
+      o->len = len;
+      memcpy( o->data, data, len );
+   }
+
+   if( index >= 0x1400 && index < 0x1C00 )
+      LoadPdos();
+}
+
+/***************************************************************************/
+/**
+  Decode the PDO configuration from the dictionary.  Called whenever it's
+  changed.
+  */
+/***************************************************************************/
+void SimAmp::LoadPdos( void )
+{
+   for( int i=0; i<16; i++ )
+   {
+      Pdo &p = (i<8) ? tpdo[i] : rpdo[i-8];
+      uint16 comm = (i<8) ? 0x1800+i : 0x1400+i-8;
+      uint16 map  = (i<8) ? 0x1A00+i : 0x1600+i-8;
+
+      uint32 cob = Get( comm, 1, 0x80000000 );
+      if( cob != p.cob )
+      {
+         // Send event PDOs once when they are enabled
+         p.sent = false;
+         p.syncCt = 0;
+      }
+
+      p.cob = cob;
+      p.type = (uint8)Get( comm, 2, 255 );
+      p.ct = (int)Get( map, 0 );
+      if( p.ct > 8 ) p.ct = 8;
+
+      for( int j=0; j<p.ct; j++ )
+         p.map[j] = Get( map, j+1 );
+   }
+}
+
+/***************************************************************************/
+/**
+  Build the data of a transmit PDO.
+  @return The length of the PDO.
+  */
+/***************************************************************************/
+int SimAmp::PdoData( Pdo &pdo, uint8 *data )
+{
+   int len = 0;
+   for( int i=0; i<pdo.ct; i++ )
+   {
+      int bytes = (pdo.map[i] & 0xFF) / 8;
+      if( len + bytes > 8 ) break;
+
+      uint8 b[SIMAMP_OBJ_SIZE];
+      int n = Read( (uint16)(pdo.map[i]>>16), (uint8)(pdo.map[i]>>8), b, bytes );
+      for( int j=0; j<bytes; j++ )
+         data[len++] = (j<n) ? b[j] : 0;
+   }
+   return len;
+}
+
+void SimAmp::SendPdo( Pdo &pdo, int64 t, bool reply )
+{
+   CanFrame frame;
+   frame.type = CAN_FRAME_DATA;
+   frame.id = pdo.cob & 0x3FFFFFFF;
+   frame.length = PdoData( pdo, frame.data );
+
+   memcpy( pdo.last, frame.data, frame.length );
+   pdo.len = frame.length;
+   pdo.sent = true;
+
+   bus.Send( this, frame, t, reply );
+}
+
+/***************************************************************************/
+/**
+  Send any event driven transmit PDO whose data has changed.
+  */
+/***************************************************************************/
+void SimAmp::CheckPdos( int64 t, bool reply )
+{
+   if( nmtState != 5 )
+      return;
+
+   for( int i=0; i<8; i++ )
+   {
+      Pdo &p = tpdo[i];
+      if( (p.cob & 0x80000000) || p.type < 254 )
+         continue;
+
+      uint8 data[8];
+      int len = PdoData( p, data );
+      if( p.sent && len == p.len && !memcmp( data, p.last, len ) )
+         continue;
+
+      SendPdo( p, t, reply );
+   }
+}
+
+/***************************************************************************/
+/**
+  Write the objects mapped to a receive PDO.
+  */
+/***************************************************************************/
+void SimAmp::WritePdo( Pdo &pdo, CanFrame &frame, int64 t )
+{
+   int off = 0;
+   for( int i=0; i<pdo.ct; i++ )
+   {
+      int bytes = (pdo.map[i] & 0xFF) / 8;
+      if( off + bytes > frame.length ) break;
+
+      Write( (uint16)(pdo.map[i]>>16), (uint8)(pdo.map[i]>>8), &frame.data[off], bytes, t );
+      off += bytes;
+   }
+}
+
+/***************************************************************************/
+/**
+  Handle a SYNC message by sending the synchronous transmit PDOs.
+  */
+/***************************************************************************/
+void SimAmp::Sync( int64 t )
+{
+   if( nmtState != 5 )
+      return;
+
+   for( int i=0; i<8; i++ )
+   {
+      Pdo &p = tpdo[i];
+      if( (p.cob & 0x80000000) || p.type > 240 )
+         continue;
+
+      if( !p.type )
+      {
+         uint8 data[8];
+         int len = PdoData( p, data );
+         if( p.sent && len == p.len && !memcmp( data, p.last, len ) )
+            continue;
+      }
+      else if( ++p.syncCt < p.type )
+         continue;
+
+      p.syncCt = 0;
+      SendPdo( p, t, false );
+   }
+}
+
+/***************************************************************************/
+/**
+  Handle a NMT command.
+  */
+/***************************************************************************/
+void SimAmp::Nmt( uint8 cmd, int64 t )
+{
+   switch( cmd )
+   {
+      case 1:   nmtState = 5;   break;
+      case 2:   nmtState = 4;   break;
+      case 128: nmtState = 127; break;
+      case 129: Reset( t );     break;
+
+      case 130:
+         DefaultComm();
+         BootUp( t );
+         break;
+   }
+}
+
+/***************************************************************************/
+/**
+  Handle a frame seen on the network.
+  @param frame The frame.
+  @param t The time at which it finished on the bus.
+  */
+/***************************************************************************/
+void SimAmp::HandleFrame( CanFrame &frame, int64 t )
+{
+   if( t > lastTime ) lastTime = t;
+
+   int32 id = frame.id;
+
+   if( frame.type == CAN_FRAME_REMOTE )
+   {
+      // Node guarding
+      if( id == 0x700 + nodeID )
+      {
+         CanFrame rsp;
+         rsp.type = CAN_FRAME_DATA;
+         rsp.id = id;
+         rsp.length = 1;
+         rsp.data[0] = nmtState | guardToggle;
+         guardToggle ^= 0x80;
+         bus.Send( this, rsp, t, true );
+         return;
+      }
+
+      // Remote requests of transmit PDOs
+      if( nmtState != 5 ) return;
+      for( int i=0; i<8; i++ )
+      {
+         Pdo &p = tpdo[i];
+         if( !(p.cob & 0xC0000000) && (int32)(p.cob & 0x3FFFFFFF) == id )
+            SendPdo( p, t, true );
+      }
+      return;
+   }
+
+   if( frame.type != CAN_FRAME_DATA )
+      return;
+
+   if( id == 0 )
+   {
+      if( frame.length >= 2 && (!frame.data[1] || frame.data[1] == nodeID) )
+         Nmt( frame.data[0], t );
+      return;
+   }
+
+   if( id == 0x600 + nodeID )
+   {
+      if( nmtState != 4 && frame.length == 8 )
+         SdoRequest( frame, t );
+      CheckPdos( t, true );
+      return;
+   }
+
+   uint32 syncCob = Get( 0x1005, 0 );
+   if( id == (int32)(syncCob & 0x7FF) && !(syncCob & 0x40000000) )
+   {
+      Sync( t );
+      return;
+   }
+
+   if( nmtState != 5 )
+      return;
+
+   bool used = false;
+   for( int i=0; i<8; i++ )
+   {
+      Pdo &p = rpdo[i];
+      if( !(p.cob & 0x80000000) && (int32)(p.cob & 0x3FFFFFFF) == id )
+      {
+         WritePdo( p, frame, t );
+         used = true;
+      }
+   }
+
+   if( used )
+      CheckPdos( t, true );
+}
+
+/***************************************************************************/
+/**
+  Update the amplifier by one millisecond.
+  */
+/***************************************************************************/
+void SimAmp::Tick( int64 t )
+{
+   lastTime = t;
+
+   if( state == SIMSTATE_OE )
+   {
+      if( halting )
+         HaltStep();
+      else switch( mode )
+      {
+         case 1:
+         case 3:
+            ProfileStep();
+            break;
+
+         case 6:
+            if( homeTime && !--homeTime )
+            {
+               cmdPos = actPos = target = 0;
+               referenced = true;
+               trjActive = false;
+            }
+            break;
+
+         case 7:
+            PvtStep();
+            break;
+      }
+   }
+   else
+   {
+      cmdVel = 0;
+
+      // With the output off the motor stays where it is
+      if( state != SIMSTATE_QS )
+         cmdPos = actPos;
+   }
+
+   double last = actPos;
+   actPos += (cmdPos - actPos) * (1.0 - exp( -1.0/SIMAMP_SERVO_TC ));
+   actVel = (actPos - last) * 1000.0;
+
+   uint32 e = EventStatus();
+   latch |= e;
+   sticky |= e;
+
+   // SYNC production
+   uint32 syncCob = Get( 0x1005, 0 );
+   int32 period = (int32)Get( 0x1006, 0 );
+   if( (syncCob & 0x40000000) && period > 0 )
+   {
+      for( syncAcc += 1000; syncAcc >= period; syncAcc -= period )
+      {
+         CanFrame frame;
+         frame.type = CAN_FRAME_DATA;
+         frame.id = syncCob & 0x7FF;
+         frame.length = 0;
+         bus.Send( this, frame, t, false );
+         Sync( t );
+      }
+   }
+
+   // Heartbeat
+   int hb = (int)Get( 0x1017, 0 );
+   if( hb && ++hbCt >= hb )
+   {
+      hbCt = 0;
+
+      CanFrame frame;
+      frame.type = CAN_FRAME_DATA;
+      frame.id = 0x700 + nodeID;
+      frame.length = 1;
+      frame.data[0] = nmtState;
+      bus.Send( this, frame, t, false );
+   }
+
+   CheckPdos( t, false );
+}
+
+/***************************************************************************/
+/**
+  Handle a request sent to the SDO server.
+  */
+/***************************************************************************/
+void SimAmp::SdoRequest( CanFrame &frame, int64 t )
+{
+   uint8 *req = frame.data;
+   uint8 rsp[8];
+   memset( rsp, 0, 8 );
+
+   // Segments of a block download have no command specifier
+   if( sdoMode == SIMSDO_BLKDNLD )
+   {
+      int seq = req[0] & 0x7F;
+      bool last = (req[0] & 0x80) != 0;
+
+      if( seq == blkSeq+1 )
+      {
+         blkSeq = seq;
+         for( int i=1; i<8 && sdoLen < SIMAMP_SDO_SIZE; i++ )
+            sdoBuff[sdoLen++] = req[i];
+      }
+      else
+         last = false;
+
+      if( seq < SIMAMP_BLKSIZE && !last )
+         return;
+
+      rsp[0] = 0xA2;
+      rsp[1] = (uint8)blkSeq;
+      rsp[2] = SIMAMP_BLKSIZE;
+      blkSeq = 0;
+
+      if( last ) sdoMode = SIMSDO_BLKEND;
+      SdoReply( rsp, t );
+      return;
+   }
+
+   int ccs = req[0] >> 5;
+
+   // Abort
+   if( ccs == 4 )
+   {
+      sdoMode = SIMSDO_IDLE;
+      return;
+   }
+
+   // The multiplexor is sent back with the initiate responses
+   uint16 index = (uint16)(req[1] | (req[2]<<8));
+   uint8 sub = req[3];
+   rsp[1] = req[1];
+   rsp[2] = req[2];
+   rsp[3] = req[3];
+
+   switch( ccs )
+   {
+      // Initiate download
+      case 1:
+         if( req[0] & 2 )
+         {
+            int n = (req[0] & 1) ? 4 - ((req[0]>>2) & 3) : 4;
+            Write( index, sub, &req[4], n, t );
+            sdoMode = SIMSDO_IDLE;
+         }
+         else
+         {
+            sdoIndex = index;
+            sdoSub = sub;
+            sdoLen = 0;
+            sdoToggle = 0;
+            sdoMode = SIMSDO_DNLD;
+         }
+         rsp[0] = 0x60;
+         break;
+
+      // Download segment
+      case 0:
+      {
+         if( sdoMode != SIMSDO_DNLD || (req[0] & 0x10) != sdoToggle )
+         {
+            SdoAbort( 0x05030000, t );
+            return;
+         }
+
+         int n = 7 - ((req[0]>>1) & 7);
+         for( int i=0; i<n && sdoLen < SIMAMP_SDO_SIZE; i++ )
+            sdoBuff[sdoLen++] = req[i+1];
+
+         memset( rsp, 0, 8 );
+         rsp[0] = 0x20 | sdoToggle;
+         sdoToggle ^= 0x10;
+
+         if( req[0] & 1 )
+         {
+            Write( sdoIndex, sdoSub, sdoBuff, sdoLen, t );
+            sdoMode = SIMSDO_IDLE;
+         }
+         break;
+      }
+
+      // Initiate upload.  Block uploads get the normal response,
+      // which tells the client to fall back to a normal upload.
+      case 2:
+      case 5:
+      {
+         if( ccs == 5 && (req[0] & 3) )
+            return;
+
+         sdoLen = Read( index, sub, sdoBuff, SIMAMP_SDO_SIZE );
+         if( sdoLen <= 4 )
+         {
+            rsp[0] = 0x43 | ((4-sdoLen)<<2);
+            memcpy( &rsp[4], sdoBuff, sdoLen );
+            sdoMode = SIMSDO_IDLE;
+         }
+         else
+         {
+            rsp[0] = 0x41;
+            rsp[4] = ByteCast(sdoLen);
+            rsp[5] = ByteCast(sdoLen>>8);
+            sdoPos = 0;
+            sdoToggle = 0;
+            sdoMode = SIMSDO_UPLD;
+         }
+         break;
+      }
+
+      // Upload segment
+      case 3:
+      {
+         if( sdoMode != SIMSDO_UPLD || (req[0] & 0x10) != sdoToggle )
+         {
+            SdoAbort( 0x05030000, t );
+            return;
+         }
+
+         int n = sdoLen - sdoPos;
+         if( n > 7 ) n = 7;
+
+         memset( rsp, 0, 8 );
+         rsp[0] = sdoToggle | ((7-n)<<1);
+         memcpy( &rsp[1], &sdoBuff[sdoPos], n );
+         sdoPos += n;
+         sdoToggle ^= 0x10;
+
+         if( sdoPos >= sdoLen )
+         {
+            rsp[0] |= 1;
+            sdoMode = SIMSDO_IDLE;
+         }
+         break;
+      }
+
+      // Block download
+      case 6:
+         if( !(req[0] & 1) )
+         {
+            sdoIndex = index;
+            sdoSub = sub;
+            sdoLen = 0;
+            blkSeq = 0;
+            sdoMode = SIMSDO_BLKDNLD;
+            rsp[0] = 0xA0;
+            rsp[4] = SIMAMP_BLKSIZE;
+         }
+         else
+         {
+            if( sdoMode != SIMSDO_BLKEND )
+            {
+               SdoAbort( 0x05040001, t );
+               return;
+            }
+
+            // Drop the unused bytes of the last segment
+            sdoLen -= (req[0]>>2) & 7;
+            if( sdoLen < 0 ) sdoLen = 0;
+
+            Write( sdoIndex, sdoSub, sdoBuff, sdoLen, t );
+            sdoMode = SIMSDO_IDLE;
+            memset( rsp, 0, 8 );
+            rsp[0] = 0xA1;
+         }
+         break;
+
+      default:
+         SdoAbort( 0x05040001, t );
+         return;
+   }
+
+   SdoReply( rsp, t );
+}
+
+void SimAmp::SdoReply( uint8 *data, int64 t )
+{
+   CanFrame frame;
+   frame.type = CAN_FRAME_DATA;
+   frame.id = 0x580 + nodeID;
+   frame.length = 8;
+   memcpy( frame.data, data, 8 );
+   bus.Send( this, frame, t, true );
+}
+
+void SimAmp::SdoAbort( uint32 code, int64 t )
+{
+   uint8 rsp[8];
+   rsp[0] = 0x80;
+   rsp[1] = ByteCast(sdoIndex);
+   rsp[2] = ByteCast(sdoIndex>>8);
+   rsp[3] = sdoSub;
+   for( int i=0; i<4; i++ )
+      rsp[4+i] = ByteCast( code >> (8*i) );
+
+   sdoMode = SIMSDO_IDLE;
+   SdoReply( rsp, t );
+}
+
+/***************************************************************************/
+/**
+  Return the status word (object 0x6041).
+  */
+/***************************************************************************/
+uint16 SimAmp::StatusWord( void )
+{
+   static const uint16 stateBits[] = { 0x0070, 0x0031, 0x0033, 0x0037, 0x0017, 0x0038 };
+
+   uint16 s = stateBits[state] | 0x0200;
+
+   if( abortBit ) s |= 0x0100;
+   if( !trjActive && fabs( cmdPos-actPos ) <= SIMAMP_SETTLE ) s |= 0x0400;
+   if( trjActive ) s |= 0x4000;
+
+   if( mode == 6 )
+   {
+      if( referenced ) s |= 0x1000;
+   }
+   else if( state == SIMSTATE_OE && (ctrl & 0x0010) )
+      s |= 0x1000;
+
+   return s;
+}
+
+/***************************************************************************/
+/**
+  Return the event status word (object 0x1002).
+  */
+/***************************************************************************/
+uint32 SimAmp::EventStatus( void )
+{
+   uint32 e = 0;
+
+   if( state != SIMSTATE_OE && state != SIMSTATE_QS )
+      e |= 0x00009000;                      // Software and PWM disable
+
+   if( faults )
+      e |= 0x00400000;
+
+   if( trjActive || fabs( cmdPos-actPos ) > SIMAMP_SETTLE )
+      e |= 0x08000000;
+
+   return e;
+}
+
+/***************************************************************************/
+/**
+  Handle a new control word.  Like the Copley amplifiers, the simulator
+  moves straight to the state the control word asks for.
+  */
+/***************************************************************************/
+void SimAmp::SetControl( uint16 cw )
+{
+   uint16 old = ctrl;
+   ctrl = cw;
+
+   // Fault reset on the rising edge of bit 7
+   if( (cw & 0x0080) && !(old & 0x0080) )
+   {
+      faults = 0;
+      if( state == SIMSTATE_FAULT )
+         NewState( SIMSTATE_SOD );
+   }
+
+   if( state == SIMSTATE_FAULT )
+      return;
+
+   if( !(cw & 0x0002) )
+      NewState( SIMSTATE_SOD );
+
+   else if( !(cw & 0x0004) )
+      NewState( (state == SIMSTATE_OE || state == SIMSTATE_QS) ? SIMSTATE_QS : SIMSTATE_SOD );
+
+   else if( (cw & 0x000F) == 0x000F )
+      NewState( SIMSTATE_OE );
+
+   else if( (cw & 0x0007) == 0x0007 )
+      NewState( SIMSTATE_SO );
+
+   else
+      NewState( SIMSTATE_RTSO );
+
+   if( state != SIMSTATE_OE )
+      return;
+
+   // Halt
+   if( (cw & 0x0100) && !(old & 0x0100) && trjActive )
+   {
+      pvtRun = false;
+      halting = true;
+   }
+
+   // New set point
+   if( (cw & 0x0010) && !(old & 0x0010) && !(cw & 0x0100) )
+      StartMove();
+}
+
+void SimAmp::NewState( int s )
+{
+   if( s == state )
+      return;
+
+   // Anything but enabled stops the trajectory
+   if( state == SIMSTATE_OE )
+      StopMove( true );
+
+   if( s == SIMSTATE_QS )
+      cmdPos = actPos;
+
+   state = s;
+}
+
+/***************************************************************************/
+/**
+  Start a move in the present mode of operation.
+  */
+/***************************************************************************/
+void SimAmp::StartMove( void )
+{
+   abortBit = false;
+   halting = false;
+
+   switch( mode )
+   {
+      case 1:
+      {
+         int32 pos = (int32)Get( 0x607A, 0 );
+         if( ctrl & 0x0040 )
+            target += pos;
+         else
+            target = pos;
+         trjActive = true;
+         break;
+      }
+
+      case 3:
+         trjActive = true;
+         break;
+
+      case 6:
+         referenced = false;
+         homeTime = SIMAMP_HOME_TIME;
+         trjActive = true;
+         break;
+
+      case 7:
+         if( pvtRun || !pvtCt )
+            break;
+
+         cur = pvt[pvtHead];
+         pvtHead = (pvtHead+1) % SIMAMP_MAX_PVT;
+         pvtCt--;
+         bus.stats.pvtDone++;
+
+         cmdPos = target = cur.pos;
+         pvtTime = 0;
+         pvtRun = true;
+         trjActive = true;
+         break;
+   }
+}
+
+void SimAmp::StopMove( bool abort )
+{
+   if( trjActive && abort )
+      abortBit = true;
+
+   trjActive = false;
+   halting = false;
+   pvtRun = false;
+   homeTime = 0;
+   cmdVel = 0;
+   target = cmdPos;
+}
+
+/***************************************************************************/
+/**
+  Update a profile position or profile velocity move by one millisecond.
+  The velocity is the fastest that is within the profile velocity and
+  acceleration limits and still allows a stop at the target.
+  */
+/***************************************************************************/
+void SimAmp::ProfileStep( void )
+{
+   if( !trjActive )
+      return;
+
+   const double dt = 0.001;
+   double vel = 0.1 * (int32)Get( 0x6081, 0 );
+   double acc = 10.0 * (int32)Get( 0x6083, 0 );
+   double dec = 10.0 * (int32)Get( 0x6084, 0 );
+   if( dec <= 0 ) dec = acc;
+
+   int type = (int16)Get( 0x6086, 0 );
+
+   // Velocity moves run until halted
+   if( mode == 3 || type == 2 )
+   {
+      double dir = ((int32)Get( 0x607A, 0 ) < 0) ? -1 : 1;
+      double v = cmdVel;
+      if( v < dir*vel ) v = (v+acc*dt > dir*vel) ? dir*vel : v+acc*dt;
+      else              v = (v-acc*dt < dir*vel) ? dir*vel : v-acc*dt;
+      cmdVel = v;
+      cmdPos += v*dt;
+      target = cmdPos;
+      return;
+   }
+
+   double dist = target - cmdPos;
+   double dir = (dist < 0) ? -1 : 1;
+   double speed = cmdVel * dir;
+
+   // Heading away from the target, so brake first
+   if( speed < 0 )
+      speed += dec*dt;
+   else
+   {
+      double limit = sqrt( 2*dec*fabs(dist) );
+      if( limit > vel ) limit = vel;
+
+      speed += acc*dt;
+      if( speed > limit ) speed = limit;
+   }
+
+   cmdVel = speed * dir;
+   cmdPos += cmdVel * dt;
+
+   if( (target - cmdPos) * dir <= 0.5 && speed >= 0 )
+   {
+      cmdPos = target;
+      cmdVel = 0;
+      trjActive = false;
+   }
+}
+
+/***************************************************************************/
+/**
+  Decelerate to a stop after a halt or an aborted PVT move.
+  */
+/***************************************************************************/
+void SimAmp::HaltStep( void )
+{
+   const double dt = 0.001;
+   double dec = 10.0 * (int32)Get( 0x6084, 0 );
+   if( dec <= 0 ) dec = 10.0 * (int32)Get( 0x6085, 0 );
+
+   double dv = dec*dt;
+   if( dv <= 0 || fabs(cmdVel) <= dv )
+   {
+      cmdVel = 0;
+      trjActive = false;
+      halting = false;
+      target = cmdPos;
+      return;
+   }
+
+   cmdVel -= (cmdVel > 0) ? dv : -dv;
+   cmdPos += cmdVel*dt;
+}
+
+/***************************************************************************/
+/**
+  Handle a write to the PVT buffer (object 0x2010).  This is either a
+  buffer command or a new segment.
+  */
+/***************************************************************************/
+void SimAmp::PvtWrite( const uint8 *data )
+{
+   if( data[0] & 0x80 )
+   {
+      switch( data[0] )
+      {
+         // Flush the buffer, aborting any PVT move in progress
+         case 0x80:
+            pvtCt = 0;
+            if( pvtRun ) StopMove( true );
+            break;
+
+         // Pop the most recently sent segments
+         case 0x81:
+         {
+            int n = data[1] | (data[2]<<8);
+            if( n > pvtCt ) n = pvtCt;
+            pvtCt -= n;
+            pvtNext -= n;
+            if( pvtCt )
+               pvtLast = pvt[ (pvtHead+pvtCt-1) % SIMAMP_MAX_PVT ].pos;
+            break;
+         }
+
+         // Clear errors
+         case 0x82:
+            pvtErr &= ~data[1];
+            break;
+      }
+      return;
+   }
+
+   if( pvtErr & PVTERR_SEQUENCE )
+   {
+      bus.stats.pvtSeqErrors++;
+      return;
+   }
+
+   if( (data[0] & 7) != (pvtNext & 7) )
+   {
+      pvtErr |= PVTERR_SEQUENCE;
+      bus.stats.pvtSeqErrors++;
+      return;
+   }
+
+   int format = (data[0] >> 3) & 0x0F;
+
+   // Initial position for following relative segments
+   if( format == 4 )
+   {
+      pvtLast = Bytes2Int( &data[1], 4 );
+      pvtNext++;
+      return;
+   }
+
+   if( pvtCt >= pvtSize )
+   {
+      pvtErr |= PVTERR_OVERFLOW;
+      bus.stats.pvtOverflows++;
+      return;
+   }
+
+   Seg &s = pvt[ (pvtHead+pvtCt) % SIMAMP_MAX_PVT ];
+   s.time = data[1];
+
+   if( format == 5 )
+   {
+      s.pos = Bytes2Int( &data[2], 4 );
+      s.vel = 0;
+      s.pt = true;
+   }
+   else
+   {
+      s.pos = Int24( &data[2] );
+      if( format & 2 ) s.pos += pvtLast;
+      s.vel = Int24( &data[5] ) * ((format & 1) ? 10.0 : 0.1);
+      s.pt = false;
+   }
+
+   pvtLast = s.pos;
+   pvtCt++;
+   pvtNext++;
+   bus.stats.pvtSegs++;
+}
+
+/***************************************************************************/
+/**
+  Return the PVT buffer status word (object 0x2012).
+  */
+/***************************************************************************/
+uint32 SimAmp::PvtStatus( void )
+{
+   uint32 s = pvtNext | ((uint32)(pvtSize-pvtCt) << 16) | ((uint32)pvtErr << 24);
+   if( !pvtCt ) s |= 0x80000000;
+   return s;
+}
+
+/***************************************************************************/
+/**
+  Update a PVT move by one millisecond.  Each segment runs from its own
+  position and velocity to those of the next segment in the buffer, on a
+  cubic for PVT segments and a straight line for PT segments.  If the next
+  segment hasn't arrived in time the move is aborted with an underflow.
+  */
+/***************************************************************************/
+void SimAmp::PvtStep( void )
+{
+   if( !pvtRun )
+      return;
+
+   pvtTime++;
+
+   while( 1 )
+   {
+      // A segment with no time ends the move
+      if( !cur.time )
+      {
+         cmdPos = target = cur.pos;
+         cmdVel = 0;
+         pvtRun = false;
+         trjActive = false;
+         return;
+      }
+
+      if( !pvtCt )
+      {
+         pvtErr |= PVTERR_UNDERFLOW;
+         bus.stats.pvtUnderflows++;
+         StopMove( true );
+         return;
+      }
+
+      if( pvtTime < cur.time )
+         break;
+
+      pvtTime -= cur.time;
+      cur = pvt[pvtHead];
+      pvtHead = (pvtHead+1) % SIMAMP_MAX_PVT;
+      pvtCt--;
+      bus.stats.pvtDone++;
+   }
+
+   Seg &next = pvt[pvtHead];
+   double T = cur.time * 0.001;
+   double s = (double)pvtTime / cur.time;
+
+   if( cur.pt )
+   {
+      cmdPos = cur.pos + (next.pos - cur.pos) * s;
+      cmdVel = (next.pos - cur.pos) / T;
+      return;
+   }
+
+   double s2 = s*s, s3 = s2*s;
+   cmdPos = (2*s3 - 3*s2 + 1) * cur.pos + (s3 - 2*s2 + s) * T * cur.vel +
+            (3*s2 - 2*s3) * next.pos + (s3 - s2) * T * next.vel;
+   cmdVel = ((6*s2 - 6*s) * (cur.pos - next.pos)) / T +
+            (3*s2 - 4*s + 1) * cur.vel + (3*s2 - 2*s) * next.vel;
+   target = cmdPos;
+}
+
+/***************************************************************************/
+/**
+  Convert little endian bytes to a signed integer.
+  */
+/***************************************************************************/
+static int32 Bytes2Int( const uint8 *b, int len )
+{
+   uint32 v = 0;
+   for( int i=len-1; i>=0; i-- )
+      v = (v<<8) | b[i];
+   return (int32)v;
+}
+
+/***************************************************************************/
+/**
+  Convert three little endian bytes to a sign extended integer.
+  */
+/***************************************************************************/
+static int32 Int24( const uint8 *b )
+{
+   int32 v = Bytes2Int( b, 3 );
+   if( v & 0x00800000 ) v |= 0xFF000000;
+   return v;
+}
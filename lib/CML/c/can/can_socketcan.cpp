@@ -0,0 +1,535 @@
+/********************************************************/
+/*                                                      */
+/*  Copley Motion Libraries                             */
+/*                                                      */
+/*  Copyright (c) 2002 Copley Controls Corp.            */
+/*                     http://www.copleycontrols.com    */
+/*                                                      */
+/********************************************************/
+
+/*
+   CAN object for the Linux SocketCAN network stack.
+   */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <net/if.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+
+#include "can_socketcan.h"
+#include "CML.h"
+
+CML_NAMESPACE_USE();
+
+// Maximum number of frames passed to the kernel in one call
+#define SOCKETCAN_BATCH         32
+
+// Space for the time stamp control message of each received frame
+#define CTRL_LEN                CMSG_SPACE( 3*sizeof(struct timespec) )
+
+/* local functions */
+static void ConvertFrame( CanFrame &frame, struct can_frame &cf, struct msghdr &msg );
+
+/***************************************************************************/
+/**
+  Construct a default CAN object.
+  The CAN interface is closed initially, and no port name is selected.
+  */
+/***************************************************************************/
+SocketCAN::SocketCAN( void ) : CanInterface()
+{
+   baud = 1000000;
+   open = false;
+   fd = -1;
+   wakeFd[0] = wakeFd[1] = -1;
+   readers = 0;
+}
+
+/***************************************************************************/
+/**
+  Construct a CAN object with a specified port name.
+  The port name is the name of the SocketCAN network interface, for 
+  example can0 or vcan0.
+  @param port The port name string identifying the CAN device.
+  */
+/***************************************************************************/
+SocketCAN::SocketCAN( const char *port ) : CanInterface(port)
+{
+   baud = 1000000;
+   open = false;
+   fd = -1;
+   wakeFd[0] = wakeFd[1] = -1;
+   readers = 0;
+}
+
+/***************************************************************************/
+/**
+  Destructor.  This closes the CAN port.
+  */
+/***************************************************************************/
+SocketCAN::~SocketCAN( void ) 
+{
+   Close();
+}
+
+/***************************************************************************/
+/**
+  Open the SocketCAN port.  The network interface must already be up.
+  If the port name is not set, it will default to can0.
+
+  @return A pointer to an error object on failure, NULL on success.
+  */
+/***************************************************************************/
+const Error *SocketCAN::Open( void )
+{
+   MutexLocker ml( mutex );
+
+   if( open )
+      return &CanError::AlreadyOpen;
+
+   const char *name = portName ? portName : "can0";
+   if( strlen(name) >= IFNAMSIZ )
+      return &CanError::BadPortName;
+
+   fd = socket( PF_CAN, SOCK_RAW, CAN_RAW );
+   if( fd < 0 )
+   {
+      cml.Error( "SocketCAN: unable to create CAN socket: %s\n", strerror(errno) );
+      return ConvertError( errno );
+   }
+
+   struct ifreq ifr;
+   memset( &ifr, 0, sizeof(ifr) );
+   strcpy( ifr.ifr_name, name );
+
+   const Error *err = 0;
+   if( ioctl( fd, SIOCGIFINDEX, &ifr ) < 0 )
+      err = &CanError::BadPortName;
+
+   struct sockaddr_can addr;
+   memset( &addr, 0, sizeof(addr) );
+   addr.can_family  = AF_CAN;
+   addr.can_ifindex = ifr.ifr_ifindex;
+
+   if( !err && bind( fd, (struct sockaddr *)&addr, sizeof(addr) ) < 0 )
+      err = ConvertError( errno );
+
+   // Pass error frames up so they can be counted
+   can_err_mask_t errMask = CAN_ERR_MASK;
+   if( !err ) setsockopt( fd, SOL_CAN_RAW, CAN_RAW_ERR_FILTER, &errMask, sizeof(errMask) );
+
+   // Ask for hardware time stamps, falling back to the kernel's 
+   // own receive time if the adapter doesn't provide them.
+   if( !err )
+   {
+      int ts = SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE |
+               SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+      if( setsockopt( fd, SOL_SOCKET, SO_TIMESTAMPING, &ts, sizeof(ts) ) < 0 )
+      {
+         ts = 1;
+         setsockopt( fd, SOL_SOCKET, SO_TIMESTAMPNS, &ts, sizeof(ts) );
+      }
+   }
+
+   if( !err && pipe( wakeFd ) < 0 )
+   {
+      wakeFd[0] = wakeFd[1] = -1;
+      err = &CanError::Alloc;
+   }
+
+   if( err )
+   {
+      cml.Error( "SocketCAN: unable to open %s: %s\n", name, err->toString() );
+      close( fd );
+      fd = -1;
+      return err;
+   }
+
+   open = true;
+   return 0;
+}
+
+/***************************************************************************/
+/**
+  Close the CAN interface.  Any threads waiting to read from the port are 
+  woken up, and the socket is closed once they have returned.
+  @return A pointer to an error object on failure, NULL on success.
+  */
+/***************************************************************************/
+const Error *SocketCAN::Close( void )
+{
+   MutexLocker ml( mutex );
+
+   if( !open )
+      return 0;
+
+   open = false;
+
+   // Wake up any reading threads and wait for them to leave
+   char ch = 0;
+   if( write( wakeFd[1], &ch, 1 ) < 0 ) {}
+
+   while( readers > 0 )
+      Thread::sleep( 1 );
+
+   close( fd );
+   close( wakeFd[0] );
+   close( wakeFd[1] );
+   fd = -1;
+   wakeFd[0] = wakeFd[1] = -1;
+   return 0;
+}
+
+/***************************************************************************/
+/**
+  Set the CAN interface baud rate.  SocketCAN interfaces have their bit rate
+  set when the network interface is configured (see the class description),
+  so this only checks the value and keeps a copy.
+  @param b The baud rate to set.
+  @return A pointer to an error object on failure, NULL on success.
+  */
+/***************************************************************************/
+const Error *SocketCAN::SetBaud( int32 b )
+{
+   if( b <= 0 || b > 1000000 )
+      return &CanError::BadBaud;
+
+   baud = b;
+   return 0;
+}
+
+/***************************************************************************/
+/**
+  Set the frames this socket receives.  The filters are passed to the 
+  kernel, so frames that don't match them never reach the program.
+  @param id Array of message IDs to receive.
+  @param mask Array of masks giving the bits of each ID to check.
+  @param ct The number of filters.  If zero, all frames are received.
+  @return A pointer to an error object on failure, NULL on success.
+  */
+/***************************************************************************/
+const Error *SocketCAN::SetRecvFilter( const uint32 id[], const uint32 mask[], int ct )
+{
+   if( ct < 0 || ct > CAN_RAW_FILTER_MAX )
+      return &CanError::BadParam;
+
+   MutexLocker ml( mutex );
+   if( !open )
+      return &CanError::NotOpen;
+
+   struct can_filter *filter = new struct can_filter[ ct ? ct : 1 ];
+   if( !filter ) return &CanError::Alloc;
+
+   for( int i=0; i<ct; i++ )
+   {
+      filter[i].can_id   = id[i] & CAN_EFF_MASK;
+      filter[i].can_mask = mask[i] & CAN_EFF_MASK;
+
+      if( id[i] & 0x20000000 )   filter[i].can_id   |= CAN_EFF_FLAG;
+      if( mask[i] & 0x20000000 ) filter[i].can_mask |= CAN_EFF_FLAG;
+   }
+
+   // A single filter with a zero mask passes everything
+   if( !ct )
+   {
+      filter[0].can_id = 0;
+      filter[0].can_mask = 0;
+      ct = 1;
+   }
+
+   int ret = setsockopt( fd, SOL_CAN_RAW, CAN_RAW_FILTER, filter, ct * sizeof(struct can_filter) );
+   delete[] filter;
+
+   return (ret < 0) ? ConvertError( errno ) : 0;
+}
+
+/***************************************************************************/
+/**
+  Receive the next CAN frame.  
+  @param frame A reference to the frame object that will be filled by the read.
+  @param timeout The timeout (ms) to wait for the frame.  A timeout of 0 will
+  return immediately if no data is available.  A timeout of < 0 will 
+  wait forever.
+  @return A pointer to an error object on failure, NULL on success.
+  */
+/***************************************************************************/
+const Error *SocketCAN::RecvFrame( CanFrame &frame, Timeout timeout )
+{
+   int ct;
+   return RecvFrames( &frame, 1, ct, timeout );
+}
+
+/***************************************************************************/
+/**
+  Receive all waiting CAN frames, up to a maximum count.  This waits for the
+  socket to become readable, then takes every frame that's queued (up to the
+  maximum) with a single recvmmsg call.
+  @param frame An array of at least max frames to be filled by the read.
+  @param max The maximum number of frames to read.
+  @param ct Returns the number of frames read.
+  @param timeout The timeout (ms) to wait for the first frame.  A timeout of 0 will
+  return immediately if no data is available.  A timeout of < 0 will 
+  wait forever.
+  @return A pointer to an error object on failure, NULL on success.
+  */
+/***************************************************************************/
+const Error *SocketCAN::RecvFrames( CanFrame frame[], int max, int &ct, Timeout timeout )
+{
+   ct = 0;
+   if( max > SOCKETCAN_BATCH ) max = SOCKETCAN_BATCH;
+
+   readers++;
+   if( !open )
+   {
+      readers--;
+      return &CanError::NotOpen;
+   }
+
+   if( timeout )
+   {
+      struct pollfd pfd[2];
+      pfd[0].fd = fd;
+      pfd[0].events = POLLIN;
+      pfd[1].fd = wakeFd[0];
+      pfd[1].events = POLLIN;
+
+      int ret = poll( pfd, 2, (timeout < 0) ? -1 : timeout );
+
+      if( ret <= 0 || !(pfd[0].revents & POLLIN) )
+      {
+         readers--;
+         if( !open ) return &CanError::NotOpen;
+         if( ret < 0 && errno != EINTR ) return ConvertError( errno );
+         return &CanError::Timeout;
+      }
+   }
+
+   struct can_frame cf[ SOCKETCAN_BATCH ];
+   struct iovec iov[ SOCKETCAN_BATCH ];
+   struct mmsghdr msg[ SOCKETCAN_BATCH ];
+   char ctrl[ SOCKETCAN_BATCH ][ CTRL_LEN ];
+
+   memset( msg, 0, max*sizeof(struct mmsghdr) );
+   for( int i=0; i<max; i++ )
+   {
+      iov[i].iov_base = &cf[i];
+      iov[i].iov_len  = sizeof(struct can_frame);
+      msg[i].msg_hdr.msg_iov        = &iov[i];
+      msg[i].msg_hdr.msg_iovlen     = 1;
+      msg[i].msg_hdr.msg_control    = ctrl[i];
+      msg[i].msg_hdr.msg_controllen = CTRL_LEN;
+   }
+
+   int n = recvmmsg( fd, msg, max, MSG_DONTWAIT, 0 );
+   int err = errno;
+   readers--;
+
+   if( n <= 0 )
+   {
+      if( n == 0 || err == EAGAIN || err == EWOULDBLOCK || err == EINTR )
+         return &CanError::Timeout;
+      return ConvertError( err );
+   }
+
+   for( int i=0; i<n; i++ )
+      ConvertFrame( frame[i], cf[i], msg[i].msg_hdr );
+
+   ct = n;
+   return 0;
+}
+
+/***************************************************************************/
+/**
+  Write a CAN frame to the CAN network.
+  @param frame A reference to the frame to write.
+  @param timeout The time to wait for the frame to be queued if the 
+  transmit queue is full.  If 0, an error is returned immediately when 
+  the queue is full.  If <0, the function will delay forever.
+  @return A pointer to an error object on failure, NULL on success.
+  */
+/***************************************************************************/
+const Error *SocketCAN::XmitFrame( CanFrame &frame, Timeout timeout )
+{
+   return XmitFrames( &frame, 1, timeout );
+}
+
+/***************************************************************************/
+/**
+  Write a block of CAN frames to the CAN network with a single sendmmsg 
+  call.  The frames are queued in order.
+  @param frame An array of frames to write.
+  @param ct The number of frames to write.
+  @param timeout The time to wait for room in the transmit queue, as for
+  XmitFrame.
+  @return A pointer to an error object on failure, NULL on success.
+  */
+/***************************************************************************/
+const Error *SocketCAN::XmitFrames( CanFrame frame[], int ct, Timeout timeout )
+{
+   // Process the frames in groups small enough for the local arrays
+   if( ct > SOCKETCAN_BATCH )
+   {
+      for( int i=0; i<ct; i+=SOCKETCAN_BATCH )
+      {
+         const Error *err = XmitFrames( &frame[i], (ct-i > SOCKETCAN_BATCH) ? SOCKETCAN_BATCH : ct-i, timeout );
+         if( err ) return err;
+      }
+      return 0;
+   }
+
+   struct can_frame cf[ SOCKETCAN_BATCH ];
+   struct iovec iov[ SOCKETCAN_BATCH ];
+   struct mmsghdr msg[ SOCKETCAN_BATCH ];
+
+   memset( cf, 0, ct*sizeof(struct can_frame) );
+   memset( msg, 0, ct*sizeof(struct mmsghdr) );
+
+   for( int i=0; i<ct; i++ )
+   {
+      if( frame[i].length > 8 )
+         return &CanError::BadParam;
+
+      const Error *err = ChkID( frame[i].id );
+      if( err ) return err;
+
+      if( frame[i].id & 0x20000000 )
+         cf[i].can_id = (frame[i].id & CAN_EFF_MASK) | CAN_EFF_FLAG;
+      else
+         cf[i].can_id = frame[i].id & CAN_SFF_MASK;
+
+      switch( frame[i].type )
+      {
+         case CAN_FRAME_DATA:   break;
+         case CAN_FRAME_REMOTE: cf[i].can_id |= CAN_RTR_FLAG; break;
+         default:
+            return &CanError::BadParam;
+      }
+
+      cf[i].can_dlc = frame[i].length;
+      memcpy( cf[i].data, frame[i].data, frame[i].length );
+
+      iov[i].iov_base = &cf[i];
+      iov[i].iov_len  = sizeof(struct can_frame);
+      msg[i].msg_hdr.msg_iov    = &iov[i];
+      msg[i].msg_hdr.msg_iovlen = 1;
+   }
+
+   if( !open )
+      return &CanError::NotOpen;
+
+   // The kernel reports a full transmit queue with ENOBUFS, which
+   // can't be waited for, so retry each millisecond until the timeout.
+   int sent = 0;
+   int64 start = Thread::getTimeNS();
+   while( sent < ct )
+   {
+      int n = sendmmsg( fd, &msg[sent], ct-sent, MSG_DONTWAIT );
+      if( n > 0 )
+      {
+         sent += n;
+         continue;
+      }
+
+      if( errno != ENOBUFS && errno != EAGAIN && errno != EINTR )
+         return ConvertError( errno );
+
+      if( !timeout || (timeout > 0 && Thread::getTimeNS()-start >= (int64)timeout*1000000) )
+         return &CanError::Overflow;
+
+      Thread::sleep( 1 );
+      if( !open )
+         return &CanError::NotOpen;
+   }
+
+   return 0;
+}
+
+/***************************************************************************/
+/**
+  Convert errno values returned by the socket calls into the standard 
+  error codes used by the motion library.
+  @param err The errno value.
+  @return A pointer to an error object.
+  */
+/***************************************************************************/
+const Error *SocketCAN::ConvertError( int err )
+{
+   switch( err )
+   {
+      case 0:             return 0;
+      case EACCES:        
+      case EPERM:         return &CanError::Permission;
+      case ENODEV:
+      case ENXIO:         return &CanError::BadPortName;
+      case EAFNOSUPPORT:
+      case EPROTONOSUPPORT: return &CanError::NoDriver;
+      case ENOBUFS:       return &CanError::Overflow;
+      case ENETDOWN:      return &CanError::BusOff;
+      case ENOMEM:        return &CanError::Alloc;
+      case EINVAL:        return &CanError::BadParam;
+      case EBADF:         return &CanError::NotOpen;
+      default:            return &CanError::Driver;
+   }
+}
+
+/***************************************************************************/
+/**
+  Fill in a library frame from a frame read from the socket.
+  @param frame The frame to fill in.
+  @param cf The frame read from the socket.
+  @param msg The message header, which holds the receive time stamp.
+  */
+/***************************************************************************/
+static void ConvertFrame( CanFrame &frame, struct can_frame &cf, struct msghdr &msg )
+{
+   // indicate an extended frame by turning on bit 29 of the frame id
+   if( cf.can_id & CAN_EFF_FLAG )
+      frame.id = (cf.can_id & CAN_EFF_MASK) | 0x20000000;
+   else
+      frame.id = cf.can_id & CAN_SFF_MASK;
+
+   // Set the frame type
+   if( cf.can_id & CAN_ERR_FLAG )
+      frame.type = CAN_FRAME_ERROR;
+
+   else if( cf.can_id & CAN_RTR_FLAG )
+      frame.type = CAN_FRAME_REMOTE;
+
+   else
+      frame.type = CAN_FRAME_DATA;
+
+   frame.length = (cf.can_dlc > 8) ? 8 : cf.can_dlc;
+   memcpy( frame.data, cf.data, 8 );
+
+   // Use the hardware time stamp if there is one, else the
+   // time the kernel received the frame.
+   struct timespec *ts = 0;
+   for( struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg,c) )
+   {
+      if( c->cmsg_level != SOL_SOCKET )
+         continue;
+
+      if( c->cmsg_type == SO_TIMESTAMPING )
+      {
+         struct timespec *t = (struct timespec *)CMSG_DATA(c);
+         ts = (t[2].tv_sec || t[2].tv_nsec) ? &t[2] : &t[0];
+      }
+      else if( c->cmsg_type == SO_TIMESTAMPNS )
+         ts = (struct timespec *)CMSG_DATA(c);
+   }
+
+   if( ts )
+      frame.timestamp = (uint32)( (int64)ts->tv_sec * 1000000 + ts->tv_nsec / 1000 );
+   else
+      frame.timestamp = 0;
+}
+
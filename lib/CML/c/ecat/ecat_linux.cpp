@@ -1,10 +1,12 @@
 #include <errno.h>
 #include <string.h>
 #include <unistd.h>
+#include <poll.h>
 #include <net/if.h>
 #include <netinet/in.h>
-#include <netpacket/packet.h>
+#include <linux/if_packet.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 
@@ -15,6 +17,16 @@ CML_NAMESPACE_USE();
 
 #define ETHERCAT_PROTOCOL    0x88A4
 
+// Size of each frame slot in the packet rings.  This holds the
+// ring header, the link level address and a full Ethernet frame.
+#define RING_FRAME_SIZE      2048
+
+// Offset of the packet data from the start of a transmit slot
+#define TX_DATA_OFFSET       (TPACKET2_HDRLEN - sizeof(struct sockaddr_ll))
+
+// Longest time (ms) to wait for the kernel to free a transmit slot
+#define TX_SLOT_TIMEOUT      100
+
 LinuxEcatHardware::LinuxEcatHardware( const char *name )
 {
    if( !name ) name = "eth0";
@@ -22,6 +34,13 @@ LinuxEcatHardware::LinuxEcatHardware( const char *name )
    fd = -1;
    ifname = CloneString( name );
 
+   useRings = true;
+   ringFrames = 256;
+   ring = 0;
+   ringLen = 0;
+   frameSize = RING_FRAME_SIZE;
+   rxNext = txNext = 0;
+
    SetRefName( "LinuxEcatHw" );
 }
 
@@ -33,11 +52,40 @@ LinuxEcatHardware::~LinuxEcatHardware( void )
    ifname = 0;
 }
 
+/**
+  Choose between memory mapped packet rings and ordinary socket reads
+  and writes.  This takes effect the next time the port is opened.
+
+  @param enable True to use packet rings if the kernel supports them.
+  @param frames Number of frames in each of the receive and transmit rings.
+*/
+void LinuxEcatHardware::SetRingMode( bool enable, int frames )
+{
+   if( frames < 2 ) frames = 2;
+   useRings = enable;
+   ringFrames = frames;
+}
+
 const Error *LinuxEcatHardware::Open( void )
 {
    // If the port is already open, just return success
    if( fd >= 0 ) return 0;
 
+   const Error *err = OpenSocket();
+   if( err || !useRings ) return err;
+
+   err = OpenRings();
+   if( !err ) return 0;
+
+   // The rings can't be removed from a socket once set up, so
+   // start again with a fresh one.
+   cml.Warn( "Unable to map packet rings for %s, using socket reads and writes\n", ifname );
+   Close();
+   return OpenSocket();
+}
+
+const Error *LinuxEcatHardware::OpenSocket( void )
+{
    fd = socket( PF_PACKET, SOCK_RAW, htons(ETHERCAT_PROTOCOL) );
 
    if( fd < 0 )
@@ -59,6 +107,7 @@ const Error *LinuxEcatHardware::Open( void )
    ifindex = r.ifr_ifindex;
 
    struct sockaddr_ll ll;
+   memset( &ll, 0, sizeof(ll) );
    ll.sll_family = AF_PACKET;
    ll.sll_protocol = htons(ETHERCAT_PROTOCOL);
    ll.sll_ifindex = ifindex;
@@ -70,17 +119,118 @@ const Error *LinuxEcatHardware::Open( void )
       return &EtherCatError::OpenHardware;
    }
 
+   // Don't bother reading back the frames I send.  Older kernels
+   // don't support this, the read thread discards them anyway.
+#ifdef PACKET_IGNORE_OUTGOING
+   int one = 1;
+   setsockopt( fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &one, sizeof(one) );
+#endif
+
    return 0;
 }
 
+/*
+ * Set up memory mapped receive and transmit rings on the open socket.
+ * The version 2 ring format is used because the kernel hands each received
+ * frame over as soon as it arrives.  With version 3 frames are only handed
+ * over a block at a time, or when the block timer expires, which would
+ * delay every reply by up to a millisecond.
+ */
+const Error *LinuxEcatHardware::OpenRings( void )
+{
+   int ver = TPACKET_V2;
+   if( setsockopt( fd, SOL_PACKET, PACKET_VERSION, &ver, sizeof(ver) ) < 0 )
+   {
+      cml.Debug( "LinuxEcatHardware: PACKET_VERSION failed: %s\n", strerror(errno) );
+      return &EtherCatError::OpenHardware;
+   }
+
+   // Have the kernel skip any badly formed transmit frames rather than
+   // stopping the transmit ring on them.
+   int one = 1;
+   setsockopt( fd, SOL_PACKET, PACKET_LOSS, &one, sizeof(one) );
+
+   // Blocks must be a whole number of pages, and hold a whole number of frames
+   int page = getpagesize();
+   int blockSize = page * ((frameSize + page - 1) / page);
+   int perBlock = blockSize / frameSize;
+
+   ringFrames = perBlock * ((ringFrames + perBlock - 1) / perBlock);
+
+   struct tpacket_req req;
+   req.tp_block_size = blockSize;
+   req.tp_block_nr   = ringFrames / perBlock;
+   req.tp_frame_size = frameSize;
+   req.tp_frame_nr   = ringFrames;
+
+   if( setsockopt( fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req) ) < 0 ||
+       setsockopt( fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req) ) < 0 )
+   {
+      cml.Debug( "LinuxEcatHardware: unable to set up packet rings: %s\n", strerror(errno) );
+      return &EtherCatError::OpenHardware;
+   }
+
+   ringLen = 2 * (size_t)blockSize * req.tp_block_nr;
+   void *map = mmap( 0, ringLen, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0 );
+   if( map == MAP_FAILED )
+   {
+      cml.Debug( "LinuxEcatHardware: unable to map packet rings: %s\n", strerror(errno) );
+      ringLen = 0;
+      return &EtherCatError::OpenHardware;
+   }
+
+   ring = (uint8 *)map;
+   rxNext = txNext = 0;
+
+   // Send straight to the driver, the EtherCAT port has no other traffic
+   // that queuing disciplines could usefully shape.
+#ifdef PACKET_QDISC_BYPASS
+   setsockopt( fd, SOL_PACKET, PACKET_QDISC_BYPASS, &one, sizeof(one) );
+#endif
+
+   return 0;
+}
+
+void LinuxEcatHardware::CloseRings( void )
+{
+   if( ring )
+      munmap( ring, ringLen );
+   ring = 0;
+   ringLen = 0;
+}
+
 const Error *LinuxEcatHardware::Close( void )
 {
+   CloseRings();
    if( fd >= 0 )
       close(fd);
    fd = -1;
    return 0;
 }
 
+/*
+ * Wait for the socket to become readable or writable.
+ */
+const Error *LinuxEcatHardware::WaitReady( short events, Timeout timeout )
+{
+   struct pollfd p;
+   p.fd = fd;
+   p.events = events;
+   p.revents = 0;
+
+   int32 to = (int32)timeout;
+   int ret = poll( &p, 1, (to < 0) ? -1 : to );
+
+   if( ret > 0 )
+      return 0;
+
+   if( ret == 0 || errno == EINTR )
+      return &ThreadError::Timeout;
+
+   cml.Error( "Error waiting on ethernet socket: %s\n", strerror(errno) );
+   return (events & POLLIN) ? &EtherCatError::ReadHardware : &EtherCatError::WriteHardware;
+}
+
 const Error *LinuxEcatHardware::SendPacket( uchar *msg, uint16 len )
 {
    CML_ASSERT( msg != 0 );
@@ -88,51 +238,84 @@ const Error *LinuxEcatHardware::SendPacket( uchar *msg, uint16 len )
 
    if( fd < 0 ) return &EtherCatError::EcatNotInit;
 
-   struct sockaddr_ll ll;
-   memset( &ll, 0, sizeof(ll) );
+   // The socket is bound to the interface and the frame already holds
+   // the destination address, so there's no need to pass one.
+   if( !ring )
+   {
+      send( fd, msg, len, 0 );
+      return 0;
+   }
 
-   ll.sll_ifindex = ifindex;
-   ll.sll_family  = AF_PACKET;
-   ll.sll_halen   = 6;
-   memcpy( ll.sll_addr, msg, 6 );
+   if( len > frameSize - TX_DATA_OFFSET )
+      return &EtherCatError::WriteHardware;
+
+   txMutex.Lock();
+
+   // Wait for the kernel to finish sending whatever was last in this slot.
+   struct tpacket2_hdr *h = (struct tpacket2_hdr *)TxSlot( txNext );
+   while( h->tp_status != TP_STATUS_AVAILABLE )
+   {
+      const Error *err = WaitReady( POLLOUT, TX_SLOT_TIMEOUT );
+      if( err )
+      {
+         txMutex.Unlock();
+         cml.Error( "Timeout waiting for ethernet transmit ring\n" );
+         return &EtherCatError::WriteHardware;
+      }
+   }
+
+   memcpy( (uint8 *)h + TX_DATA_OFFSET, msg, len );
+   h->tp_len = len;
+   __sync_synchronize();
+   h->tp_status = TP_STATUS_SEND_REQUEST;
+
+   if( ++txNext == ringFrames )
+      txNext = 0;
+
+   // Kick the kernel to send everything queued in the ring.  It doesn't
+   // need to wait for the frames to go out on the wire.
+   int ret = send( fd, 0, 0, MSG_DONTWAIT );
+   txMutex.Unlock();
+
+   if( ret < 0 && errno != EAGAIN && errno != ENOBUFS )
+   {
+      cml.Error( "Error writing to ethernet socket: %s\n", strerror(errno) );
+      return &EtherCatError::WriteHardware;
+   }
 
-   sendto( fd, msg, len, 0, (const sockaddr *)&ll, sizeof(ll) );
    return 0;
 }
 
 const Error *LinuxEcatHardware::RecvPacket( uchar *msg, uint16 *len, Timeout to )
 {
-   int32 timeout = (int32)to;
-   int flags = 0;
-
    if( fd < 0 ) return &EtherCatError::EcatNotInit;
 
-   if( timeout == 0 )
-      flags |= MSG_DONTWAIT;
+   const Error *err;
 
-   else
+   // With the rings in use, just copy out of the receive ring
+   if( ring )
    {
-      struct timeval tv;
-
-      tv.tv_sec = 0;
-      if( timeout < 0 )
-         tv.tv_usec = 0;
-      else if( timeout < 1000 )
-         tv.tv_usec = 1000 * timeout;
-      else
-      {
-         tv.tv_sec = timeout / 1000;
-         tv.tv_usec = 1000 * (timeout % 1000);
-      }
+      uchar *pkt;
+      uint16 ct;
+      err = RecvPacketInPlace( &pkt, &ct, to );
+      if( err ) return err;
 
-      if( setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv) ) < 0 )
-      {
-         cml.Error( "Error setting timeout for ethernet socket read: %s\n", strerror(errno) );
-         return &EtherCatError::ReadHardware;
-      }
+      if( ct > *len ) ct = *len;
+      memcpy( msg, pkt, ct );
+      *len = ct;
+      ReleasePacket( pkt );
+      return 0;
    }
 
-   int ret = recv( fd, msg, *len, flags );
+   // Wait for a frame with poll rather than setting a socket timeout on
+   // every read.
+   if( to != 0 )
+   {
+      err = WaitReady( POLLIN, to );
+      if( err ) return err;
+   }
+
+   int ret = recv( fd, msg, *len, MSG_DONTWAIT );
 
    if( ret < 0 )
    {
@@ -146,3 +329,68 @@ const Error *LinuxEcatHardware::RecvPacket( uchar *msg, uint16 *len, Timeout to
    return 0;
 }
 
+/**
+  Receive a packet, leaving it in the receive ring.  If the rings aren't in
+  use the packet is read into the passed buffer instead.  Either way it must
+  be returned with ReleasePacket once it has been processed, and no other
+  packet may be received until then.
+
+  @param msg On entry points to a buffer the packet may be read into.  On
+         return points to the packet.
+  @param len On entry holds the size of the buffer, on return the size of
+         the packet.
+  @param to The timeout (ms) to wait for a packet.
+  @return An error object pointer or NULL on success
+*/
+const Error *LinuxEcatHardware::RecvPacketInPlace( uchar **msg, uint16 *len, Timeout to )
+{
+   if( fd < 0 ) return &EtherCatError::EcatNotInit;
+
+   if( !ring )
+      return RecvPacket( *msg, len, to );
+
+   struct tpacket2_hdr *h;
+   for( ;; )
+   {
+      h = (struct tpacket2_hdr *)RxSlot( rxNext );
+      if( !(h->tp_status & TP_STATUS_USER) )
+      {
+         const Error *err = WaitReady( POLLIN, to );
+         if( err ) return err;
+         continue;
+      }
+
+      // Don't look at the frame until the kernel's status write is visible
+      __sync_synchronize();
+
+      // Skip frames I sent, and any too large to have been captured whole.
+      struct sockaddr_ll *ll = (struct sockaddr_ll *)((uint8 *)h + TPACKET_ALIGN(sizeof(*h)));
+      if( ll->sll_pkttype != PACKET_OUTGOING && h->tp_snaplen == h->tp_len )
+         break;
+
+      ReleasePacket( (uint8 *)h + h->tp_mac );
+   }
+
+   *msg = (uint8 *)h + h->tp_mac;
+   *len = h->tp_snaplen;
+   return 0;
+}
+
+/**
+  Return a packet received by RecvPacketInPlace to the receive ring.
+
+  @param msg The packet pointer returned by RecvPacketInPlace
+*/
+void LinuxEcatHardware::ReleasePacket( uchar *msg )
+{
+   // Packets read into the caller's buffer have nothing to give back
+   if( !ring || msg < RxSlot(0) || msg >= RxSlot(ringFrames) )
+      return;
+
+   struct tpacket2_hdr *h = (struct tpacket2_hdr *)RxSlot( rxNext );
+   __sync_synchronize();
+   h->tp_status = TP_STATUS_KERNEL;
+
+   if( ++rxNext == ringFrames )
+      rxNext = 0;
+}
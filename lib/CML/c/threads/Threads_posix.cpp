@@ -15,8 +15,17 @@
 #include <pthread.h>
 #include <semaphore.h>
 #include <errno.h>
+#include <string.h>
+#include <alloca.h>
+#include <unistd.h>
 #include <time.h>
 #include <sys/time.h>
+#include <sys/mman.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
 
 // Max time to wait in ms before checking for thread exit
 #define MAX_WAIT   100
@@ -31,8 +40,9 @@ struct PosixThreadData
    // Posix thread structure
    pthread_t pthread;
 
-   // True if the thread is being requested to exit
-   bool pleaseStop;
+   // True if the thread is being requested to exit.  Set by the stopping
+   // thread and polled by this one, so it's atomic.
+   std::atomic<bool> pleaseStop;
 
    // Semaphore used to wait for the thread to finish
    Semaphore stopSem;
@@ -81,6 +91,8 @@ class ThreadExitException
 
 /* local functions */
 static void *ThreadStarter( void *arg );
+static int SchedPriority( int pri );
+static void SetAffinity( pthread_attr_t *attr, int cpu );
 
 /* local data */
 static TlsKey tls;
@@ -94,6 +106,9 @@ this class the default constructor doesn't do anything.
 Thread::Thread( void )
 {
    priority = 5;
+   cpu = -1;
+   realTime = false;
+   rtSched = true;
    data = 0;
 }
 
@@ -114,8 +129,8 @@ Set the threads priority.  The priority must be specified in the range 0
 (lowest priority) to 9 (highest priority).  The default thread priority 
 is 5 and this will be used if the priority is not explicitely set.
 
-This funciton must be called before the thread is started.  Calling it
-after the thread has already started will have no effect.
+If the thread has already been started its scheduling is changed right 
+away.
 
 @param pri The thread's priority, in the range 0 to 9.
 @return A valid error object.
@@ -128,6 +143,76 @@ const Error *Thread::setPriority( int pri )
 
    priority = pri;
 
+   PosixThreadData *tData = (PosixThreadData *)data;
+   if( !tData || !rtSched ) return 0;
+
+   struct sched_param sched;
+   sched.sched_priority = SchedPriority( priority );
+
+   int ret = pthread_setschedparam( tData->pthread, SCHED_FIFO, &sched );
+   realTime = !ret;
+   if( ret )
+   {
+      cml.Warn( "Unable to set SCHED_FIFO priority %d on a running thread: %s\n", 
+                sched.sched_priority, strerror(ret) );
+      return &ThreadError::General;
+   }
+
+   return 0;
+}
+
+/***************************************************************************/
+/**
+Choose whether the thread asks for real time (SCHED_FIFO) scheduling when
+it's started.  A thread started without it runs under the default time 
+sharing policy, and its priority isn't used.
+
+@param rt True (the default) for real time scheduling.
+@return A valid error object.
+*/
+/***************************************************************************/
+const Error *Thread::setRealTime( bool rt )
+{
+   if( data ) return &ThreadError::Running;
+   rtSched = rt;
+   return 0;
+}
+
+/***************************************************************************/
+/**
+Pin the thread to a CPU.  If the thread has already been started it is
+moved right away, otherwise it will start on that CPU.
+
+@param c The CPU index, or -1 to let the thread run on any CPU.
+@return A valid error object.
+*/
+/***************************************************************************/
+const Error *Thread::setAffinity( int c )
+{
+   if( c < -1 || c >= CPU_SETSIZE || c >= sysconf( _SC_NPROCESSORS_CONF ) )
+      return &ThreadError::BadParam;
+
+   cpu = c;
+
+   PosixThreadData *tData = (PosixThreadData *)data;
+   if( !tData ) return 0;
+
+   cpu_set_t set;
+   CPU_ZERO( &set );
+   if( cpu < 0 )
+   {
+      for( int i=0; i<CPU_SETSIZE; i++ )
+         CPU_SET( i, &set );
+   }
+   else
+      CPU_SET( cpu, &set );
+
+   int ret = pthread_setaffinity_np( tData->pthread, sizeof(set), &set );
+   if( ret )
+   {
+      cml.Warn( "Unable to pin thread to CPU %d: %s\n", cpu, strerror(ret) );
+      return &ThreadError::General;
+   }
    return 0;
 }
 
@@ -139,47 +224,65 @@ the thread has started.
 /***************************************************************************/
 const Error *Thread::start( void )
 {
-   if( data ) return &ThreadError::Running;
+   // A thread whose run method has returned keeps its data until it's 
+   // joined or stopped.  If that's the case it's reclaimed here so the
+   // thread can be started again.
+   if( data && join(0) ) return &ThreadError::Running;
 
    PosixThreadData *tData = new PosixThreadData( this );
    if( !tData ) return &ThreadError::Alloc;
    data = tData;
 
-   int min, max, inc;
-   min = sched_get_priority_min( SCHED_FIFO );
-   max = sched_get_priority_max( SCHED_FIFO );
-   inc = (max-min+5)/10;
-
    struct sched_param sched;
-   sched.sched_priority = min + priority * inc;
-
-   if( sched.sched_priority < min ) sched.sched_priority = min;
-   if( sched.sched_priority > max ) sched.sched_priority = max;
+   sched.sched_priority = SchedPriority( priority );
 
+   // The thread is created detached so its memory is reclaimed when it
+   // ends.  The thread data stays until the thread is joined or stopped.
    pthread_attr_t attr;
-   pthread_attr_init( &attr );
-   pthread_attr_setinheritsched( &attr, PTHREAD_EXPLICIT_SCHED );
-   pthread_attr_setschedpolicy( &attr, SCHED_FIFO );
-   pthread_attr_setschedparam( &attr, &sched );
+   int ret = 0;
+   realTime = false;
 
-   int ret = pthread_create( &tData->pthread, &attr, ThreadStarter, tData );
+   if( rtSched )
+   {
+      pthread_attr_init( &attr );
+      pthread_attr_setinheritsched( &attr, PTHREAD_EXPLICIT_SCHED );
+      pthread_attr_setschedpolicy( &attr, SCHED_FIFO );
+      pthread_attr_setschedparam( &attr, &sched );
+      SetAffinity( &attr, cpu );
+      pthread_attr_setdetachstate( &attr, PTHREAD_CREATE_DETACHED );
+
+      ret = pthread_create( &tData->pthread, &attr, ThreadStarter, tData );
+      pthread_attr_destroy( &attr );
+      realTime = !ret;
+
+      // If this fails, I'll try a second time with normal scheduling.  The
+      // usual cause is a lack of permission, which is worth reporting clearly
+      // since the thread will then compete with every other process.
+      if( ret )
+         cml.Warn( "Unable to start thread with SCHED_FIFO priority %d (%s).  It will run with "
+                   "normal scheduling.  Real time scheduling needs root, CAP_SYS_NICE or an "
+                   "RLIMIT_RTPRIO of at least %d.\n", sched.sched_priority, strerror(ret), sched.sched_priority );
+   }
 
-   // If this fails, I'll try a second time with default attributes.  
-   if( ret )
+   // Threads that don't ask for real time scheduling, or couldn't get it,
+   // are started with the default attributes.
+   if( ret || !rtSched )
    {
-      cml.Error( "pthread_create error %d creating a thread of pri %d.  Retrying...\n", ret, priority );
-      ret = pthread_create( &tData->pthread, 0, ThreadStarter, tData );
+      pthread_attr_init( &attr );
+      SetAffinity( &attr, cpu );
+      pthread_attr_setdetachstate( &attr, PTHREAD_CREATE_DETACHED );
+      ret = pthread_create( &tData->pthread, &attr, ThreadStarter, tData );
+      pthread_attr_destroy( &attr );
    }
 
    // If this still fails, I'll return an error.
    if( ret )
    {
       cml.Error( "pthread_create error %d creating a thread with default attributes.\n", ret );
+      data = 0;
+      delete tData;
       return &ThreadError::Start;
    }
-  
-   //detatch pthread, so memory can be reclaimed upon termination
-   pthread_detach(tData->pthread);
 
    return 0;
 }
@@ -212,6 +315,33 @@ const Error *Thread::stop( Timeout to )
    return err;
 }
 
+/***************************************************************************/
+/**
+Wait for this thread's run method to return.  Unlike stop the thread isn't
+asked to exit, so this is used to collect threads that end by themselves.
+Once this returns without error the thread has finished with its data and
+the thread object may be deleted.
+@param to The time to wait in milliseconds, or <0 to wait forever.
+@return A valid error object.
+*/
+/***************************************************************************/
+const Error *Thread::join( Timeout to )
+{
+   if( !data ) return 0;
+
+   // A thread can't wait for itself
+   if( data == tls.Get() )
+      return &ThreadError::BadParam;
+
+   PosixThreadData *tData = (PosixThreadData *)data;
+   const Error *err = tData->stopSem.Get( to );
+   if( err ) return err;
+
+   data = 0;
+   delete tData;
+   return 0;
+}
+
 /***************************************************************************/
 /**
 Put the thread to sleep for a specified amount of time.
@@ -223,18 +353,77 @@ const Error *Thread::sleep( Timeout to )
 {
    if( to == 0 ) return 0;
 
-   // Create a semaphore that no-one will ever post to
-   // and wait on that with a timeout
-   Semaphore sem(0);
+   // Sleeping forever just means waiting to be stopped
+   if( to < 0 )
+   {
+      while( 1 )
+      {
+         const Error *err = sleepUntil( getTimeNS() + (int64)MAX_WAIT*1000000 );
+         if( err ) return err;
+      }
+   }
+
+   return sleepUntil( getTimeNS() + (int64)(to * 1000000) );
+}
+
+/***************************************************************************/
+/**
+Put the thread to sleep until an absolute time on the CLOCK_MONOTONIC clock.
+Long sleeps are broken up so a request to stop the thread is still noticed
+within MAX_WAIT milliseconds.
+@param ns The time to wake, in nanoseconds as returned by Thread::getTimeNS.
+*/
+/***************************************************************************/
+const Error *Thread::sleepUntil( int64 ns )
+{
+   PosixThreadData *tData = (PosixThreadData *)tls.Get();
+
+   while( 1 )
+   {
+      if( tData && tData->pleaseStop )
+         throw ThreadExitException();
 
-   const Error *err = sem.Get( to );
+      int64 wake = getTimeNS() + (int64)MAX_WAIT*1000000;
+      if( wake > ns ) wake = ns;
 
-   // Convert timeout errors to no error since
-   // that's what we expect to see.
-   if( err == &ThreadError::Timeout )
-      err = 0;
+      struct timespec ts;
+      ts.tv_sec  = (time_t)(wake / 1000000000);
+      ts.tv_nsec = (long)(wake % 1000000000);
 
-   return err;
+      int err = clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0 );
+      if( err && err != EINTR )
+         return &ThreadError::General;
+
+      if( getTimeNS() >= ns )
+         return 0;
+   }
+}
+
+/***************************************************************************/
+/**
+Lock the process memory with mlockall and prefault the calling thread's 
+stack.
+@param stackPrefault Bytes of stack to touch.
+*/
+/***************************************************************************/
+const Error *Thread::lockMemory( int32 stackPrefault )
+{
+   if( mlockall( MCL_CURRENT | MCL_FUTURE ) )
+   {
+      cml.Warn( "mlockall failed (%s), process memory is not locked.  This needs root, "
+                "CAP_IPC_LOCK or a large enough RLIMIT_MEMLOCK.\n", strerror(errno) );
+      return &ThreadError::MemLock;
+   }
+
+   if( stackPrefault > 0 )
+   {
+      volatile uint8 *stack = (volatile uint8 *)alloca( stackPrefault );
+      long page = sysconf( _SC_PAGESIZE );
+      for( int32 i=0; i<stackPrefault; i+=page )
+         stack[i] = 0;
+   }
+
+   return 0;
 }
 
 /***************************************************************************/
@@ -244,21 +433,26 @@ Return the current time in millisecond units
 /***************************************************************************/
 uint32 Thread::getTimeMS( void )
 {
-   struct timeval tv;
-   gettimeofday( &tv, 0 );
+   return (uint32)( getTimeNS() / 1000000 );
+}
+
+/***************************************************************************/
+/**
+Return the current time in nanosecond units, from the CLOCK_MONOTONIC clock.
+*/
+/***************************************************************************/
+int64 Thread::getTimeNS( void )
+{
+   struct timespec ts;
+   clock_gettime( CLOCK_MONOTONIC, &ts );
 
-   return (uint32)( tv.tv_sec*1000 + tv.tv_usec/1000 );
+   return (int64)ts.tv_sec*1000000000 + ts.tv_nsec;
 }
 
 
 void Thread::__run( void )
 {
    run();
-
-   // If the run method returns, delete the threads local data.
-   // Note that this won't happen here if the thread is stopped.
-   delete (PosixThreadData *)data;
-   data = 0;
 }
 
 /***************************************************************************/
@@ -370,12 +564,11 @@ static const Error *SemaWait( sem_t *sem, Timeout to )
    int err = clock_gettime( CLOCK_REALTIME, &ts );
    if( err ) return &ThreadError::General;
 
-   to += (ts.tv_nsec / 1000000);
-   long sec = to / 1000;
-   to -= sec * 1000;
-
-   ts.tv_sec += sec;
-   ts.tv_nsec = to * 1000000;
+   // Keep the full resolution of the current time, so timeouts shorter
+   // than a millisecond don't expire early.
+   int64 ns = ts.tv_nsec + (int64)(to * 1000000);
+   ts.tv_sec += (time_t)(ns / 1000000000);
+   ts.tv_nsec = (long)(ns % 1000000000);
 
    err = sem_timedwait( sem, &ts );
    if( !err ) return 0;
@@ -447,6 +640,112 @@ const Error *Semaphore::Put( void )
    return 0;
 }
 
+#ifndef __linux__
+// Without futexes, all Futex objects share one condition variable
+static pthread_mutex_t futexMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  futexCond  = PTHREAD_COND_INITIALIZER;
+#endif
+
+/***************************************************************************/
+/**
+Set a new value, and wake any threads waiting on the futex.
+@param v The new value
+*/
+/***************************************************************************/
+void Futex::Post( uint32 v )
+{
+   value.store( v );
+
+#ifdef __linux__
+   syscall( SYS_futex, (uint32 *)&value, FUTEX_WAKE_PRIVATE, 0x7fffffff, 0, 0, 0 );
+#else
+   pthread_mutex_lock( &futexMutex );
+   pthread_cond_broadcast( &futexCond );
+   pthread_mutex_unlock( &futexMutex );
+#endif
+}
+
+/***************************************************************************/
+/**
+Wait for the value of the futex to differ from the one passed.  Like
+Semaphore::Get, long waits are broken up so a request to stop the calling
+thread is still noticed.
+@param old The value the caller last saw.
+@param to The timeout in milliseconds.  Any negative value will cause
+       the thread to wait indefinitely.
+@return NULL once the value has changed, or &ThreadError::Timeout.
+*/
+/***************************************************************************/
+const Error *Futex::Wait( uint32 old, Timeout to )
+{
+   bool forever = (to < 0);
+   int64 end = Thread::getTimeNS() + (int64)(to * 1000000);
+
+   PosixThreadData *tData = (PosixThreadData *)tls.Get();
+
+   while( value.load() == old )
+   {
+      if( tData && tData->pleaseStop )
+         throw ThreadExitException();
+
+      int64 ns = (int64)MAX_WAIT * 1000000;
+      if( !forever )
+      {
+         int64 left = end - Thread::getTimeNS();
+         if( left <= 0 ) return &ThreadError::Timeout;
+         if( left < ns ) ns = left;
+      }
+
+#ifdef __linux__
+      struct timespec ts;
+      ts.tv_sec  = (time_t)(ns / 1000000000);
+      ts.tv_nsec = (long)(ns % 1000000000);
+
+      // Returns at once if the value no longer matches
+      syscall( SYS_futex, (uint32 *)&value, FUTEX_WAIT_PRIVATE, old, &ts, 0, 0 );
+#else
+      struct timespec ts;
+      clock_gettime( CLOCK_REALTIME, &ts );
+      ns += ts.tv_nsec;
+      ts.tv_sec += (time_t)(ns / 1000000000);
+      ts.tv_nsec = (long)(ns % 1000000000);
+
+      pthread_mutex_lock( &futexMutex );
+      if( value.load() == old )
+         pthread_cond_timedwait( &futexCond, &futexMutex, &ts );
+      pthread_mutex_unlock( &futexMutex );
+#endif
+   }
+
+   return 0;
+}
+
+// Map the 0 to 9 CML priority onto the SCHED_FIFO range
+static int SchedPriority( int pri )
+{
+   int min, max, inc;
+   min = sched_get_priority_min( SCHED_FIFO );
+   max = sched_get_priority_max( SCHED_FIFO );
+   inc = (max-min+5)/10;
+
+   int p = min + pri * inc;
+   if( p < min ) p = min;
+   if( p > max ) p = max;
+   return p;
+}
+
+// Add a CPU affinity to thread attributes.  A negative CPU leaves the
+// default of any CPU.
+static void SetAffinity( pthread_attr_t *attr, int cpu )
+{
+   if( cpu < 0 ) return;
+
+   cpu_set_t set;
+   CPU_ZERO( &set );
+   CPU_SET( cpu, &set );
+   pthread_attr_setaffinity_np( attr, sizeof(set), &set );
+}
+
 /// Static function used to start a new thread.
 static void *ThreadStarter( void *arg )
 {
@@ -460,10 +759,12 @@ static void *ThreadStarter( void *arg )
    }
    catch( ThreadExitException )
    {
-      tData->stopSem.Put();
    }
 
+   // Let stop or join know the thread is done.  The thread data may be
+   // deleted as soon as this is posted, so it isn't touched again.
    tls.Set( NULL );
+   tData->stopSem.Put();
    return NULL;
 }
 
@@ -11,6 +11,11 @@
 #include <process.h>
 #include "CML.h"
 
+// WaitOnAddress, used by the Futex class, needs Windows 8 or later
+#ifdef _MSC_VER
+#pragma comment( lib, "synchronization.lib" )
+#endif
+
 CML_NAMESPACE_USE();
 
 /* local data */
@@ -82,6 +87,9 @@ this class the default constructor doesn't do anything.
 Thread::Thread( void )
 {
    priority = 5;
+   cpu = -1;
+   realTime = false;
+   rtSched = true;
    WinThreadData *tData = new WinThreadData( this );
 
    // Make sure the events were created successfully
@@ -143,6 +151,51 @@ const Error *Thread::setPriority( int pri )
    return 0;
 }
 
+/***************************************************************************/
+/**
+Choose whether the thread asks for real time scheduling.  Windows threads 
+are always scheduled with the rest of the process, so the flag is only 
+recorded.  This must be called before the thread is started.
+
+@param rt True (the default) for real time scheduling.
+@return A valid error object.
+*/
+/***************************************************************************/
+const Error *Thread::setRealTime( bool rt )
+{
+   rtSched = rt;
+   return 0;
+}
+
+/***************************************************************************/
+/**
+Pin the thread to a CPU.  This must be called before the thread is started.
+
+@param c The CPU index, or -1 to let the thread run on any CPU.
+@return A valid error object.
+*/
+/***************************************************************************/
+const Error *Thread::setAffinity( int c )
+{
+   if( c < -1 || c >= 32 )
+      return &ThreadError::BadParam;
+
+   cpu = c;
+   return 0;
+}
+
+/***************************************************************************/
+/**
+Memory locking is not supported under Windows.
+@param stackPrefault Not used.
+@return ThreadError::MemLock
+*/
+/***************************************************************************/
+const Error *Thread::lockMemory( int32 stackPrefault )
+{
+   return &ThreadError::MemLock;
+}
+
 /***************************************************************************/
 /**
 Start this thread.  The thread's virtual run() function will be called when
@@ -196,7 +249,13 @@ const Error *Thread::start( void )
          default: pri = THREAD_PRIORITY_NORMAL;        break;
       }
 
-      SetThreadPriority( h, pri );
+      realTime = (SetThreadPriority( h, pri ) != 0);
+      if( !realTime )
+         cml.Warn( "Unable to set thread priority %d\n", priority );
+
+      if( cpu >= 0 )
+         SetThreadAffinityMask( h, (DWORD_PTR)1 << cpu );
+
       tData->running = true;
    }
 
@@ -265,6 +324,40 @@ const Error *Thread::stop( Timeout timeout )
    return 0;
 }
 
+/***************************************************************************/
+/**
+Wait for this thread's run method to return without asking it to exit.
+@param to The time to wait in milliseconds, or <0 to wait forever.
+@return A valid error object.
+*/
+/***************************************************************************/
+const Error *Thread::join( Timeout to )
+{
+   if( !data ) return &ThreadError::Alloc;
+
+   WinThreadData *tData = (WinThreadData *)data;
+   if( tData == GetThreadData() )
+      return &ThreadError::BadParam;
+
+   // Just return if the thread wasn't running
+   tData->mtx.Lock();
+   bool running = tData->running;
+   tData->mtx.Unlock();
+   if( !running ) return 0;
+
+   DWORD ret = WaitForSingleObject( tData->exitEvent, (to < 0) ? INFINITE : (int32)to );
+   if( ret == WAIT_TIMEOUT )
+      return &ThreadError::Timeout;
+   if( ret != WAIT_OBJECT_0 )
+      return &ThreadError::General;
+
+   // The exit event is set while the thread holds its mutex, so once 
+   // that's released the thread is done with its data.
+   tData->mtx.Lock();
+   tData->mtx.Unlock();
+   return 0;
+}
+
 void Thread::__run( void )
 {
    run();
@@ -340,6 +433,38 @@ uint32 Thread::getTimeMS( void )
    return (uint32)(li.QuadPart/10000);
 }
 
+/***************************************************************************/
+/**
+Return the current time in nanosecond units, from the performance counter.
+*/
+/***************************************************************************/
+int64 Thread::getTimeNS( void )
+{
+   LARGE_INTEGER freq, count;
+
+   QueryPerformanceFrequency( &freq );
+   QueryPerformanceCounter( &count );
+
+   int64 sec = count.QuadPart / freq.QuadPart;
+   int64 rem = count.QuadPart % freq.QuadPart;
+   return sec*1000000000 + rem*1000000000/freq.QuadPart;
+}
+
+/***************************************************************************/
+/**
+Put the thread to sleep until an absolute time.
+@param ns The time to wake, in nanoseconds as returned by Thread::getTimeNS.
+*/
+/***************************************************************************/
+const Error *Thread::sleepUntil( int64 ns )
+{
+   int64 now = getTimeNS();
+   if( ns <= now ) return 0;
+
+   // Round up so the deadline is never missed by a partial millisecond
+   return sleep( (Timeout)((ns - now + 999999) / 1000000) );
+}
+
 
 /***************************************************************************/
 /**
@@ -455,6 +580,54 @@ const Error *Semaphore::Put( void )
    return &ThreadError::General;
 }
 
+/***************************************************************************/
+/**
+Set a new value, and wake any threads waiting on the futex.
+@param v The new value
+*/
+/***************************************************************************/
+void Futex::Post( uint32 v )
+{
+   value.store( v );
+   WakeByAddressAll( &value );
+}
+
+/***************************************************************************/
+/**
+Wait for the value of the futex to differ from the one passed.  Long waits
+are broken up so a thread being destroyed using Thread::stop still exits.
+@param old The value the caller last saw.
+@param timeout The timeout in milliseconds.  Any negative value will cause
+       the thread to wait indefinitely.
+@return NULL once the value has changed, or &ThreadError::Timeout.
+*/
+/***************************************************************************/
+const Error *Futex::Wait( uint32 old, Timeout timeout )
+{
+   bool forever = (timeout < 0);
+   int64 end = Thread::getTimeNS() + (int64)(timeout * 1000000);
+
+   WinThreadData *tData = GetThreadData();
+
+   while( value.load() == old )
+   {
+      if( tData && WaitForSingleObject( tData->killEvent, 0 ) == WAIT_OBJECT_0 )
+         KillThread( tData );
+
+      DWORD ms = 100;
+      if( !forever )
+      {
+         int64 left = end - Thread::getTimeNS();
+         if( left <= 0 ) return &ThreadError::Timeout;
+         if( left < (int64)ms * 1000000 ) ms = (DWORD)((left + 999999) / 1000000);
+      }
+
+      WaitOnAddress( &value, &old, sizeof(old), ms );
+   }
+
+   return 0;
+}
+
 /***************************************************************************/
 /**
 Kill the running thread.
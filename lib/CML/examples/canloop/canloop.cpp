@@ -0,0 +1,158 @@
+/** \file
+
+Loopback test of the SocketCAN interface.
+
+Two SocketCAN objects are opened on the same network interface (normally a
+virtual vcan interface).  Bursts of frames are sent from one with a single 
+batched Xmit call and read back on the other with batched Recv calls.  The
+frames are checked against what was sent, and the spread of the receive time
+stamps in each burst is printed.
+
+The same bursts are then timed twice, once with the batched calls and once
+a frame at a time, and the frame rate of each is printed.
+
+The last part of the test sets a receive filter on the reading port and
+checks that only the matching frames arrive.
+
+Usage: canloop [interface] [bursts]
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "CML.h"
+#include "can/can_socketcan.h"
+
+// If a namespace has been defined in CML_Settings.h, this
+// macros starts using it. 
+CML_NAMESPACE_USE();
+
+#define BURST    32
+
+static void showerr( const Error *err, const char *str )
+{
+   if( err )
+   {
+      printf( "Error %s: %s\n", str, err->toString() );
+      exit(1);
+   }
+}
+
+// Send and receive bursts of frames, either batched or one at a time.
+// Returns the frame rate in frames/second.
+static double TimeBursts( SocketCAN &tx, SocketCAN &rx, CanFrame *out, int bursts, bool batch, double &perRecv )
+{
+   CanFrame in[ BURST ];
+   int calls = 0;
+
+   int64 start = Thread::getTimeNS();
+   for( int b=0; b<bursts; b++ )
+   {
+      if( batch )
+         showerr( tx.Xmit( out, BURST, 100 ), "sending frames" );
+      else
+      {
+         for( int i=0; i<BURST; i++ )
+            showerr( tx.Xmit( out[i], 100 ), "sending frames" );
+      }
+
+      int got = 0;
+      while( got < BURST )
+      {
+         int ct = 1;
+         if( batch )
+            showerr( rx.Recv( &in[got], BURST-got, ct, 100 ), "receiving frames" );
+         else
+            showerr( rx.Recv( in[got], 100 ), "receiving frames" );
+         got += ct;
+         calls++;
+      }
+   }
+   int64 ns = Thread::getTimeNS() - start;
+
+   perRecv = (double)bursts * BURST / calls;
+   return (double)bursts * BURST * 1e9 / ns;
+}
+
+int main( int argc, char **argv )
+{
+   const char *port = (argc > 1) ? argv[1] : "vcan0";
+   int bursts = (argc > 2) ? atoi(argv[2]) : 100;
+
+   SocketCAN tx( port ), rx( port );
+   showerr( tx.Open(), "opening transmit port" );
+   showerr( rx.Open(), "opening receive port" );
+
+   CanFrame out[ BURST ], in[ BURST ];
+   int bad = 0;
+
+   for( int b=0; b<bursts; b++ )
+   {
+      for( int i=0; i<BURST; i++ )
+      {
+         out[i].type = CAN_FRAME_DATA;
+         out[i].id = (i & 1) ? (0x20000000 | (b<<8) | i) : (0x100 + i);
+         out[i].length = i % 9;
+         for( int j=0; j<8; j++ )
+            out[i].data[j] = (uint8)(b + i + j);
+      }
+
+      showerr( tx.Xmit( out, BURST, 100 ), "sending frames" );
+
+      int got = 0;
+      while( got < BURST )
+      {
+         int ct;
+         showerr( rx.Recv( &in[got], BURST-got, ct, 100 ), "receiving frames" );
+         got += ct;
+      }
+
+      for( int i=0; i<BURST; i++ )
+      {
+         if( in[i].id != out[i].id || in[i].length != out[i].length ||
+             memcmp( in[i].data, out[i].data, out[i].length ) )
+         {
+            printf( "Burst %d frame %d mismatch: sent 0x%08x/%d, got 0x%08x/%d\n", b, i, 
+                    (unsigned)out[i].id, out[i].length, (unsigned)in[i].id, in[i].length );
+            bad++;
+         }
+      }
+
+      if( b < 5 )
+         printf( "Burst %d: time stamps span %u us\n", b, (unsigned)(in[BURST-1].timestamp - in[0].timestamp) );
+   }
+
+   printf( "%d bursts of %d frames, %d errors\n", bursts, BURST, bad );
+
+   double perRecv;
+   double rate = TimeBursts( tx, rx, out, bursts, true, perRecv );
+   printf( "Batched:      %8.0f frames/s, %.1f frames per Recv\n", rate, perRecv );
+   rate = TimeBursts( tx, rx, out, bursts, false, perRecv );
+   printf( "One at a time:%8.0f frames/s\n", rate );
+
+   // Only accept the standard IDs 0x100 to 0x10F
+   uint32 id = 0x100, mask = 0x200007F0;
+   showerr( rx.SetRecvFilter( &id, &mask, 1 ), "setting filter" );
+   showerr( tx.Xmit( out, BURST, 100 ), "sending frames" );
+
+   int got = 0, ct;
+   while( !rx.Recv( &in[got], BURST-got, ct, 100 ) )
+   {
+      for( int i=0; i<ct; i++ )
+      {
+         if( (in[got+i].id & 0x200007F0) != 0x100 )
+         {
+            printf( "Filter passed frame 0x%08x\n", (unsigned)in[got+i].id );
+            bad++;
+         }
+      }
+      got += ct;
+   }
+
+   printf( "Filter passed %d of %d frames (expected 8)\n", got, BURST );
+   if( got != 8 ) bad++;
+
+   return bad ? 1 : 0;
+}
+
@@ -0,0 +1,83 @@
+/** \file
+
+Stand in for a vcan interface on hosts whose kernel has no CAN support.
+
+Loaded with LD_PRELOAD, this turns each CAN_RAW socket into a local 
+datagram socket.  Frames sent on one are delivered to every other one whose
+CAN_RAW_FILTER passes them, so canloop runs unchanged.  Received frames are
+read with the program's own recvmmsg call, but frames sent with sendmmsg are
+delivered one at a time here, so only the receive side of the batching is
+really exercised.  SO_TIMESTAMPING is refused, so the SO_TIMESTAMPNS 
+fallback is used.
+
+The receiving socket's queue is limited by net.unix.max_dgram_qlen, which 
+must be at least the burst size.
+*/
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/ioctl.h>
+#include <net/if.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <unistd.h>
+#include <stddef.h>
+
+#define MAXS 16
+static struct { int fd; int bound; int nf; struct can_filter f[CAN_RAW_FILTER_MAX]; } s[MAXS];
+static int ns;
+static int find(int fd){ for(int i=0;i<ns;i++) if(s[i].fd==fd) return i; return -1; }
+static void addr(int i, struct sockaddr_un *a, socklen_t *l){
+   memset(a,0,sizeof *a); a->sun_family=AF_UNIX;
+   int n=snprintf(a->sun_path+1,sizeof a->sun_path-1,"vcanshim-%d-%d",getpid(),i);
+   *l=offsetof(struct sockaddr_un,sun_path)+1+n; }
+
+#define REAL(T,name,...) static T (*real_##name)(__VA_ARGS__); if(!real_##name) real_##name=dlsym(RTLD_NEXT,#name)
+
+int socket(int d,int t,int p){
+   REAL(int,socket,int,int,int);
+   if(d!=PF_CAN) return real_socket(d,t,p);
+   int fd=real_socket(AF_UNIX,SOCK_DGRAM,0);
+   if(fd>=0){ s[ns].fd=fd; s[ns].bound=0; s[ns].nf=1; s[ns].f[0].can_id=0; s[ns].f[0].can_mask=0; ns++; }
+   return fd; }
+
+int ioctl(int fd,unsigned long r,...){
+   REAL(int,ioctl,int,unsigned long,...);
+   __builtin_va_list ap; __builtin_va_start(ap,r); void *arg=__builtin_va_arg(ap,void*); __builtin_va_end(ap);
+   if(find(fd)>=0 && r==SIOCGIFINDEX){ ((struct ifreq*)arg)->ifr_ifindex=99; return 0; }
+   return real_ioctl(fd,r,arg); }
+
+int bind(int fd,const struct sockaddr *a,socklen_t l){
+   REAL(int,bind,int,const struct sockaddr*,socklen_t);
+   int i=find(fd); if(i<0) return real_bind(fd,a,l);
+   struct sockaddr_un u; socklen_t ul; addr(i,&u,&ul);
+   int r=real_bind(fd,(struct sockaddr*)&u,ul); if(!r) s[i].bound=1; return r; }
+
+int setsockopt(int fd,int lv,int o,const void *v,socklen_t l){
+   REAL(int,setsockopt,int,int,int,const void*,socklen_t);
+   int i=find(fd);
+   if(i>=0 && lv==SOL_CAN_RAW){
+      if(o==CAN_RAW_FILTER){ s[i].nf=l/sizeof(struct can_filter); memcpy(s[i].f,v,l); }
+      return 0; }
+   if(i>=0 && lv==SOL_SOCKET && o==SO_TIMESTAMPING){ errno=ENOPROTOOPT; return -1; }
+   return real_setsockopt(fd,lv,o,v,l); }
+
+static int pass(int i,canid_t id){
+   for(int k=0;k<s[i].nf;k++) if(((id^s[i].f[k].can_id)&s[i].f[k].can_mask)==0) return 1;
+   return 0; }
+
+int sendmmsg(int fd,struct mmsghdr *m,unsigned int n,int fl){
+   REAL(int,sendmmsg,int,struct mmsghdr*,unsigned int,int);
+   int i=find(fd); if(i<0) return real_sendmmsg(fd,m,n,fl);
+   for(unsigned k=0;k<n;k++){
+      struct can_frame *cf=m[k].msg_hdr.msg_iov[0].iov_base;
+      for(int j=0;j<ns;j++){
+         if(j==i || !s[j].bound || !pass(j,cf->can_id)) continue;
+         struct sockaddr_un u; socklen_t ul; addr(j,&u,&ul);
+         if(sendto(fd,cf,sizeof *cf,fl,(struct sockaddr*)&u,ul)<0) return k?(int)k:-1; }
+      m[k].msg_len=sizeof *cf; }
+   return n; }
@@ -0,0 +1,82 @@
+/** \file
+
+Convert a binary CAN trace file to text.
+
+The CML log can write every CAN frame to a compact binary trace file instead
+of the text log (see CopleyMotionLibrary::SetCanTraceFile).  This program 
+reads such a file and prints each frame as the same CAN.R: / CAN.X: line 
+that would have been written to the log file.
+
+Usage: cantrace [-t] <trace file>
+
+   -t  Prefix each line with the time it was logged, in seconds relative 
+       to the first frame in the file.
+*/
+
+#include <cstdio>
+#include <cstring>
+
+#include "CML.h"
+
+// If a namespace has been defined in CML_Settings.h, this
+// macros starts using it. 
+CML_NAMESPACE_USE();
+
+int main( int argc, char **argv )
+{
+   bool showTime = false;
+   const char *fname = 0;
+
+   for( int i=1; i<argc; i++ )
+   {
+      if( !strcmp( argv[i], "-t" ) )
+         showTime = true;
+      else
+         fname = argv[i];
+   }
+
+   if( !fname )
+   {
+      printf( "Usage: %s [-t] <trace file>\n", argv[0] );
+      return 1;
+   }
+
+   FILE *fp = fopen( fname, "rb" );
+   if( !fp )
+   {
+      printf( "Unable to open %s\n", fname );
+      return 1;
+   }
+
+   // Check the file header
+   char magic[8];
+   if( fread( magic, 1, 8, fp ) != 8 || memcmp( magic, CML_CANTRACE_MAGIC, 8 ) )
+   {
+      printf( "%s is not a CML CAN trace file\n", fname );
+      fclose( fp );
+      return 1;
+   }
+
+   CanTraceRecord rec;
+   int64 t0 = 0;
+   bool first = true;
+   char text[128];
+
+   while( fread( &rec, sizeof(rec), 1, fp ) == 1 )
+   {
+      if( first )
+      {
+         t0 = rec.time;
+         first = false;
+      }
+
+      if( showTime )
+         printf( "%12.6f ", (double)(rec.time - t0) * 1e-9 );
+
+      CopleyMotionLibrary::FormatCAN( text, sizeof(text), rec );
+      fputs( text, stdout );
+   }
+
+   fclose( fp );
+   return 0;
+}
@@ -0,0 +1,174 @@
+/** \file
+
+Reference locking microbenchmark.
+
+Nearly every CML object is reached through a reference ID which is locked
+for the short time the object is used (RefObjLocker, RefObj::LockRef, 
+RefObj::UnlockRef).  The CANopen receive thread alone locks several 
+references for every frame it receives.  This program measures how many 
+lock/unlock pairs per second can be made with 1 to 8 threads running at 
+once in three cases:
+
+   shared   All threads lock the same object, the worst case for the 
+            reference counts.
+
+   private  Each thread locks its own object.
+
+   old      All threads lock the same object through a copy of the 
+            reference table as it used to be, where lock and unlock 
+            each took the one table mutex and looked the reference up
+            in its block.  This is included for comparison.
+
+Usage: refbench [loops per thread]
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#include "CML.h"
+
+// If a namespace has been defined in CML_Settings.h, this
+// macros starts using it. 
+CML_NAMESPACE_USE();
+
+#define MAX_THREADS  8
+
+#define OLD_REF_BITS 10
+#define OLD_BLOCKS   1
+
+enum BenchMode { MODE_SHARED, MODE_PRIVATE, MODE_OLD };
+
+// Reference information kept by the old reference table
+struct OldRefInfo
+{
+   RefObj *ptr;
+   int32 lockCt;
+};
+
+/* local data */
+static RefObj *object[ MAX_THREADS ];
+static uint32 ref[ MAX_THREADS ];
+static volatile uint32 work;
+
+static OldRefInfo *oldBlocks[ OLD_BLOCKS ];
+static Mutex oldMtx;
+
+/**************************************************
+* The old reference table.  Lock and unlock both
+* take the table mutex and find the reference in
+* its block, as RefObj::LockRef and UnlockRef did.
+**************************************************/
+static OldRefInfo *OldRefInfoPtr( int32 id )
+{
+   int32 blk = id >> OLD_REF_BITS;
+   if( id < 0 || blk >= OLD_BLOCKS || !oldBlocks[blk] )
+      return 0;
+   return &oldBlocks[blk][ id & ((1<<OLD_REF_BITS)-1) ];
+}
+
+static RefObj *OldLockRef( uint32 val )
+{
+   MutexLocker ml( oldMtx );
+
+   OldRefInfo *ri = OldRefInfoPtr( val-1 );
+   if( !ri || ri->lockCt < 0 ) return 0;
+
+   if( ri->ptr )
+      ri->lockCt++;
+   return ri->ptr;
+}
+
+static void OldUnlockRef( uint32 val )
+{
+   MutexLocker ml( oldMtx );
+
+   OldRefInfo *ri = OldRefInfoPtr( val-1 );
+   if( !ri || ri->lockCt <= 0 ) return;
+
+   ri->lockCt--;
+}
+
+/**************************************************
+* Lock and unlock a reference the given number of
+* times.
+**************************************************/
+static void LockLoop( BenchMode mode, int id, long loops )
+{
+   uint32 r = ref[ (mode == MODE_PRIVATE) ? id : 0 ];
+
+   for( long i=0; i<loops; i++ )
+   {
+      if( mode == MODE_OLD )
+      {
+         RefObj *obj = OldLockRef( 1 );
+         if( obj )
+         {
+            work++;
+            OldUnlockRef( 1 );
+         }
+      }
+      else
+      {
+         RefObjLocker<RefObj> obj( r );
+         if( obj ) work++;
+      }
+   }
+}
+
+/**************************************************
+* Run one test and return the number of lock/unlock
+* pairs per second made by all threads together.
+**************************************************/
+static double RunTest( BenchMode mode, int threads, long loops )
+{
+   std::thread th[ MAX_THREADS ];
+
+   int64 start = Thread::getTimeNS();
+
+   for( int i=0; i<threads; i++ )
+      th[i] = std::thread( LockLoop, mode, i, loops );
+
+   for( int i=0; i<threads; i++ )
+      th[i].join();
+
+   int64 ns = Thread::getTimeNS() - start;
+   return (double)threads * loops * 1e9 / ns;
+}
+
+int main( int argc, char **argv )
+{
+   long loops = 2000000;
+   if( argc > 1 ) loops = atol( argv[1] );
+
+   for( int i=0; i<MAX_THREADS; i++ )
+   {
+      object[i] = new RefObj( "bench" );
+      ref[i] = object[i]->GrabRef();
+   }
+
+   oldBlocks[0] = new OldRefInfo[ 1<<OLD_REF_BITS ];
+   oldBlocks[0][0].ptr = object[0];
+   oldBlocks[0][0].lockCt = 0;
+
+   printf( "%ld lock/unlock pairs per thread, %u CPUs\n\n", loops, std::thread::hardware_concurrency() );
+   printf( "threads     shared Mops/s   private Mops/s       old Mops/s\n" );
+
+   for( int t=1; t<=MAX_THREADS; t++ )
+   {
+      double shared = RunTest( MODE_SHARED, t, loops );
+      double priv   = RunTest( MODE_PRIVATE, t, loops );
+      double old    = RunTest( MODE_OLD, t, loops );
+
+      printf( "%7d %16.2f %16.2f %16.2f\n", t, shared/1e6, priv/1e6, old/1e6 );
+   }
+
+   for( int i=0; i<MAX_THREADS; i++ )
+   {
+      RefObj::ReleaseRef( ref[i] );
+      delete object[i];
+   }
+   delete[] oldBlocks[0];
+
+   return 0;
+}
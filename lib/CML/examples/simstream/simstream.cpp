@@ -0,0 +1,194 @@
+/** \file
+
+Load test of the linkage streaming path against simulated amplifiers.
+
+A SimCAN network of simulated Copley amplifiers stands in for the CAN
+hardware, so the whole library from Amp::Init down can be exercised and
+timed on a machine with no CAN adapter.
+
+The amplifiers are initialized and homed, a batch of SDO reads is timed,
+and then a series of random multi-axis moves is streamed to the linkage
+in PVT mode.  At the end the SDO round trip time, the average time taken
+to upload and start each move, the PVT segment and frame rates, the largest
+final position error, any PVT buffer errors seen by the amplifiers, and the
+PVT flow control statistics of each amplifier are printed.
+
+Usage: simstream [amps] [moves] [pvt buffer size] [PDO drop rate] [adaptive]
+*/
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "CML.h"
+#include "can/can_sim.h"
+
+// If a namespace has been defined in CML_Settings.h, this
+// macros starts using it.
+CML_NAMESPACE_USE();
+
+/* local functions */
+static void showerr( const Error *err, const char *str );
+
+/* local defines */
+#define MAXAMPS  8
+#define SDO_READS 1000
+
+/* local data */
+int32 canBPS = 1000000;             // CAN network bit rate
+int16 canNodeID = 1;                // CANopen node ID of first amp.  Second will be ID+1, etc.
+
+int main( int argc, char **argv )
+{
+   int ampCt = (argc > 1) ? atoi(argv[1]) : 6;
+   int moves = (argc > 2) ? atoi(argv[2]) : 20;
+   int buffSize = (argc > 3) ? atoi(argv[3]) : 32;
+   int dropRate = (argc > 4) ? atoi(argv[4]) : 0;
+   bool adaptive = (argc > 5) ? (atoi(argv[5]) != 0) : false;
+
+   if( ampCt < 1 || ampCt > MAXAMPS )
+   {
+      printf( "Between 1 and %d amplifiers may be simulated\n", MAXAMPS );
+      return 1;
+   }
+
+   SimCAN hw( "sim" );
+   hw.SetBaud( canBPS );
+
+   int i;
+   for( i=0; i<ampCt; i++ )
+      showerr( hw.AddAmp( canNodeID+i, buffSize ), "adding simulated amp" );
+
+   CanOpen net;
+   const Error *err = net.Open( hw );
+   showerr( err, "Opening network" );
+
+   Amp amp[MAXAMPS];
+   AmpSettings set;
+   set.guardTime = 0;
+   set.pvtAdaptive = adaptive;
+
+   for( i=0; i<ampCt; i++ )
+   {
+      err = amp[i].Init( net, canNodeID+i, set );
+      showerr( err, "Initting amp" );
+   }
+
+   // Time a batch of SDO reads
+   int64 start = Thread::getTimeNS();
+   for( i=0; i<SDO_READS; i++ )
+   {
+      int32 pos;
+      err = amp[i%ampCt].Upld32( OBJID_POS_ACT, 0, pos );
+      showerr( err, "reading position" );
+   }
+   double sdoTime = (Thread::getTimeNS() - start) / 1000.0 / SDO_READS;
+
+   Linkage link;
+   err = link.Init( ampCt, amp );
+   showerr( err, "Linkage init" );
+
+   HomeConfig hcfg;
+   hcfg.method  = CHM_NONE;
+   hcfg.offset  = 0;
+
+   for( i=0; i<ampCt; i++ )
+   {
+      err = link[i].GoHome( hcfg );
+      showerr( err, "Going home" );
+   }
+
+   err = link.WaitMoveDone( 20000 );
+   showerr( err, "waiting on home" );
+
+   err = link.SetMoveLimits( 200000, 2000000, 2000000, 20000000 );
+   showerr( err, "setting move limits" );
+
+   hw.SetDropRate( dropRate );
+   hw.ClearStats();
+
+   int failed = 0;
+   int32 maxErr = 0;
+   int64 startTime = 0;
+   start = Thread::getTimeNS();
+   for( i=0; i<ampCt; i++ )
+      amp[i].ClearPvtFlowStats();
+
+   for( int j=0; j<moves; j++ )
+   {
+      Point<MAXAMPS> pos;
+      pos.setDim( ampCt );
+      for( i=0; i<ampCt; i++ )
+         pos[i] = (rand() % 100000) - 50000;
+
+      // Time how long the move takes to upload and start
+      int64 t0 = Thread::getTimeNS();
+      err = link.MoveTo( pos );
+      startTime += Thread::getTimeNS() - t0;
+
+      if( !err ) err = link.WaitMoveDone( 10000 );
+      if( err )
+      {
+         printf( "Move %d failed: %s\n", j, err->toString() );
+         failed++;
+
+         // Recover from the error and carry on
+         for( i=0; i<ampCt; i++ )
+         {
+            link[i].ClearFaults();
+            link[i].Enable();
+         }
+         continue;
+      }
+
+      // Check where the simulated motors ended up
+      for( i=0; i<ampCt; i++ )
+      {
+         int32 p;
+         hw.GetAmpPosition( canNodeID+i, p );
+         int32 e = abs( p - (int32)pos[i] );
+         if( e > maxErr ) maxErr = e;
+      }
+   }
+   double secs = (Thread::getTimeNS() - start) / 1e9;
+
+   SimCANStats stats;
+   hw.GetStats( stats );
+
+   printf( "%d amps, %d moves in %.3f s, %d failed\n", ampCt, moves, secs, failed );
+   printf( "Final pos error:  %8d counts\n", maxErr );
+   printf( "SDO round trip:   %8.1f us\n", sdoTime );
+   printf( "Move start:       %8.1f us\n", startTime / 1000.0 / moves );
+   printf( "PVT segments:     %8u (%.0f/s)\n", stats.pvtSegs, stats.pvtSegs / secs );
+   printf( "Frames sent:      %8u (%.0f/s)\n", stats.xmitFrames, stats.xmitFrames / secs );
+   printf( "Frames received:  %8u (%.0f/s)\n", stats.recvFrames, stats.recvFrames / secs );
+   printf( "Frames dropped:   %8u\n", stats.dropped );
+   printf( "Receive overflow: %8u\n", stats.overflows );
+   printf( "PVT sequence err: %8u\n", stats.pvtSeqErrors );
+   printf( "PVT overflows:    %8u\n", stats.pvtOverflows );
+   printf( "PVT underflows:   %8u\n", stats.pvtUnderflows );
+   printf( "Longest bus wait: %8d us\n", stats.maxBusWait );
+
+   printf( "\nPVT flow     latency us (min/avg/max)  status lag us  margin ms (min)  target  risk  seq  resent  miss\n" );
+   for( i=0; i<ampCt; i++ )
+   {
+      PvtFlowStats fs;
+      amp[i].GetPvtFlowStats( fs );
+      printf( "  amp %d   %6d %6d %6d    %6d %6d    %4d %4d     %4d ms %5u %4u %7u %5u\n", i,
+              fs.latencyMin, fs.latencyAvg, fs.latencyMax, fs.statusGapAvg, fs.statusGapMax,
+              fs.margin, (fs.marginMin == 0x7FFFFFFF) ? 0 : fs.marginMin, fs.target, fs.riskCt,
+              fs.seqErrors, fs.resends, fs.cacheMisses );
+   }
+
+   return failed ? 1 : 0;
+}
+
+/**************************************************/
+
+static void showerr( const Error *err, const char *str )
+{
+   if( err )
+   {
+      printf( "Error %s: %s\n", str, err->toString() );
+      exit(1);
+   }
+}
@@ -0,0 +1,169 @@
+/** \file
+
+User unit conversion microbenchmark.
+
+Every PVT segment sent to an amplifier has its position and velocity 
+converted from user units to amplifier units.  This program measures the 
+time taken per value by five ways of doing that conversion:
+
+   Amp           Amp::PosUser2Load from the library, a virtual call using
+                 the scaling factor set by Amp::SetCountsPerUnit.  This 
+                 runs at the optimization the library was built with.
+
+   Old Amp       An Amp whose PosUser2Load is the code the library used to
+                 have, with a branching round.  It's compiled here, so it 
+                 runs at this program's optimization.
+
+   New Amp       The same, with the code the library has now.  Comparing
+                 it with Old Amp shows the effect of the rounding alone.
+
+   UnitScale     UnitScale::PosUser2Load, with the scaling factor fixed
+                 at compile time, called for each value.
+
+   UnitScale[]   UnitScale::PosUser2Load called once for each point,
+                 which converts all its axes in one loop.
+
+The scale used is the 1600 counts / mm of the PSM robot.  Every method is
+checked against Amp::PosUser2Load, and any value converted differently is
+counted.
+
+Usage: unitbench [repeats]
+*/
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "CML.h"
+
+// If a namespace has been defined in CML_Settings.h, this
+// macros starts using it. 
+CML_NAMESPACE_USE();
+
+#define AXES     6
+#define POINTS   1024
+
+typedef UnitScale<8000,5> MmUnits;
+
+/* local data */
+static Point<AXES> pt[ POINTS ];
+static int32 ref[ POINTS ][ AXES ];
+static int32 out[ POINTS ][ AXES ];
+
+// An Amp with the position conversion it used to have
+#define Round(x)  ((x>=0) ? (x+0.5) : (x-0.5))
+class OldAmp: public Amp
+{
+public:
+   double scale;
+   int32 PosUser2Load( uunit pos )
+   {
+      pos *= scale;
+      return (int32)Round(pos);
+   }
+};
+
+// An Amp with the position conversion it has now
+class NewAmp: public Amp
+{
+public:
+   double scale;
+   int32 PosUser2Load( uunit pos )
+   {
+      return RoundToInt32( pos * scale );
+   }
+};
+
+static Amp amplifier;
+static OldAmp oldAmp;
+static NewAmp newAmp;
+static Amp *volatile ampPtr[] = { &amplifier, &oldAmp, &newAmp };
+
+enum BenchMode { MODE_AMP, MODE_OLD, MODE_NEW, MODE_SCALAR, MODE_BATCH };
+
+/**************************************************
+* Convert every point the given number of times 
+* and return the time taken per value (ns).
+**************************************************/
+static double RunTest( BenchMode mode, int repeats )
+{
+   Amp &amp = *ampPtr[ (mode <= MODE_NEW) ? mode : 0 ];
+
+   int64 start = Thread::getTimeNS();
+
+   for( int r=0; r<repeats; r++ )
+   {
+      for( int i=0; i<POINTS; i++ )
+      {
+         switch( mode )
+         {
+            case MODE_AMP:
+            case MODE_OLD:
+            case MODE_NEW:
+               for( int j=0; j<AXES; j++ )
+                  out[i][j] = amp.PosUser2Load( pt[i][j] );
+               break;
+
+            case MODE_SCALAR:
+               for( int j=0; j<AXES; j++ )
+                  out[i][j] = MmUnits::PosUser2Load( pt[i][j] );
+               break;
+
+            case MODE_BATCH:
+               MmUnits::PosUser2Load( pt[i], out[i] );
+               break;
+         }
+      }
+   }
+
+   int64 ns = Thread::getTimeNS() - start;
+   return (double)ns / ((double)repeats * POINTS * AXES);
+}
+
+/**************************************************
+* Count the values converted differently from Amp.
+**************************************************/
+static int Mismatches( void )
+{
+   int ct = 0;
+   for( int i=0; i<POINTS; i++ )
+      for( int j=0; j<AXES; j++ )
+         if( out[i][j] != ref[i][j] ) ct++;
+   return ct;
+}
+
+int main( int argc, char **argv )
+{
+   int repeats = 2000;
+   if( argc > 1 ) repeats = atoi( argv[1] );
+
+   amplifier.SetCountsPerUnit( MmUnits::CountsPerUnit() );
+   oldAmp.scale = MmUnits::CountsPerUnit();
+   newAmp.scale = MmUnits::CountsPerUnit();
+
+   // Random positions within +/-300 mm.  Some fall exactly half way
+   // between two counts to check the rounding.
+   srand( 1 );
+   for( int i=0; i<POINTS; i++ )
+   {
+      for( int j=0; j<AXES; j++ )
+      {
+         int32 c = (rand() % 960000) - 480000;
+         uunit half = (rand() & 1) ? 0.5 : (rand() % 1000) / 1000.0;
+         pt[i][j] = (c + half) / MmUnits::CountsPerUnit();
+         ref[i][j] = amplifier.PosUser2Load( pt[i][j] );
+      }
+   }
+
+   static const char *name[] = { "Amp", "Old Amp", "New Amp", "UnitScale", "UnitScale[]" };
+
+   printf( "%d points of %d axes, %d repeats\n\n", POINTS, AXES, repeats );
+   printf( "method          ns/value   mismatches\n" );
+
+   for( int m=MODE_AMP; m<=MODE_BATCH; m++ )
+   {
+      double ns = RunTest( (BenchMode)m, repeats );
+      printf( "%-12s %11.2f %12d\n", name[m], ns, Mismatches() );
+   }
+
+   return 0;
+}
@@ -44,9 +44,14 @@ utility methods dealing with the library as a whole.
 #include "CML_SDO.h"
 #include "CML_Threads.h"
 #include "CML_Trajectory.h"
+#include "CML_TrjOnline.h"
 #include "CML_TrjScurve.h"
+#include "CML_TrjStream.h"
+#include "CML_Units.h"
 #include "CML_Utils.h"
 
+#include <stdarg.h>
+
 CML_NAMESPACE_START()
 
 /***************************************************************************/
@@ -80,6 +85,40 @@ enum CML_LOG_LEVEL
    LOG_EVERYTHING = 99   ///< Log everything
 };
 
+/// Eight byte header written at the start of a binary CAN trace file.
+#define CML_CANTRACE_MAGIC "CMLCAN01"
+
+/***************************************************************************/
+/**
+Binary CAN trace record.
+
+When a CAN trace file is set with CopleyMotionLibrary::SetCanTraceFile, every
+CAN frame that passes the log filter is written to that file as one of these
+fixed size records rather than as a line of text in the log file.  The file 
+starts with the eight bytes of CML_CANTRACE_MAGIC and is followed by the 
+records in the order they were logged.
+
+The record is 24 bytes long with all fields naturally aligned, so it contains
+no padding.  Multi-byte fields are in the byte order of the machine that 
+wrote the file.
+
+The cantrace example program converts a trace file back into the same 
+CAN.R: / CAN.X: text that is written to the log file.
+*/
+/***************************************************************************/
+struct CanTraceRecord
+{
+   int64 time;       ///< Time the frame was logged (nanoseconds, see Thread::getTimeNS)
+   uint32 id;        ///< CAN message ID
+   uint8 type;       ///< Frame type, one of the CAN_FRAME_TYPE values
+   uint8 recv;       ///< 1 for received frames, 0 for transmitted frames
+   uint8 length;     ///< Number of data bytes (0 to 8)
+   uint8 reserved;   ///< Unused, always zero
+   uint8 data[8];    ///< Frame data
+};
+
+class LogWriter;
+
 /***************************************************************************/
 /**
 Copley Motion Libraries utility object.
@@ -102,6 +141,19 @@ class CopleyMotionLibrary
    int32 logSize, maxLogSize;
    bool OpenLogFile( void );
    void ResizeLog( void );
+
+   bool asyncLog;
+   LogWriter *writer;
+   Mutex drainMutex;
+   char *traceFileName;
+   void *trace;
+   int32 traceSize;
+   bool OpenTraceFile( void );
+   void WriteText( const char *text, int len );
+   void WriteCAN( const CanTraceRecord &rec );
+   void LogText( const char *fmt, va_list ap );
+   void Drain( void );
+   friend class LogWriter;
 public:
    CopleyMotionLibrary();
    ~CopleyMotionLibrary();
@@ -115,6 +167,18 @@ public:
    void Warn( const char *fmt, ... );
    void Error( const char *fmt, ... );
    void LogCAN( bool recv, struct CanFrame &frame );
+   void SetAsyncLog( bool async );
+   void SetCanTraceFile( const char *fname );
+   uint32 GetDroppedLogCount( void );
+   static int FormatCAN( char *buff, int max, const CanTraceRecord &rec );
+
+   /// Return the state of asynchronous logging.
+   /// @return true if log messages are written by a background thread.
+   bool GetAsyncLog( void ){ return asyncLog; }
+
+   /// Return the name of the binary CAN trace file.
+   /// @return The trace file name, or NULL if CAN frames are written to the log file.
+   const char *GetCanTraceFile( void ){ return traceFileName; }
 
    /// Return the debug level 
    /// @return The debug level presently set
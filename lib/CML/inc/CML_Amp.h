@@ -278,6 +278,45 @@ public:
    ///
    /// Default 6
    uint8 maxPvtSendCt;
+
+   /// Adapt the PVT buffer fill to the network.  If true, the amp object
+   /// measures how long PVT segments take to reach the amplifier and how
+   /// late PVT status updates arrive while a trajectory is being streamed,
+   /// and keeps enough motion buffered in the amplifier to ride out those 
+   /// delays, but no more.  While the buffer is below that target the 
+   /// maxPvtSendCt limit is lifted so it can catch up.  If false, the buffer
+   /// is kept as full as possible.  See Amp::GetPvtFlowStats.
+   ///
+   /// On a network that loses frames a full buffer still rides out lost
+   /// segments better, so this is off unless asked for.
+   ///
+   /// Default: false
+   bool pvtAdaptive;
+
+   /// Motion time (milliseconds) that the adaptive PVT flow control keeps in
+   /// the amplifier's buffer on top of the measured network delays.
+   ///
+   /// Default: 20
+   uint16 pvtMinMargin;
+
+   /// Number of recently sent PVT segments kept by the amp object so that 
+   /// they can be sent again if some are lost in transit.  If zero, the
+   /// cache is sized at the start of each trajectory to twice the buffer
+   /// size reported by the amplifier, which covers every segment that can be
+   /// buffered in the amplifier or on the way to it.
+   ///
+   /// Default: 0
+   uint16 pvtCacheSize;
+
+   /// Cache the amplifier's configuration objects.  If true, the values 
+   /// read and written by Amp::GetAmpConfig and Amp::SetAmpConfig are kept 
+   /// in the SDO dictionary cache.  Reading the configuration again is then
+   /// answered locally, and only the objects that changed are written.
+   /// The cache is cleared whenever the amplifier is initialized or reset.
+   /// See SDO::EnableCache for details.
+   ///
+   /// Default: false
+   bool cacheConfig;
 };
 
 /***************************************************************************/
@@ -285,6 +324,9 @@ public:
 PVT trajectory segment cache object.  This is used internally by the Amp
 object to keep track of PVT segments recently sent.  It allows the amp object
 to recover if a segment is lost in transit by resending the missing segments.
+
+The cache is a ring of PVTCACHESIZE segments by default.  The amp object 
+resizes it to suit the amplifier's buffer when a trajectory is started.
 */
 /***************************************************************************/
 class PvtSegCache
@@ -292,13 +334,21 @@ class PvtSegCache
    #define PVTCACHESIZE  32
 public:
    /// Default constructor.  Clears the cache.
-   PvtSegCache(){ Clear(); }
+   PvtSegCache(): size(0), cache(0), pos(0){ SetSize( PVTCACHESIZE ); }
+
+   /// Destructor.  Frees the cache memory.
+   ~PvtSegCache(){ delete[] cache; delete[] pos; }
 
    /// Clear the cache
    void Clear(){ ct = top = 0; }
 
+   /// Return the number of segments the cache can hold
+   uint16 GetSize( void ){ return size; }
+
+   void SetSize( uint16 n );
    void AddSegment( uint8 *seg, uint16 id, uunit p );
    bool GetSegment( uint8 *seg, uint16 id );
+   int GetSegments( uint8 seg[][8], uint16 id, int n );
    bool GetPosition( uunit *p, uint16 id );
 
 private:
@@ -308,10 +358,12 @@ private:
    uint16 top;
    /// ID of the oldest segment in the cache
    uint16 oldest;
+   /// Number of segments the cache can hold
+   uint16 size;
    /// Holds copies of the cached segments
-   uint8 cache[ PVTCACHESIZE ][8];
+   uint8 (*cache)[8];
    /// Holds position info for each segment.
-   uunit pos[ PVTCACHESIZE ];
+   uunit *pos;
 
    /// Private copy constructor (not supported)
    PvtSegCache( const PvtSegCache& );
@@ -320,6 +372,129 @@ private:
    PvtSegCache& operator=( const PvtSegCache& );
 };
 
+/***************************************************************************/
+/**
+Statistics kept by the adaptive PVT flow control of an Amp object.  These 
+show how well the amplifier's PVT buffer is being kept supplied while 
+trajectories are streamed to it.  See Amp::GetPvtFlowStats.
+*/
+/***************************************************************************/
+struct PvtFlowStats
+{
+   /// PVT status updates received
+   uint32 statusCt;
+
+   /// New segments sent in response to status updates
+   uint32 segsSent;
+
+   /// Time (microseconds) from writing PVT segments to the status update
+   /// showing the amplifier received them.  Minimum, average and maximum.
+   int32 latencyMin, latencyAvg, latencyMax;
+
+   /// Time (microseconds) by which status updates arrive later than the
+   /// motion the amplifier ran since the last one.  Average and maximum.
+   int32 statusGapAvg, statusGapMax;
+
+   /// Motion time (milliseconds) held in the amplifier's buffer at the 
+   /// last status update, and the least seen while streaming.
+   int32 margin, marginMin;
+
+   /// Motion time (milliseconds) the flow control is aiming to keep buffered
+   int32 target;
+
+   /// Status updates, while streaming, where less motion was buffered than
+   /// the worst measured delay in getting new segments to the amplifier.
+   /// These are near misses of a buffer underflow.
+   uint32 riskCt;
+
+   /// Trajectories aborted by a PVT buffer underflow
+   uint32 underflows;
+
+   /// PVT sequence errors reported by the amplifier.  Each means that
+   /// one or more segments were lost on the way to the amplifier.
+   uint32 seqErrors;
+
+   /// Segments sent again from the cache after a sequence error, or 
+   /// after the last segments written failed to arrive
+   uint32 resends;
+
+   /// Trajectories aborted because a segment that had to be sent again
+   /// was no longer in the cache
+   uint32 cacheMisses;
+
+   /// Shortest segment time (milliseconds) last suggested to the trajectory
+   uint8 minSegTime;
+};
+
+/***************************************************************************/
+/**
+Adaptive PVT flow control.  This is used internally by the Amp object to
+decide how much of a trajectory to keep buffered in the amplifier.  It keeps
+the time of each segment sent, and measures the delays in getting segments 
+to the amplifier, so that the buffer holds enough motion to cover those
+delays without being filled further then needed.
+*/
+/***************************************************************************/
+class PvtFlowCtrl
+{
+public:
+   PvtFlowCtrl();
+
+   void Reset( uint16 buffSize, uint16 minMargin, uint16 firstID );
+   void ClearStats( void );
+   void SegmentSent( uint16 id, uint8 time ){ segTime[ id & 0xFF ] = time; }
+   uint8 SegTime( uint16 id ){ return segTime[ id & 0xFF ]; }
+   void BatchSent( uint16 nextID, int64 now );
+   int32 Status( uint16 nextID, uint16 activeID, uint16 sentID, bool streaming, int64 now );
+   bool Stalled( uint16 nextID, uint16 sentID, int64 now );
+   uint8 MinSegTime( void );
+
+   /// Check whether enough motion is queued for the amplifier
+   /// @param queued Motion time (ms) buffered or on the way
+   /// @param segs Number of segments buffered or on the way
+   /// @return true if no more segments need be sent for now
+   bool Enough( int32 queued, int segs ){ return (queued >= stats.target) && (segs >= 3); }
+
+   /// Flow statistics
+   PvtFlowStats stats;
+
+private:
+   /// Time (ms) of each recent segment, indexed by the low byte of its ID
+   uint8 segTime[256];
+
+   /// Amplifier buffer size
+   uint16 buffSize;
+
+   /// Least margin (ms) on top of the measured delays
+   uint16 minMargin;
+
+   /// Set while waiting for a status showing a written batch was received
+   bool pending;
+
+   /// Last segment ID of that batch, and when it was written
+   uint16 pendID;
+   int64 pendTime;
+
+   /// When the last batch of segments was written
+   int64 sentTime;
+
+   /// ID of the first segment of the trajectory
+   uint16 firstID;
+
+   /// Time of the last status update while the trajectory was running,
+   /// and the segment the amplifier was running then
+   int64 lastStatus;
+   uint16 lastActive;
+
+   void UpdateTarget( void );
+
+   /// Private copy constructor (not supported)
+   PvtFlowCtrl( const PvtFlowCtrl& );
+
+   /// Private assignment operator (not supported)
+   PvtFlowCtrl& operator=( const PvtFlowCtrl& );
+};
+
 /***************************************************************************/
 /**
 Trapezoidal profile parameters.  This structure holds all the parameters 
@@ -475,6 +650,7 @@ public:
 
    const Error *Init( Network &net, int16 nodeID );
    const Error *Init( Network &net, int16 nodeID, AmpSettings &settings );
+   static const Error *InitParallel( Network &net, uint16 ct, Amp a[], int16 nodeID[], AmpSettings &settings );
    const Error *ReInit( void );
    const Error *Reset( void );
 
@@ -631,6 +807,7 @@ public:
    const Error *Dnld32( int16 index, int16 sub, int32 data );
    const Error *Upld32( int16 index, int16 sub, uint32 &data );
    const Error *Upld32( int16 index, int16 sub, int32 &data );
+   const Error *UpldAsync( int16 index, int16 sub, SdoFuture &f );
    const Error *Dnld16( int16 index, int16 sub, uint16 data );
    const Error *Dnld16( int16 index, int16 sub, int16 data );
    const Error *Upld16( int16 index, int16 sub, uint16 &data );
@@ -810,11 +987,16 @@ public:
    /***************************************************************************/
    //@{
    const Error *SendTrajectory( Trajectory &trj, bool start=true );
+   const Error *PvtPreloadStart( SdoFuture &f );
+   const Error *PvtPreload( Trajectory &trj, SdoFuture &f );
+   const Error *PvtPreloadFinish( Trajectory &trj, SdoFuture &f, bool start=true );
    const Error *StartPVT( void );
    const Error *GetPvtBuffFree( int16 &n );
    const Error *GetPvtSegID( uint16 &id );
    const Error *GetPvtBuffStat( uint32 &stat );
    const Error *GetPvtSegPos( uunit &pos );
+   void GetPvtFlowStats( PvtFlowStats &stats );
+   void ClearPvtFlowStats( void );
    //@}
 
    /***************************************************************************/
@@ -1034,9 +1216,15 @@ private:
    /// PVT cache object used to keep track of old PVT segments.
    PvtSegCache pvtCache;
 
+   /// Adaptive control of the PVT buffer fill
+   PvtFlowCtrl pvtFlow;
+
    /// Reference to the currently running PVT trajectory
    uint32 pvtTrjRef;
 
+   /// Set by PvtPreload if the whole trajectory fit in the amp's buffer
+   bool pvtPreloadAll;
+
 #ifdef CML_ENABLE_USER_UNITS
    // Load encoder unit conversion scaling factors
    double u2lPos; ///< Used to convert position from user units to load units
@@ -183,12 +183,33 @@ public:
 
    const Error *Recv( CanFrame &frame, Timeout timeout=-1 );
    const Error *Xmit( CanFrame &frame, Timeout timeout=0 );
+   const Error *Recv( CanFrame frame[], int max, int &ct, Timeout timeout=-1 );
+   const Error *Xmit( CanFrame frame[], int ct, Timeout timeout=0 );
 
    /// Return true if the CAN interface supports timestamps on 
    /// received frames.
    /// @return true if timestamps are supported
    virtual bool SupportsTimestamps( void ){ return false; }
 
+   /***************************************************************************/
+   /**
+     Set the frames the interface should receive.  A frame is received if for
+     any of the filters (frame.id & mask[i]) == (id[i] & mask[i]).  Bit 29 of
+     the ID and mask identifies extended frames as for CanFrame::id.  Error 
+     frames are always received.
+
+     Filtering is only a hint used to reduce the number of frames the host
+     has to handle.  Interfaces that can't filter frames simply ignore this, 
+     which is what the default implementation does.
+
+     @param id Array of message IDs to receive.
+     @param mask Array of masks giving the bits of each ID to check.
+     @param ct The number of filters.  If zero, all frames are received.
+     @return A pointer to an error object, or NULL on success.
+     */
+   /***************************************************************************/
+   virtual const Error *SetRecvFilter( const uint32 id[], const uint32 mask[], int ct ){ return 0; }
+
    /***************************************************************************/
    /**
      Check an ID to make sure it's valid.  To be valid, a message ID
@@ -246,6 +267,44 @@ protected:
    /***************************************************************************/
    virtual const Error *XmitFrame( CanFrame &frame, Timeout timeout );
 
+   /***************************************************************************/
+   /**
+     Receive all CAN frames that are waiting, up to a maximum count.  This is 
+     called by the public Recv function for a block of frames.  It waits for 
+     the first frame as RecvFrame does, and then returns any others that have 
+     already been received without waiting for more.
+
+     The default implementation calls RecvFrame once for each frame.  CAN
+     interfaces that can read several frames at once should override it.
+
+     @param frame An array of at least max frames that will be filled by the read.
+     @param max The maximum number of frames to read (at least 1).
+     @param ct On success, the number of frames read (at least 1).
+     @param timeout The timeout (ms) to wait for the first frame.  A timeout 
+     of 0 will return immediately if no data is available.  A timeout of < 0 
+     will wait forever.
+     @return A pointer to an error object, or NULL on success.
+     */
+   /***************************************************************************/
+   virtual const Error *RecvFrames( CanFrame frame[], int max, int &ct, Timeout timeout );
+
+   /***************************************************************************/
+   /**
+     Write a block of CAN frames to the CAN network, in order.  This is called
+     by the public Xmit function for a block of frames.
+
+     The default implementation calls XmitFrame once for each frame.  CAN
+     interfaces that can write several frames at once should override it.
+
+     @param frame An array of the frames to write.
+     @param ct The number of frames to write.
+     @param timeout The time to wait for each frame to be sent, as for XmitFrame.
+     @return A pointer to an error object, or NULL on success.  If an error 
+     is returned, the frames after the one that failed were not sent.
+     */
+   /***************************************************************************/
+   virtual const Error *XmitFrames( CanFrame frame[], int ct, Timeout timeout );
+
    int FindPortNumber( const char *id );
 };
 
@@ -25,6 +25,8 @@ the CANopen network.
 #include "CML_Threads.h"
 #include "CML_Utils.h"
 
+#include <atomic>
+
 CML_NAMESPACE_START()
 
 /**
@@ -117,6 +119,12 @@ public:
    /// Default: 9
    int readThreadPriority;
 
+   /// CPU the read thread is pinned to, or -1 to let it run on any CPU.
+   /// Pinning the read thread to a core kept free of other work stops 
+   /// it migrating between cores.  See Thread::setAffinity.
+   /// Default: -1
+   int readThreadCPU;
+
    /// If true, the master (i.e. the computer that CML is running on) will
    /// generate sync timing messages used to synchronize the clocks of the 
    /// nodes on the CANopen network.  This is only possible if the CAN 
@@ -139,6 +147,14 @@ public:
    /// must match the corresponding value passed in the AmpSettings object.
    /// Default 0x180
    uint32 timeID;
+
+   /// If true, the CAN interface is asked to only pass on frames the 
+   /// CanOpen object uses: those with an enabled receiver, and emergency,
+   /// node guarding and SDO response frames (see CanInterface::SetRecvFilter).
+   /// This is only a hint, most CAN interfaces receive all frames anyway.
+   /// Note that frames which are filtered out won't appear in the CAN log.
+   /// Default: true
+   bool filterFrames;
 };
 
 /***************************************************************************/
@@ -236,6 +252,8 @@ public:
    const Error *Xmit( CanFrame &frame, Timeout timeout=2000 );
 
    const Error *XmitSDO( Node *n, uint8 *data, uint16 len, uint16 *ret, Timeout timeout=2000 );
+   const Error *StartSDO( Node *n, uint8 *data, uint16 len, Semaphore *done, Timeout timeout=2000 );
+   const Error *FinishSDO( Node *n, Semaphore *done, Timeout timeout=2000 );
    const Error *XmitPDO( class PDO *pdo, Timeout timeout=2000 );
 
    const Error *PdoEnable( Node *node, uint16 slot, PDO *pdo );
@@ -274,6 +292,8 @@ public:
 private:
    const Error *NMT_Msg( int code, int nodeID );
    void HandleNmtFrame( CanFrame &frame, Node *n );
+   void HandleFrame( CanFrame &frame );
+   void UpdateRecvFilter( void );
    const Error *WaitNodeState( Node *n, NodeState state, Timeout timeout );
    CanOpenNodeInfo *GetCoInfo( Node *n );
 
@@ -281,11 +301,20 @@ private:
    uint32 LookupReceiver( uint32 canMsgID );
    void ClearHash( void );
 
+   /// Receivers of standard (11-bit) message IDs, indexed by ID.
+   /// The receive thread reads these without locking, they are
+   /// only changed with the hash mutex held.
+   std::atomic<uint32> stdRcvr[ 2048 ];
+
    /// This hash is used to keep track of the Receiver
-   /// objects that are enabled.
+   /// objects that are enabled for extended message IDs.
    class coHashEntry *hash[ CML_HASH_SIZE ];
    Mutex hashMtx;
 
+   /// True if the CAN interface's receive filter should follow
+   /// the enabled receivers.
+   bool filterFrames;
+
    /// This array keeps track of all node objects associated 
    /// with this CANopen network
    uint32 nodes[128];
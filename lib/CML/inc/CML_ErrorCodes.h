@@ -138,6 +138,7 @@
 #define CMLERR_ThreadError_General             125
 #define CMLERR_ThreadError_BadParam            126
 #define CMLERR_ThreadError_Alloc               127
+#define CMLERR_ThreadError_MemLock             446
 #define CMLERR_EventError_AlreadyOwned         128
 #define CMLERR_EventError_NotMapped            129
 #define CMLERR_AmpFileError_format             130
@@ -212,6 +213,15 @@
 #define CMLERR_AmpError_NotInit                  434
 #define CMLERR_AmpFileError_axisCt               435
 #define CMLERR_EtherCatError_Sync0Config         436
+#define CMLERR_TrjStreamError_BadParam           437
+#define CMLERR_TrjStreamError_Full               438
+#define CMLERR_TrjStreamError_InUse              439
+#define CMLERR_TrjStreamError_Ended              440
+#define CMLERR_LinkError_BadSetting              441
+#define CMLERR_PathError_BadPlane                442
+#define CMLERR_TrjOnlineError_BadParam           443
+#define CMLERR_TrjOnlineError_InUse              444
+#define CMLERR_TrjOnlineError_Ended              445
 
 #endif
 
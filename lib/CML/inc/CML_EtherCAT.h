@@ -23,6 +23,8 @@ top level of the EtherCAT network interface.
 #include "CML_Threads.h"
 #include "CML_Utils.h"
 
+#include <atomic>
+
 CML_NAMESPACE_START()
 
 /**
@@ -137,7 +139,11 @@ public:
    {
       cycleThreadPriority = 9;
       readThreadPriority = 9;
+      cycleThreadCPU = -1;
+      readThreadCPU = -1;
       cyclePeriod = 1;
+      dcAlign = true;
+      dcShift = -1;
    }
 
    /// Defines the EtherCAT read thread priority.  The read thread is started
@@ -155,10 +161,77 @@ public:
    /// Default: 9
    int cycleThreadPriority;
 
+   /// CPU the read thread is pinned to, or -1 to let it run on any CPU.
+   /// See Thread::setAffinity.
+   /// Default: -1
+   int readThreadCPU;
+
+   /// CPU the cycle thread is pinned to, or -1 to let it run on any CPU.
+   /// Keeping the cycle thread on a core of its own removes most of the
+   /// jitter caused by other work on the host.  See Thread::setAffinity.
+   /// Default: -1
+   int cycleThreadCPU;
+
    /// EtherCAT cycle period.  This parameter defines the
    /// update rate at which the EtherCAT network is polled.
+   /// Fractions of a millisecond may be used, for example 0.25
+   /// for a 4 kHz cycle.
    /// Default: 1 ms.
    Timeout cyclePeriod;
+
+   /// Lock the cycle thread to the distributed clock.  When set, and
+   /// the nodes have been given a SYNC0 period that divides evenly
+   /// into the cycle period, the start of each cycle is nudged so that
+   /// the process data frame reaches the reference clock at the same 
+   /// point in every SYNC0 period.  See dcShift.
+   /// Default: true
+   bool dcAlign;
+
+   /// Time (nanoseconds) after each SYNC0 pulse at which the process
+   /// data frame should pass the reference clock when dcAlign is set.
+   /// A negative value places it half way between SYNC0 pulses, which
+   /// leaves the most margin for jitter either side.
+   /// Default: -1
+   int32 dcShift;
+};
+
+/***************************************************************************/
+/**
+Statistics kept by the EtherCAT cycle thread.  See EtherCAT::GetCycleStats.
+*/
+/***************************************************************************/
+struct EtherCatCycleStats
+{
+   /// Number of cycles run
+   uint32 cycles;
+
+   /// Number of cycles skipped because the cycle thread fell more
+   /// than a whole period behind
+   uint32 overruns;
+
+   /// Smallest, largest and average wake up jitter in nanoseconds
+   int32 jitterMin, jitterMax, jitterAvg;
+
+   /// Smallest, largest and average time (nanoseconds) from the cycle
+   /// thread waking up to the process data of that cycle being returned
+   /// and processed
+   int32 latencyMin, latencyMax, latencyAvg;
+
+   /// Process data frames not returned within one cycle period
+   uint32 lostFrames;
+
+   /// Process data datagrams returned with a bad working counter,
+   /// i.e. not read or written by the node they were addressed to
+   uint32 wkcErrors;
+
+   /// Number of times the process data frames were rebuilt because
+   /// a node or PDO was added, removed or changed state
+   uint32 rebuilds;
+
+   /// Most recent offset (nanoseconds) of the process data frame from
+   /// its target point in the SYNC0 period.  Zero if the cycle isn't
+   /// locked to the distributed clock.
+   int32 dcPhase;
 };
 
 /**
@@ -175,6 +248,19 @@ public:
    virtual const Error *SendPacket( uchar *msg, uint16 len ) = 0;
    virtual const Error *RecvPacket( uchar *msg, uint16 *len, Timeout timeout=-1 ) = 0;
    virtual const Error *CloseSockets( void ){ return 0;}
+
+   /// Receive a packet, leaving it where the hardware put it if possible.
+   /// On entry *msg points to a buffer of *len bytes the packet may be
+   /// copied to.  Hardware that can hand out its own receive buffers
+   /// replaces *msg with a pointer into them instead.  In either case the
+   /// packet must be given back with ReleasePacket once it's processed.
+   /// The default just calls RecvPacket.
+   virtual const Error *RecvPacketInPlace( uchar **msg, uint16 *len, Timeout timeout=-1 ){
+      return RecvPacket( *msg, len, timeout );
+   }
+
+   /// Give back a packet returned by RecvPacketInPlace.
+   virtual void ReleasePacket( uchar *msg ){}
 };
 
 /***************************************************************************/
@@ -241,6 +327,12 @@ public:
 
    Timeout GetCyclicPeriod( void ){ return settings.cyclePeriod; }
 
+   /// Return timing statistics of the cyclic thread.
+   /// @param stats The statistics are returned here.
+   void GetCycleStats( PeriodicTimerStats &stats ){ cycleTimer.GetStats( stats ); }
+   void GetCycleStats( EtherCatCycleStats &stats );
+   void ClearCycleStats( void );
+
 protected:
    const Error *InitDistClk( void );
    const Error *NodeRead( Node *n, int16 addr, int16 len, void *buff );
@@ -262,8 +354,21 @@ private:
    Semaphore *stopSem;
    Mutex mtx;
    Mutex cyclicMutex;
+   PeriodicTimer cycleTimer;
    EventMap cyclicUpdate;
 
+   /// Changed whenever the process data exchanged by the cycle thread
+   /// needs to be rebuilt.  Changes which free node information are 
+   /// made with cyclicMutex held.
+   std::atomic<uint32> cycleLayout;
+
+   /// SYNC0 period (ns) last set with SetSync0Period
+   uint32 sync0Period;
+
+   EtherCatCycleStats cycStats;
+   int64 latencySum;
+   uint32 latencyCt;
+
    bool readThreadRunning;
    bool cycThreadRunning;
 
@@ -302,8 +407,13 @@ private:
    const Error *FindSyncMgrCfg( Node *n, bool boot );
    const Error *CfgSyncMgr( Node *n, uint16 smReg, uint16 base, uint16 len, uint16 ctrl );
    bool LoadPdoDat( uint32 ref, uint8 *buff, int max );
+   void InvalidateCycle( void ){ cycleLayout++; }
+   void BuildCycleImage( class EcatCycleImage &img );
+   void RunCycle( class EcatCycleImage &img, int64 start );
+   void AlignToDC( class EcatCycleImage &img, int64 dc );
 
    friend class PDO_List;
+   friend class TPDO_List;
    friend class RPDO_List;
    friend class EcatCycleThread;
    friend class EcatReadThread;
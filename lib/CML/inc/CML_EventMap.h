@@ -58,23 +58,24 @@ Event objects are not thread safe.  Only one thread should access a particular
 Event object at a time.  EventMap objects however are thread safe, so any 
 number of threads may attach their own Event objects to the same EventMap
 object without issue.
+
+An attached event is tested when it's added to the map, and after that each
+time one of the map bits it's waiting on changes.  An event with a value of
+zero is treated as waiting on every bit.
 */
 /***************************************************************************/
 class Event
 {
    friend class EventMap;
 
-   Mutex mtx;
-
    /// Pointer to the map that this event is assigned to
    class EventMap *map;
 
    Event *prev, *next;
 
-   /// If a semaphore is attached to the Event, then the
-   /// semaphone will be posted each time the event becomes
-   /// true.
-   Semaphore *semPtr;
+   /// Set to one when the event becomes true while a thread
+   /// is waiting on it in Event::Wait.
+   Futex fired;
 
    /// Used for more complex event types
    class EventMap *chainMap;
@@ -83,6 +84,9 @@ class Event
    /// This is the most recent mask that cause the event to succeed
    uint32 trueMask;
 
+   /// The map bits that this event depends on
+   uint32 watchBits( void ){ return value ? value : 0xFFFFFFFF; }
+
    /// Called by the EventMap for all attached Events 
    /// whenever the map's mask is updated.
    void update( uint32 newMask );
@@ -301,9 +305,8 @@ class EventMap
    EventMap &operator=( const EventMap & );
 
 public:
-   EventMap()
+   EventMap(): mask(0), watched(0)
    {
-      mask = 0;
       list = 0;
    }
 
@@ -317,7 +320,7 @@ public:
      @return The 32-bit mask value.
      */
    /***************************************************************************/
-   uint32 getMask( void ){ return mask; }
+   uint32 getMask( void ){ return mask.load(); }
 
    /***************************************************************************/
    /**
@@ -327,9 +330,7 @@ public:
    /***************************************************************************/
    void setMask( uint32 mask )
    {
-      mutex.Lock();
-      update( mask );
-      mutex.Unlock();
+      update( 0xFFFFFFFF, mask );
    }
 
    /***************************************************************************/
@@ -340,9 +341,7 @@ public:
    /***************************************************************************/
    void setBits( uint32 bits )
    {
-      mutex.Lock();
-      update( mask | bits );
-      mutex.Unlock();
+      update( bits, bits );
    }
 
    /***************************************************************************/
@@ -353,9 +352,7 @@ public:
    /***************************************************************************/
    void clrBits( uint32 bits )
    {
-      mutex.Lock();
-      update( mask & ~bits );
-      mutex.Unlock();
+      update( bits, 0 );
    }
 
    /***************************************************************************/
@@ -370,19 +367,25 @@ public:
    /***************************************************************************/
    void changeBits( uint32 bits, uint32 value )
    {
-      value &= bits;
-
-      mutex.Lock();
-      update( (mask & ~bits) | value );
-      mutex.Unlock();
+      update( bits, value & bits );
    }
 
 private:
+   /// Protects the list of attached events
    Mutex mutex;
-   uint32 mask;
+
+   /// The map's mask.  It's changed atomically, and the mutex is only
+   /// taken when a bit that some attached event depends on changes.
+   std::atomic<uint32> mask;
+
+   /// Map bits that at least one attached event depends on
+   std::atomic<uint32> watched;
+
    Event *list;
 
-   void update( uint32 newMask );
+   void update( uint32 bits, uint32 value );
+   void Notify( uint32 newMask );
+   void Rewatch( void );
 
    friend class Event;
 };
@@ -102,6 +102,10 @@ public:
    void setPos( int i, uunit p ){ CML_ASSERT( (i>=0) && (i<N) ); pos[i]=p; }
    uunit &operator[]( int i ){ CML_ASSERT( (i>=0) && (i<N) ); return pos[i]; }
    uunit operator[]( int i ) const { CML_ASSERT( (i>=0) && (i<N) ); return pos[i]; }
+
+   /// Get the positions of all axes as an array of getDim() values
+   /// @return A pointer to the array
+   const uunit *getArray( void ) const { return pos; }
 };
 
 CML_NAMESPACE_END()
@@ -25,6 +25,8 @@ work together.
 #include "CML_Geometry.h"
 #include "CML_TrjScurve.h"
 
+#include <atomic>
+
 CML_NAMESPACE_START()
 
 /***************************************************************************/
@@ -146,6 +148,9 @@ public:
    /// An amp object referenced by the linkage is no longer valid
    static const LinkError AmpRemoved;
 
+   /// An illegal setting was passed to Linkage::Configure
+   static const LinkError BadSetting;
+
 protected:
    /// Standard protected constructor
    LinkError( uint16 id, const char *desc ): Error( id, desc ){}
@@ -215,6 +220,35 @@ public:
    ///
    /// Default: false
    bool haltOnVelWin;
+
+   /// Number of PVT points buffered for each amplifier between the
+   /// linkage trajectory and the amplifier.  Points are calculated 
+   /// from the LinkTrajectory in batches and held here until each 
+   /// amplifier has room for them.
+   ///
+   /// This can only be changed while no trajectory is running.
+   ///
+   /// Default: CML_LINKAGE_TRJ_BUFFER_SIZE
+   uint16 trjBufferSize;
+
+   /// Maximum number of points requested from the linkage trajectory 
+   /// at once.  The batch is also limited by the free space in the
+   /// amplifier buffers and by LinkTrajectory::MaximumBatchPoints.
+   ///
+   /// Default: 8
+   uint16 trjBatchSize;
+
+   /// Priority (0 to 9) of the linkage thread, which watches the amplifiers
+   /// during moves and ends them.  See Thread::setPriority.
+   ///
+   /// Default: 5
+   int threadPriority;
+
+   /// CPU the linkage thread is pinned to, or -1 for any CPU.  
+   /// See Thread::setAffinity.
+   ///
+   /// Default: -1
+   int threadCPU;
 };
 
 /***************************************************************************/
@@ -236,14 +270,21 @@ public:
 
    const Error *Init( uint16 ct, Amp a[] );
    const Error *Init( uint16 ct, Amp *a[] );
+   const Error *Init( Network &net, uint16 ct, Amp a[], int16 nodeID[], AmpSettings &settings );
    const Error *Configure( LinkSettings &settings );
 
+   const Error *GetAmpConfig( AmpConfig cfg[] );
+   const Error *SetAmpConfig( AmpConfig cfg[] );
+
    Amp &GetAmp( uint16 i );
    uint32 GetAmpRef( uint16 i );
 
    const Error *MoveTo( PointN &p, uunit vel, uunit acc, uunit dec, uunit jrk, bool start=true );
    const Error *SetMoveLimits( uunit vel, uunit acc, uunit dec, uunit jrk );
    const Error *GetMoveLimits( uunit &vel, uunit &acc, uunit &dec, uunit &jrk );
+   const Error *MoveTo( PointN &p, PointN &vel, PointN &acc, PointN &dec, PointN &jrk, bool start=true );
+   const Error *SetMoveLimits( PointN &vel, PointN &acc, PointN &dec, PointN &jrk );
+   const Error *GetMoveLimits( PointN &vel, PointN &acc, PointN &dec, PointN &jrk );
    const Error *MoveTo( PointN &p, bool start=true );
    const Error *StartMove( void );
    const Error *WaitMoveDone( Timeout timeout=-1 );
@@ -378,7 +419,6 @@ public:
    }
 
 private:
-   Mutex mtx;
    LinkSettings cfg;
    RPDO_LinkCtrl ctrlPDO;
    uint16 ampct;
@@ -386,6 +426,10 @@ private:
    uunit maxVel, maxAcc, maxDec, maxJrk;
    Semaphore startSema;
 
+   /// Per-axis move limits, used by MoveTo when axisLimits is set
+   bool axisLimits;
+   Point<CML_MAX_AMPS_PER_LINK> axisVel, axisAcc, axisDec, axisJrk;
+
 #ifdef CML_ALLOW_FLOATING_POINT
    LinkTrjScurve scurve;
 #endif
@@ -393,38 +437,63 @@ private:
    int latchedErrAmp;
    const Error *latchedErr;
 
+   /// Collects the move acknowledgements of the amplifiers in StartMove.
+   /// Bit N is set while amplifier N has acknowledged the move.
+   EventMap startMap;
+
    const Error *LatchError( const Error *err, int ndx );
+   const Error *AmpConfigAll( AmpConfig cfg[], bool set );
 
    void CheckIndex( uint16 i );
 
 #ifdef CML_LINKAGE_TRJ_BUFFER_SIZE
-   /// Utility class used internally by the linkage object
+   /// Utility class used internally by the linkage object.
+   ///
+   /// Each amplifier has one of these.  It's a single producer, single
+   /// consumer ring of points.  Points are added by whichever thread is
+   /// generating a batch from the linkage trajectory, and removed by the 
+   /// amplifier as it streams them out.  Neither side takes a lock.
    class AmpTrj: public Trajectory
    {
+      struct TrjPoint
+      {
+         uunit p, v;
+         uint8 t;
+         bool  u;
+      };
+
       Linkage *linkPtr;
-      uint8 ampNum, head, tail;
+      TrjPoint *pts;
+      int size;
+      std::atomic<int> head, tail;
       bool inUse;
-      uunit p[ CML_LINKAGE_TRJ_BUFFER_SIZE ];
-      uunit v[ CML_LINKAGE_TRJ_BUFFER_SIZE ];
-      uint8 t[ CML_LINKAGE_TRJ_BUFFER_SIZE ];
-      bool  u[ CML_LINKAGE_TRJ_BUFFER_SIZE ];
+      bool lastUseVel;
+      uint8 minSegTime;
 
    public:
-      ~AmpTrj(){ KillRef(); }
+      AmpTrj(): pts(0), size(0), head(0), tail(0) {}
+      ~AmpTrj(){ KillRef(); delete[] pts; }
       void Init( Linkage *lptr );
+      const Error *SetSize( int n );
+      int FreeCount( void );
       const Error *StartNew( void );
       void Finish( void );
       bool UseVelocityInfo( void );
       int MaximumBufferPointsToUse( void );
+      void SetMinSegmentTime( uint8 ms );
       const Error *NextSegment( uunit &pos, uunit &vel, uint8 &time );
       const Error *AddPoint( uunit pos, uunit vel, uint8 time, bool useVel );
    };
    friend class AmpTrj;
 
    const Error *RequestNextTrjPoint( void );
+   const Error *GenerateTrjBatch( void );
 
    uint32 linkTrjRef;
    AmpTrj ampTrj[ CML_MAX_AMPS_PER_LINK ];
+
+   /// Set while some thread is generating trajectory points
+   std::atomic_flag trjGenBusy;
 #endif
 
    /// Utility class used to keep the linkage status up to date
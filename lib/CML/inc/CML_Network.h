@@ -27,6 +27,7 @@ CML_NAMESPACE_START()
 // Forward references
 class Node;
 class PDO;
+class Semaphore;
 
 /**
 This class holds the error codes that describe various
@@ -140,6 +141,8 @@ public:
    virtual const Error *BootModeNode( Node *n ) = 0;
 
    virtual const Error *XmitSDO( Node *n, uint8 *data, uint16 len, uint16 *ret, Timeout timeout=2000 ) = 0;
+   virtual const Error *StartSDO( Node *n, uint8 *data, uint16 len, Semaphore *done, Timeout timeout=2000 );
+   virtual const Error *FinishSDO( Node *n, Semaphore *done, Timeout timeout=2000 );
    virtual const Error *XmitPDO( class PDO *pdo, Timeout timeout=2000 ) = 0;
    virtual const Error *PdoEnable( Node *node, uint16 slot, PDO *pdo ) = 0;
    virtual const Error *PdoDisable( Node *node, uint16 slot, PDO *pdo ) = 0;
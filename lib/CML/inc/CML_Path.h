@@ -10,9 +10,13 @@
 #ifndef _DEF_INC_PATH
 #define _DEF_INC_PATH
 
+#include "CML_Settings.h"
 #include "CML_Threads.h"
 #include "CML_Trajectory.h"
 
+#if defined(CML_ALLOW_FLOATING_POINT) && defined(CML_ENABLE_USER_UNITS)
+
+
 CML_NAMESPACE_START()
 
 /**
@@ -29,42 +33,294 @@ public:
    static const PathError Alloc;          ///< Unable to allocate memory for path 
    static const PathError BadLength;      ///< An illegal negative length value was passed
    static const PathError Empty;          ///< Attempt to execute an empty path
+   static const PathError BadPlane;       ///< The arc plane is not valid for this move
 
 protected:
    /// Standard protected constructor
    PathError( uint16 id, const char *desc ): Error( id, desc ){}
 };
 
-#define PATH_MAX_DIMENSIONS        2
+/// Maximum number of dimensions of a Path object.  Use the PathDim
+/// template directly for paths with more dimensions.
+#define PATH_MAX_DIMENSIONS        8
+
+/**
+ Internal class used by Path planning code.
+
+ A path element holds the velocity profile along the length of one segment
+ of the path.  Classes derived from it map that length onto the axes of
+ the path.
+ */
+class PathElement
+{
+protected:
+   PathElement *next;
+   PathElement *prev;
+
+   // These values are calculated when a segment is first
+   // initialized and never change during the life of the
+   // segment.
+   double length;   // Length of current segment
+
+   double velMax;   // Maximum velocity limit during this segment
+   double accMax;   // Acceleration limit to use during this segment
+   double decMax;   // Deceleration limit to use during this segment (use accel limit if <= 0)
+   double jrkMax;   // Jerk limit to use during this segment (no limit if <= 0)
+
+   // These parameters will change as more segments are added
+   // to the path.
+   double velEnd;   // Maximum velocity at end of segment
+   double velPeak;  // Maximum ending velocity possible based on earlier segments
+
+   // Once I've determined the starting and ending velocity for a segment, I'll
+   // calculate the times of each of the seven possible sub-segments in the move.
+   bool calculated;
+   double SegT[7], SegP[7], SegV[7], SegA[7];
+
+   /**
+    * Set the segment length.  This must be called in the
+    * constructor of the segment object before the segment
+    * is added to a path.
+    */
+   void setLength( double L )
+   {
+      length = L;
+   }
+
+   virtual void CalcNoJrk( void );
+   bool CalcForVel( double V, bool force=false );
+   void CalcTimes( void );
+
+public:
+   PathElement( void );
+
+   virtual ~PathElement()
+   {
+      Unlink();
+   }
+
+   void Unlink( void );
+   void Add( PathElement *pe );
+
+   PathElement *getPrev( void ){ return prev; }
+   PathElement *getNext( void ){ return next; }
+
+   double getVelStart( void )
+   {
+      PathElement *pe = getPrev();
+      return (pe) ? pe->getVelEnd() : 0.0;
+   }
+
+   double getVelEnd( void )
+   {
+      return velEnd;
+   }
+
+   /**
+    * Initialize some internal parameters based on
+    * segment length and various limits (velocity,
+    * accel, decel).
+    */
+   void Init( double V, double A, double D, double J )
+   {
+      // Save the constraints
+      velMax = V;
+      accMax = A;
+      decMax = D;
+      jrkMax = J;
+   }
+
+   /// Return the length of the path element
+   virtual double getLength( void ){ return length; }
+
+   /// Get the maximum velocity limit used during this
+   /// segment.
+   virtual double getMaxVel( void ){ return velMax; }
+
+   /// Get the acceleration limit used during this segment.
+   virtual double getMaxAcc( void ){ return accMax; }
+
+   /// Get the deceleration limit used during this segment
+   virtual double getMaxDec( void )
+   {
+      return (decMax <= 0.0) ? accMax : decMax;
+   }
+
+   /// Get the jerk limit used during this segment.
+   /// Note that a value of <= 0.0 means no jerk limit
+   virtual double getMaxJrk( void ){ return jrkMax; }
+
+   /// Return true if jerk limits are being used
+   virtual bool usingJerkLimits( void ){ return getMaxJrk() >= 0.0; }
+
+   // Return the maximum starting velocity that this segment
+   // could possibly handle.  This is just the end velocity
+   // increased by the amount we could speed up going back
+   // through this segment.
+   virtual double getMaxStartVel( void )
+   {
+      return getMaxVelInc( velEnd, getMaxDec() );
+   }
+
+   virtual double getMaxVelInc( double Vs, double A );
+   bool adjustEndState( void );
+   virtual bool Calculate( void );
+   virtual double getDuration( void );
+   virtual bool getNextSegTime( double &t );
+   virtual void getPathPos( double t, double &pos, double &vel );
+
+   /**
+     Get the position and velocity of each axis at the specified time into
+     the segment.
+     @param t The time (seconds) into the segment.
+     @param pos Array where the axis positions are returned.
+     @param vel Array where the axis velocities are returned.
+     @return An error object or null on success
+    */
+   virtual const Error *getTrjSeg( double t, uunit pos[], uunit vel[] ) = 0;
+};
 
-class PathElement;
+/**
+ * Line segment path element.
+ */
+template<int N> class PathLineSeg: public PathElement
+{
+   Point<N> start;
+   Point<N> dir;
+public:
+   /**
+    * @param start Position at the start of the line
+    * @param dir Unit vector giving the direction of motion
+    * @param len Length of the line
+    */
+   PathLineSeg( PointN &start, PointN &dir, double len )
+   {
+      this->start = start;
+      this->dir = dir;
+      setLength( len );
+   }
+
+   const Error *getTrjSeg( double t, uunit p[], uunit v[] )
+   {
+      double pos, vel;
+
+      getPathPos( t, pos, vel );
+
+      for( int i=0; i<start.getDim(); i++ )
+      {
+         p[i] = start[i] + dir[i] * pos;
+         v[i] = dir[i] * vel;
+      }
+      return 0;
+   }
+};
 
 /**
-  Multi-axis complex trajectory path.
-  The object may be used to construct one or two dimensional trajectories 
-  built out of line segments and arcs.
+ * Arc path element.  This holds the parts of an arc that don't depend
+ * on the number of axes.  The arc angle at time t is startAng - s/radius
+ * for positive (clockwise) arcs and startAng + s/radius for negative ones,
+ * where s is the distance traveled.
  */
-class Path : public LinkTrajectory 
+class PathArcElement: public PathElement
 {
-   // Dimension (number of axes) of the path.
-   int dim;       
+protected:
+   double radius, startAng, totAng;
+   double velCentrip;
+
+   void getArcPos( double t, double &cosAng, double &sinAng, double &vel );
 
-   // Position at end of most recent segment added
-   Point<PATH_MAX_DIMENSIONS> posEnd;
+public:
+   PathArcElement( double r, double start, double tot );
+   double getMaxVel( void );
+   bool getNextSegTime( double &t );
+};
 
-   // Starting position of the trajectory
-   Point<PATH_MAX_DIMENSIONS> posStart;
+/**
+ * Arc path element.  The arc lies in the plane through the center point
+ * spanned by the two orthonormal vectors u and v.  Angles are measured
+ * from u toward v.
+ */
+template<int N> class PathArcSeg: public PathArcElement
+{
+   Point<N> center, u, v;
+public:
+   PathArcSeg( PointN &ctr, PointN &u, PointN &v, double r, double start, double tot ):
+      PathArcElement( r, start, tot )
+   {
+      center = ctr;
+      this->u = u;
+      this->v = v;
+   }
+
+   const Error *getTrjSeg( double t, uunit p[], uunit vl[] )
+   {
+      double cosAng, sinAng, vel;
+
+      getArcPos( t, cosAng, sinAng, vel );
+
+      for( int i=0; i<center.getDim(); i++ )
+      {
+         p[i]  = center[i] + radius * (cosAng * u[i] + sinAng * v[i]);
+         vl[i] = vel * (sinAng * u[i] - cosAng * v[i]);
+      }
+      return 0;
+   }
+};
+
+/**
+ * Path segment used to delay for a specified amount of time.
+ */
+template<int N> class PathDelaySeg: public PathElement
+{
+   Point<N> pos;
+   double delayTime;
+public:
+   PathDelaySeg( PointN &p, double t )
+   {
+      pos = p;
+      delayTime = t;
+      setLength( 0.0 );
+   }
+   virtual double getMaxVel( void ){ return 0.0; }
+   virtual bool Calculate( void )
+   {
+      if( calculated ) return true;
+      calculated = true;
+      SegT[3] = delayTime;
+      return false;
+   }
+
+   const Error *getTrjSeg( double t, uunit p[], uunit v[] )
+   {
+      for( int i=0; i<pos.getDim(); i++ )
+      {
+         p[i] = pos[i];
+         v[i] = 0;
+      }
+      return 0;
+   }
+};
 
-   // Direction of motion at end of last segment
-   double dirEnd;
+/**
+  Multi-axis complex trajectory path.
 
+  This is the base class of all paths.  It holds the list of path segments
+  and calculates the velocity profile along them.  It is independent of the
+  number of axes; the segments themselves are created by the PathDim template,
+  which fixes the maximum number of axes at compile time.
+ */
+class PathN : public LinkTrajectory
+{
    /// Private copy constructor (not supported)
-   Path( const Path& );
+   PathN( const PathN& );
 
    /// Private assignment operator (not supported)
-   Path& operator=( const Path& );
+   PathN& operator=( const PathN& );
 
 protected:
+   // Dimension (number of axes) of the path.
+   int dim;       
+
    /*
     * Global limits.  These limits apply to new
     * segments added to the path.
@@ -86,26 +342,54 @@ protected:
    // Time into current segment of next point to retrieve
    double segTime;
 
-   const Error *AddSegment( PathElement *e );
+   // Shortest segment time (ms) suggested by the amplifiers
+   uint8 minSegMs;
+
+   // Position at end of most recent segment added, starting position
+   // of the trajectory and direction of motion (unit vector) at end of
+   // last segment.  These are held by the PathDim template.
+   PointN *posEnd, *posStart, *dirEnd;
+
+   // Orthonormal vectors giving the plane for new arcs
+   PointN *arcU, *arcV;
+
+   // Scratch points used while adding segments
+   PointN *tmpA, *tmpB;
+
+   const Error *AddSegment( PathElement *e, uunit vel=0 );
+   const Error *AddArcSeg( PointN &center, double radius, double startAng, double angle, uunit vel );
    uint8 GetTime( void );
+   void InitGeometry( void );
+
+   /// Create a line segment sized for this path
+   virtual PathElement *NewLine( PointN &start, PointN &dir, double len ) = 0;
 
-   void OffsetPos( double p[] );
+   /// Create an arc segment sized for this path
+   virtual PathElement *NewArc( PointN &center, double radius, double start, double tot ) = 0;
+
+   /// Create a delay segment sized for this path
+   virtual PathElement *NewDelay( PointN &pos, double sec ) = 0;
+
+   /**
+     Offset the passed array of relative positions based
+     on the starting position set by the user.
+     @param p Array of positions to be adjusted
+    */
+   virtual void OffsetPos( double p[] ) = 0;
 
 public:
 
    /**
      Path object constructor.  The number of dimensions for the path
-     must be passed.  This object currently supports one and two 
-     dimensional (i.e. one and two axis) path construction.
-     @param d The number of dimensions for the path.  Must be either
-              one or two for now.
+     must be passed.
+     @param d The number of dimensions for the path.
     */
-   Path( uint d );
+   PathN( uint d );
 
    /**
      Destructor for the path object.
     */
-   virtual ~Path( void );
+   virtual ~PathN( void );
 
    /**
      Reset the path to the first position.
@@ -164,6 +448,21 @@ public:
    */
    virtual const Error *SetJrk( uunit j );
 
+   /**
+     Set the plane that arcs added after this call are drawn in.  The plane
+     is spanned by the two passed vectors, which need not be normalized but
+     must not be parallel.  Arc angles are measured from the first vector
+     toward the second, so positive (clockwise) angles rotate from the
+     second vector toward the first.
+
+     The default plane is formed by the first two axes of the path.
+
+     @param u First vector in the plane.
+     @param v Second vector in the plane.
+     @return An error object or null on success
+    */
+   virtual const Error *SetArcPlane( PointN &u, PointN &v );
+
    /**
      Add a line segment from the current position to the 
      specified point.  The direction of motion required 
@@ -175,9 +474,11 @@ public:
      initial velocity will be set to zero.
 
      @param p The point to move to.
+     @param vel Velocity limit for this segment only.  If zero (the default)
+                the limit set by Path::SetVel is used.
      @return An error object or null on success
     */
-   virtual const Error *AddLine( PointN &p );
+   virtual const Error *AddLine( PointN &p, uunit vel=0 );
 
    /**
      Add a line segment of the specified length.  The direction
@@ -187,37 +488,45 @@ public:
      first axis.
 
      @param length The length of the line segment to add.
+     @param vel Velocity limit for this segment only.  If zero (the default)
+                the limit set by Path::SetVel is used.
      @return An error object or null on success
     */
-   virtual const Error *AddLine( uunit length );
+   virtual const Error *AddLine( uunit length, uunit vel=0 );
 
    /**
      Add an arc with the specified radius and angle (radians).
      The arc will start at the current position and will move in either a 
      clockwise (positive angle), or counter-clockwise (negative angle)
-     direction.
+     direction.  The arc is drawn in the plane set by Path::SetArcPlane,
+     which must contain the current direction of motion.
 
      @param radius The radius of the arc
      @param angle The number of radians to rotate through.  Positive 
                  values will result in clockwise rotation.
+     @param vel Velocity limit for this segment only.  If zero (the default)
+                the limit set by Path::SetVel is used.
 
      @return An error object or null on success
     */
-   virtual const Error *AddArc( double radius, double angle );
+   virtual const Error *AddArc( double radius, double angle, uunit vel=0 );
 
    /**
      Add an arc with the specified center point and angle (radians).
      The arc will start at the current position and will move in 
      clockwise (positive angle), or counter-clockwise (negative angle)
-     direction.
+     direction.  The arc is drawn in the plane set by Path::SetArcPlane,
+     which must contain the current position.
 
      @param center The center point of the arc.
      @param angle The number of radians to rotate through.  Positive 
                   values will result in clockwise rotation.
+     @param vel Velocity limit for this segment only.  If zero (the default)
+                the limit set by Path::SetVel is used.
 
      @return An error object or null on success
     */
-   virtual const Error *AddArc( PointN &center, double angle );
+   virtual const Error *AddArc( PointN &center, double angle, uunit vel=0 );
 
    /**
      Set the current velocity to 0 and pause for the specified 
@@ -264,6 +573,14 @@ public:
     */
    virtual const Error *StartNew( void );
 
+   /**
+     Suggest a shortest segment time.  Segments shorter then this are only
+     used where the path requires them, such as at its end.
+
+     @param ms The suggested shortest segment time in milliseconds.
+    */
+   virtual void SetMinSegmentTime( uint8 ms );
+
    /**
      Play back path data.  This method may be used to itterate through a path 
      for display purposes.
@@ -289,6 +606,80 @@ public:
    bool PlayPath( double timeInc, double pos[], double vel[] );
 };
 
+/**
+  Multi-axis path of up to N dimensions.
+
+  The path is built out of line segments and arcs.  Lines may run in any
+  direction and arcs may lie in any plane (see PathN::SetArcPlane).  All
+  positions are held in fixed size Point<N> objects, so the segments
+  calculate their trajectory points without any run time sizing.
+
+  For example, a path for a six axis linkage would be declared as
+  PathDim<6> path;
+ */
+template<int N> class PathDim : public PathN
+{
+   Point<N> ptEnd, ptStart, ptDir, ptU, ptV, ptA, ptB;
+
+protected:
+   void OffsetPos( double p[] )
+   {
+      for( int i=0; i<dim; i++ )
+         p[i] += ptStart[i];
+   }
+
+   PathElement *NewLine( PointN &start, PointN &dir, double len )
+   {
+      return new PathLineSeg<N>( start, dir, len );
+   }
+
+   PathElement *NewArc( PointN &center, double radius, double start, double tot )
+   {
+      return new PathArcSeg<N>( center, ptU, ptV, radius, start, tot );
+   }
+
+   PathElement *NewDelay( PointN &pos, double sec )
+   {
+      return new PathDelaySeg<N>( pos, sec );
+   }
+
+public:
+   /**
+     Path object constructor.
+     @param d The number of dimensions for the path, 1 to N.  Default N.
+    */
+   PathDim( uint d=N ): PathN( (d>N) ? N : d )
+   {
+      CML_ASSERT( d <= N );
+
+      posEnd = &ptEnd;
+      posStart = &ptStart;
+      dirEnd = &ptDir;
+      arcU = &ptU;
+      arcV = &ptV;
+      tmpA = &ptA;
+      tmpB = &ptB;
+      InitGeometry();
+   }
+};
+
+/**
+  Multi-axis complex trajectory path.
+  The object may be used to construct trajectories of up to
+  PATH_MAX_DIMENSIONS axes built out of line segments and arcs.
+ */
+class Path : public PathDim<PATH_MAX_DIMENSIONS>
+{
+public:
+   /**
+     Path object constructor.  The number of dimensions for the path
+     must be passed.
+     @param d The number of dimensions for the path, 1 to PATH_MAX_DIMENSIONS.
+    */
+   Path( uint d ): PathDim<PATH_MAX_DIMENSIONS>( d ){}
+};
+
 CML_NAMESPACE_END()
-#endif
 
+#endif
+#endif
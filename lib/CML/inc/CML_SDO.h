@@ -19,9 +19,13 @@ to CANopen nodes using Service Data Objects (SDOs).
 
 #include "CML_Settings.h"
 #include "CML_Network.h"
+#include "CML_Threads.h"
 
 CML_NAMESPACE_START()
 
+class SDO;
+class SdoCache;
+
 /**************************************************
 * SDO abort codes
 **************************************************/
@@ -144,6 +148,73 @@ protected:
    SDO_Error( uint16 id, const char *desc ): Error( id, desc ){}
 };
 
+/***************************************************************************/
+/**
+Result of an asynchronous SDO transfer.
+
+SDO::UpldAsync and SDO::DnldAsync send a request to a node and return 
+without waiting for the node's response.  The response is collected by 
+calling SdoFuture::Wait.  Requests to different nodes may be started one 
+after another and will all be in flight on the network at the same time,
+so the time taken to access N nodes is close to one round trip rather 
+than N.
+
+\code
+   SdoFuture f[AMPCT];
+   for( i=0; i<AMPCT; i++ )
+      amp[i].sdo.UpldAsync( OBJID_AMP_INFO, 13, f[i] );
+
+   for( i=0; i<AMPCT; i++ )
+   {
+      err = f[i].Wait();
+      if( !err ) hwType[i] = f[i].GetValue();
+   }
+\endcode
+
+The future must stay in scope until the transfer is done.  If it's 
+destroyed first, the destructor waits for the response.
+*/
+/***************************************************************************/
+class SdoFuture
+{
+   /// Private copy constructor (not supported)
+   SdoFuture( const SdoFuture& );
+
+   /// Private assignment operator (not supported)
+   SdoFuture& operator=( const SdoFuture& );
+public:
+   SdoFuture( void );
+   ~SdoFuture( void );
+
+   const Error *Wait( void );
+
+   /// Return true while the transfer is waiting for its response.
+   /// @return true if SdoFuture::Wait has not yet collected the response.
+   bool IsPending( void ){ return sdo != 0; }
+
+   /// Return the value uploaded by SDO::UpldAsync.  This is only valid
+   /// once SdoFuture::Wait has returned success.
+   /// @return The uploaded value.  Values of less then 32-bits are
+   ///         returned in the low bytes.
+   uint32 GetValue( void ){ return value; }
+
+   /// Return the number of bytes uploaded by SDO::UpldAsync.
+   /// @return The size of the uploaded object (1 to 4 bytes), or 0 if the
+   ///         node did not indicate a size.
+   int32 GetSize( void ){ return size; }
+
+private:
+   friend class SDO;
+
+   SDO *sdo;
+   Semaphore done;
+   const Error *err;
+   bool upload;
+   uint32 value;
+   int32 size;
+   uint8 buff[8];
+};
+
 /***************************************************************************/
 /**
 CANopen Service Data Object (SDO).  This class represents the state of a
@@ -161,6 +232,7 @@ class SDO
    SDO& operator=( const SDO& );
 public:
    SDO();
+   ~SDO();
 
    const Error *Init( Node *node, Timeout to=2000 );
 
@@ -179,6 +251,9 @@ public:
    const Error *DnldString( int16 index, int16 sub, char *data );
    const Error *UpldString( int16 index, int16 sub, int32 &len, char *data );
 
+   const Error *UpldAsync( int16 index, int16 sub, SdoFuture &f );
+   const Error *DnldAsync( int16 index, int16 sub, int32 size, uint32 data, SdoFuture &f );
+
    /// Download data using this SDO.  The passed array of data is downloaded to the
    /// object dictionary of a node on the CANopen network using this SDO.
    /// @param index The index of the object to be downloaded.
@@ -313,7 +388,20 @@ public:
    /// attempted before returning an error
    void SetMaxRetry( uint8 max );
 
+   const Error *EnableCache( bool enable=true );
+   void InvalidateCache( void );
+   uint32 GetCacheVersion( void );
+   void GetCacheStats( uint32 &hits, uint32 &xfers );
+
 private:
+   friend class SdoFuture;
+
+   bool CacheUpld( int16 index, int16 sub, int32 &size, byte *data );
+   bool CacheDnld( int16 index, int16 sub, int32 size, byte *data, bool check );
+   void CacheStore( int16 index, int16 sub, int32 max, int32 size, byte *data );
+
+   const Error *StartAsync( int16 index, int16 sub, SdoFuture &f );
+   const Error *FinishAsync( SdoFuture &f );
    const Error *XmitSDO( uint8 *buff, uint16 len, uint16 *retLen, Timeout timeout );
    const Error *UploadFinish( int32 &size, byte *data, uint16 retLen, uint8 *buff );
 
@@ -352,6 +440,41 @@ private:
 
    /// Maximum number of times to retry the transfer before returning an error.
    uint8 maxRetry;
+
+   /// Asynchronous transfer waiting for its response, if any.
+   SdoFuture *pending;
+
+   /// Local copy of the node's object dictionary, or NULL if the
+   /// cache is disabled.
+   SdoCache *cache;
+};
+
+/***************************************************************************/
+/**
+Marks a block of code whose SDO transfers may be answered from the SDO's 
+dictionary cache.  The cache is used by the current thread from the time 
+this object is created until it's destroyed.  See SDO::EnableCache for 
+details.
+
+This is intended for reading and writing configuration objects, which only 
+change when they are written.  Status objects must never be read within a 
+scope.
+*/
+/***************************************************************************/
+class SdoCacheScope
+{
+public:
+   SdoCacheScope( SDO &sdo );
+   ~SdoCacheScope();
+
+private:
+   SDO *prev;
+
+   /// Private copy constructor (not supported)
+   SdoCacheScope( const SdoCacheScope& );
+
+   /// Private assignment operator (not supported)
+   SdoCacheScope& operator=( const SdoCacheScope& );
 };
 
 CML_NAMESPACE_END()
@@ -22,7 +22,9 @@ the Copley Motion Libraries.
 
 /// Size of the hash table used to associate CAN messages with
 /// their receivers.  Larger tables give faster access, but
-/// use more memory.
+/// use more memory.  Only extended (29-bit) message IDs are
+/// kept in the hash, standard IDs use a table with an entry 
+/// for every ID.
 ///
 /// The following values have been selected as good options
 /// for a typical CANopen system: 2053, 1483, 1097, 683, 409.
@@ -127,6 +129,10 @@ the Copley Motion Libraries.
 /// keep track of at a time.
 #define CML_MAX_ECAT_FRAMES         100
 
+/// Number of Ethernet frames the EtherCAT cycle thread may use to 
+/// exchange process data each cycle.
+#define CML_MAX_ECAT_CYCLE_FRAMES   4
+
 /// Compiler native type to use for 64-bit integer.  
 /// Normally this doesn't need to be defined, but if you're getting
 /// compiler errors related to the int64 type you can set this
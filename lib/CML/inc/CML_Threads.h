@@ -22,6 +22,8 @@ supported platforms.
 #include "CML_Settings.h"
 #include "CML_Error.h"
 
+#include <atomic>
+
 CML_NAMESPACE_START()
 
 /***************************************************************************/
@@ -50,6 +52,9 @@ public:
    /// Error allocating memory for thread data
    static const ThreadError Alloc;
 
+   /// Process memory could not be locked
+   static const ThreadError MemLock;
+
 protected:
    ThreadError( uint16 id, const char *desc ): Error( id, desc ){}
 };
@@ -95,6 +100,39 @@ public:
    /// @return An error object is returned indicating the success of the call.
    const Error *setPriority( int pri );
 
+   /// Choose whether the thread asks for real time scheduling when it's 
+   /// started (the default).  Background threads that must never compete
+   /// with time critical ones should turn this off, and then run under 
+   /// the operating system's normal scheduling.  On Linux their priority
+   /// is then not used.  This must be called before the thread is started.
+   /// @param rt True for real time scheduling.
+   /// @return An error object is returned indicating the success of the call.
+   const Error *setRealTime( bool rt );
+
+   /// Set the CPU this thread runs on.  This may be called before or after
+   /// the thread is started.  Pinning time critical threads to cores that
+   /// are kept free of other work stops them migrating between cores and
+   /// waiting behind unrelated processes.
+   /// @param cpu The CPU index, starting at zero, or -1 to allow any CPU (default).
+   /// @return An error object is returned indicating the success of the call.
+   const Error *setAffinity( int cpu );
+
+   /// Return true if the thread was started with the real time scheduling
+   /// its priority asks for.  If the operating system refused (on Linux 
+   /// this needs root, CAP_SYS_NICE or a high enough RLIMIT_RTPRIO) the 
+   /// thread runs with normal scheduling, and a warning is logged when it
+   /// is started.
+   bool isRealTime( void ){ return realTime; }
+
+   /// Lock all current and future memory of the process into RAM, so time
+   /// critical threads never wait on a page fault.  Threads started after
+   /// this call have their stacks locked as they are created.  The stack of
+   /// the calling thread is also touched to the passed depth so it is 
+   /// faulted in now rather than the first time it is used.
+   /// @param stackPrefault Bytes of the calling thread's stack to prefault.
+   /// @return An error object is returned indicating the success of the call.
+   static const Error *lockMemory( int32 stackPrefault=65536 );
+
    /// Make this thread eligible to run.  The new thread will be created
    /// if possible and identified to the operating system as eligible to run.
    /// When the thread actually starts, the run() method will be called.
@@ -111,20 +149,37 @@ public:
    /// @return An error object is returned indicating the success of the call.
    const Error *stop( Timeout to=1000 );
 
+   /// Wait for the thread's run() method to return.  The thread isn't asked
+   /// to exit, so this is for threads that finish by themselves.  A thread 
+   /// object must not be deleted until its thread has been joined or stopped.
+   /// @param to The amount of time to wait, or <0 to wait forever (default).
+   /// @return An error object is returned indicating the success of the call.
+   const Error *join( Timeout to=-1 );
+
    /// Cause the calling thread to sleep for a specified number of milliseconds.
    /// @param to The time to sleep, in milliseconds.
    /// @return An error object is returned indicating the success of the call.
    static const Error *sleep( Timeout to );
 
+   /// Cause the calling thread to sleep until an absolute time.
+   /// @param ns The time to wake up, in the units returned by getTimeNS.
+   /// @return An error object is returned indicating the success of the call.
+   static const Error *sleepUntil( int64 ns );
+
    /// Return the current time in millisecond units.  The value returned may be 
    /// offset by a consistent, but arbitrary value.  This makes it useful for 
    /// checking relative times, but not useful for absolute time calculations.
    /// @return The time in millisecond units
    static uint32 getTimeMS( void );
 
+   /// Return the current time in nanosecond units.  Like getTimeMS this has an
+   /// arbitrary offset, but it is never adjusted with the system clock.
+   /// @return The time in nanosecond units
+   static int64 getTimeNS( void );
+
    /// When a new thread is started, this function will be called.  All of the 
    /// thread specific code should be contained in this function.  If the run()
-   /// method ever returns, the thread will be destroyed.
+   /// method ever returns, the thread will end, and is collected by join().
    virtual void run( void ) = 0;
 
    /// This is an internal function which should not be called directly.
@@ -134,6 +189,15 @@ private:
    /// Holds the threads priority.
    int priority;
 
+   /// CPU the thread is pinned to, or -1 for any
+   int cpu;
+
+   /// True if the thread got the scheduling its priority asks for
+   bool realTime;
+
+   /// True if the thread asks for real time scheduling when started
+   bool rtSched;
+
    /// Holds system specific data necessary to implement the thread object.
 #ifdef CML_EXTRA_THREAD_DATA
    byte data[ CML_EXTRA_THREAD_DATA ];
@@ -142,6 +206,92 @@ private:
 #endif
 };
 
+/***************************************************************************/
+/**
+A thread that does one job and keeps the error it returned.  Derived 
+classes set err from their run() method.  JobThread::RunAll runs a group
+of these at the same time, for example to make slow SDO transfers to 
+several nodes overlap on the network.
+*/
+/***************************************************************************/
+class JobThread: public Thread
+{
+public:
+   /// The error returned by the job, or NULL if it succeeded
+   const Error *err;
+
+   JobThread( void ){ err = 0; started = false; }
+
+   static const Error *RunAll( JobThread *job[], int ct );
+
+private:
+   /// True if the job is running on its own thread
+   bool started;
+};
+
+
+/***************************************************************************/
+/**
+Statistics kept by a PeriodicTimer.  Jitter is the time (nanoseconds) from
+a deadline to the waiting thread actually waking up.
+*/
+/***************************************************************************/
+struct PeriodicTimerStats
+{
+   /// Number of times PeriodicTimer::Wait has returned
+   uint32 cycles;
+
+   /// Number of deadlines skipped because the thread was more than a whole
+   /// period late
+   uint32 overruns;
+
+   /// Smallest, largest and average wake up jitter in nanoseconds
+   int32 jitterMin, jitterMax, jitterAvg;
+};
+
+/***************************************************************************/
+/**
+Fixed rate timer for periodic threads.
+
+A thread that calls Thread::sleep in a loop runs at the sleep time plus the
+time taken by its own work, and picks up any wake up delay each cycle.  This
+timer instead keeps a series of absolute deadlines, each one period after
+the last, so the loop runs at a fixed rate no matter how long its work
+takes.  The deadlines are kept on a clock that is never adjusted, on 
+systems that have one.
+
+If the thread falls more than a whole period behind, the missed deadlines
+are counted as overruns and skipped rather than run back to back.
+
+A thread waiting here can still be stopped with Thread::stop.  As in 
+Thread::sleep, Wait then doesn't return, and the thread exits from within 
+the call.
+*/
+/***************************************************************************/
+class PeriodicTimer
+{
+   /// Private copy constructor (not supported)
+   PeriodicTimer( const PeriodicTimer &t ){}
+
+   /// Private assignment operator (not supported)
+   PeriodicTimer &operator=( const PeriodicTimer &t ){ return *this;}
+public:
+   PeriodicTimer( void );
+
+   const Error *Start( Timeout period );
+   const Error *Wait( void );
+   void Adjust( int32 ns );
+   void GetStats( PeriodicTimerStats &stats );
+   void ClearStats( void );
+
+private:
+   int64 period;
+   int64 deadline;
+
+   uint32 cycles, overruns;
+   int32 jitterMin, jitterMax;
+   int64 jitterSum;
+};
 
 /***************************************************************************/
 /**
@@ -268,6 +418,52 @@ private:
 #endif
 };
 
+/***************************************************************************/
+/**
+A 32-bit value that threads can wait on until some other thread changes it.
+
+This is a lighter weight alternative to a Semaphore for signalling a change
+of state.  The object holds no system resources, so it costs nothing to
+create, and posting a new value is a single atomic store followed by a wake
+up of any waiting threads.  On Linux it's implemented with a futex.
+*/
+/***************************************************************************/
+class Futex
+{
+   /// Private copy constructor (not supported)
+   Futex( const Futex &f ){}
+
+   /// Private assignment operator (not supported)
+   Futex &operator=( const Futex &f ){ return *this; }
+public:
+   /// Create a new futex holding the passed value
+   /// @param v The initial value
+   Futex( uint32 v=0 ): value(v){}
+
+   /// Return the present value of the futex.
+   /// @return The value
+   uint32 Value( void ){ return value.load(); }
+
+   /// Set a new value without waking any waiting threads.
+   /// @param v The new value
+   void Set( uint32 v ){ value.store( v ); }
+
+   /// Set a new value, and wake any threads waiting on the futex.
+   /// @param v The new value
+   void Post( uint32 v );
+
+   /// Wait for the value of the futex to differ from the one passed.
+   /// The wait returns immediately if it already does.
+   /// @param old The value the caller last saw.
+   /// @param timeout The timeout in milliseconds.  Any negative value will
+   ///        cause the thread to wait indefinitely.
+   /// @return NULL once the value has changed, or &ThreadError::Timeout.
+   const Error *Wait( uint32 old, Timeout timeout=-1 );
+
+private:
+   std::atomic<uint32> value;
+};
+
 CML_NAMESPACE_END()
 
 #endif
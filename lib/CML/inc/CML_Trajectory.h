@@ -115,6 +115,16 @@ public:
    ///         which ensures that the amplifier's full buffer will be used.
    virtual int MaximumBufferPointsToUse( void ){ return 10000; }
 
+   /// Suggest a shortest segment time.  The amplifier's adaptive PVT flow
+   /// control calls this when the delays it measures mean that shorter
+   /// segments would let the amplifier's buffer run too close to empty.
+   /// Trajectories that can choose their segment times should avoid returning
+   /// shorter ones where they can.  By default the suggestion is ignored.
+   /// Like NextSegment, this is called from the CANopen receiver task.
+   ///
+   /// @param ms The suggested shortest segment time, in milliseconds.
+   virtual void SetMinSegmentTime( uint8 ms ){}
+
    /// Get the next segment of position, velocity & time info.
    /// Note that this function will be called from the high 
    /// priority CANopen receiver task.  Therefore, no lengthy 
@@ -214,6 +224,25 @@ public:
    ///         which ensures that the amplifier's full buffer will be used.
    virtual int MaximumBufferPointsToUse( void ){ return 10000; }
 
+   /// The linkage requests trajectory segments in batches, so that the 
+   /// cost of each request is shared by several segments.  This function 
+   /// limits the size of the next batch.  Trajectories that are calculated
+   /// in advance can leave the default, while trajectories that are fed in
+   /// real time should return the number of segments that are ready now, so
+   /// that segments are not generated before they're needed.
+   ///
+   /// @return The maximum number of segments to request in the next batch.
+   ///         This should never be less then 1.  The default is a very large
+   ///         number, which leaves the batch size up to the linkage settings.
+   virtual int MaximumBatchPoints( void ){ return 10000; }
+
+   /// Suggest a shortest segment time.  The linkage passes on the longest of
+   /// the times suggested by the adaptive PVT flow control of its amplifiers.
+   /// See Trajectory::SetMinSegmentTime.  By default the suggestion is ignored.
+   ///
+   /// @param ms The suggested shortest segment time, in milliseconds.
+   virtual void SetMinSegmentTime( uint8 ms ){}
+
    /// Get the next segment of position, velocity & time info.
    /// Note that this function will be called from the high 
    /// priority CANopen receiver task.  Therefore, no lengthy 
@@ -0,0 +1,136 @@
+/********************************************************/
+/*                                                      */
+/*  Copley Motion Libraries                             */
+/*                                                      */
+/*  Copyright (c) 2002 Copley Controls Corp.            */
+/*                     http://www.copleycontrols.com    */
+/*                                                      */
+/********************************************************/
+
+/** \file
+This file defines the LinkTrjOnline class, a linkage trajectory that
+follows a target which may be changed at any time during the move.
+*/
+
+#ifndef _DEF_INC_TRJONLINE
+#define _DEF_INC_TRJONLINE
+
+#include "CML_Settings.h"
+#include "CML_Geometry.h"
+#include "CML_Threads.h"
+#include "CML_Trajectory.h"
+
+#include <atomic>
+
+CML_NAMESPACE_START()
+
+/***************************************************************************/
+/**
+This class represents error conditions that can occur in the LinkTrjOnline class.
+*/
+/***************************************************************************/
+class TrjOnlineError: public Error
+{
+public:
+   static const TrjOnlineError BadParam;         ///< Illegal input parameter
+   static const TrjOnlineError InUse;            ///< Trajectory is currently in use
+   static const TrjOnlineError Ended;            ///< The trajectory has been ended
+
+protected:
+   /// Standard protected constructor
+   TrjOnlineError( uint16 id, const char *desc ): Error( id, desc ){}
+};
+
+/***************************************************************************/
+/**
+Online jerk limited multi-axis trajectory.
+
+This trajectory is sent to a Linkage once with Linkage::SendTrajectory and
+then follows a target position which may be changed with
+LinkTrjOnline::SetTarget at any time while the linkage is moving.  The
+trajectory never stops to replan; each new target is approached from the
+position, velocity and acceleration the trajectory has at that moment.
+
+Each axis is planned separately within its own velocity, acceleration,
+deceleration and jerk limits.  Every millisecond the jerk is chosen so that
+the quickest jerk limited stop from the resulting state would end right at
+the target.  Far from the target this gives full jerk up to the acceleration
+and velocity limits, near it the axis rides the braking curve down onto the
+target.  A target that moves is simply chased, and if the target jumps
+behind an axis that can no longer stop in time the axis brakes, reverses
+and comes back to it.
+
+The linkage is fed segments of a fixed length.  The delay between a new
+target and the linkage reacting to it is at most the segment length times
+the number of segments buffered in the amplifiers, both of which are set in
+LinkTrjOnline::Init.
+
+The move continues until LinkTrjOnline::End is called.  The linkage then
+comes to rest at the last target and the move finishes normally.
+*/
+/***************************************************************************/
+class LinkTrjOnline: public LinkTrajectory
+{
+public:
+   LinkTrjOnline();
+   ~LinkTrjOnline(){ KillRef(); }
+
+   const Error *Init( PointN &start, PointN &vel, PointN &acc, PointN &dec, PointN &jrk,
+                      uint8 segTime=10, int bufferPts=3 );
+   const Error *SetTarget( PointN &p );
+   const Error *GetTarget( PointN &p );
+   const Error *End( void );
+
+   /// Return true while the trajectory is being used by a linkage.
+   bool IsActive( void ){ return inUse; }
+
+   bool IsSettled( void );
+
+   int GetDim( void ){ return dim; }
+   int MaximumBufferPointsToUse( void ){ return maxBuff; }
+   const Error *StartNew( void );
+   void Finish( void );
+   const Error *NextSegment( uunit pos[], uunit vel[], uint8 &time );
+
+private:
+   Mutex mtx;
+
+   int dim;
+   int maxBuff;
+   uint8 segMs;
+   std::atomic<bool> inUse;
+   std::atomic<bool> ending;
+
+   /// Target, and whether the axes have come to rest at it.  These are 
+   /// shared with SetTarget and protected by the mutex.
+   double target[ CML_MAX_AMPS_PER_LINK ];
+   uint32 targetID;
+   bool settled;
+
+   /// Limits of each axis
+   double maxV[ CML_MAX_AMPS_PER_LINK ];
+   double maxA[ CML_MAX_AMPS_PER_LINK ];
+   double maxD[ CML_MAX_AMPS_PER_LINK ];
+   double maxJ[ CML_MAX_AMPS_PER_LINK ];
+
+   /// Present state of each axis
+   double p[ CML_MAX_AMPS_PER_LINK ];
+   double v[ CML_MAX_AMPS_PER_LINK ];
+   double a[ CML_MAX_AMPS_PER_LINK ];
+
+   bool Step( int i, double tgt );
+   double Brake( int i, double v, double a );
+   double Endpoint( int i, double j, double tgt );
+   double VelPeak( int i, double j, double sign );
+
+   /// Private copy constructor (not supported)
+   LinkTrjOnline( const LinkTrjOnline& );
+
+   /// Private assignment operator (not supported)
+   LinkTrjOnline& operator=( const LinkTrjOnline& );
+};
+
+CML_NAMESPACE_END()
+
+#endif
+
@@ -101,6 +101,12 @@ public:
 /**
 Multi-axis s-curve profile.  This extends the single axis TrjScurve object
 for use in multi-axis linkage moves.
+
+The move is a straight line in N space.  Its limits may be given either for
+the vector distance along the line, or for each axis separately.  With
+per-axis limits the profile is the fastest one along the line that keeps
+every axis within its own limits, so at each stage of the move the axis
+closest to its limit runs right at it.
 */
 /***************************************************************************/
 class LinkTrjScurve: public LinkTrajectory
@@ -108,6 +114,8 @@ class LinkTrjScurve: public LinkTrajectory
    TrjScurve trj;
    Point<CML_MAX_AMPS_PER_LINK> start;
    double scale[CML_MAX_AMPS_PER_LINK];
+
+   double AxisLimit( PointN &lim, uunit dist );
    
    /// Private copy constructor (not supported)
    LinkTrjScurve( const LinkTrjScurve& );
@@ -120,6 +128,7 @@ public:
    ~LinkTrjScurve(){ KillRef(); }
 
    const Error *Calculate( PointN &start, PointN &end, uunit vel, uunit acc, uunit dec, uunit jrk );
+   const Error *Calculate( PointN &start, PointN &end, PointN &vel, PointN &acc, PointN &dec, PointN &jrk );
    int GetDim( void ){ return start.getDim(); }
 
    const Error *StartNew( void );
@@ -0,0 +1,129 @@
+/********************************************************/
+/*                                                      */
+/*  Copley Motion Libraries                             */
+/*                                                      */
+/*  Copyright (c) 2002 Copley Controls Corp.            */
+/*                     http://www.copleycontrols.com    */
+/*                                                      */
+/********************************************************/
+
+/** \file
+This file defines the LinkTrjStream class, a linkage trajectory that
+is fed with set-points while the linkage is moving.
+*/
+
+#ifndef _DEF_INC_TRJSTREAM
+#define _DEF_INC_TRJSTREAM
+
+#include "CML_Settings.h"
+#include "CML_Geometry.h"
+#include "CML_Threads.h"
+#include "CML_Trajectory.h"
+
+#include <atomic>
+
+CML_NAMESPACE_START()
+
+/// Number of set-points that may be queued in a LinkTrjStream
+#define CML_TRJSTREAM_SIZE    64
+
+/***************************************************************************/
+/**
+This class represents error conditions that can occur in the LinkTrjStream class.
+*/
+/***************************************************************************/
+class TrjStreamError: public Error
+{
+public:
+   static const TrjStreamError BadParam;         ///< Illegal input parameter
+   static const TrjStreamError Full;             ///< The set-point queue is full
+   static const TrjStreamError InUse;            ///< Trajectory is currently in use
+   static const TrjStreamError Ended;            ///< The stream has been ended
+
+protected:
+   /// Standard protected constructor
+   TrjStreamError( uint16 id, const char *desc ): Error( id, desc ){}
+};
+
+/***************************************************************************/
+/**
+Streaming multi-axis trajectory.
+
+This trajectory is sent to a Linkage once with Linkage::SendTrajectory and
+then fed set-points with LinkTrjStream::AddPoint while the linkage is moving.
+Each set-point gives the position to reach and the time to take getting there
+from the previous one.  The linkage blends through the set-points with PVT
+segments.  The velocity at each set-point is calculated from its neighbors
+and is zero wherever an axis changes direction, so no axis overshoots a
+set-point.
+
+The velocity at a set-point can only be calculated once the following
+set-point is known.  If the amplifiers ask for a segment before that, the
+linkage decelerates to a stop at the last set-point and holds there, sending
+hold segments of a configurable length until more data arrives.  To keep
+the linkage moving smoothly, the producer should stay at least one
+set-point ahead of the amplifiers.
+
+The stream continues until LinkTrjStream::End is called.  The linkage then
+comes to rest at the last set-point and the move finishes normally.
+
+The set-point queue is a single producer, single consumer ring.  One thread 
+may add set-points while the linkage pulls segments from the CANopen receive
+thread, and neither ever waits on the other.
+*/
+/***************************************************************************/
+class LinkTrjStream: public LinkTrajectory
+{
+public:
+   LinkTrjStream();
+   ~LinkTrjStream(){ KillRef(); }
+
+   const Error *Init( PointN &start, uint8 holdTime=10, int bufferPts=4 );
+   const Error *AddPoint( PointN &p, uint8 time, Timeout timeout=0 );
+   const Error *End( void );
+   int GetQueueCount( void );
+
+   /// Return true while the trajectory is being used by a linkage.
+   bool IsActive( void ){ return inUse; }
+
+   int GetDim( void ){ return dim; }
+   int MaximumBufferPointsToUse( void ){ return maxBuff; }
+   int MaximumBatchPoints( void );
+   const Error *StartNew( void );
+   void Finish( void );
+   const Error *NextSegment( uunit pos[], uunit vel[], uint8 &time );
+
+private:
+   /// Posted by the linkage when it takes a set-point while AddPoint is
+   /// waiting for space.
+   Semaphore spaceSem;
+   std::atomic<bool> waiting;
+
+   int dim;
+   int maxBuff;
+   uint8 hold;
+   std::atomic<bool> inUse;
+   std::atomic<bool> ending;
+   bool stopped;
+
+   /// Set-point the linkage is at when the next segment starts,
+   /// and the one before it.
+   uunit cur[ CML_MAX_AMPS_PER_LINK ];
+   uunit prev[ CML_MAX_AMPS_PER_LINK ];
+   uint8 prevTime;
+
+   /// Queue of set-points not yet started
+   uunit qPos[ CML_TRJSTREAM_SIZE ][ CML_MAX_AMPS_PER_LINK ];
+   uint8 qTime[ CML_TRJSTREAM_SIZE ];
+   std::atomic<int> head, tail;
+
+   /// Private copy constructor (not supported)
+   LinkTrjStream( const LinkTrjStream& );
+
+   /// Private assignment operator (not supported)
+   LinkTrjStream& operator=( const LinkTrjStream& );
+};
+
+CML_NAMESPACE_END()
+
+#endif
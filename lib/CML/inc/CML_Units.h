@@ -0,0 +1,146 @@
+/********************************************************/
+/*                                                      */
+/*  Copley Motion Libraries                             */
+/*                                                      */
+/*  Copyright (c) 2002 Copley Controls Corp.            */
+/*                     http://www.copleycontrols.com    */
+/*                                                      */
+/********************************************************/
+
+/** \file
+Compile time user unit scaling.
+
+The scaling between user units and amplifier units is normally set at run 
+time with Amp::SetCountsPerUnit, and each value is then converted by a 
+virtual Amp method.  When the scaling is known at the time the program is 
+built, the UnitScale template defined here does the same conversions with the 
+scaling factor as a constant, and can convert whole arrays or points at once.
+*/
+
+#ifndef _DEF_INC_UNITS
+#define _DEF_INC_UNITS
+
+#include "CML_Settings.h"
+#include "CML_Utils.h"
+#include "CML_Geometry.h"
+
+CML_NAMESPACE_START()
+
+/***************************************************************************/
+/**
+Round a value to the nearest integer, with halves rounded away from zero.
+This is the rounding used by all the Amp unit conversions.  It's done without
+branches so that loops of conversions can be vectorized by the compiler.
+
+@param x The value to round
+@return The rounded value
+*/
+/***************************************************************************/
+inline int32 RoundToInt32( double x )
+{
+   return (int32)(x + (0.5 - (x < 0)));
+}
+
+/***************************************************************************/
+/**
+User unit scaling fixed at compile time.
+
+The template parameters give the number of encoder counts per user distance
+unit as the ratio NUM / DEN, so a scale of 1600 counts / mm may be given as 
+UnitScale<1600> or UnitScale<8000,5>.  Each factor is computed from 
+CountsPerUnit() just as Amp::SetCountsPerUnit computes it, so the conversions
+give the same results as those of an Amp whose units were set by passing 
+UnitScale::CountsPerUnit() to Amp::SetCountsPerUnit.
+
+\code
+   typedef UnitScale<8000,5> MmUnits;
+
+   amp.SetCountsPerUnit( MmUnits::CountsPerUnit() );
+
+   Point<6> p;
+   int32 cts[6];
+   MmUnits::PosUser2Load( p, cts );
+\endcode
+
+If user units are disabled in CML_Settings.h, then values are already in 
+amplifier units and are passed through unchanged.
+*/
+/***************************************************************************/
+template< int32 NUM, int32 DEN=1 > class UnitScale
+{
+public:
+   /// Return the number of encoder counts / user distance unit.
+   /// @return The scaling factor
+   static double CountsPerUnit( void ){ return (double)NUM / DEN; }
+
+   /// Convert a position from user units to encoder counts.
+   /// @param pos The position in user units
+   /// @return The position in encoder counts
+   static int32 PosUser2Load( uunit pos ){ return Scale( pos, CountsPerUnit() ); }
+
+   /// Convert a velocity from user units to 0.1 encoder counts / second.
+   /// @param vel The velocity in user units
+   /// @return The velocity in amplifier units
+   static int32 VelUser2Load( uunit vel ){ return Scale( vel, CountsPerUnit() * 10.0 ); }
+
+   /// Convert an acceleration from user units to 10 encoder counts / second^2.
+   /// @param acc The acceleration in user units
+   /// @return The acceleration in amplifier units
+   static int32 AccUser2Load( uunit acc ){ return Scale( acc, CountsPerUnit() * 0.1 ); }
+
+   /// Convert a jerk value from user units to 100 encoder counts / second^3.
+   /// As with Amp::JrkUser2Load, a value that would round to zero is 
+   /// returned as one so that it doesn't prevent motion.
+   /// @param jrk The jerk in user units
+   /// @return The jerk in amplifier units
+   static int32 JrkUser2Load( uunit jrk )
+   {
+      int32 j = Scale( jrk, CountsPerUnit() * 0.01 );
+      return j ? j : 1;
+   }
+
+   /// Convert an array of positions from user units to encoder counts.
+   /// @param pos The positions in user units
+   /// @param cts The positions in encoder counts are returned here
+   /// @param n The number of positions to convert
+   static void PosUser2Load( const uunit pos[], int32 cts[], int n )
+   {
+      for( int i=0; i<n; i++ )
+         cts[i] = PosUser2Load( pos[i] );
+   }
+
+   /// Convert an array of velocities from user units to 0.1 encoder 
+   /// counts / second.
+   /// @param vel The velocities in user units
+   /// @param cts The velocities in amplifier units are returned here
+   /// @param n The number of velocities to convert
+   static void VelUser2Load( const uunit vel[], int32 cts[], int n )
+   {
+      for( int i=0; i<n; i++ )
+         cts[i] = VelUser2Load( vel[i] );
+   }
+
+   /// Convert each axis of a point from user units to encoder counts.
+   /// @param p The point in user units
+   /// @param cts The position of each axis in encoder counts is returned
+   ///        here.  This must have room for p.getDim() values.
+   template< int N > static void PosUser2Load( const Point<N> &p, int32 cts[] )
+   {
+      PosUser2Load( p.getArray(), cts, p.getDim() );
+   }
+
+private:
+   static int32 Scale( uunit x, double s )
+   {
+#ifdef CML_ENABLE_USER_UNITS
+      return RoundToInt32( x * s );
+#else
+      return x;
+#endif
+   }
+};
+
+CML_NAMESPACE_END()
+
+#endif
+
@@ -51,6 +51,8 @@ public:
 protected:
    const Error *RecvFrame( CanFrame &frame, Timeout timeout );
    const Error *XmitFrame( CanFrame &frame, Timeout timeout );
+   const Error *RecvFrames( CanFrame frame[], int max, int &ct, Timeout timeout );
+   const Error *XmitFrames( CanFrame frame[], int ct, Timeout timeout );
 
    /// tracks the state of the interface as open or closed.
    int open;
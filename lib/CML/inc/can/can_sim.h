@@ -0,0 +1,213 @@
+/********************************************************/
+/*                                                      */
+/*  Copley Motion Libraries                             */
+/*                                                      */
+/*  Copyright (c) 2002 Copley Controls Corp.            */
+/*                     http://www.copleycontrols.com    */
+/*                                                      */
+/********************************************************/
+
+/** \file
+
+Simulated CAN network of Copley amplifiers.
+
+*/
+
+#ifndef _DEF_INC_CAN_SIM
+#define _DEF_INC_CAN_SIM
+
+#include "CML_Settings.h"
+#include "CML_Can.h"
+#include "CML_Threads.h"
+
+CML_NAMESPACE_START()
+
+/// Most amplifiers that may be added to one simulated network
+#define SIMCAN_MAX_AMPS         32
+
+/// Frames the simulated network can hold for the program before overflowing
+#define SIMCAN_RXQ              1024
+
+/// Most receive filters held by the simulated network
+#define SIMCAN_MAX_FILTER       128
+
+class SimAmp;
+
+/***************************************************************************/
+/**
+Statistics kept by a simulated CAN network.
+*/
+/***************************************************************************/
+struct SimCANStats
+{
+   /// Frames written by the program
+   uint32 xmitFrames;
+
+   /// Frames written by the simulated amplifiers
+   uint32 recvFrames;
+
+   /// Frames written by the program and discarded by SimCAN::SetDropRate
+   uint32 dropped;
+
+   /// Frames lost because the program didn't read them quickly enough
+   uint32 overflows;
+
+   /// PVT segments accepted into the amplifier buffers
+   uint32 pvtSegs;
+
+   /// PVT segments run to completion by the amplifiers
+   uint32 pvtDone;
+
+   /// PVT segments rejected for being out of sequence
+   uint32 pvtSeqErrors;
+
+   /// PVT segments rejected because the buffer was full
+   uint32 pvtOverflows;
+
+   /// PVT moves aborted because the buffer ran empty
+   uint32 pvtUnderflows;
+
+   /// Longest time (microseconds) a frame has waited for the bus
+   int32 maxBusWait;
+};
+
+/***************************************************************************/
+/**
+A CAN interface connected to a network of simulated Copley amplifiers
+rather than to hardware.  It lets the whole library, from Amp::Init down,
+be run and load tested on a machine with no CAN adapter.
+
+Each simulated amplifier runs in the program's own process and answers the
+parts of the CANopen protocol used by this library:
+
+- NMT commands, node guarding, heartbeat and the boot up message.
+- Expedited, segmented and block SDO transfers.  Objects the simulator
+  doesn't know about hold whatever was last written to them, and read
+  as zero until then.
+- Transmit and receive PDOs with any mapping, sent on change, on request
+  or on every Nth SYNC.  An amplifier configured as the SYNC producer
+  sends SYNC messages.
+- The device control state machine, profile position and velocity
+  moves, homing, and PVT moves from a PVT buffer of a set depth with
+  the same sequence, overflow and underflow checks as the real drive.
+
+The motor follows the commanded position with a short first order lag,
+so moves settle a few milliseconds after the trajectory ends.  Homing
+finishes after a short delay and simply declares the present position
+to be zero.
+
+Bus timing is modeled from the bit rate set with SimCAN::SetBaud.  Every
+frame takes the bus for the time it would on a real network, frames wait
+for each other when the bus is busy, and amplifiers answer SDOs and remote
+requests after the delay set with SimCAN::SetResponseDelay.  Received
+frames are time stamped with the microsecond at which they finished on the
+simulated bus, and are handed to the program no earlier than that.
+
+Amplifiers should be added with SimCAN::AddAmp before the port is opened.
+They then reset and send their boot up messages when it is.
+*/
+/***************************************************************************/
+class SimCAN : public CanInterface, Thread
+{
+public:
+   SimCAN( void );
+   SimCAN( const char *port );
+   virtual ~SimCAN( void );
+
+   const Error *Open( const char *name ){
+      SetName(name);
+      return Open();
+   }
+   const Error *Open( void );
+   const Error *Close( void );
+   const Error *SetBaud( int32 baud );
+   const Error *SetRecvFilter( const uint32 id[], const uint32 mask[], int ct );
+
+   bool SupportsTimestamps( void ){ return true; }
+
+   const Error *AddAmp( int16 nodeID, int pvtBuffSize=32 );
+   const Error *GetAmpPosition( int16 nodeID, int32 &pos );
+   void SetResponseDelay( int32 us );
+   void SetDropRate( uint32 n );
+   void GetStats( SimCANStats &stats );
+   void ClearStats( void );
+
+protected:
+   const Error *RecvFrame( CanFrame &frame, Timeout timeout );
+   const Error *XmitFrame( CanFrame &frame, Timeout timeout );
+   const Error *RecvFrames( CanFrame frame[], int max, int &ct, Timeout timeout );
+   const Error *XmitFrames( CanFrame frame[], int ct, Timeout timeout );
+
+   /// tracks the state of the interface as open or closed.
+   bool open;
+
+   /// Bit rate used to time frames on the simulated bus
+   int32 baud;
+
+   /// Time (ns) the amplifiers take to answer a request
+   int32 respDelay;
+
+   /// One of this many PDOs written by the program is dropped
+   uint32 dropRate;
+
+   /// Count of PDOs written since the last one dropped
+   uint32 dropCt;
+
+   /// Time (ns) at which the bus finishes with the last frame given to it
+   int64 busFree;
+
+   /// Time (ns) of the next motion update of the amplifiers
+   int64 nextTick;
+
+   /// The simulated amplifiers
+   SimAmp *amp[ SIMCAN_MAX_AMPS ];
+
+   /// Number of simulated amplifiers
+   int ampCt;
+
+   /// Frames waiting for the program, in the order they finish on the bus
+   CanFrame rxFrame[ SIMCAN_RXQ ];
+
+   /// The time (ns) each waiting frame finishes on the bus
+   int64 rxTime[ SIMCAN_RXQ ];
+
+   /// Index of the oldest waiting frame
+   int rxHead;
+
+   /// Number of waiting frames
+   int rxCt;
+
+   /// Set when a frame for the program has been lost
+   bool rxOverflow;
+
+   /// Receive filters set by SetRecvFilter
+   uint32 filtID[ SIMCAN_MAX_FILTER ];
+   uint32 filtMask[ SIMCAN_MAX_FILTER ];
+   int filtCt;
+
+   SimCANStats stats;
+
+   /// Protects the simulated network
+   Mutex mutex;
+
+   /// Posted when a new earliest frame is waiting for the program
+   Semaphore rxSem;
+
+private:
+   friend class SimAmp;
+
+   void Init( void );
+   void run( void );
+   void Advance( int64 now );
+   int64 FrameTime( CanFrame &frame );
+   int64 BusSlot( CanFrame &frame, int64 ready );
+   void Send( SimAmp *from, CanFrame &frame, int64 t, bool reply );
+   bool Accept( CanFrame &frame );
+   void Queue( CanFrame &frame, int64 t );
+   SimAmp *FindAmp( int16 nodeID );
+};
+
+CML_NAMESPACE_END()
+
+#endif
+
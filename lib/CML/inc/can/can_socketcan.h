@@ -0,0 +1,96 @@
+/********************************************************/
+/*                                                      */
+/*  Copley Motion Libraries                             */
+/*                                                      */
+/*  Copyright (c) 2002 Copley Controls Corp.            */
+/*                     http://www.copleycontrols.com    */
+/*                                                      */
+/********************************************************/
+
+/** \file
+
+CAN hardware interface for the Linux SocketCAN network stack.
+
+*/
+
+#ifndef _DEF_INC_CAN_SOCKETCAN
+#define _DEF_INC_CAN_SOCKETCAN
+
+#include "CML_Settings.h"
+#include "CML_Can.h"
+#include "CML_Threads.h"
+
+#include <atomic>
+
+CML_NAMESPACE_START()
+
+/**
+This class extends the generic CanInterface class into a working
+interface for any CAN adapter supported by the Linux SocketCAN 
+network stack, including the virtual vcan interface.
+
+The port name is the name of the network interface, such as can0 or
+vcan0.  If no name is given, can0 is used.
+
+The bit rate of a SocketCAN interface is configured outside of the 
+program when the interface is brought up, for example:
+
+   ip link set can0 type can bitrate 1000000
+   ip link set can0 up
+
+SetBaud only records the rate.
+
+Frames are read and written in blocks with single recvmmsg and sendmmsg 
+calls, and every received frame carries the time (microseconds) at which
+the kernel, or the adapter if it supports hardware time stamps, received it.
+*/
+class SocketCAN : public CanInterface
+{
+public:
+   SocketCAN( void );
+   SocketCAN( const char *port );
+   virtual ~SocketCAN( void );
+
+   const Error *Open( const char *name ){
+      SetName(name);
+      return Open();
+   }
+   const Error *Open( void );
+   const Error *Close( void );
+   const Error *SetBaud( int32 baud );
+   const Error *SetRecvFilter( const uint32 id[], const uint32 mask[], int ct );
+
+   bool SupportsTimestamps( void ){ return true; }
+
+protected:
+   const Error *RecvFrame( CanFrame &frame, Timeout timeout );
+   const Error *XmitFrame( CanFrame &frame, Timeout timeout );
+   const Error *RecvFrames( CanFrame frame[], int max, int &ct, Timeout timeout );
+   const Error *XmitFrames( CanFrame frame[], int ct, Timeout timeout );
+
+   /// tracks the state of the interface as open or closed.
+   std::atomic<bool> open;
+
+   /// Holds a copy of the last baud rate set
+   int32 baud;
+
+   /// Raw CAN socket
+   int fd;
+
+   /// Pipe used to wake up reading threads when the port is closed
+   int wakeFd[2];
+
+   /// Number of threads presently reading from the socket
+   std::atomic<int> readers;
+
+   /// Used to serialize opening and closing the port
+   Mutex mutex;
+
+private:
+   const Error *ConvertError( int err );
+};
+
+CML_NAMESPACE_END()
+
+#endif
+
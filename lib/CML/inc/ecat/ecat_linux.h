@@ -1,8 +1,8 @@
-
 #ifndef _DEF_INC_ECAT_LINUX
 #define _DEF_INC_ECAT_LINUX
 
 #include "CML_EtherCAT.h"
+#include "CML_Threads.h"
 
 CML_NAMESPACE_START()
 
@@ -10,11 +10,48 @@ CML_NAMESPACE_START()
  * This class provides an interface to the Ethernet ports on a linux
  * system.  It can be used to send and received formatted EtherCAT 
  * packets.
+ *
+ * By default the socket's receive and transmit queues are memory mapped
+ * into the process as packet rings (PACKET_MMAP).  Received frames are
+ * then processed where the kernel wrote them and sent frames are written
+ * straight into the transmit ring, which saves a copy and a system call
+ * per frame.  If the kernel can't set up the rings the port falls back
+ * to ordinary socket reads and writes.
  */
 class LinuxEcatHardware: public EtherCatHardware
 {
    int fd, ifindex;
    char *ifname;
+
+   /// Use memory mapped packet rings if possible
+   bool useRings;
+
+   /// Number of frames in each ring
+   int ringFrames;
+
+   /// The mapped rings, receive first then transmit.  Null if not in use.
+   uint8 *ring;
+   size_t ringLen;
+
+   /// Size of each frame slot in the rings
+   int frameSize;
+
+   /// Next slot to read from the receive ring
+   int rxNext;
+
+   /// Next slot to write in the transmit ring
+   int txNext;
+
+   /// Protects the transmit ring, which may be written from several threads
+   Mutex txMutex;
+
+   const Error *OpenRings( void );
+   void CloseRings( void );
+   uint8 *RxSlot( int i ){ return ring + i*frameSize; }
+   uint8 *TxSlot( int i ){ return ring + (ringFrames+i)*frameSize; }
+   const Error *OpenSocket( void );
+   const Error *WaitReady( short events, Timeout timeout );
+
 public:
    LinuxEcatHardware( const char *name=0 );
    virtual ~LinuxEcatHardware( void );
@@ -22,6 +59,12 @@ public:
    const Error *Close( void );
    const Error *SendPacket( uchar *msg, uint16 len );
    const Error *RecvPacket( uchar *msg, uint16 *len, Timeout timeout=-1 );
+   const Error *RecvPacketInPlace( uchar **msg, uint16 *len, Timeout timeout=-1 );
+   void ReleasePacket( uchar *msg );
+   void SetRingMode( bool enable, int frames=256 );
+
+   /// Returns true if the port is open and using memory mapped rings
+   bool UsingRings( void ){ return ring != 0; }
 };
 
 CML_NAMESPACE_END()
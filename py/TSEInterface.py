@@ -46,4 +46,21 @@ def sendCommand(q):
             break
         elif(readData=='BAD Q'):
             print 'Bad Q!'
-            break
\ No newline at end of file
+            break
+
+def sendPose(p):
+    #Send the TSE Program the desired pose [x, y, z, rotZ, rotY, rotX] in INCHES and RADIANS.
+    #Inverse kinematics are solved by PSM_main, no need for TSEMath.solveNDIK.
+    iter = 0
+    while(1):
+        readData = interface.stdout.readline()[:-1]
+        if(readData=='RUN CHECK'):
+            interface.stdin.write('2')
+        elif(readData=='GIMME'):
+            interface.stdin.write(struct.pack('d',p[iter]))
+            iter+=1
+        elif(readData=='GOOD Q'):
+            break
+        elif(readData=='BAD Q'):
+            print 'Bad Q!'
+            break
@@ -0,0 +1,55 @@
+"""
+TSE Binary Stream Interface
+Sends whole commands to PSM_main as fixed-size binary frames (see src/PSM_protocol.h)
+"""
+
+import subprocess as sp
+import struct
+import time
+
+binLocation = "../bin/PSM_main"
+
+CMD_MAGIC = 0x434D5350
+ACK_MAGIC = 0x414D5350
+CMD_FMT = '<IIdHHI6d'
+ACK_FMT = '<IIdhHI'
+ACK_SIZE = struct.calcsize(ACK_FMT)
+
+CMD_STOP = 0
+CMD_SIGMA = 1
+CMD_POSE = 2
+
+ACK_STATUS = {0: 'OK', 1: 'BAD Q', 2: 'IK FAILED', 3: 'BAD MSG'}
+
+class TSEStream:
+    def __init__(self, binLocation=binLocation, streaming=False):
+        #With streaming, PSM_main blends through points instead of stopping at each one
+        args = [binLocation, '-b']
+        if(streaming):
+            args.append('-s')
+        self.proc = sp.Popen(args, stdout=sp.PIPE, stdin=sp.PIPE)
+        self.seq = 0
+
+    def send(self, cmdType, vals, segTime=0):
+        #Send one command and wait for its ack. Returns (status, seq, round trip seconds)
+        #segTime is the ms to reach this point from the last one when streaming, 0 for the default
+        self.seq += 1
+        t = time.time()
+        self.proc.stdin.write(struct.pack(CMD_FMT, CMD_MAGIC, self.seq, t, cmdType, segTime, 0, *vals))
+        self.proc.stdin.flush()
+        (magic, seq, tEcho, status, flags, res) = struct.unpack(ACK_FMT, self.proc.stdout.read(ACK_SIZE))
+        if(magic != ACK_MAGIC or seq != self.seq):
+            raise IOError('Lost sync with PSM_main')
+        return (status, seq, time.time()-tEcho)
+
+    def sendPose(self, p, segTime=0):
+        #Pose [x, y, z, rotZ, rotY, rotX] in INCHES and RADIANS
+        return self.send(CMD_POSE, p, segTime)
+
+    def sendCommand(self, q, segTime=0):
+        #Sigmas in MILLIMETERS
+        return self.send(CMD_SIGMA, q, segTime)
+
+    def stop(self):
+        self.send(CMD_STOP, [0.0]*6)
+        self.proc.wait()
@@ -10,8 +10,57 @@ Daniel J. Gonzalez - dgonz@mit.edu
 // Comment this out to use EtherCAT
 #define USE_CAN
 
-int main( void )
+int main( int argc, char **argv )
 {
+   // -b streams binary PSMCommand frames over stdin/stdout,
+   // -u <path> streams them over a Unix domain socket.
+   // Otherwise the text protocol used by TSEInterface.sendCommand is spoken.
+   // -s blends through binary commands instead of stopping at each one.
+   // -c follows pose commands in a straight line in pose space, solving the
+   //    IK for every trajectory segment, instead of moving the actuators
+   //    straight to the IK solution of the end point.
+   // -f follows binary commands as a moving target, retargeting the move
+   //    in progress as each one arrives (e.g. from the vision system).
+   // -p <cpu> pins the network and linkage threads to one CPU.
+   // -t <file> traces every CAN frame to a binary file instead of cml.log,
+   //    decode it with lib/CML/examples/cantrace.
+   // -v runs against simulated amplifiers instead of the robot, so the
+   //    whole control path can be exercised without hardware.
+   int cmdFd = -1, ackFd = -1;
+   int rtCPU = -1;
+   const char *traceFile = 0;
+   bool streamMode = false;
+   bool cartMode = false;
+   bool followMode = false;
+   bool simulate = false;
+   for( int a=1; a<argc; a++ )
+   {
+      if( !strcmp( argv[a], "-s" ) ){
+         streamMode = true;
+      }else if( !strcmp( argv[a], "-c" ) ){
+         cartMode = true;
+      }else if( !strcmp( argv[a], "-f" ) ){
+         followMode = true;
+      }else if( !strcmp( argv[a], "-p" ) && a+1<argc ){
+         rtCPU = atoi( argv[++a] );
+      }else if( !strcmp( argv[a], "-v" ) ){
+         simulate = true;
+         robotPlugged = true;
+      }else if( !strcmp( argv[a], "-t" ) && a+1<argc ){
+         traceFile = argv[++a];
+      }else if( !strcmp( argv[a], "-b" ) ){
+         cmdFd = 0;
+         ackFd = dup(1);
+         dup2(2, 1); //Keep diagnostic prints off the ack stream
+      }else if( !strcmp( argv[a], "-u" ) && a+1<argc ){
+         printf( "Waiting for planner on %s\n", argv[a+1] );
+         cmdFd = ackFd = psmListenUnix( argv[++a] );
+         if( cmdFd < 0 ){
+            printf( "Error opening socket %s\n", argv[a] );
+            exit(1);
+         }
+      }
+   }
 
    ////////////////////////////////////////////////////////////////////////////////////////// VVV Initialization and Homing VVV
    //cout << "ayy lmao\n"; //For debugging
@@ -25,11 +74,23 @@ int main( void )
    // a log file for debugging
    cml.SetDebugLevel( LOG_EVERYTHING );
 
+   // Leave the file writes to a background thread so logging every CAN
+   // frame doesn't hold up the network read thread.
+   cml.SetAsyncLog( true );
+   if( traceFile )
+      cml.SetCanTraceFile( traceFile );
+
    // Create an object used to access the low level CAN network.
    // This examples assumes that we're using the Copley PCI CAN card.
    #if defined( USE_CAN )
-      KvaserCAN hw( "CAN0" );
+      KvaserCAN kvaser( "CAN0" );
+      SimCAN sim( "sim" );
+      CanInterface &hw = simulate ? (CanInterface &)sim : (CanInterface &)kvaser;
       hw.SetBaud( canBPS );
+      if( simulate ){
+         for( int a=0; a<AMPCT; a++ )
+            sim.AddAmp( canNodeID+a );
+      }
    #elif defined( WIN32 )
       WinUdpEcatHardware hw( "eth0" );
    #else
@@ -47,22 +108,36 @@ int main( void )
    int i;
    Amp amp[AMPCT];
    if(robotPlugged){
-      err = net.Open( hw );
+      // Keep the real time threads from waiting on page faults
+      err = Thread::lockMemory();
+      if( err ) printf( "Warning: %s, running without locked memory\n", err->toString() );
+
+   #if defined( USE_CAN )
+      CanOpenSettings netSettings;
+   #else
+      EtherCatSettings netSettings;
+      netSettings.cycleThreadCPU = rtCPU;
+   #endif
+      netSettings.readThreadCPU = rtCPU;
+      err = net.Open( hw, netSettings );
       showerr( err, "Opening network" );
 
       // Initialize the amplifiers using default settings
       AmpSettings set;
       set.guardTime = 0;
 
-      cout << "Doing initialization"<<endl;
+      // All the amps are initialized at once, their SDO traffic overlaps
+      // on the bus so this takes about as long as a single amp.
+      cout << "Initializing Amplifiers " << canNodeID << " to " << (canNodeID+AMPCT-1) << endl;
+      int16 nodeID[AMPCT];
       for( i=0; i<AMPCT; i++ )
-      {
-         //printf( "Initiating Amplifier %d\n", canNodeID+i );
-         cout << "Initializing Amplifier " << (canNodeID+i) << endl;
+         nodeID[i] = canNodeID+i;
 
-         err = amp[i].Init( net, canNodeID+i, set );
-         showerr( err, "Initting amp" );
+      err = Amp::InitParallel( net, AMPCT, amp, nodeID, set );
+      showerr( err, "Initting amp" );
 
+      for( i=0; i<AMPCT; i++ )
+      {
          MtrInfo mtrInfo;
          err = amp[i].GetMtrInfo( mtrInfo );
          showerr( err, "Getting motor info\n" );
@@ -70,14 +145,23 @@ int main( void )
          // err = amp[i].SetCountsPerUnit( mtrInfo.ctsPerRev );
          // printf( "CountsPerRev %d\n", mtrInfo.ctsPerRev );
 
-         err = amp[i].SetCountsPerUnit( 8000.0/5.0);     // User Units are now in mm
+         err = amp[i].SetCountsPerUnit( ActuatorUnits::CountsPerUnit() );     // User Units are now in mm
          showerr( err, "Setting cpr\n" );
       }
    }
-      // Create a linkage object holding these amps
-      Linkage link;
+      // Create a linkage object holding these amps. It can also take its
+      // axes in pose space, see TSELinkage::SetPoseMode.
+      TSELinkage link( tseGeom, SIGMA2ACTUATOR, in2mm );
+      LinkTrjStream stream;
+      LinkTrjOnline follow;
+      link.SetTravel( 0, 250 );
 
    if(robotPlugged){
+      LinkSettings linkSettings;
+      linkSettings.threadCPU = rtCPU;
+      err = link.Configure( linkSettings );
+      showerr( err, "Linkage configure" );
+
       err = link.Init( AMPCT, amp );
       showerr( err, "Linkage init" );
 
@@ -94,14 +178,20 @@ int main( void )
       printf( "Home Velocity Slow %f \n", hcfg.velSlow );
 
       
-      // Setup the velocity, acceleration, deceleration & jerk limits
-      // for multi-axis moves using the linkage object
-      err = link.SetMoveLimits( 75, 75, 75, 100 );
-      showerr( err, "setting move limits" );
-
       // Create an N dimensional position to move to
       Point<AMPCT> act;
 
+      // Setup the velocity, acceleration, deceleration & jerk limits of
+      // each actuator for multi-axis moves using the linkage object
+      Point<AMPCT> limVel, limAcc, limJrk;
+      for (int i = 0; i<AMPCT; i++){
+         limVel[i] = 75;
+         limAcc[i] = 75;
+         limJrk[i] = 100;
+      }
+      err = link.SetMoveLimits( limVel, limAcc, limAcc, limJrk );
+      showerr( err, "setting move limits" );
+
       for( i=0; i<AMPCT; i++ )
       {
          // Assuming we are low to the ground and centered, first move forward 30mm. 
@@ -183,23 +273,129 @@ int main( void )
    // Create an N dimensional slide vector
    // Point<AMPCT> q;
    double q[AMPCT];
+   double pose[AMPCT];
+   TSEKinematics ik( tseGeom );
    char msgBack;
    char qMsg[sizeof(double)];
    double qTemp;
 
    ////////////////////////////////////////////////////////////////////////////////////////////////////////////////Main Function
+   // Binary streaming protocol: one frame in, one ack out per command
+   PSMCommand cmd;
+   while(isRunning && cmdFd >= 0){
+      if(psmReadCommand(cmdFd, cmd)){
+         break;
+      }
+
+      int16_t status = PSM_ACK_OK;
+      if(cmd.magic != PSM_CMD_MAGIC){
+         status = PSM_ACK_BAD_MSG;
+      }else if(cmd.type == PSM_CMD_STOP){
+         isRunning = 0;
+      }else if(cmd.type == PSM_CMD_SIGMA){
+         memcpy(q, cmd.vals, sizeof(q));
+      }else if(cmd.type == PSM_CMD_POSE){
+         if(ik.SolveIK(cmd.vals, q)){
+            status = PSM_ACK_IK_FAIL;
+         }else{
+            for (int i = 0; i<AMPCT; i++){
+               q[i] *= in2mm;
+            }
+         }
+      }else{
+         status = PSM_ACK_BAD_MSG;
+      }
+
+      if(isRunning && status == PSM_ACK_OK){
+         if(!validQ(q)){
+            status = PSM_ACK_BAD_Q;
+         }else{
+            // In Cartesian mode act holds the pose and the linkage runs the IK
+            bool posePath = cartMode && cmd.type == PSM_CMD_POSE;
+            for (int i = 0; i<AMPCT; i++){
+               act[i] = posePath ? cmd.vals[i] : SIGMA2ACTUATOR - q[i];
+            }
+            bool moving = stream.IsActive() || follow.IsActive();
+            if(robotPlugged && moving && link.GetPoseMode() != posePath){
+               status = PSM_ACK_BAD_MSG; //Can't switch between pose and sigma points mid-stream
+            }else if(robotPlugged && followMode){
+               // Start following on the first point, then just move the target
+               if(!follow.IsActive()){
+                  link.SetPoseMode( posePath );
+                  Point<AMPCT> start, fVel, fAcc, fDec, fJrk;
+                  err = link.GetMoveLimits( fVel, fAcc, fDec, fJrk );
+                  showerr( err, "Getting move limits" );
+                  if(posePath){
+                     for (int i = 0; i<AMPCT; i++){
+                        fVel[i] = CART_VEL;
+                        fAcc[i] = fDec[i] = CART_ACC;
+                        fJrk[i] = CART_JRK;
+                     }
+                  }
+                  err = link.GetPositionCommand( start );
+                  showerr( err, "Getting position command" );
+                  err = follow.Init( start, fVel, fAcc, fDec, fJrk, FOLLOW_SEG_MS, FOLLOW_BUFF_PTS );
+                  showerr( err, "Starting follow" );
+                  err = link.SendTrajectory( follow );
+                  showerr( err, "Sending follow" );
+               }
+               err = follow.SetTarget( act );
+               showerr( err, "Setting target" );
+            }else if(robotPlugged && streamMode){
+               // (Re)start the stream on the first point, or after a move was aborted
+               if(!stream.IsActive()){
+                  link.SetPoseMode( posePath );
+                  Point<AMPCT> start;
+                  err = link.GetPositionCommand( start );
+                  showerr( err, "Getting position command" );
+                  err = stream.Init( start, STREAM_HOLD_MS, STREAM_BUFF_PTS );
+                  showerr( err, "Starting stream" );
+                  err = link.SendTrajectory( stream );
+                  showerr( err, "Sending stream" );
+               }
+               int segTime = cmd.segTime ? cmd.segTime : STREAM_SEG_MS;
+               if(segTime > 255){
+                  segTime = 255;
+               }
+               // Blocks while the stream is full, which paces the planner
+               err = stream.AddPoint( act, segTime, -1 );
+               showerr( err, "Streaming point" );
+            }else if(robotPlugged){
+               err = moveLink( link, act, posePath );
+               showerr( err, "Moving linkage" );
+               err = link.WaitMoveDone( 20000 ); 
+               showerr( err, "waiting on move" );
+            }
+         }
+      }
+
+      if(psmWriteAck(ackFd, cmd, status)){
+         break;
+      }
+   }
+   isRunning = isRunning && cmdFd < 0;
+
+   if(robotPlugged && (stream.IsActive() || follow.IsActive())){
+      stream.End();
+      follow.End();
+      printf( "Waiting for stream to finish...\n" );
+      err = link.WaitMoveDone( 20000 ); 
+      showerr( err, "waiting on stream" );
+   }
+
    while(isRunning){
       std::cout<< "RUN CHECK\n";
 
       msgBack = std::cin.get();
       std::cout<< "CPP Receieves Message!\n";
       isRunning = msgBack-48;
+      // '1' sends sigmas in mm, '2' sends a pose {x,y,z,rotZ,rotY,rotX} in inches and radians
+      bool poseCmd = (isRunning == 2);
 
       if(isRunning){
          std::cout<< "RUN OK\n";
 
          //Check if valid q. If not, then isRunning = false, break. Or, try again. 
-         int checker = 0;
          for (int i = 0; i<AMPCT; i++){
             std::cout<< "GIMME\n";
 
@@ -213,20 +409,25 @@ int main( void )
             memcpy(&qTemp,&qMsg,sizeof(double));
             printf( "Converted %f \n", qTemp);
 
-            q[i] = qTemp;
-            
-            if(SIGMA2ACTUATOR - q[i]<=250 && SIGMA2ACTUATOR - q[i] >= 0){
-               checker++;
+            if(poseCmd){
+               pose[i] = qTemp;
+            }else{
+               q[i] = qTemp;
             }
          }
-         for (int i = 0; i<AMPCT; i+=2){
-            if(sqrt(q[i]*q[i]+q[i]*q[i+1]+q[i+1]*q[i+1])<=MAXWIDTH){
-               checker+=2;
+         if(poseCmd){
+            if(ik.SolveIK(pose, q)){
+               std::cout<< "IK FAILED\n";
+               for (int i = 0; i<AMPCT; i++){
+                  q[i] = -1; //Fails the range check below
+               }
+            }else{
+               for (int i = 0; i<AMPCT; i++){
+                  q[i] *= in2mm;
+               }
             }
          }
-
-         if(checker == 2*AMPCT){
-            checker = 0;
+         if(validQ(q)){
             std::cout<< "GOOD Q\n";
             std::cout<< "Moving to point...\n";
             //If all safe, Assign vector act[] with the new coords. If not, stay. 
@@ -237,8 +438,14 @@ int main( void )
             act[3] = SIGMA2ACTUATOR - q[3];
             act[4] = SIGMA2ACTUATOR - q[4];
             act[5] = SIGMA2ACTUATOR - q[5];
+            bool posePath = cartMode && poseCmd;
+            if(posePath){
+               for (int i = 0; i<AMPCT; i++){
+                  act[i] = pose[i];
+               }
+            }
             if(robotPlugged){
-               err = link.MoveTo( act );
+               err = moveLink( link, act, posePath );
                showerr( err, "Moving linkage" );
 
                // Wait for all amplifiers to finish the initial move by waiting on the
@@ -248,7 +455,6 @@ int main( void )
                showerr( err, "waiting on initial move" );
             }
          }else{
-            checker = 0;
             std::cout<< "BAD Q\n";
             std::cout<< "Please try again...\n";
          }      
@@ -273,7 +479,7 @@ int main( void )
    //cout << "Press ENTER to coninue...";
    //std::cin.ignore();
    if(robotPlugged){
-      err = link.MoveTo( act );
+      err = moveLink( link, act, false );
       showerr( err, "Moving linkage" );
 
       // Wait for all amplifiers to finish the initial move by waiting on the
@@ -288,6 +494,34 @@ int main( void )
 
 /**************************************************/
 
+// Check that every sigma is within actuator travel and each scissor pair
+// is narrower than MAXWIDTH.
+static bool validQ( const double *q )
+{
+   for (int i = 0; i<AMPCT; i++){
+      if(!(SIGMA2ACTUATOR - q[i]<=250 && SIGMA2ACTUATOR - q[i] >= 0)){
+         return false;
+      }
+   }
+   for (int i = 0; i<AMPCT; i+=2){
+      if(!(sqrt(q[i]*q[i]+q[i]*q[i+1]+q[i+1]*q[i+1])<=MAXWIDTH)){
+         return false;
+      }
+   }
+   return true;
+}
+
+// Start a linkage move to act. If posePath is set act is a pose and the
+// platform moves in a straight line in pose space.
+static const Error *moveLink( TSELinkage &link, PointN &act, bool posePath )
+{
+   link.SetPoseMode( posePath );
+   if(posePath){
+      return link.MoveTo( act, CART_VEL, CART_ACC, CART_ACC, CART_JRK );
+   }
+   return link.MoveTo( act );
+}
+
 static void showerr( const Error *err, const char *str )
 {
    if( err )
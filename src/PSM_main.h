@@ -12,11 +12,17 @@ Daniel J. Gonzalez - dgonz@mit.edu
 #include <iostream>
 #include <fstream>  //THIS IS TO WRITE FILE
 #include <cmath>
+#include <cstring>
 
 #include "CML.h"
+#include "TSE_IK.h"
+#include "TSE_Linkage.h"
+#include "PSM_protocol.h"
+#include <unistd.h>
 
 #if defined( USE_CAN )
 #include "can/can_kvaser.h"   // formerly can_copley.h
+#include "can/can_sim.h"
 #elif defined( WIN32 )
 #include "ecat/ecat_winudp.h"
 #else
@@ -62,12 +68,18 @@ float l_0 = 18;
 float l_1 = 14;
 float l_2 = 11;
 float L = l_0 + l_1*2+ l_2*2;
+float eta = PI/6; //Actuator angle from the scissor axis
 
 float q[6] = {0,0,0,0,0,0};
 
 //Top Platform
 float rT = 8; //Radius from center of top to ball joint
 float hT = 2; //2.125; //Distance from top to ball joint
+
+//The scissor offset is tDIST, not rDIST: py/TSEMain.py calls solveNDIK with
+//k3 = 0.03710 = tDIST/L (0.0186 = rDIST/L is only solveNDIK's default), so
+//poses solved here give the same sigmas as the Python path did.
+TSEGeometry tseGeom = {L, l_0, eta, tDIST, rT, hT, hB};
 //float pose[6];
 
 // If a namespace has been defined in CML_Settings.h, this
@@ -78,10 +90,23 @@ using namespace arma;
 
 /* local functions */
 static int RunTest( void );
+static const Error *moveLink( TSELinkage &link, PointN &act, bool posePath );
 static void showerr( const Error *err, const char *str );
+static bool validQ( const double *q );
 
 /* local defines */
 #define AMPCT 6
+#define STREAM_SEG_MS   20       // Default time between streamed points
+#define STREAM_HOLD_MS  10       // Hold segment length when the planner falls behind
+#define STREAM_BUFF_PTS 4        // Segments buffered in each amp while streaming
+#define FOLLOW_SEG_MS   10       // Segment length while following a target
+#define FOLLOW_BUFF_PTS 3        // Segments buffered in each amp while following
+#define CART_VEL        2.0      // Cartesian move limits, in/s and rad/s
+#define CART_ACC        4.0
+#define CART_JRK        20.0
+
+// Actuator user units are mm: 8000 encoder counts per 5 mm of travel
+typedef UnitScale<8000,5> ActuatorUnits;
 
 /* local data */
 int32 canBPS = 1000000;             // CAN network bit rate
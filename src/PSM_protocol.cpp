@@ -0,0 +1,90 @@
+/**
+Parallel Scissor Manipulator Robot (PSMR) binary command protocol
+*/
+
+#include "PSM_protocol.h"
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Read exactly ct bytes. Returns 0 on success, -1 on error or end of file.
+static int readAll( int fd, void *buff, size_t ct )
+{
+   char *p = (char *)buff;
+   while( ct > 0 )
+   {
+      ssize_t n = read( fd, p, ct );
+      if( n < 0 && errno == EINTR ) continue;
+      if( n <= 0 ) return -1;
+      p += n;
+      ct -= n;
+   }
+   return 0;
+}
+
+static int writeAll( int fd, const void *buff, size_t ct )
+{
+   const char *p = (const char *)buff;
+   while( ct > 0 )
+   {
+      ssize_t n = write( fd, p, ct );
+      if( n < 0 && errno == EINTR ) continue;
+      if( n <= 0 ) return -1;
+      p += n;
+      ct -= n;
+   }
+   return 0;
+}
+
+/**
+Read one command frame.
+@return 0 on success, -1 if the stream closed or failed. A frame with a bad
+        magic number is still returned so it can be NAKed by sequence number.
+*/
+int psmReadCommand( int fd, PSMCommand &cmd )
+{
+   return readAll( fd, &cmd, sizeof(cmd) );
+}
+
+// Acknowledge a command with one write, no flush needed.
+int psmWriteAck( int fd, const PSMCommand &cmd, int16_t status )
+{
+   PSMAck ack;
+   ack.magic = PSM_ACK_MAGIC;
+   ack.seq = cmd.seq;
+   ack.timestamp = cmd.timestamp;
+   ack.status = status;
+   ack.flags = 0;
+   ack.reserved = 0;
+   return writeAll( fd, &ack, sizeof(ack) );
+}
+
+/**
+Listen on a Unix domain stream socket and wait for the planner to connect.
+@return The connected socket, or -1 on error.
+*/
+int psmListenUnix( const char *path )
+{
+   struct sockaddr_un addr;
+   if( strlen(path) >= sizeof(addr.sun_path) ) return -1;
+
+   int lsock = socket( AF_UNIX, SOCK_STREAM, 0 );
+   if( lsock < 0 ) return -1;
+
+   memset( &addr, 0, sizeof(addr) );
+   addr.sun_family = AF_UNIX;
+   strcpy( addr.sun_path, path );
+   unlink( path );
+
+   if( bind( lsock, (struct sockaddr *)&addr, sizeof(addr) ) < 0 || listen( lsock, 1 ) < 0 )
+   {
+      close( lsock );
+      return -1;
+   }
+
+   int sock = accept( lsock, 0, 0 );
+   close( lsock );
+   return sock;
+}
@@ -0,0 +1,59 @@
+/**
+Parallel Scissor Manipulator Robot (PSMR) binary command protocol
+
+Each command is one fixed-size PSMCommand frame and is answered by one
+fixed-size PSMAck frame. Both are little-endian with no padding, so the
+planner can build them with Python's struct module:
+
+   command: struct.pack('<IIdHHI6d', PSM_CMD_MAGIC, seq, t, type, segTime, 0, *vals)
+   ack:     struct.unpack('<IIdhHI', data)
+*/
+
+#ifndef _PSM_PROTOCOL_H
+#define _PSM_PROTOCOL_H
+
+#include <stdint.h>
+
+#define PSM_CMD_MAGIC   0x434D5350   // "PSMC"
+#define PSM_ACK_MAGIC   0x414D5350   // "PSMA"
+
+// Command types
+#define PSM_CMD_STOP    0            // End the program, vals are ignored
+#define PSM_CMD_SIGMA   1            // vals are the six sigmas in mm
+#define PSM_CMD_POSE    2            // vals are {x,y,z,rotZ,rotY,rotX} in inches and radians
+
+// Acknowledgement status
+#define PSM_ACK_OK      0            // Command accepted
+#define PSM_ACK_BAD_Q   1            // Sigmas outside the safe range, robot did not move
+#define PSM_ACK_IK_FAIL 2            // Pose has no IK solution, robot did not move
+#define PSM_ACK_BAD_MSG 3            // Bad magic or unknown type
+
+struct PSMCommand
+{
+   uint32_t magic;
+   uint32_t seq;                     // Sender's sequence number, echoed in the ack
+   double   timestamp;               // Sender's time stamp, echoed in the ack
+   uint16_t type;
+   uint16_t segTime;                 // Streaming mode: ms to reach this point from the last, 0 for the default
+   uint32_t reserved;
+   double   vals[6];
+};
+
+struct PSMAck
+{
+   uint32_t magic;
+   uint32_t seq;
+   double   timestamp;
+   int16_t  status;
+   uint16_t flags;
+   uint32_t reserved;
+};
+
+static_assert( sizeof(PSMCommand) == 72, "PSMCommand must not be padded" );
+static_assert( sizeof(PSMAck) == 24, "PSMAck must not be padded" );
+
+int psmReadCommand( int fd, PSMCommand &cmd );
+int psmWriteAck( int fd, const PSMCommand &cmd, int16_t status );
+int psmListenUnix( const char *path );
+
+#endif
@@ -0,0 +1,404 @@
+/**
+Parallel Scissor Manipulator Robot (PSMR) Triple Scissor Extender (TSE) Inverse Kinematics
+*/
+
+#include "TSE_IK.h"
+#include <cmath>
+
+#define IK_MAX_ITER 25
+#define IK_TOL      1e-12
+#define FK_MAX_ITER 20
+#define FK_TOL      1e-10
+
+TSEKinematics::TSEKinematics( const TSEGeometry &g )
+{
+   geom = g;
+
+   cosEta  = cos( g.eta );
+   sinEta  = sin( g.eta );
+   cos2Eta = cos( 2*g.eta );
+   kW = 0.25*(1 - (g.L/g.l0)*(g.L/g.l0));
+   k3 = g.tDist / g.L;
+
+   // Scissor pair frames sit at -90, 30 and 150 degrees around the base.
+   // The top platform ball joints sit at 0, 120 and 240 degrees.
+   const double legAng[TSE_LEGS] = { -M_PI/2, M_PI/6, 5*M_PI/6 };
+   for( int i=0; i<TSE_LEGS; i++ )
+   {
+      legC[i] = cos( legAng[i] );
+      legS[i] = sin( legAng[i] );
+      legX[i] = -g.rT * legS[i];
+      legY[i] =  g.rT * legC[i];
+      topX[i] = g.rT * cos( 2*M_PI*i/3 );
+      topY[i] = g.rT * sin( 2*M_PI*i/3 );
+   }
+
+   ClearWarmStart();
+}
+
+// Forget the previous solution. The next solve starts from the symmetric
+// (x = 0) solution of each pair instead.
+void TSEKinematics::ClearWarmStart( void )
+{
+   for( int i=0; i<TSE_DOF; i++ )
+      sig[i] = 0;
+   warm = false;
+   lastIter = 0;
+}
+
+/**
+Solve the inverse kinematics for one pose.
+@param pose {x, y, z, rotZ, rotY, rotX}, lengths in the geometry unit
+@param q Returns the six actuator sigmas in the geometry unit
+@return 0 on success, -1 if a scissor pair has no solution. On failure
+        q is not written and the warm start is left untouched.
+*/
+int TSEKinematics::SolveIK( const double pose[TSE_DOF], double q[TSE_DOF] )
+{
+   double cz = cos(pose[3]), sz = sin(pose[3]);
+   double cy = cos(pose[4]), sy = sin(pose[4]);
+   double cx = cos(pose[5]), sx = sin(pose[5]);
+
+   // R = Rx*Ry*Rz, only the first two columns are needed since the
+   // ball joints are at z = -hT in the platform frame.
+   double r00 = cy*cz,            r01 = -cy*sz;
+   double r10 = sx*sy*cz + cx*sz, r11 = -sx*sy*sz + cx*cz;
+   double r20 = -cx*sy*cz + sx*sz, r21 = cx*sy*sz + sx*cz;
+   double r02 = sy, r12 = -sx*cy, r22 = cx*cy;
+
+   double save[TSE_DOF];
+   for( int i=0; i<TSE_DOF; i++ )
+      save[i] = sig[i];
+
+   double pt[TSE_LEGS][3];
+
+   lastIter = 0;
+   for( int i=0; i<TSE_LEGS; i++ )
+   {
+      // Ball joint in the base frame
+      double px = pose[0] + r00*topX[i] + r01*topY[i] - r02*geom.hT;
+      double py = pose[1] + r10*topX[i] + r11*topY[i] - r12*geom.hT;
+      double pz = pose[2] + r20*topX[i] + r21*topY[i] - r22*geom.hT;
+
+      // Move into the frame of this scissor pair
+      double dx = px - legX[i];
+      double dy = py - legY[i];
+      double tx =  legC[i]*dx + legS[i]*dy;
+      double ty = -legS[i]*dx + legC[i]*dy;
+
+      pt[i][0] = tx/geom.L;
+      pt[i][1] = ty/geom.L;
+      pt[i][2] = (pz-geom.hB)/geom.L;
+
+      if( SolveLeg( i, pt[i][0], pt[i][1], pt[i][2] ) )
+      {
+         for( int j=0; j<TSE_DOF; j++ )
+            sig[j] = save[j];
+         return -1;
+      }
+   }
+
+   for( int i=0; i<TSE_LEGS; i++ )
+      for( int j=0; j<3; j++ )
+         legP[i][j] = pt[i][j];
+
+   warm = true;
+   for( int i=0; i<TSE_DOF; i++ )
+      q[i] = sig[i] * geom.L;
+   return 0;
+}
+
+/*
+Solve the two constraint equations of one scissor pair, with the top point
+(x,y,z) normalized by L:
+
+  F1 = |A-C|^2 - |B-C|^2 = 0
+  F2 = |A-C|^2 - 1 - kW*|A-B|^2 = 0
+
+where A and B are the actuator points at sA and sB along their guides.
+The result is left in sig[2*leg] and sig[2*leg+1].
+*/
+int TSEKinematics::SolveLeg( int leg, double x, double y, double z )
+{
+   double yk = y - k3;
+   double a =  x*cosEta + yk*sinEta;
+   double b = -x*cosEta + yk*sinEta;
+   double cc = x*x + yk*yk + z*z;
+
+   double sA, sB;
+   bool seeded = warm;
+
+   for( int pass=0; pass<2; pass++ )
+   {
+      if( seeded )
+      {
+         sA = sig[2*leg];
+         sB = sig[2*leg+1];
+      }
+      else
+      {
+         // Symmetric solution sA = sB, exact when x = 0
+         double m = 0.5*(a+b);
+         double qa = 1 - 2*kW*(1+cos2Eta);
+         double disc = m*m - qa*(cc-1);
+         if( disc < 0 ) return -1;
+         sA = sB = (m + sqrt(disc)) / qa;
+      }
+
+      for( int n=0; n<IK_MAX_ITER; n++ )
+      {
+         lastIter++;
+
+         double fA = sA*sA - 2*a*sA;
+         double f1 = fA - (sB*sB - 2*b*sB);
+         double f2 = fA + cc - 1 - kW*(sA*sA + sB*sB + 2*sA*sB*cos2Eta);
+
+         double j11 = 2*(sA-a);
+         double j12 = -2*(sB-b);
+         double j21 = j11 - 2*kW*(sA + sB*cos2Eta);
+         double j22 = -2*kW*(sB + sA*cos2Eta);
+
+         double det = j11*j22 - j12*j21;
+         if( fabs(det) < 1e-300 ) break;
+
+         double dA = ( j22*f1 - j12*f2) / det;
+         double dB = (-j21*f1 + j11*f2) / det;
+         sA -= dA;
+         sB -= dB;
+
+         if( fabs(dA) < IK_TOL && fabs(dB) < IK_TOL )
+         {
+            if( !(sA > 0 && sB > 0) ) break;
+            sig[2*leg]   = sA;
+            sig[2*leg+1] = sB;
+            return 0;
+         }
+      }
+
+      // The warm start failed to converge, try again from scratch
+      if( !seeded ) break;
+      seeded = false;
+   }
+   return -1;
+}
+
+/**
+Solve the inverse kinematics for one pose and its velocity.
+@param pose {x, y, z, rotZ, rotY, rotX}
+@param poseVel Rate of change of each pose value
+@param q Returns the six actuator sigmas
+@param qVel Returns the rate of change of each sigma
+@return 0 on success, -1 if a scissor pair has no solution
+*/
+int TSEKinematics::SolveIKVel( const double pose[TSE_DOF], const double poseVel[TSE_DOF],
+                               double q[TSE_DOF], double qVel[TSE_DOF] )
+{
+   if( SolveIK( pose, q ) ) return -1;
+   PoseRates( pose, poseVel, qVel );
+   return 0;
+}
+
+/**
+Find the inverse Jacobian J[i][j] = dq[i]/dpose[j] at a pose.
+@return 0 on success, -1 if a scissor pair has no solution
+*/
+int TSEKinematics::GetJacobian( const double pose[TSE_DOF], double J[TSE_DOF][TSE_DOF] )
+{
+   double q[TSE_DOF], a[TSE_DOF][TSE_DOF+1];
+   if( SolveIK( pose, q ) ) return -1;
+
+   RateMatrix( pose, a );
+   for( int i=0; i<TSE_DOF; i++ )
+      for( int j=0; j<TSE_DOF; j++ )
+         J[i][j] = a[i][j];
+   return 0;
+}
+
+// Fill the first six columns of J with dq/dpose at the pose last solved by SolveIK
+void TSEKinematics::RateMatrix( const double pose[TSE_DOF], double J[TSE_DOF][TSE_DOF+1] )
+{
+   for( int j=0; j<TSE_DOF; j++ )
+   {
+      double dp[TSE_DOF] = { 0, 0, 0, 0, 0, 0 };
+      double dq[TSE_DOF];
+      dp[j] = 1;
+      PoseRates( pose, dp, dq );
+      for( int i=0; i<TSE_DOF; i++ )
+         J[i][j] = dq[i];
+   }
+}
+
+// Solve the 6x6 system a*x = b, with b in the last column of a, by
+// Gaussian elimination with partial pivoting. a is destroyed.
+static int SolveLinear( double a[TSE_DOF][TSE_DOF+1], double x[TSE_DOF] )
+{
+   for( int c=0; c<TSE_DOF; c++ )
+   {
+      int piv = c;
+      for( int r=c+1; r<TSE_DOF; r++ )
+         if( fabs(a[r][c]) > fabs(a[piv][c]) ) piv = r;
+      if( fabs(a[piv][c]) < 1e-12 ) return -1;
+
+      if( piv != c )
+         for( int k=c; k<=TSE_DOF; k++ )
+         {
+            double t = a[c][k]; a[c][k] = a[piv][k]; a[piv][k] = t;
+         }
+
+      for( int r=c+1; r<TSE_DOF; r++ )
+      {
+         double f = a[r][c] / a[c][c];
+         for( int k=c; k<=TSE_DOF; k++ )
+            a[r][k] -= f*a[c][k];
+      }
+   }
+
+   for( int c=TSE_DOF-1; c>=0; c-- )
+   {
+      double d = a[c][TSE_DOF];
+      for( int k=c+1; k<TSE_DOF; k++ )
+         d -= a[c][k] * x[k];
+      x[c] = d / a[c][c];
+   }
+   return 0;
+}
+
+/**
+Solve the forward kinematics with Newton iteration on the IK.
+@param q The six actuator sigmas
+@param pose Holds the starting guess on entry, normally the last known
+       pose. Returns the pose.
+@return 0 on success, -1 if the iteration left the workspace or did not
+        converge. pose is not written on failure.
+*/
+int TSEKinematics::SolveFK( const double q[TSE_DOF], double pose[TSE_DOF] )
+{
+   double p[TSE_DOF];
+   for( int i=0; i<TSE_DOF; i++ )
+      p[i] = pose[i];
+
+   for( int n=0; n<FK_MAX_ITER; n++ )
+   {
+      double qc[TSE_DOF], J[TSE_DOF][TSE_DOF+1];
+      if( SolveIK( p, qc ) ) return -1;
+
+      double err = 0;
+      for( int i=0; i<TSE_DOF; i++ )
+      {
+         J[i][TSE_DOF] = qc[i] - q[i];
+         err = fmax( err, fabs( J[i][TSE_DOF] ) );
+      }
+      if( err < FK_TOL*geom.L )
+      {
+         for( int i=0; i<TSE_DOF; i++ )
+            pose[i] = p[i];
+         return 0;
+      }
+
+      RateMatrix( p, J );
+
+      double dp[TSE_DOF];
+      if( SolveLinear( J, dp ) ) return -1;
+
+      for( int i=0; i<TSE_DOF; i++ )
+         p[i] -= dp[i];
+   }
+   return -1;
+}
+
+/**
+Solve the forward kinematics for positions and velocities.
+@param q The six actuator sigmas
+@param qVel The rate of change of each sigma
+@param pose Holds the starting guess on entry, returns the pose
+@param poseVel Returns the rate of change of each pose value
+@return 0 on success, -1 on failure
+*/
+int TSEKinematics::SolveFKVel( const double q[TSE_DOF], const double qVel[TSE_DOF],
+                               double pose[TSE_DOF], double poseVel[TSE_DOF] )
+{
+   if( SolveFK( q, pose ) ) return -1;
+
+   // SolveFK leaves the IK solved at the pose, solve J*poseVel = qVel
+   double J[TSE_DOF][TSE_DOF+1];
+   RateMatrix( pose, J );
+   for( int i=0; i<TSE_DOF; i++ )
+      J[i][TSE_DOF] = qVel[i];
+
+   return SolveLinear( J, poseVel );
+}
+
+// Rotate v about one axis by an angle with cosine c and sine s, or by the
+// derivative of that rotation with respect to the angle when d is set.
+static void RotX( double c, double s, bool d, const double v[3], double o[3] )
+{
+   if( d ){ o[0] = 0;    o[1] = -s*v[1] - c*v[2]; o[2] = c*v[1] - s*v[2]; }
+   else   { o[0] = v[0]; o[1] =  c*v[1] - s*v[2]; o[2] = s*v[1] + c*v[2]; }
+}
+
+static void RotY( double c, double s, bool d, const double v[3], double o[3] )
+{
+   if( d ){ o[0] = -s*v[0] + c*v[2]; o[1] = 0;    o[2] = -c*v[0] - s*v[2]; }
+   else   { o[0] =  c*v[0] + s*v[2]; o[1] = v[1]; o[2] = -s*v[0] + c*v[2]; }
+}
+
+static void RotZ( double c, double s, bool d, const double v[3], double o[3] )
+{
+   if( d ){ o[0] = -s*v[0] - c*v[1]; o[1] = c*v[0] - s*v[1]; o[2] = 0; }
+   else   { o[0] =  c*v[0] - s*v[1]; o[1] = s*v[0] + c*v[1]; o[2] = v[2]; }
+}
+
+/*
+Actuator rates for a pose velocity, at the pose last solved by SolveIK.
+
+Each scissor pair satisfies F(s, p) = 0, where s = (sA, sB) and p is the
+top point in the pair's frame, so ds = -(dF/ds)^-1 (dF/dp) dp.  The 2x2
+dF/ds is the Newton Jacobian used in SolveLeg.
+*/
+void TSEKinematics::PoseRates( const double pose[TSE_DOF], const double poseVel[TSE_DOF], double qVel[TSE_DOF] )
+{
+   double cz = cos(pose[3]), sz = sin(pose[3]);
+   double cy = cos(pose[4]), sy = sin(pose[4]);
+   double cx = cos(pose[5]), sx = sin(pose[5]);
+
+   for( int i=0; i<TSE_LEGS; i++ )
+   {
+      // Velocity of the ball joint in the base frame, d(R*w)/dt with R = Rx*Ry*Rz
+      double w[3] = { topX[i], topY[i], -geom.hT };
+      double a[3], b[3], dz[3], dy[3], dx[3];
+
+      RotZ( cz, sz, true, w, a );  RotY( cy, sy, false, a, b ); RotX( cx, sx, false, b, dz );
+      RotZ( cz, sz, false, w, a ); RotY( cy, sy, true, a, b );  RotX( cx, sx, false, b, dy );
+      RotY( cy, sy, false, a, b ); RotX( cx, sx, true, b, dx );
+
+      double v[3];
+      for( int j=0; j<3; j++ )
+         v[j] = poseVel[j] + dz[j]*poseVel[3] + dy[j]*poseVel[4] + dx[j]*poseVel[5];
+
+      // Into the frame of this scissor pair, normalized by L
+      double vx = ( legC[i]*v[0] + legS[i]*v[1]) / geom.L;
+      double vy = (-legS[i]*v[0] + legC[i]*v[1]) / geom.L;
+      double vz = v[2] / geom.L;
+
+      double x = legP[i][0], yk = legP[i][1] - k3, z = legP[i][2];
+      double pa =  x*cosEta + yk*sinEta;
+      double pb = -x*cosEta + yk*sinEta;
+      double sA = sig[2*i], sB = sig[2*i+1];
+
+      double da  =  vx*cosEta + vy*sinEta;
+      double db  = -vx*cosEta + vy*sinEta;
+      double dcc = 2*(x*vx + yk*vy + z*vz);
+
+      double f1 = -2*sA*da + 2*sB*db;
+      double f2 = -2*sA*da + dcc;
+
+      double j11 = 2*(sA-pa);
+      double j12 = -2*(sB-pb);
+      double j21 = j11 - 2*kW*(sA + sB*cos2Eta);
+      double j22 = -2*kW*(sB + sA*cos2Eta);
+      double det = j11*j22 - j12*j21;
+
+      qVel[2*i]   = -( j22*f1 - j12*f2) / det * geom.L;
+      qVel[2*i+1] = -(-j21*f1 + j11*f2) / det * geom.L;
+   }
+}
@@ -0,0 +1,80 @@
+/**
+Parallel Scissor Manipulator Robot (PSMR) Triple Scissor Extender (TSE) Inverse Kinematics
+Native replacement for solveNDIK in py/TSEMath.py
+*/
+
+#ifndef _TSE_IK_H
+#define _TSE_IK_H
+
+#define TSE_LEGS 3     // Scissor pairs
+#define TSE_DOF  6     // Pose dimensions / actuator count
+
+// TSE geometry. All lengths share one unit (inches on our robot).
+struct TSEGeometry
+{
+   double L;         // Total scissor length, l_0 + 2*l_1 + 2*l_2
+   double l0;        // Length of the first scissor link
+   double eta;       // Actuator angle from the scissor axis (radians)
+   double tDist;     // Offset of scissor point t from the leg center (k3*L)
+   double rT;        // Radius from center of top to ball joint
+   double hT;        // Distance from top to ball joint
+   double hB;        // Height from base top surface to actuator ball joint
+};
+
+/**
+Inverse kinematics of the TSE.
+
+A pose is {x, y, z, rotZ, rotY, rotX} with the platform rotation applied as
+Rx*Ry*Rz, matching solveNDIK. The solution q holds the six actuator sigmas
+(A then B for each scissor pair) in the geometry's length unit.
+
+Each scissor pair is solved with Newton iteration on its two constraint
+equations using the analytic 2x2 Jacobian. The previous solution is used
+as the starting point for the next one, so streamed poses converge in one
+or two iterations.
+
+Actuator rates follow from the same constraints by implicit
+differentiation, which gives the inverse Jacobian dq/dpose directly.
+The forward kinematics are solved by Newton iteration on the IK.
+*/
+class TSEKinematics
+{
+public:
+   TSEKinematics( const TSEGeometry &g );
+
+   int SolveIK( const double pose[TSE_DOF], double q[TSE_DOF] );
+   int SolveIKVel( const double pose[TSE_DOF], const double poseVel[TSE_DOF],
+                   double q[TSE_DOF], double qVel[TSE_DOF] );
+   int GetJacobian( const double pose[TSE_DOF], double J[TSE_DOF][TSE_DOF] );
+   int SolveFK( const double q[TSE_DOF], double pose[TSE_DOF] );
+   int SolveFKVel( const double q[TSE_DOF], const double qVel[TSE_DOF],
+                   double pose[TSE_DOF], double poseVel[TSE_DOF] );
+   void ClearWarmStart( void );
+
+   /// Newton iterations used by the last call to SolveIK (all legs)
+   int GetIterations( void ){ return lastIter; }
+
+private:
+   int SolveLeg( int leg, double x, double y, double z );
+   void PoseRates( const double pose[TSE_DOF], const double poseVel[TSE_DOF], double qVel[TSE_DOF] );
+   void RateMatrix( const double pose[TSE_DOF], double J[TSE_DOF][TSE_DOF+1] );
+
+   TSEGeometry geom;
+
+   // Constants derived from the geometry
+   double cosEta, sinEta, cos2Eta;
+   double kW;                       // 0.25*(1-(L/l0)^2)
+   double k3;                       // tDist/L
+   double legC[TSE_LEGS], legS[TSE_LEGS];
+   double legX[TSE_LEGS], legY[TSE_LEGS];
+   double topX[TSE_LEGS], topY[TSE_LEGS];
+
+   // Last solution, normalized by L, and the top point of each
+   // scissor pair in its own frame that it was solved for
+   double sig[TSE_DOF];
+   double legP[TSE_LEGS][3];
+   bool warm;
+   int lastIter;
+};
+
+#endif
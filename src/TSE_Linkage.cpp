@@ -0,0 +1,123 @@
+/**
+Parallel Scissor Manipulator Robot (PSMR) Triple Scissor Extender (TSE) Linkage
+*/
+
+#include "TSE_Linkage.h"
+
+CML_NEW_ERROR( TSEError, NoSolution, "The pose has no inverse kinematics solution" );
+CML_NEW_ERROR( TSEError, Range,      "An actuator position is outside its travel" );
+CML_NEW_ERROR( TSEError, NoFK,       "The forward kinematics did not converge" );
+
+/**
+@param g TSE geometry
+@param sigmaOffset Actuator position (amplifier units) at which sigma is zero
+@param scale Amplifier units per geometry length unit
+*/
+TSELinkage::TSELinkage( const TSEGeometry &g, double sigmaOffset, double scale ):
+   trjIK( g ), fkIK( g )
+{
+   offset = sigmaOffset;
+   this->scale = scale;
+   minAct = 1;
+   maxAct = 0;
+   poseMode = false;
+
+   // Start the forward kinematics from the platform centered above the base
+   for( int i=0; i<TSE_DOF; i++ )
+      lastPose[i] = 0;
+   lastPose[2] = g.hB + g.hT + 0.5*g.L;
+}
+
+/**
+Limit the actuator positions (amplifier units) that pose mode may command.
+A point of a pose trajectory that falls outside returns TSEError::Range,
+which stops the trajectory. Pass min > max to disable the check (default).
+*/
+void TSELinkage::SetTravel( double min, double max )
+{
+   minAct = min;
+   maxAct = max;
+}
+
+// Scale sigmas into actuator positions and check the travel
+const Error *TSELinkage::SigmaToAct( const double q[TSE_DOF], const double qVel[TSE_DOF], uunit pos[], uunit vel[] )
+{
+   for( int i=0; i<TSE_DOF; i++ )
+   {
+      pos[i] = offset - scale*q[i];
+      if( minAct <= maxAct && (pos[i] < minAct || pos[i] > maxAct) )
+         return &TSEError::Range;
+      if( vel )
+         vel[i] = -scale*qVel[i];
+   }
+   return 0;
+}
+
+const Error *TSELinkage::ConvertAxisToAmpPos( uunit pos[] )
+{
+   if( !poseMode ) return 0;
+
+   double q[TSE_DOF];
+   if( trjIK.SolveIK( pos, q ) )
+      return &TSEError::NoSolution;
+
+   return SigmaToAct( q, 0, pos, 0 );
+}
+
+const Error *TSELinkage::ConvertAxisToAmp( uunit pos[], uunit vel[] )
+{
+   if( !poseMode ) return 0;
+
+   double q[TSE_DOF], qVel[TSE_DOF];
+   if( trjIK.SolveIKVel( pos, vel, q, qVel ) )
+      return &TSEError::NoSolution;
+
+   return SigmaToAct( q, qVel, pos, vel );
+}
+
+// Sigmas from actuator positions and velocities
+void TSELinkage::ActToSigma( const uunit pos[], const uunit vel[], double q[TSE_DOF], double qVel[TSE_DOF] )
+{
+   for( int i=0; i<TSE_DOF; i++ )
+   {
+      q[i] = (offset - pos[i]) / scale;
+      if( vel )
+         qVel[i] = -vel[i] / scale;
+   }
+}
+
+const Error *TSELinkage::ConvertAmpToAxisPos( uunit pos[] )
+{
+   if( !poseMode ) return 0;
+
+   double q[TSE_DOF], pose[TSE_DOF];
+   ActToSigma( pos, 0, q, 0 );
+
+   for( int i=0; i<TSE_DOF; i++ )
+      pose[i] = lastPose[i];
+
+   if( fkIK.SolveFK( q, pose ) )
+      return &TSEError::NoFK;
+
+   for( int i=0; i<TSE_DOF; i++ )
+      pos[i] = lastPose[i] = pose[i];
+   return 0;
+}
+
+const Error *TSELinkage::ConvertAmpToAxis( uunit pos[], uunit vel[] )
+{
+   if( !poseMode ) return 0;
+
+   double q[TSE_DOF], qVel[TSE_DOF], pose[TSE_DOF];
+   ActToSigma( pos, vel, q, qVel );
+
+   for( int i=0; i<TSE_DOF; i++ )
+      pose[i] = lastPose[i];
+
+   if( fkIK.SolveFKVel( q, qVel, pose, vel ) )
+      return &TSEError::NoFK;
+
+   for( int i=0; i<TSE_DOF; i++ )
+      pos[i] = lastPose[i] = pose[i];
+   return 0;
+}
@@ -0,0 +1,85 @@
+/**
+Parallel Scissor Manipulator Robot (PSMR) Triple Scissor Extender (TSE) Linkage
+
+A CML Linkage whose axes can be the platform pose instead of the actuators.
+In pose mode each PVT segment of a trajectory (Path, TrjScurve, stream) is
+passed through the TSE inverse kinematics as the linkage sends it to the
+amplifiers, so straight lines and arcs in pose space stay straight on the
+robot.
+*/
+
+#ifndef _TSE_LINKAGE_H
+#define _TSE_LINKAGE_H
+
+#include "CML.h"
+#include "TSE_IK.h"
+
+CML_NAMESPACE_USE();
+
+// Error codes for TSEError, kept clear of the CML range
+#define CMLERR_TSEError_NoSolution    1000
+#define CMLERR_TSEError_Range         1001
+#define CMLERR_TSEError_NoFK          1002
+
+/**
+Errors returned by TSELinkage.
+*/
+class TSEError: public Error
+{
+public:
+   static const TSEError NoSolution;   ///< The pose has no IK solution
+   static const TSEError Range;        ///< An actuator would leave its travel
+   static const TSEError NoFK;         ///< Forward kinematics did not converge
+
+protected:
+   TSEError( uint16 id, const char *desc ): Error( id, desc ){}
+};
+
+/**
+Linkage of the six TSE actuators.
+
+Pose axes are {x, y, z, rotZ, rotY, rotX} in the geometry's length unit and
+radians. Actuator (amplifier) positions are
+
+   act = sigmaOffset - scale*q
+
+where q are the sigmas returned by TSEKinematics. Velocities are mapped
+through the inverse Jacobian dq/dpose.
+
+Pose mode is off by default, in which case the linkage behaves exactly like
+a plain Linkage. Only change it while no trajectory is running.
+*/
+class TSELinkage: public Linkage
+{
+public:
+   TSELinkage( const TSEGeometry &g, double sigmaOffset, double scale );
+
+   /// Select pose (true) or actuator (false) axes
+   void SetPoseMode( bool on ){ poseMode = on; }
+   bool GetPoseMode( void ){ return poseMode; }
+
+   void SetTravel( double min, double max );
+
+   const Error *ConvertAmpToAxisPos( uunit pos[] );
+   const Error *ConvertAxisToAmpPos( uunit pos[] );
+   const Error *ConvertAmpToAxis( uunit pos[], uunit vel[] );
+   const Error *ConvertAxisToAmp( uunit pos[], uunit vel[] );
+
+private:
+   void ActToSigma( const uunit pos[], const uunit vel[], double q[TSE_DOF], double qVel[TSE_DOF] );
+   const Error *SigmaToAct( const double q[TSE_DOF], const double qVel[TSE_DOF], uunit pos[], uunit vel[] );
+
+   // Separate solvers so the trajectory thread and the caller of
+   // GetPositionCommand don't share warm start state
+   TSEKinematics trjIK;
+   TSEKinematics fkIK;
+
+   double offset, scale;
+   double minAct, maxAct;
+   bool poseMode;
+
+   // Last pose found by the forward kinematics, the starting guess for the next
+   double lastPose[TSE_DOF];
+};
+
+#endif